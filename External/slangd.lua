@@ -16,6 +16,23 @@ package("slangd")
         end
     end
 
+    -- No Linux archive is pinned, point SLANG_DIR at an unpacked release
+    -- instead, e.g. slang-2024.13-linux-x86_64.zip from the release page
+    on_fetch("linux", function (package, opt)
+        local slangdir = os.getenv("SLANG_DIR")
+        if not slangdir or not os.isfile(path.join(slangdir, "include", "slang.h")) then
+            return
+        end
+        local includedirs = {path.join(slangdir, "include")}
+        if os.isdir(path.join(slangdir, "prelude")) then
+            table.insert(includedirs, path.join(slangdir, "prelude"))
+        end
+        local linkdir = path.join(slangdir, "lib")
+        return {includedirs = includedirs, linkdirs = {linkdir},
+                links = {"slang", "gfx"},
+                ldflags = {"-Wl,-rpath," .. linkdir}}
+    end)
+
     on_load("macosx", "linux|i386", "linux|x86_64", function (package)
         package:add("ldflags", "-Wl,-rpath," .. package:installdir("lib"))
         package:add("links", "slang", "gfx")
@@ -24,6 +41,8 @@ package("slangd")
 
     on_install("windows|x64", "macosx|arm64", function (package)
         os.cp("include", package:installdir())
+        -- Host code shares the resource types of CPU kernels with the prelude
+        os.trycp(path.join("prelude", "*.h"), package:installdir("include"))
         if package:is_plat("windows") then
             os.trycp(path.join("bin", "*.dll"), package:installdir("bin"))
             os.trycp(path.join("lib", "*.lib"), package:installdir("lib"))
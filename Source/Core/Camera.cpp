@@ -88,6 +88,11 @@ void Camera::onMouseEvent(const MouseEvent& mouseEvent) const {
     mpController->update();
 }
 
+const CameraData& Camera::getData() const {
+    calculateCameraParameters();
+    return mData;
+}
+
 void Camera::bindShaderData(const ShaderVar& var) const {
     calculateCameraParameters();
     var["cameraData"] = mData;
@@ -30,6 +30,15 @@ class VL_API Camera {
     Camera();
 
     void bindShaderData(const ShaderVar& var) const;
+
+    /** Get the camera data as bound to shaders, e.g. for CPU renderers.
+     */
+    const CameraData& getData() const;
+
+    void setPosition(float3 posW) { mData.posW = posW; }
+    void setTarget(float3 target) { mData.target = target; }
+    void setUp(float3 up) { mData.up = up; }
+    void setAspectRatio(float aspectRatio) { mData.aspectRatio = aspectRatio; }
     void onMouseEvent(const MouseEvent& mouseEvent) const;
 
    private:
@@ -3,6 +3,7 @@
 #include <fmt/format.h>
 
 #include <span>
+#include <string_view>
 #include <type_traits>
 
 #include "Utils/Logger.h"
@@ -31,6 +32,19 @@ inline const std::string& enumToString(T value) {
     if (it == items.end()) logFatal("Invalid enum value {}", int(value));
     return it->second;
 }
+
+/** Find the enum value with the given name, returns false if there is none.
+ */
+template <typename T, std::enable_if_t<has_enum_info_v<T>, bool> = true>
+inline bool stringToEnum(std::string_view name, T& value) {
+    for (const auto& item : EnumInfo<T>::items()) {
+        if (item.second == name) {
+            value = item.first;
+            return true;
+        }
+    }
+    return false;
+}
 }  // namespace Voluma
 
 #define VL_ENUM_FLAG(T)                                                    \
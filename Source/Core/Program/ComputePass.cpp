@@ -0,0 +1,53 @@
+#include "ComputePass.h"
+
+#include "Core/Error.h"
+#include "Utils/Logger.h"
+
+namespace Voluma {
+ComputePass::SharedPtr ComputePass::create(
+    std::shared_ptr<Device> pDevice, const ProgramManager& programManager,
+    std::string_view filePath, const std::string& entryPoint) {
+    SharedPtr pPass(new ComputePass());
+    pPass->mpLinkedProgram = programManager.linkProgram(
+        filePath, {{entryPoint, ShaderType::Compute}});
+    pPass->mpProgram = programManager.createProgram(pPass->mpLinkedProgram);
+    VL_ASSERT(pPass->mpProgram != nullptr);
+
+    SlangUInt groupSize[3] = {1, 1, 1};
+    pPass->mpLinkedProgram->getLayout()
+        ->getEntryPointByIndex(0)
+        ->getComputeThreadGroupSize(3, groupSize);
+    pPass->mThreadGroupSize =
+        uint3(groupSize[0], groupSize[1], groupSize[2]);
+
+    auto gfxDevice = pDevice->getGfxDevice();
+    gfx::ComputePipelineStateDesc desc;
+    desc.program = pPass->mpProgram;
+    pPass->mpPipelineState = gfxDevice->createComputePipelineState(desc);
+    VL_ASSERT(pPass->mpPipelineState != nullptr);
+
+    if (SLANG_FAILED(gfxDevice->createMutableRootShaderObject(
+            pPass->mpProgram, pPass->mpRootObject.writeRef())))
+        logFatal("Failed to create the root object of {}", filePath);
+    pPass->mRootVar = ShaderVar(pPass->mpRootObject);
+    return pPass;
+}
+
+const ShaderVar& ComputePass::operator[](std::string_view name) {
+    auto it = mVars.find(std::string(name));
+    if (it == mVars.end())
+        it = mVars.emplace(std::string(name), mRootVar[name]).first;
+    return it->second;
+}
+
+void ComputePass::execute(gfx::IComputeCommandEncoder* pEncoder,
+                          uint32_t threadsX, uint32_t threadsY,
+                          uint32_t threadsZ) {
+    uint3 groupCount = getGroupCount(uint3(threadsX, threadsY, threadsZ),
+                                     mThreadGroupSize);
+    pEncoder->bindPipelineWithRootObject(mpPipelineState, mpRootObject);
+    if (SLANG_FAILED(pEncoder->dispatchCompute(groupCount.x, groupCount.y,
+                                               groupCount.z)))
+        logFatal("dispatchCompute failed");
+}
+} // namespace Voluma
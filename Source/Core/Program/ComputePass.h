@@ -0,0 +1,68 @@
+#pragma once
+#include <slang-com-ptr.h>
+#include <slang-gfx.h>
+#include <slang.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "Core/Device.h"
+#include "Core/Macros.h"
+#include "Core/Math.h"
+#include "Core/Program/Program.h"
+#include "Core/Program/ShaderVar.h"
+
+namespace Voluma {
+/** Compute entry point with its pipeline state and bindings.
+ *
+ * The thread group size is reflected from [numthreads], execute takes a
+ * thread count and dispatches the groups covering it. Bindings live in a
+ * root object owned by the pass, so they persist across executes and only
+ * changed variables need to be set again. Variables looked up by name on
+ * the root are cached.
+ */
+class VL_API ComputePass {
+   public:
+    using SharedPtr = std::shared_ptr<ComputePass>;
+
+    static SharedPtr create(std::shared_ptr<Device> pDevice,
+                            const ProgramManager& programManager,
+                            std::string_view filePath,
+                            const std::string& entryPoint = "main");
+
+    /** Get the number of groups covering threadCount threads per axis.
+     */
+    static uint3 getGroupCount(uint3 threadCount, uint3 groupSize) {
+        return (threadCount + groupSize - 1u) / groupSize;
+    }
+
+    uint3 getThreadGroupSize() const { return mThreadGroupSize; }
+
+    /** Get the root variable, bindings set through it persist.
+     */
+    const ShaderVar& getRootVar() const { return mRootVar; }
+
+    /** Get a root variable by name, the lookup is cached.
+     */
+    const ShaderVar& operator[](std::string_view name);
+
+    /** Bind the pipeline and the bindings and dispatch enough groups to
+     * cover the threads, threads past the count are expected to early out.
+     */
+    void execute(gfx::IComputeCommandEncoder* pEncoder, uint32_t threadsX,
+                 uint32_t threadsY, uint32_t threadsZ = 1);
+
+   private:
+    ComputePass() = default;
+
+    Slang::ComPtr<slang::IComponentType> mpLinkedProgram;
+    Slang::ComPtr<gfx::IShaderProgram> mpProgram;
+    Slang::ComPtr<gfx::IPipelineState> mpPipelineState;
+    Slang::ComPtr<gfx::IShaderObject> mpRootObject;
+    ShaderVar mRootVar;
+    std::unordered_map<std::string, ShaderVar> mVars; ///< By root field
+    uint3 mThreadGroupSize = uint3(1);
+};
+} // namespace Voluma
@@ -0,0 +1,138 @@
+#include "CpuKernel.h"
+
+#include <fmt/format.h>
+
+#include <chrono>
+
+#include "Core/Program/ComputePass.h"
+#include "Utils/Parallel.h"
+
+namespace Voluma {
+using Kind = slang::TypeReflection::Kind;
+
+CpuShaderVar CpuShaderVar::operator[](std::string_view name) const {
+    if (!isValid()) logFatal("Shader var is not valid!");
+    if (mpTypeLayout->getKind() != Kind::Struct)
+        logFatal("CpuShaderVar::operator[]: No such field \"{}\"", name);
+
+    // Fields of a struct are laid out inline, resources included
+    std::string fieldName(name);
+    SlangInt fieldIndex = mpTypeLayout->findFieldIndexByName(fieldName.data());
+    if (fieldIndex == -1)
+        logFatal("CpuShaderVar::operator[]: No such field \"{}\"", name);
+    slang::VariableLayoutReflection* fieldLayout =
+        mpTypeLayout->getFieldByIndex((unsigned int)fieldIndex);
+    size_t offset = fieldLayout->getOffset(SLANG_PARAMETER_CATEGORY_UNIFORM);
+    size_t fieldSize = fieldLayout->getTypeLayout()->getSize(
+        SLANG_PARAMETER_CATEGORY_UNIFORM);
+    size_t structSize = mpTypeLayout->getSize(SLANG_PARAMETER_CATEGORY_UNIFORM);
+    if (offset + fieldSize > structSize)
+        logFatal("CpuShaderVar::operator[]: Field \"{}\" ends past its struct",
+                 name);
+    return CpuShaderVar(fieldLayout->getTypeLayout(), mpData + offset);
+}
+
+void CpuShaderVar::setBlob(void const* data, size_t size) const {
+    if (!isValid()) logFatal("Shader var is not valid!");
+    size_t varSize = mpTypeLayout->getSize(SLANG_PARAMETER_CATEGORY_UNIFORM);
+    if (size != varSize)
+        logFatal("CpuShaderVar::setBlob: {} bytes set to a {} byte variable",
+                 size, varSize);
+    std::memcpy(mpData, data, size);
+}
+
+void CpuShaderVar::setTexture(SlangCpu::ITexture* pTexture) const {
+    if (!isValid()) logFatal("Shader var is not valid!");
+    if (mpTypeLayout->getKind() != Kind::Resource)
+        logFatal("CpuShaderVar: Binding a texture to a non resource variable");
+    // Resources of the C++ target are interface pointers
+    if (mpTypeLayout->getSize(SLANG_PARAMETER_CATEGORY_UNIFORM) !=
+        sizeof(pTexture))
+        logFatal("CpuShaderVar: Texture variable is not a pointer");
+    std::memcpy(mpData, &pTexture, sizeof(pTexture));
+}
+
+std::string CpuKernel::Stats::toString() const {
+    double seconds = std::max(elapsedMs, 1e-3) * 1e-3;
+    return fmt::format(
+        "CpuKernelStats(threads = {}, groups = {}, time = {:.1f} ms, "
+        "Mthreads/s = {:.2f})",
+        threadCount, groupCount, elapsedMs,
+        double(threadCount) / seconds * 1e-6);
+}
+
+CpuKernel::CpuKernel(std::string name,
+                     Slang::ComPtr<slang::IComponentType> pProgram,
+                     Slang::ComPtr<ISlangSharedLibrary> pLibrary,
+                     GroupFunc groupFunc)
+    : mName(std::move(name)),
+      mpProgram(pProgram),
+      mpLibrary(pLibrary),
+      mGroupFunc(groupFunc) {
+    slang::ProgramLayout* pLayout = mpProgram->getLayout();
+
+    // The kernel takes a pointer to the struct of the global parameters.
+    // Reflection wraps it in a constant buffer or parameter block when there
+    // are ordinary uniforms, unwrap it like the gfx CPU device does.
+    mpGlobalLayout = pLayout->getGlobalParamsTypeLayout();
+    while (mpGlobalLayout->getKind() == Kind::ConstantBuffer ||
+           mpGlobalLayout->getKind() == Kind::ParameterBlock)
+        mpGlobalLayout = mpGlobalLayout->getElementTypeLayout();
+    if (mpGlobalLayout->getKind() != Kind::Struct)
+        logFatal("CpuKernel {}: Global parameters are not a struct", mName);
+    mUniformState.resize(
+        mpGlobalLayout->getSize(SLANG_PARAMETER_CATEGORY_UNIFORM));
+
+    // Entry point parameters would be passed by a second pointer, all
+    // bindings go through the globals here
+    slang::EntryPointReflection* pEntryPoint = pLayout->getEntryPointByIndex(0);
+    if (pEntryPoint->getTypeLayout()->getSize(
+            SLANG_PARAMETER_CATEGORY_UNIFORM) != 0)
+        logFatal("CpuKernel {}: Uniform entry point parameters are not "
+                 "supported",
+                 mName);
+
+    SlangUInt groupSize[3] = {1, 1, 1};
+    pEntryPoint->getComputeThreadGroupSize(3, groupSize);
+    mGroupSize = uint3(groupSize[0], groupSize[1], groupSize[2]);
+}
+
+CpuShaderVar CpuKernel::getRootVar(std::span<uint8_t> state) const {
+    if (state.size() != mUniformState.size())
+        logFatal("CpuKernel {}: Uniform state of {} bytes, expected {}",
+                 mName, state.size(), mUniformState.size());
+    return CpuShaderVar(mpGlobalLayout, state.data());
+}
+
+CpuKernel::Stats CpuKernel::dispatch(uint3 threadCount,
+                                     std::span<const uint8_t> state) const {
+    if (state.size() != mUniformState.size())
+        logFatal("CpuKernel {}: Uniform state of {} bytes, expected {}",
+                 mName, state.size(), mUniformState.size());
+    auto start = std::chrono::steady_clock::now();
+
+    uint3 groupCount = ComputePass::getGroupCount(threadCount, mGroupSize);
+    size_t totalGroupCount =
+        size_t(groupCount.x) * groupCount.y * groupCount.z;
+    parallelFor(totalGroupCount, [&](size_t group) {
+        uint3 groupID(group % groupCount.x,
+                      group / groupCount.x % groupCount.y,
+                      group / groupCount.x / groupCount.y);
+        SlangCpu::ComputeVaryingInput varyingInput;
+        varyingInput.startGroupID = {groupID.x, groupID.y, groupID.z};
+        varyingInput.endGroupID = {groupID.x + 1, groupID.y + 1,
+                                   groupID.z + 1};
+        // Kernels only read their uniforms
+        mGroupFunc(&varyingInput, nullptr, const_cast<uint8_t*>(state.data()));
+    });
+
+    Stats stats;
+    stats.groupCount = totalGroupCount;
+    stats.threadCount =
+        stats.groupCount * mGroupSize.x * mGroupSize.y * mGroupSize.z;
+    stats.elapsedMs = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    return stats;
+}
+} // namespace Voluma
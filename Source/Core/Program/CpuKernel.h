@@ -0,0 +1,229 @@
+#pragma once
+#include <slang-com-ptr.h>
+#include <slang.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "Core/Macros.h"
+#include "Core/Math.h"
+#include "Utils/Logger.h"
+
+// Resource and entry point types of host callable kernels from the Slang
+// prelude, kept in a namespace as its vector types clash with the glm ones
+#define SLANG_PRELUDE_NAMESPACE SlangCpu
+#include <slang-cpp-types.h>
+
+namespace Voluma {
+/** Texture3D of a CPU kernel. Texels are fetched through fetch(texLoc, lod)
+ * so the data keeps its CPU layout, e.g. VolData mips or octree levels.
+ * Fetch is a functor type, so the only indirection per load is the virtual
+ * Load called by the kernel. Loads outside of a level return zero like GPU
+ * texture loads. Kernels only Load, samples return zero.
+ */
+template <typename T, typename Fetch>
+class CpuTexture3D final : public SlangCpu::ITexture {
+   public:
+    /** Create a texture from the dims of its mip levels, level 0 first.
+     */
+    CpuTexture3D(std::vector<uint3> mipDims, Fetch fetch)
+        : mMipDims(std::move(mipDims)), mFetch(std::move(fetch)) {}
+
+    SlangCpu::TextureDimensions GetDimensions(int mipLevel) override {
+        uint3 dims = mMipDims[std::clamp(mipLevel, 0,
+                                         int(mMipDims.size()) - 1)];
+        return {SLANG_TEXTURE_3D, dims.x, dims.y, dims.z,
+                uint32_t(mMipDims.size()), 0};
+    }
+
+    void Load(const int32_t* loc, void* outData, size_t dataSize) override {
+        // loc is int4(texLoc, lod)
+        T texel = {};
+        if (loc[3] >= 0 && size_t(loc[3]) < mMipDims.size()) {
+            const uint3& dims = mMipDims[loc[3]];
+            if (uint32_t(loc[0]) < dims.x && uint32_t(loc[1]) < dims.y &&
+                uint32_t(loc[2]) < dims.z)
+                texel = mFetch(int3(loc[0], loc[1], loc[2]), uint32_t(loc[3]));
+        }
+        std::memcpy(outData, &texel, std::min(dataSize, sizeof(T)));
+    }
+
+    void Sample(SlangCpu::SamplerState, const float*, void* outData,
+                size_t dataSize) override {
+        std::memset(outData, 0, dataSize);
+    }
+
+    void SampleLevel(SlangCpu::SamplerState, const float*, float,
+                     void* outData, size_t dataSize) override {
+        std::memset(outData, 0, dataSize);
+    }
+
+   private:
+    std::vector<uint3> mMipDims;
+    Fetch mFetch;
+};
+
+/** RWTexture2D of a CPU kernel holding its texels row by row. Threads of a
+ * dispatch must write disjoint texels, writes outside of the texture are
+ * dropped.
+ */
+template <typename T>
+class CpuRWTexture2D final : public SlangCpu::IRWTexture {
+   public:
+    explicit CpuRWTexture2D(uint2 dim)
+        : mDim(dim), mTexels(size_t(dim.x) * dim.y) {}
+
+    uint2 getDim() const { return mDim; }
+
+    std::span<const T> getTexels() const { return mTexels; }
+
+    SlangCpu::TextureDimensions GetDimensions(int) override {
+        return {SLANG_TEXTURE_2D, mDim.x, mDim.y, 1, 1, 0};
+    }
+
+    void Load(const int32_t* loc, void* outData, size_t dataSize) override {
+        // loc is int3(texLoc, lod)
+        T texel = {};
+        if (loc[2] == 0 && uint32_t(loc[0]) < mDim.x &&
+            uint32_t(loc[1]) < mDim.y)
+            texel = mTexels[size_t(loc[1]) * mDim.x + loc[0]];
+        std::memcpy(outData, &texel, std::min(dataSize, sizeof(T)));
+    }
+
+    void Sample(SlangCpu::SamplerState, const float*, void* outData,
+                size_t dataSize) override {
+        std::memset(outData, 0, dataSize);
+    }
+
+    void SampleLevel(SlangCpu::SamplerState, const float*, float,
+                     void* outData, size_t dataSize) override {
+        std::memset(outData, 0, dataSize);
+    }
+
+    void* refAt(const uint32_t* loc) override {
+        if (loc[0] < mDim.x && loc[1] < mDim.y)
+            return &mTexels[size_t(loc[1]) * mDim.x + loc[0]];
+        thread_local T discarded;
+        return &discarded;
+    }
+
+   private:
+    uint2 mDim;
+    std::vector<T> mTexels;
+};
+
+/** Shader variable of a CPU kernel, the counterpart of ShaderVar writing
+ * into the uniform state of the kernel. Textures are bound by pointer and
+ * must outlive the dispatches using them.
+ */
+class VL_API CpuShaderVar {
+   public:
+    CpuShaderVar(slang::TypeLayoutReflection* pTypeLayout, uint8_t* pData)
+        : mpTypeLayout(pTypeLayout), mpData(pData) {}
+
+    CpuShaderVar() = default;
+
+    CpuShaderVar operator[](std::string_view name) const;
+
+    void setBlob(void const* data, size_t size) const;
+
+    template <typename T>
+    void setBlob(const T& val) const {
+        setBlob(&val, sizeof(val));
+    }
+
+    template <typename T>
+    void operator=(const T& val) const {
+        if constexpr (std::is_base_of_v<SlangCpu::ITexture, T>)
+            setTexture(const_cast<T*>(&val));
+        else
+            setBlob(val);
+    }
+
+    bool isValid() const { return mpData != nullptr; }
+
+   private:
+    void setTexture(SlangCpu::ITexture* pTexture) const;
+
+    slang::TypeLayoutReflection* mpTypeLayout = nullptr;
+    uint8_t* mpData = nullptr; ///< Start of the variable in the state
+};
+
+/** Compute entry point built to host callable CPU code, see
+ * ProgramManager::createCpuKernel.
+ *
+ * Uniforms and textures are bound through the root variable like on a GPU
+ * root object. A dispatch runs the thread groups of the grid as parallel
+ * tasks, the threads of a group run in sequence. Bindings must not change
+ * during a dispatch. Bindings that change per call go into a copy of the
+ * uniform state, which leaves the kernel untouched and lets calls with
+ * their own state run concurrently.
+ */
+class VL_API CpuKernel {
+   public:
+    using SharedPtr = std::shared_ptr<CpuKernel>;
+
+    /** Exported entry point, runs the thread groups of a range.
+     */
+    using GroupFunc = SlangCpu::ComputeFunc;
+
+    struct Stats {
+        uint64_t threadCount = 0;
+        uint64_t groupCount = 0;
+        double elapsedMs = 0.0;
+
+        std::string toString() const;
+    };
+
+    CpuKernel(std::string name, Slang::ComPtr<slang::IComponentType> pProgram,
+              Slang::ComPtr<ISlangSharedLibrary> pLibrary,
+              GroupFunc groupFunc);
+
+    const std::string& getName() const { return mName; }
+
+    /** Get the thread group size declared by [numthreads].
+     */
+    uint3 getGroupSize() const { return mGroupSize; }
+
+    CpuShaderVar getRootVar() {
+        return CpuShaderVar(mpGlobalLayout, mUniformState.data());
+    }
+
+    /** Copy the uniform state with the bindings made so far.
+     */
+    std::vector<uint8_t> copyUniformState() const { return mUniformState; }
+
+    /** Get the root variable of a copy of the uniform state.
+     */
+    CpuShaderVar getRootVar(std::span<uint8_t> state) const;
+
+    /** Run enough thread groups to cover threadCount threads, threads past
+     * threadCount run too and are expected to early out like on the GPU.
+     */
+    Stats dispatch(uint3 threadCount) const {
+        return dispatch(threadCount, mUniformState);
+    }
+
+    /** Run the thread groups with a copy of the uniform state.
+     */
+    Stats dispatch(uint3 threadCount, std::span<const uint8_t> state) const;
+
+   private:
+    std::string mName;
+    Slang::ComPtr<slang::IComponentType> mpProgram; ///< Owns the reflection
+    Slang::ComPtr<ISlangSharedLibrary> mpLibrary;   ///< Owns the code
+    GroupFunc mGroupFunc;
+    slang::TypeLayoutReflection* mpGlobalLayout;
+    uint3 mGroupSize;
+    std::vector<uint8_t> mUniformState;
+};
+} // namespace Voluma
+
+VL_FMT(Voluma::CpuKernel::Stats)
@@ -22,7 +22,12 @@ std::vector<std::string> getShaderSearchDirectories() {
 }
 
 ProgramManager::ProgramManager(std::shared_ptr<Device> device)
-    : mpDevice(device) {}
+    : mpDevice(device), mpGlobalSession(device->getGlobalSession()) {}
+
+ProgramManager::ProgramManager() {
+    if (SLANG_FAILED(slang::createGlobalSession(mpGlobalSession.writeRef())))
+        logFatal("Failed to create Slang global session");
+}
 
 SlangCompileTarget getSlangCompileTarget() {
 #if VL_WINDOWS
@@ -44,9 +49,9 @@ const char* getSlangProfileString() {
 #endif
 }
 
-Slang::ComPtr<gfx::IShaderProgram> ProgramManager::createProgram(
-    std::string_view filePath,
-    std::vector<ProgramEntryPoint> entryPoints) const {
+Slang::ComPtr<slang::IComponentType> ProgramManager::linkForTarget(
+    const slang::TargetDesc& targetDesc, std::string_view filePath,
+    const std::vector<ProgramEntryPoint>& entryPoints) const {
     // Create session
     slang::SessionDesc sessionDesc;
 
@@ -59,19 +64,11 @@ Slang::ComPtr<gfx::IShaderProgram> ProgramManager::createProgram(
     }
     sessionDesc.searchPaths = slangSearchPaths.data();
     sessionDesc.searchPathCount = (SlangInt)slangSearchPaths.size();
-
-    slang::TargetDesc targetDesc;
-    targetDesc.format = getSlangCompileTarget();
-    targetDesc.profile =
-        mpDevice->getGlobalSession()->findProfile(getSlangProfileString());
-    targetDesc.forceGLSLScalarBufferLayout = true;
     sessionDesc.targetCount = 1;
     sessionDesc.targets = &targetDesc;
-    targetDesc.flags |= SLANG_TARGET_FLAG_GENERATE_SPIRV_DIRECTLY;
 
     Slang::ComPtr<slang::ISession> pSlangSession;
-    mpDevice->getGlobalSession()->createSession(sessionDesc,
-                                                pSlangSession.writeRef());
+    mpGlobalSession->createSession(sessionDesc, pSlangSession.writeRef());
 
     Slang::ComPtr<slang::IBlob> diagnosticsBlob;
     slang::IModule* module =
@@ -95,10 +92,62 @@ Slang::ComPtr<gfx::IShaderProgram> ProgramManager::createProgram(
         diagnosticsBlob.writeRef());
     VL_ASSERT(linkedProgram != nullptr);
     diagnoseIfNeeded(diagnosticsBlob);
+    return linkedProgram;
+}
+
+Slang::ComPtr<slang::IComponentType> ProgramManager::linkProgram(
+    std::string_view filePath,
+    const std::vector<ProgramEntryPoint>& entryPoints) const {
+    slang::TargetDesc targetDesc;
+    targetDesc.format = getSlangCompileTarget();
+    targetDesc.profile = mpGlobalSession->findProfile(getSlangProfileString());
+    targetDesc.forceGLSLScalarBufferLayout = true;
+    targetDesc.flags |= SLANG_TARGET_FLAG_GENERATE_SPIRV_DIRECTLY;
+    return linkForTarget(targetDesc, filePath, entryPoints);
+}
 
+Slang::ComPtr<gfx::IShaderProgram> ProgramManager::createProgram(
+    slang::IComponentType* pLinkedProgram) const {
+    VL_ASSERT(mpDevice != nullptr);
     gfx::IShaderProgram::Desc programDesc = {};
-    programDesc.slangGlobalScope = linkedProgram;
+    programDesc.slangGlobalScope = pLinkedProgram;
 
     return mpDevice->getGfxDevice()->createProgram(programDesc);
 }
+
+Slang::ComPtr<gfx::IShaderProgram> ProgramManager::createProgram(
+    std::string_view filePath,
+    std::vector<ProgramEntryPoint> entryPoints) const {
+    return createProgram(linkProgram(filePath, entryPoints));
+}
+
+CpuKernel::SharedPtr ProgramManager::createCpuKernel(
+    std::string_view filePath, const std::string& entryPoint) const {
+    // Slang emits C++ and builds it into a shared library in memory
+    slang::TargetDesc targetDesc;
+    targetDesc.format = SLANG_SHADER_HOST_CALLABLE;
+
+    auto linkedProgram = linkForTarget(targetDesc, filePath,
+                                       {{entryPoint, ShaderType::Compute}});
+
+    Slang::ComPtr<ISlangSharedLibrary> pLibrary;
+    Slang::ComPtr<slang::IBlob> diagnosticsBlob;
+    SlangResult result = linkedProgram->getEntryPointHostCallable(
+        0, 0, pLibrary.writeRef(), diagnosticsBlob.writeRef());
+    diagnoseIfNeeded(diagnosticsBlob);
+    if (SLANG_FAILED(result) || !pLibrary) {
+        logError("Failed to build {} {} for the CPU", filePath, entryPoint);
+        return nullptr;
+    }
+
+    auto groupFunc = (CpuKernel::GroupFunc)pLibrary->findFuncByName(
+        entryPoint.c_str());
+    if (!groupFunc) {
+        logError("Entry point {} not found in the CPU library of {}",
+                 entryPoint, filePath);
+        return nullptr;
+    }
+    return std::make_shared<CpuKernel>(entryPoint, linkedProgram, pLibrary,
+                                       groupFunc);
+}
 } // namespace Voluma
\ No newline at end of file
@@ -11,6 +11,7 @@
 
 #include "Core/Device.h"
 #include "Core/Macros.h"
+#include "Core/Program/CpuKernel.h"
 
 namespace Voluma {
 enum class ShaderType {
@@ -35,12 +36,41 @@ class VL_API ProgramManager {
    public:
     using SharedPtr = std::shared_ptr<ProgramManager>;
     ProgramManager(std::shared_ptr<Device> device);
+
+    /** Create a manager without a GPU device, only CPU kernels can be
+     * created.
+     */
+    ProgramManager();
+
     Slang::ComPtr<gfx::IShaderProgram> createProgram(
         std::string_view filePath,
         std::vector<ProgramEntryPoint> entryPoints) const;
 
+    /** Link entry points for the GPU target, the linked program holds the
+     * reflection, e.g. the thread group size of a compute entry point.
+     */
+    Slang::ComPtr<slang::IComponentType> linkProgram(
+        std::string_view filePath,
+        const std::vector<ProgramEntryPoint>& entryPoints) const;
+
+    /** Create a GPU program from a program linked by linkProgram.
+     */
+    Slang::ComPtr<gfx::IShaderProgram> createProgram(
+        slang::IComponentType* pLinkedProgram) const;
+
+    /** Compile a compute entry point to host callable CPU code, returns
+     * nullptr if Slang has no downstream C++ compiler to build it with.
+     */
+    CpuKernel::SharedPtr createCpuKernel(std::string_view filePath,
+                                         const std::string& entryPoint) const;
+
    private:
+    Slang::ComPtr<slang::IComponentType> linkForTarget(
+        const slang::TargetDesc& targetDesc, std::string_view filePath,
+        const std::vector<ProgramEntryPoint>& entryPoints) const;
+
     std::shared_ptr<Device> mpDevice;
+    Slang::ComPtr<slang::IGlobalSession> mpGlobalSession;
 };
 
 } // namespace Voluma
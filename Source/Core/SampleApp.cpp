@@ -7,6 +7,9 @@
 #include <slang-gfx.h>
 #include <slang.h>
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <cstring>
 
 #include "Core/Camera.h"
@@ -18,6 +21,8 @@
 #include "Core/Window.h"
 #include "Data/VolData.h"
 #include "Error.h"
+#include "Render/CpuRayMarcher.h"
+#include "Render/CpuRenderer.h"
 #include "Utils/Gui.h"
 #include "Utils/Logger.h"
 #include "Utils/UiInputs.h"
@@ -154,15 +159,8 @@ SampleApp::SampleApp() {
 
     // Create compute pipeline
     {
-        Slang::ComPtr<gfx::IShaderProgram> computeProgram =
-            mpProgramManager->createProgram("Shaders/RayMarching.cs.slang",
-                                            {{"main", ShaderType::Compute}});
-        VL_ASSERT(computeProgram != nullptr);
-        ComputePipelineStateDesc desc;
-        desc.program = computeProgram;
-        mComputePipelineState = gfxDevice->createComputePipelineState(desc);
-        VL_ASSERT(mComputePipelineState != nullptr);
-
+        mpRayMarchingPass = ComputePass::create(
+            mpDevice, *mpProgramManager, "Shaders/RayMarching.cs.slang");
         createPresentTexture();
     }
 
@@ -263,24 +261,175 @@ void SampleApp::createVolDataTexture() {
 
     ITextureResource::Desc volTextureDesc = {};
     volTextureDesc.type = IResource::Type::Texture3D;
-    volTextureDesc.numMipLevels = 1;
+    volTextureDesc.numMipLevels = mpVolData->getMipLevelCount();
     volTextureDesc.size.width = width;
     volTextureDesc.size.height = height;
     volTextureDesc.size.depth = depth;
-    volTextureDesc.defaultState = ResourceState::UnorderedAccess;
-    volTextureDesc.format = Format::R32_FLOAT;
+    volTextureDesc.defaultState = ResourceState::ShaderResource;
+    volTextureDesc.allowedStates = ResourceStateSet(
+        ResourceState::ShaderResource, ResourceState::CopyDestination);
+    // Voxels are uploaded as stored, the shader applies the rescale
+    volTextureDesc.format =
+        mpVolData->getVoxelFormat() == VoxelFormat::Int16 ? Format::R16_SNORM
+                                                           : Format::R16_UNORM;
+
+    IResourceView::Desc volSRVDesc = {};
+    volSRVDesc.format = volTextureDesc.format;
+    volSRVDesc.type = IResourceView::Type::ShaderResource;
+    volSRVDesc.subresourceRange.mipLevelCount = volTextureDesc.numMipLevels;
+    volSRVDesc.subresourceRange.layerCount = 1;
+
+    mpVolDataTexture = mpDevice->createTexture(volTextureDesc, volSRVDesc);
+
+    // One texel per occupancy cell, lets the ray marcher leap over empty
+    // space
+    const auto& cellGrid = mpOccupancy->getGrid();
+    ITextureResource::Desc cellTextureDesc = volTextureDesc;
+    cellTextureDesc.size.width = cellGrid[0];
+    cellTextureDesc.size.height = cellGrid[1];
+    cellTextureDesc.size.depth = cellGrid[2];
+    cellTextureDesc.numMipLevels = 1;
+    cellTextureDesc.format = Format::R8_UINT;
+
+    IResourceView::Desc cellSRVDesc = {};
+    cellSRVDesc.format = cellTextureDesc.format;
+    cellSRVDesc.type = IResourceView::Type::ShaderResource;
+
+    mpCellDistanceTexture =
+        mpDevice->createTexture(cellTextureDesc, cellSRVDesc);
+
+    // Mip level k holds octree level k, both halve the padded leaf grid
+    const auto& leafDims = mpOctree->getLevelDims(0);
+    ITextureResource::Desc nodeTextureDesc = cellTextureDesc;
+    nodeTextureDesc.size.width = leafDims[0];
+    nodeTextureDesc.size.height = leafDims[1];
+    nodeTextureDesc.size.depth = leafDims[2];
+    nodeTextureDesc.numMipLevels = mpOctree->getLevelCount();
+    nodeTextureDesc.format = Format::R32G32_FLOAT;
+
+    IResourceView::Desc nodeSRVDesc = {};
+    nodeSRVDesc.format = nodeTextureDesc.format;
+    nodeSRVDesc.type = IResourceView::Type::ShaderResource;
+    nodeSRVDesc.subresourceRange.mipLevelCount = nodeTextureDesc.numMipLevels;
+    nodeSRVDesc.subresourceRange.layerCount = 1;
+
+    mpNodeRangeTexture =
+        mpDevice->createTexture(nodeTextureDesc, nodeSRVDesc);
+}
 
-    IResourceView::Desc volUAVDesc = {};
-    volUAVDesc.format = volTextureDesc.format;
-    volUAVDesc.type = IResourceView::Type::UnorderedAccess;
+void SampleApp::createGradientTexture() {
+    auto pGradients = getShaderGradients();
+    ITextureResource::Desc gradientTextureDesc = {};
+    gradientTextureDesc.type = IResource::Type::Texture3D;
+    gradientTextureDesc.numMipLevels = 1;
+    gradientTextureDesc.size.width = pGradients ? pGradients->getDims()[0] : 1;
+    gradientTextureDesc.size.height = pGradients ? pGradients->getDims()[1] : 1;
+    gradientTextureDesc.size.depth = pGradients ? pGradients->getDims()[2] : 1;
+    gradientTextureDesc.defaultState = ResourceState::ShaderResource;
+    gradientTextureDesc.allowedStates = ResourceStateSet(
+        ResourceState::ShaderResource, ResourceState::CopyDestination);
+    // No 3-channel 16-bit format, alpha is padding
+    gradientTextureDesc.format = Format::R16G16B16A16_UNORM;
+
+    IResourceView::Desc gradientSRVDesc = {};
+    gradientSRVDesc.format = gradientTextureDesc.format;
+    gradientSRVDesc.type = IResourceView::Type::ShaderResource;
+
+    mpGradientTexture =
+        mpDevice->createTexture(gradientTextureDesc, gradientSRVDesc);
+    mIsGradientDirty = true;
+}
 
-    mpVolDataTexture = mpDevice->createTexture(volTextureDesc, volUAVDesc);
+void SampleApp::uploadTexture3D(gfx::IResourceCommandEncoder* pEncoder,
+                                const Texture::SharedPtr& pTexture,
+                                uint32_t mipLevel, const void* pData,
+                                uint3 offset, uint3 size) {
+    gfx::ITextureResource::Offset3D gfxOffset = {
+        static_cast<gfx::GfxIndex>(offset.x),
+        static_cast<gfx::GfxIndex>(offset.y),
+        static_cast<gfx::GfxIndex>(offset.z)};
+
+    gfx::ITextureResource::Extents gfxSize = {
+        static_cast<gfx::GfxCount>(size.x), static_cast<gfx::GfxCount>(size.y),
+        static_cast<gfx::GfxCount>(size.z)};
+
+    gfx::FormatInfo formatInfo = {};
+    gfx::gfxGetFormatInfo(pTexture->getFormat(), &formatInfo);
+
+    SubresourceRange range = {};
+    range.mipLevel = mipLevel;
+    range.mipLevelCount = 1;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+
+    gfx::ITextureResource::SubresourceData data = {};
+    data.data = pData;
+    data.strideY = static_cast<int64_t>(gfxSize.width) /
+                   formatInfo.blockWidth * formatInfo.blockSizeInBytes;
+    data.strideZ = data.strideY * (gfxSize.height / formatInfo.blockHeight);
+
+    pEncoder->uploadTextureData(pTexture->getResource().get(), range,
+                                gfxOffset, gfxSize, &data, 1);
+}
+
+void SampleApp::uploadStreamedVolume(gfx::IResourceCommandEncoder* pEncoder) {
+    const auto& pCache = mpVolData->getBrickCache();
+    const auto& pStore = pCache->getStore();
+    const auto& dims = pStore->getVolumeDims();
+    const auto& grid = pStore->getBrickGrid();
+    constexpr uint32_t kSize = BrickedVolume::kBrickSize;
+    constexpr uint32_t kPadded = BrickedVolume::kPaddedSize;
+
+    std::vector<uint16_t> interior(size_t(kSize) * kSize * kSize);
+    for (uint32_t bz = 0; bz < grid[2]; bz++) {
+        // Read the next layer while this one is uploaded
+        std::vector<uint32_t> nextLayer;
+        for (uint32_t by = 0; bz + 1 < grid[2] && by < grid[1]; by++)
+            for (uint32_t bx = 0; bx < grid[0]; bx++)
+                nextLayer.push_back(pStore->getBrickIndex(bx, by, bz + 1));
+        pCache->prefetch(nextLayer);
+
+        for (uint32_t by = 0; by < grid[1]; by++) {
+            for (uint32_t bx = 0; bx < grid[0]; bx++) {
+                auto pBrick =
+                    pCache->getBrick(pStore->getBrickIndex(bx, by, bz));
+                uint3 offset(bx * kSize, by * kSize, bz * kSize);
+                uint3 size(std::min(kSize, dims[0] - offset.x),
+                           std::min(kSize, dims[1] - offset.y),
+                           std::min(kSize, dims[2] - offset.z));
+
+                // Strip the apron, rows of the clipped brick are packed
+                uint16_t* pDst = interior.data();
+                for (uint32_t z = 0; z < size.z; z++) {
+                    for (uint32_t y = 0; y < size.y; y++) {
+                        const uint16_t* pSrc =
+                            pBrick->data() +
+                            ((size_t(z) + BrickedVolume::kApron) * kPadded +
+                             y + BrickedVolume::kApron) *
+                                kPadded +
+                            BrickedVolume::kApron;
+                        pDst = std::copy(pSrc, pSrc + size.x, pDst);
+                    }
+                }
+                uploadTexture3D(pEncoder, mpVolDataTexture, 0, interior.data(),
+                                offset, size);
+            }
+        }
+    }
+    logInfo("Uploaded streamed volume, {}", pCache->getStats());
 }
 
 void SampleApp::handleRenderFrame() {
+    updateLoadTask();
+
     int framebufferIndex = mSwapchain->acquireNextImage();
 
     mTransientHeaps[framebufferIndex]->synchronizeAndReset();
+    // Every heap synchronized since a texture was retired, no frame can
+    // reference it anymore
+    for (auto& retired : mRetiredTextures) retired.second--;
+    std::erase_if(mRetiredTextures,
+                  [](const auto& retired) { return retired.second == 0; });
     executeRenderFrame(framebufferIndex);
 
     renderUI();
@@ -311,14 +460,137 @@ void SampleApp::handleKeyboardEvent(const KeyboardEvent& keyEvent) {
     }
 }
 
+void SampleApp::handleDroppedFile(const std::filesystem::path& path) {
+    // Accept a series folder or any file inside of it
+    std::error_code ec;
+    auto folder =
+        std::filesystem::is_directory(path, ec) ? path : path.parent_path();
+    loadFromDisk(folder.string());
+}
+
 void SampleApp::loadFromDisk(const std::string& filename) {
-    mpVolData = VolData::loadFromDisk(filename);
+    if (mpLoadTask) mpLoadTask->cancel();
+    logInfo("Loading volume {}", filename);
+    mLoadOptions.buildGradients =
+        mParams.gradientMode == GradientMode::Precomputed;
+    mpLoadTask = VolLoadTask::start(filename, mLoadOptions);
+}
+
+void SampleApp::updateLoadTask() {
+    if (!mpLoadTask) return;
+
+    if (mpLoadTask->isDone()) {
+        auto volume = mpLoadTask->getResult();
+        mpLoadTask = nullptr;
+        if (!volume) return;
+
+        logInfo("Slice count: {}", volume.pVolData->getSliceCount());
+        logInfo("patient info: {}", volume.pVolData->getPatientData());
+        logInfo("scan meta: {}", volume.pVolData->getScanMetaData());
+        setVolData(volume);
+    } else if (auto preview = mpLoadTask->takePreview()) {
+        setVolData(preview);
+    }
+}
 
-    logInfo("Slice count: {}", mpVolData->getSliceCount());
-    logInfo("patient info: {}", mpVolData->getPatientData());
-    logInfo("scan meta: {}", mpVolData->getScanMetaData());
+void SampleApp::setVolData(const VolLoadTask::Volume& volume) {
+    // The previous textures may still be referenced by in-flight frames
+    retireTexture(mpVolDataTexture);
+    retireTexture(mpCellDistanceTexture);
+    retireTexture(mpNodeRangeTexture);
 
+    mpVolData = volume.pVolData;
+    mpOctree = volume.pOctree;
+    mpOccupancy = volume.pOccupancy;
     createVolDataTexture();
+    mIsVolDataDirty = true;
+    updateGradients();
+
+    mWindow = mpVolData->getAutoWindow();
+    mTissuePresets = mpVolData->getTissuePresets();
+    updateHistogramPlot();
+}
+
+void SampleApp::retireTexture(Texture::SharedPtr pTexture) {
+    if (!pTexture) return;
+    mRetiredTextures.emplace_back(std::move(pTexture),
+                                  uint32_t(kSwapChainImageCount));
+}
+
+void SampleApp::updateHistogramPlot() {
+    const uint32_t kBarCount = 128;
+    mHistogramPlot.assign(kBarCount, 0.f);
+    const auto& histogram = mpVolData->getHistogram();
+    if (histogram.isEmpty()) return;
+
+    auto toBin = [&](float value) {
+        int32_t bin = histogram.toBin(mpVolData->toStoredValue(value));
+        return uint32_t(
+            std::clamp(bin, 0, int32_t(Histogram::kBinCount) - 1));
+    };
+    uint32_t firstBin = toBin(mWindow.getLow());
+    uint32_t binCount =
+        std::max(toBin(mWindow.getHigh()), firstBin) - firstBin + 1;
+    auto bins = histogram.getBins();
+    for (uint32_t i = 0; i < binCount; i++) {
+        mHistogramPlot[uint64_t(i) * kBarCount / binCount] +=
+            float(bins[firstBin + i]);
+    }
+    // Log scale so the air and soft tissue peaks fit in one plot
+    for (float& bar : mHistogramPlot) bar = std::log1p(bar);
+}
+
+void SampleApp::updateGradients() {
+    if (mParams.gradientMode == GradientMode::Precomputed &&
+        !mpVolData->buildGradients()) {
+        logWarning("Precomputed gradients unavailable, using finite "
+                   "differences.");
+        mParams.gradientMode = GradientMode::FiniteDifference;
+    }
+    // Switching back to finite differences shrinks it to the placeholder
+    retireTexture(mpGradientTexture);
+    createGradientTexture();
+}
+
+GradientVolume::SharedPtr SampleApp::getShaderGradients() const {
+    return mParams.gradientMode == GradientMode::Precomputed
+               ? mpVolData->getGradients()
+               : nullptr;
+}
+
+void SampleApp::measureSamplesPerRay() {
+    // A quarter of the frame keeps the CPU reference interactive
+    uint2 frameDim(std::max(mSwapchain->getDesc().width / 4, 1),
+                   std::max(mSwapchain->getDesc().height / 4, 1));
+    float threshold = float(mParams.filterValue);
+    // A private grid, the shared one must match the uploaded distances
+    auto pOccupancy = OccupancyGrid::create(*mpOctree);
+    pOccupancy->setThreshold(threshold);
+    const auto& camera = mCamera.getData();
+    auto marched =
+        CpuRayMarcher(mpVolData).measure(camera, frameDim, threshold);
+    auto distanceField = CpuRayMarcher(mpVolData, pOccupancy)
+                             .measure(camera, frameDim, threshold);
+    auto octree = CpuRayMarcher(mpVolData, nullptr, mpOctree)
+                      .measure(camera, frameDim, threshold);
+    logInfo("Every step: {}", marched);
+    logInfo("Distance field: {}, {:.1f}% of the cells occupied",
+            distanceField, 100.f * pOccupancy->getOccupiedFraction());
+    logInfo("Min/max octree: {}", octree);
+}
+
+void SampleApp::saveCpuReference() {
+    Image image(mSwapchain->getDesc().width, mSwapchain->getDesc().height, 4);
+    CpuRenderer renderer(mpVolData, mpOctree, mpVolData->getGradients());
+    auto stats = renderer.render(mCamera.getData(), mParams, image);
+    image.writeEXR("cpu_reference.exr");
+    logInfo("Saved cpu_reference.exr, {}", stats);
+}
+
+void SampleApp::benchmarkCpuRenderer() {
+    uint2 frameDim(mSwapchain->getDesc().width, mSwapchain->getDesc().height);
+    CpuRenderer renderer(mpVolData, mpOctree, mpVolData->getGradients());
+    renderer.runBenchmark(mCamera.getData(), mParams, frameDim);
 }
 
 void SampleApp::beginLoop() { mpWindow->msgLoop(); }
@@ -327,8 +599,41 @@ void SampleApp::renderUI() {
     mpGui->beginFrame();
     ImGui::Begin("Dashboard");
 
-    ImGui::SliderInt("Volume filter", &mParams.filterValue,
-                     mpVolData->getMinValue(), mpVolData->getMaxValue());
+    if (mpLoadTask) {
+        ImGui::ProgressBar(mpLoadTask->getProgress(), ImVec2(-1.f, 0.f),
+                           fmt::format("Loading {}/{}",
+                                       mpLoadTask->getLoadedSliceCount(),
+                                       mpLoadTask->getTotalSliceCount())
+                               .c_str());
+        if (ImGui::Button("Cancel")) mpLoadTask->cancel();
+    }
+
+    if (mpVolData) {
+        ImGui::PlotHistogram("##Histogram", mHistogramPlot.data(),
+                             int(mHistogramPlot.size()), 0,
+                             fmt::format("{:.0f} .. {:.0f}", mWindow.getLow(),
+                                         mWindow.getHigh())
+                                 .c_str(),
+                             0.f, FLT_MAX, ImVec2(0.f, 80.f));
+        ImGui::SliderInt("Volume filter", &mParams.filterValue,
+                         int(mWindow.getLow()), int(mWindow.getHigh()));
+
+        for (size_t i = 0; i < mTissuePresets.size(); i++) {
+            const auto& preset = mTissuePresets[i];
+            if (i > 0) ImGui::SameLine();
+            if (ImGui::Button(preset.name.c_str())) {
+                mParams.filterValue = int(preset.threshold);
+                mWindow = preset.window;
+                updateHistogramPlot();
+            }
+        }
+        if (ImGui::Button("Full range")) {
+            mWindow = {0.5f * (mpVolData->getMinValue() +
+                               mpVolData->getMaxValue()),
+                       mpVolData->getMaxValue() - mpVolData->getMinValue()};
+            updateHistogramPlot();
+        }
+    }
 
     static const char* kShadingItems[] = {
         Voluma::enumToString(ShadingMode::Normal).c_str(),
@@ -338,83 +643,185 @@ void SampleApp::renderUI() {
     ImGui::Combo("Shading mode", (int*)&mParams.shadingMode, kShadingItems,
                  IM_ARRAYSIZE(kShadingItems));
 
+    static const char* kGradientItems[] = {
+        Voluma::enumToString(GradientMode::FiniteDifference).c_str(),
+        Voluma::enumToString(GradientMode::Precomputed).c_str(),
+        Voluma::enumToString(GradientMode::Analytic).c_str(),
+    };
+    if (ImGui::Combo("Gradient mode", (int*)&mParams.gradientMode,
+                     kGradientItems, IM_ARRAYSIZE(kGradientItems)) &&
+        mpVolData) {
+        updateGradients();
+    }
+
+    static const char* kEmptySpaceItems[] = {
+        Voluma::enumToString(EmptySpaceMode::Disabled).c_str(),
+        Voluma::enumToString(EmptySpaceMode::DistanceField).c_str(),
+        Voluma::enumToString(EmptySpaceMode::Octree).c_str(),
+    };
+    ImGui::Combo("Empty space skipping", (int*)&mParams.emptySpaceMode,
+                 kEmptySpaceItems, IM_ARRAYSIZE(kEmptySpaceItems));
+
+    if (mpVolData && ImGui::Button("Measure samples per ray")) {
+        measureSamplesPerRay();
+    }
+    if (mpVolData && ImGui::Button("Save CPU reference")) {
+        saveCpuReference();
+    }
+    if (mpVolData && ImGui::Button("Benchmark CPU renderer")) {
+        benchmarkCpuRenderer();
+    }
+
     ImGui::End();
 }
 
 void SampleApp::executeRenderFrame(int framebufferIndex) {
-    auto gfxDevice = mpDevice->getGfxDevice();
-
     int width = mSwapchain->getDesc().width;
     int height = mSwapchain->getDesc().height;
-    static bool isDataCopied = false;
-    if (!isDataCopied) {
-        gfx::ITextureResource::Offset3D gfxOffset = {
-            static_cast<gfx::GfxIndex>(0), static_cast<gfx::GfxIndex>(0),
-            static_cast<gfx::GfxIndex>(0)};
-
-        gfx::ITextureResource::Extents gfxSize = {
-            static_cast<gfx::GfxCount>(mpVolData->getColWidth()),
-            static_cast<gfx::GfxCount>(mpVolData->getRowWidth()),
-            static_cast<gfx::GfxCount>(mpVolData->getSliceCount())};
-
-        gfx::FormatInfo formatInfo = {};
-        gfx::gfxGetFormatInfo(mpVolDataTexture->getFormat(), &formatInfo);
-
-        SubresourceRange range = {};
-        range.mipLevel = 0;
-        range.mipLevelCount = 1;
-        range.baseArrayLayer = 0;
-        range.layerCount = 1;
-
-        gfx::ITextureResource::SubresourceData data = {};
-        data.data = mpVolData->getBufferData().data();
-        data.strideY = static_cast<int64_t>(gfxSize.width) /
-                       formatInfo.blockWidth * formatInfo.blockSizeInBytes;
-        data.strideZ = data.strideY * (gfxSize.height / formatInfo.blockHeight);
+    if (mpVolData && mIsVolDataDirty) {
+        const auto& cellGrid = mpOccupancy->getGrid();
 
         ComPtr<ICommandBuffer> resourceCommandBuffer =
             mTransientHeaps[framebufferIndex]->createCommandBuffer();
         auto resourceEncoder = resourceCommandBuffer->encodeResourceCommands();
 
-        resourceEncoder->textureBarrier(mpVolDataTexture->getResource().get(),
+        for (auto* pTexture :
+             {mpVolDataTexture.get(), mpCellDistanceTexture.get(),
+              mpNodeRangeTexture.get()}) {
+            resourceEncoder->textureBarrier(pTexture->getResource().get(),
+                                            ResourceState::Undefined,
+                                            ResourceState::CopyDestination);
+        }
+        if (mpVolData->isOutOfCore()) {
+            uploadStreamedVolume(resourceEncoder);
+        } else {
+            for (uint32_t level = 0; level < mpVolData->getMipLevelCount();
+                 level++) {
+                auto dims = mpVolData->getMipDims(level);
+                uploadTexture3D(resourceEncoder, mpVolDataTexture, level,
+                                mpVolData->getMipData(level).data(), uint3(0),
+                                uint3(dims[0], dims[1], dims[2]));
+            }
+        }
+        uploadTexture3D(resourceEncoder, mpCellDistanceTexture, 0,
+                        mpOccupancy->getDistances().data(), uint3(0),
+                        uint3(cellGrid[0], cellGrid[1], cellGrid[2]));
+        for (uint32_t level = 0; level < mpOctree->getLevelCount(); level++) {
+            const auto& dims = mpOctree->getLevelDims(level);
+            uploadTexture3D(resourceEncoder, mpNodeRangeTexture, level,
+                            mpOctree->getLevelRanges(level).data(), uint3(0),
+                            uint3(dims[0], dims[1], dims[2]));
+        }
+        for (auto* pTexture :
+             {mpVolDataTexture.get(), mpCellDistanceTexture.get(),
+              mpNodeRangeTexture.get()}) {
+            resourceEncoder->textureBarrier(pTexture->getResource().get(),
+                                            ResourceState::CopyDestination,
+                                            ResourceState::ShaderResource);
+        }
+
+        resourceEncoder->endEncoding();
+        resourceCommandBuffer->close();
+        mQueue->executeCommandBuffer(resourceCommandBuffer);
+
+        mIsVolDataDirty = false;
+    }
+
+    // The octree needs no update, the distance field only near flipped cells
+    if (mpVolData &&
+        mParams.emptySpaceMode == EmptySpaceMode::DistanceField) {
+        auto region = mpOccupancy->setThreshold(float(mParams.filterValue));
+        if (!region.isEmpty()) {
+            std::vector<uint8_t> distances(region.getCellCount());
+            mpOccupancy->copyRegion(region, distances);
+
+            ComPtr<ICommandBuffer> resourceCommandBuffer =
+                mTransientHeaps[framebufferIndex]->createCommandBuffer();
+            auto resourceEncoder =
+                resourceCommandBuffer->encodeResourceCommands();
+            auto* pResource = mpCellDistanceTexture->getResource().get();
+            resourceEncoder->textureBarrier(pResource,
+                                            ResourceState::ShaderResource,
+                                            ResourceState::CopyDestination);
+            uploadTexture3D(
+                resourceEncoder, mpCellDistanceTexture, 0, distances.data(),
+                uint3(region.offset[0], region.offset[1], region.offset[2]),
+                uint3(region.size[0], region.size[1], region.size[2]));
+            resourceEncoder->textureBarrier(pResource,
+                                            ResourceState::CopyDestination,
+                                            ResourceState::ShaderResource);
+
+            resourceEncoder->endEncoding();
+            resourceCommandBuffer->close();
+            mQueue->executeCommandBuffer(resourceCommandBuffer);
+        }
+    }
+
+    if (mpVolData && mIsGradientDirty) {
+        ComPtr<ICommandBuffer> resourceCommandBuffer =
+            mTransientHeaps[framebufferIndex]->createCommandBuffer();
+        auto resourceEncoder = resourceCommandBuffer->encodeResourceCommands();
+
+        resourceEncoder->textureBarrier(mpGradientTexture->getResource().get(),
                                         ResourceState::Undefined,
                                         ResourceState::CopyDestination);
-        resourceEncoder->uploadTextureData(
-            mpVolDataTexture->getResource().get(), range, gfxOffset, gfxSize,
-            &data, 1);
-
-        resourceEncoder->textureBarrier(mpVolDataTexture->getResource().get(),
+        auto pGradients = getShaderGradients();
+        const GradientVolume::Texel kPlaceholder = {};
+        if (pGradients) {
+            const auto& dims = pGradients->getDims();
+            uploadTexture3D(resourceEncoder, mpGradientTexture, 0,
+                            pGradients->getTexels().data(), uint3(0),
+                            uint3(dims[0], dims[1], dims[2]));
+        } else {
+            uploadTexture3D(resourceEncoder, mpGradientTexture, 0,
+                            &kPlaceholder, uint3(0), uint3(1));
+        }
+        resourceEncoder->textureBarrier(mpGradientTexture->getResource().get(),
                                         ResourceState::CopyDestination,
-                                        ResourceState::UnorderedAccess);
+                                        ResourceState::ShaderResource);
+
         resourceEncoder->endEncoding();
         resourceCommandBuffer->close();
         mQueue->executeCommandBuffer(resourceCommandBuffer);
 
-        isDataCopied = true;
+        mIsGradientDirty = false;
     }
 
-    {
+    if (mpVolData) {
         ComPtr<ICommandBuffer> computeCommandBuffer =
             mTransientHeaps[framebufferIndex]->createCommandBuffer();
         auto computeEncoder = computeCommandBuffer->encodeComputeCommands();
 
-        auto rootObject = computeEncoder->bindPipeline(mComputePipelineState);
-
-        auto deviceInfo = gfxDevice->getDeviceInfo();
-
-        ShaderVar rootVar(rootObject);
-        mCamera.bindShaderData(rootVar);
-        rootVar["frameDim"] = uint2(width, height);
-        rootVar["dstTex"] = *mpPresentTexture;
-        rootVar["volData"]["volTex"] = *mpVolDataTexture;
-        rootVar["volData"]["volDim"] =
+        auto& pass = *mpRayMarchingPass;
+        mCamera.bindShaderData(pass.getRootVar());
+        pass["frameDim"] = uint2(width, height);
+        pass["dstTex"] = *mpPresentTexture;
+        const ShaderVar& volData = pass["volData"];
+        volData["volTex"] = *mpVolDataTexture;
+        volData["volDim"] =
             uint3(mpVolData->getColWidth(), mpVolData->getRowWidth(),
                   mpVolData->getSliceCount());
-        rootVar["params"].setBlob(mParams);
-
-        if (SLANG_FAILED(computeEncoder->dispatchCompute(width, height, 1))) {
-            logFatal("dispatchCompute failed");
-        }
+        // Map normalized texel back to stored value, then to modality value
+        const auto& scanMeta = mpVolData->getScanMetaData();
+        float normScale =
+            mpVolData->getVoxelFormat() == VoxelFormat::Int16 ? 32767.f
+                                                               : 65535.f;
+        volData["valueScale"] = normScale * scanMeta.rescaleSlope;
+        volData["valueOffset"] = scanMeta.rescaleIntercept;
+        const auto& cellGrid = mpOccupancy->getGrid();
+        volData["cellDistance"] = *mpCellDistanceTexture;
+        volData["cellGrid"] = uint3(cellGrid[0], cellGrid[1], cellGrid[2]);
+        volData["cellSize"] = OccupancyGrid::kCellSize;
+        volData["nodeRange"] = *mpNodeRangeTexture;
+        volData["octreeLevelCount"] = mpOctree->getLevelCount();
+        volData["mipLevelCount"] = mpVolData->getMipLevelCount();
+        volData["gradientTex"] = *mpGradientTexture;
+        auto pGradients = getShaderGradients();
+        volData["gradientScale"] =
+            pGradients ? pGradients->getMaxMagnitude() : 0.f;
+        pass["params"].setBlob(mParams);
+
+        pass.execute(computeEncoder, width, height);
         computeEncoder->endEncoding();
         computeCommandBuffer->close();
         mQueue->executeCommandBuffer(computeCommandBuffer);
@@ -451,6 +858,11 @@ void SampleApp::executeRenderFrame(int framebufferIndex) {
         mQueue->executeCommandBuffer(presentCommandBuffer);
     }
 }
-SampleApp::~SampleApp() = default;
+SampleApp::~SampleApp() {
+    if (mpLoadTask) {
+        mpLoadTask->cancel();
+        mpLoadTask->wait();
+    }
+}
 
 } // namespace Voluma
\ No newline at end of file
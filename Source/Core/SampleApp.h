@@ -8,8 +8,11 @@
 
 #include "Buffer.h"
 #include "Core/Camera.h"
+#include "Core/Program/ComputePass.h"
 #include "Core/Program/Program.h"
+#include "Data/OccupancyGrid.h"
 #include "Data/VolData.h"
+#include "Data/VolLoader.h"
 #include "Device.h"
 #include "SampleAppShared.slangh"
 #include "Texture.h"
@@ -31,12 +34,25 @@ class SampleApp : public Window::ICallbacks {
 
     void createVolDataTexture();
 
+    /** Create the precomputed gradient texture, a 1x1x1 placeholder unless
+     * the gradient mode is Precomputed.
+     */
+    void createGradientTexture();
+
     Slang::ComPtr<gfx::IShaderProgram> createGraphicsShader();
 
     Slang::ComPtr<gfx::IShaderProgram> createComputeShader();
 
+    /** Start loading a volume in the background, the current volume keeps
+     * rendering until the preview or the full volume is ready.
+     */
     void loadFromDisk(const std::string &filename);
 
+    /** Set the host memory budget of the voxels of later loads in bytes,
+     * larger volumes are streamed from disk. 0 disables the budget.
+     */
+    void setMemoryBudget(uint64_t bytes) { mLoadOptions.memoryBudget = bytes; }
+
     void beginLoop();
 
     void renderUI();
@@ -45,8 +61,7 @@ class SampleApp : public Window::ICallbacks {
     virtual void handleRenderFrame() override;
     virtual void handleKeyboardEvent(const KeyboardEvent &keyEvent) override;
     virtual void handleMouseEvent(const MouseEvent &mouseEvent) override;
-    virtual void handleDroppedFile(const std::filesystem::path &path) override {
-    }
+    virtual void handleDroppedFile(const std::filesystem::path &path) override;
 
     SampleApp &operator=(const SampleApp &other) = delete;
     SampleApp &operator=(SampleApp &&other) noexcept;
@@ -56,6 +71,57 @@ class SampleApp : public Window::ICallbacks {
    private:
     void executeRenderFrame(int framebufferIndex);
 
+    /** Poll the in-flight load and swap in its preview or result.
+     */
+    void updateLoadTask();
+
+    void setVolData(const VolLoadTask::Volume &volume);
+
+    /** Release a texture once the frames in flight are done with it.
+     */
+    void retireTexture(Texture::SharedPtr pTexture);
+
+    /** Rebin the volume histogram over the current window for the UI plot.
+     */
+    void updateHistogramPlot();
+
+    /** Build the gradient volume if the Precomputed gradient mode needs it,
+     * out-of-core volumes fall back to finite differences.
+     */
+    void updateGradients();
+
+    /** Get the gradients sampled by the shader, nullptr unless the gradient
+     * mode is Precomputed.
+     */
+    GradientVolume::SharedPtr getShaderGradients() const;
+
+    /** Log the average samples per ray of the CPU reference marcher without
+     * empty space skipping, with the distance field and with the octree.
+     */
+    void measureSamplesPerRay();
+
+    /** Render the current view with the CPU reference renderer at swapchain
+     * size and write it to cpu_reference.exr.
+     */
+    void saveCpuReference();
+
+    /** Log the rays/s and samples/s of the CPU renderer with and without ray
+     * packets for the current view.
+     */
+    void benchmarkCpuRenderer();
+
+    /** Upload a whole mip level of a 3D texture with tightly packed texels,
+     * the texture must be in the CopyDestination state.
+     */
+    void uploadTexture3D(gfx::IResourceCommandEncoder *pEncoder,
+                         const Texture::SharedPtr &pTexture, uint32_t mipLevel,
+                         const void *pData, uint3 offset, uint3 size);
+
+    /** Upload an out-of-core volume to the volume texture brick by brick, so
+     * host memory stays within the brick cache budget.
+     */
+    void uploadStreamedVolume(gfx::IResourceCommandEncoder *pEncoder);
+
     static const int kSwapChainImageCount = 2;
 
     Camera mCamera;
@@ -78,9 +144,23 @@ class SampleApp : public Window::ICallbacks {
 
     Texture::SharedPtr mpPresentTexture;
     Texture::SharedPtr mpVolDataTexture;
-    Slang::ComPtr<gfx::IPipelineState> mComputePipelineState; ///<
+    Texture::SharedPtr mpCellDistanceTexture; ///< Occupancy distances
+    Texture::SharedPtr mpNodeRangeTexture;    ///< Min/max octree levels
+    Texture::SharedPtr mpGradientTexture;   ///< Octahedral gradients
+    /// Replaced textures and the heap synchronizations left until release
+    std::vector<std::pair<Texture::SharedPtr, uint32_t>> mRetiredTextures;
+    ComputePass::SharedPtr mpRayMarchingPass;
 
     std::shared_ptr<VolData> mpVolData;
+    MinMaxOctree::SharedPtr mpOctree;
+    OccupancyGrid::SharedPtr mpOccupancy; ///< As uploaded to the GPU
+    bool mIsVolDataDirty = false; ///< Volume texture needs an upload
+    bool mIsGradientDirty = false; ///< Gradient texture needs an upload
+    VolLoadTask::SharedPtr mpLoadTask;
+    VolLoadTask::Options mLoadOptions;
+    VolData::WindowLevel mWindow = {0.f, 1.f}; ///< Threshold slider range
+    std::vector<float> mHistogramPlot; ///< log(1 + count) per plot bar
+    std::vector<VolData::TissuePreset> mTissuePresets;
     SampleAppParam mParams;
 };
 } // namespace Voluma
\ No newline at end of file
@@ -0,0 +1,224 @@
+#include "BrickCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Utils/Logger.h"
+
+namespace Voluma {
+static constexpr size_t kBrickBytes =
+    BrickedVolume::kBrickVoxelCount * sizeof(uint16_t);
+
+std::string BrickCache::Stats::toString() const {
+    uint64_t requests = std::max<uint64_t>(hits + misses, 1);
+    return fmt::format(
+        "BrickCacheStats(hits = {}, misses = {}, hit rate = {:.1f}%, "
+        "prefetches = {}, evictions = {}, MB read = {:.1f})",
+        hits, misses, 100.0 * double(hits) / double(requests), prefetches,
+        evictions, double(bytesRead) / (1 << 20));
+}
+
+BrickCache::BrickCache(BrickStore::SharedPtr pStore, uint64_t budgetBytes,
+                       uint32_t prefetchThreadCount)
+    : mpStore(std::move(pStore)) {
+    uint64_t capacity = budgetBytes / kBrickBytes;
+    if (capacity < kMinCapacity) {
+        logWarning("Brick cache budget of {} bytes is below {} bricks.",
+                   budgetBytes, kMinCapacity);
+        capacity = kMinCapacity;
+    }
+    mCapacity = uint32_t(std::min<uint64_t>(
+        capacity, std::max(mpStore->getBrickCount(), kMinCapacity)));
+    mEntries.reserve(mCapacity);
+
+    for (uint32_t i = 0; i < prefetchThreadCount; i++)
+        mPrefetchThreads.emplace_back([this]() { prefetchWorker(); });
+}
+
+BrickCache::~BrickCache() {
+    {
+        std::unique_lock<std::mutex> lck(mMutex);
+        mIsStopping = true;
+        mPrefetchQueue.clear();
+    }
+    mPrefetchCond.notify_all();
+    for (auto& thread : mPrefetchThreads) thread.join();
+}
+
+std::shared_future<BrickCache::BrickRef> BrickCache::insert(
+    uint32_t index, std::promise<BrickRef>& promise) {
+    while (mEntries.size() >= mCapacity && !mLru.empty()) {
+        // In-flight reads stay valid, their waiters hold the future
+        mEntries.erase(mLru.back());
+        mLru.pop_back();
+        mCounters.evictions++;
+    }
+    mLru.push_front(index);
+    Entry& entry = mEntries[index];
+    entry.brick = promise.get_future().share();
+    entry.lruIt = mLru.begin();
+    return entry.brick;
+}
+
+BrickCache::BrickRef BrickCache::readBrick(uint32_t index) {
+    auto pVoxels = std::make_shared<std::vector<uint16_t>>(
+        BrickedVolume::kBrickVoxelCount);
+    if (mpStore->readBrick(index, *pVoxels)) {
+        mCounters.bytesRead += kBrickBytes;
+    } else {
+        // Keep going with an empty brick, a failed read is not fatal
+        logError("Failed to read brick {} from the brick store.", index);
+        std::fill(pVoxels->begin(), pVoxels->end(), uint16_t(0));
+    }
+    return pVoxels;
+}
+
+BrickCache::BrickRef BrickCache::getBrick(uint32_t index) {
+    std::shared_future<BrickRef> brick;
+    std::promise<BrickRef> promise;
+    bool isOwner = false;
+    {
+        std::unique_lock<std::mutex> lck(mMutex);
+        auto it = mEntries.find(index);
+        if (it != mEntries.end()) {
+            mCounters.hits++;
+            mLru.splice(mLru.begin(), mLru, it->second.lruIt);
+            brick = it->second.brick;
+        } else {
+            mCounters.misses++;
+            brick = insert(index, promise);
+            isOwner = true;
+        }
+    }
+    // Read outside of the lock so hits on other bricks are not blocked
+    if (isOwner) promise.set_value(readBrick(index));
+    return brick.get();
+}
+
+void BrickCache::prefetch(std::span<const uint32_t> indices) {
+    {
+        std::unique_lock<std::mutex> lck(mMutex);
+        for (uint32_t index : indices) {
+            if (index < mpStore->getBrickCount() && !mEntries.contains(index))
+                mPrefetchQueue.push_back(index);
+        }
+        // Prefetched bricks must not evict the whole working set
+        size_t maxQueueSize = std::max<size_t>(mCapacity / 2, 1);
+        while (mPrefetchQueue.size() > maxQueueSize)
+            mPrefetchQueue.pop_front();
+    }
+    mPrefetchCond.notify_all();
+}
+
+void BrickCache::prefetchWorker() {
+    while (true) {
+        uint32_t index;
+        std::promise<BrickRef> promise;
+        {
+            std::unique_lock<std::mutex> lck(mMutex);
+            mPrefetchCond.wait(lck, [&]() {
+                return mIsStopping || !mPrefetchQueue.empty();
+            });
+            if (mIsStopping) return;
+            index = mPrefetchQueue.front();
+            mPrefetchQueue.pop_front();
+            if (mEntries.contains(index)) continue;
+            insert(index, promise);
+        }
+        promise.set_value(readBrick(index));
+        mCounters.prefetches++;
+    }
+}
+
+int32_t BrickCache::getStoredValue(int32_t x, int32_t y, int32_t z) {
+    const auto& dims = mpStore->getVolumeDims();
+    if (x < 0 || y < 0 || z < 0 || x >= int32_t(dims[0]) ||
+        y >= int32_t(dims[1]) || z >= int32_t(dims[2]))
+        return 0;
+    constexpr uint32_t kSize = BrickedVolume::kBrickSize;
+    constexpr uint32_t kPadded = BrickedVolume::kPaddedSize;
+    auto pBrick = getBrick(mpStore->getBrickIndex(x / kSize, y / kSize,
+                                                  z / kSize));
+    size_t lx = x % kSize + BrickedVolume::kApron;
+    size_t ly = y % kSize + BrickedVolume::kApron;
+    size_t lz = z % kSize + BrickedVolume::kApron;
+    return BrickedVolume::decode((*pBrick)[(lz * kPadded + ly) * kPadded + lx],
+                                 mpStore->isSigned());
+}
+
+float BrickCache::sampleStored(float x, float y, float z) {
+    int32_t x0 = int32_t(std::floor(x));
+    int32_t y0 = int32_t(std::floor(y));
+    int32_t z0 = int32_t(std::floor(z));
+    float f[3] = {x - float(x0), y - float(y0), z - float(z0)};
+
+    const auto& dims = mpStore->getVolumeDims();
+    constexpr uint32_t kSize = BrickedVolume::kBrickSize;
+    if (x0 >= 0 && y0 >= 0 && z0 >= 0 && x0 < int32_t(dims[0]) &&
+        y0 < int32_t(dims[1]) && z0 < int32_t(dims[2])) {
+        auto pBrick = getBrick(
+            mpStore->getBrickIndex(x0 / kSize, y0 / kSize, z0 / kSize));
+        return BrickedVolume::sampleBrick(
+            *pBrick, mpStore->isSigned(), x0 % kSize + BrickedVolume::kApron,
+            y0 % kSize + BrickedVolume::kApron,
+            z0 % kSize + BrickedVolume::kApron, f);
+    }
+
+    auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+    float c[2][2];
+    for (int dz = 0; dz < 2; dz++)
+        for (int dy = 0; dy < 2; dy++)
+            c[dz][dy] =
+                lerp(float(getStoredValue(x0, y0 + dy, z0 + dz)),
+                     float(getStoredValue(x0 + 1, y0 + dy, z0 + dz)), f[0]);
+    return lerp(lerp(c[0][0], c[0][1], f[1]), lerp(c[1][0], c[1][1], f[1]),
+                f[2]);
+}
+
+void BrickCache::readSlice(uint32_t z, std::span<uint16_t> dst) {
+    const auto& dims = mpStore->getVolumeDims();
+    const auto& grid = mpStore->getBrickGrid();
+    constexpr uint32_t kSize = BrickedVolume::kBrickSize;
+    constexpr uint32_t kPadded = BrickedVolume::kPaddedSize;
+    uint32_t bz = z / kSize;
+
+    // Queue the whole layer so its reads overlap, and the next layer once
+    // a sweep enters this one
+    std::vector<uint32_t> layer;
+    for (uint32_t layerZ : {bz, bz + 1}) {
+        if (layerZ >= grid[2] || (layerZ != bz && z % kSize != 0)) continue;
+        for (uint32_t by = 0; by < grid[1]; by++)
+            for (uint32_t bx = 0; bx < grid[0]; bx++)
+                layer.push_back(mpStore->getBrickIndex(bx, by, layerZ));
+    }
+    prefetch(layer);
+
+    size_t lz = z % kSize + BrickedVolume::kApron;
+    for (uint32_t by = 0; by < grid[1]; by++) {
+        for (uint32_t bx = 0; bx < grid[0]; bx++) {
+            auto pBrick = getBrick(mpStore->getBrickIndex(bx, by, bz));
+            uint32_t width = std::min(kSize, dims[0] - bx * kSize);
+            uint32_t height = std::min(kSize, dims[1] - by * kSize);
+            for (uint32_t y = 0; y < height; y++) {
+                const uint16_t* pSrc =
+                    pBrick->data() +
+                    (lz * kPadded + y + BrickedVolume::kApron) * kPadded +
+                    BrickedVolume::kApron;
+                std::copy(pSrc, pSrc + width,
+                          dst.data() + (size_t(by) * kSize + y) * dims[0] +
+                              size_t(bx) * kSize);
+            }
+        }
+    }
+}
+
+BrickCache::Stats BrickCache::getStats() const {
+    Stats stats;
+    stats.hits = mCounters.hits;
+    stats.misses = mCounters.misses;
+    stats.prefetches = mCounters.prefetches;
+    stats.evictions = mCounters.evictions;
+    stats.bytesRead = mCounters.bytesRead;
+    return stats;
+}
+} // namespace Voluma
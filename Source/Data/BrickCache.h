@@ -0,0 +1,129 @@
+#pragma once
+#include <fmt/core.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Core/Macros.h"
+#include "Data/BrickStore.h"
+
+namespace Voluma {
+/** Fixed budget LRU cache of the bricks of a BrickStore.
+ *
+ * Bricks are read on demand and the least recently used brick is evicted
+ * once the budget is reached. Readers get a shared reference to the brick
+ * voxels, an evicted brick stays valid until its last reference is dropped,
+ * so hold references for short spans only. Prefetch requests are served by
+ * background threads, a brick requested while its prefetch is in flight
+ * waits for that read instead of issuing a second one.
+ */
+class VL_API BrickCache {
+   public:
+    using SharedPtr = std::shared_ptr<BrickCache>;
+    /// Padded voxels of a brick, see BrickedVolume::getBrickVoxels
+    using BrickRef = std::shared_ptr<const std::vector<uint16_t>>;
+
+    static constexpr uint32_t kMinCapacity = 16; ///< Bricks
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t prefetches = 0; ///< Bricks read by the prefetch threads
+        uint64_t evictions = 0;
+        uint64_t bytesRead = 0;
+
+        std::string toString() const;
+    };
+
+    /** Create a cache holding at most budgetBytes of brick voxels, at least
+     * kMinCapacity bricks.
+     */
+    BrickCache(BrickStore::SharedPtr pStore, uint64_t budgetBytes,
+               uint32_t prefetchThreadCount = 2);
+
+    BrickCache(const BrickCache&) = delete;
+    BrickCache& operator=(const BrickCache&) = delete;
+
+    ~BrickCache();
+
+    const BrickStore::SharedPtr& getStore() const { return mpStore; }
+
+    /** Get the number of bricks the cache can hold.
+     */
+    uint32_t getCapacity() const { return mCapacity; }
+
+    /** Get a brick, blocks until it is read on a miss. Thread safe.
+     */
+    BrickRef getBrick(uint32_t index);
+
+    /** Queue bricks for asynchronous reads, bricks already resident are
+     * skipped. The oldest requests are dropped if the queue is full so the
+     * latest view wins.
+     */
+    void prefetch(std::span<const uint32_t> indices);
+
+    /** Get a stored voxel value, 0 outside of the volume.
+     */
+    int32_t getStoredValue(int32_t x, int32_t y, int32_t z);
+
+    /** Trilinear sample of stored values, see BrickedVolume::sampleStored.
+     */
+    float sampleStored(float x, float y, float z);
+
+    /** Gather the raw voxels of a Z slice, dst must hold a whole slice. The
+     * next brick layer is prefetched when a layer is entered.
+     */
+    void readSlice(uint32_t z, std::span<uint16_t> dst);
+
+    Stats getStats() const;
+
+   private:
+    struct Entry {
+        std::shared_future<BrickRef> brick;
+        std::list<uint32_t>::iterator lruIt;
+    };
+
+    /** Insert an entry for a missing brick, evicting the LRU bricks to stay
+     * in budget. mMutex must be held.
+     */
+    std::shared_future<BrickRef> insert(uint32_t index,
+                                        std::promise<BrickRef>& promise);
+
+    BrickRef readBrick(uint32_t index);
+
+    void prefetchWorker();
+
+    BrickStore::SharedPtr mpStore;
+    uint32_t mCapacity = 0;
+
+    mutable std::mutex mMutex;
+    std::unordered_map<uint32_t, Entry> mEntries; ///< Guarded by mMutex
+    std::list<uint32_t> mLru; ///< Most recently used first, by mMutex
+
+    std::deque<uint32_t> mPrefetchQueue; ///< Guarded by mMutex
+    std::condition_variable mPrefetchCond;
+    bool mIsStopping = false; ///< Guarded by mMutex
+    std::vector<std::thread> mPrefetchThreads;
+
+    struct {
+        std::atomic<uint64_t> hits = 0;
+        std::atomic<uint64_t> misses = 0;
+        std::atomic<uint64_t> prefetches = 0;
+        std::atomic<uint64_t> evictions = 0;
+        std::atomic<uint64_t> bytesRead = 0;
+    } mCounters;
+};
+} // namespace Voluma
+
+VL_FMT(Voluma::BrickCache::Stats)
@@ -0,0 +1,268 @@
+#include "BrickStore.h"
+
+#if VL_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <system_error>
+#include <type_traits>
+
+#include "Data/VolCache.h"
+#include "Utils/FileUtils.h"
+#include "Utils/Logger.h"
+#include "Utils/Parallel.h"
+
+namespace Voluma {
+static_assert(std::is_trivially_copyable_v<BrickStore::Header>);
+static_assert(std::is_trivially_copyable_v<BrickedVolume::BrickInfo>);
+static_assert(std::is_trivially_copyable_v<BrickStore::SliceRange>);
+
+static constexpr char kMagic[8] = {'V', 'L', 'B', 'R', 'I', 'C', 'K', 0};
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/** Read size bytes at offset without moving a shared file position.
+ */
+#if VL_WINDOWS
+static bool readAt(void* handle, uint64_t offset, void* pDst, size_t size) {
+    auto* pBytes = static_cast<char*>(pDst);
+    while (size > 0) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = DWORD(offset);
+        overlapped.OffsetHigh = DWORD(offset >> 32);
+        DWORD chunk = DWORD(std::min<size_t>(size, 1u << 30));
+        DWORD readSize = 0;
+        if (!ReadFile(handle, pBytes, chunk, &readSize, &overlapped) ||
+            readSize == 0)
+            return false;
+        pBytes += readSize;
+        offset += readSize;
+        size -= readSize;
+    }
+    return true;
+}
+#else
+static bool readAt(int fd, uint64_t offset, void* pDst, size_t size) {
+    auto* pBytes = static_cast<char*>(pDst);
+    while (size > 0) {
+        ssize_t readSize = pread(fd, pBytes, size, off_t(offset));
+        if (readSize <= 0) return false;
+        pBytes += readSize;
+        offset += uint64_t(readSize);
+        size -= size_t(readSize);
+    }
+    return true;
+}
+#endif
+
+std::filesystem::path BrickStore::getStorePath(uint64_t contentKey) {
+    auto dir = getUserCacheDir();
+    if (dir.empty()) return dir;
+    return dir / fmt::format("{:016x}.vlbrk", contentKey);
+}
+
+BrickStore::Writer::Writer(const std::filesystem::path& path,
+                           const std::array<uint32_t, 3>& dims,
+                           bool isSigned, uint64_t contentKey)
+    : mPath(path), mStart(std::chrono::steady_clock::now()) {
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    std::memcpy(mHeader.magic, kMagic, sizeof(kMagic));
+    mHeader.version = kVersion;
+    mHeader.headerSize = sizeof(Header);
+    mHeader.contentKey = contentKey;
+    auto grid = BrickedVolume::getBrickGrid(dims);
+    for (int i = 0; i < 3; i++) {
+        mHeader.dims[i] = dims[i];
+        mHeader.grid[i] = grid[i];
+    }
+    mHeader.brickSize = BrickedVolume::kBrickSize;
+    mHeader.apron = BrickedVolume::kApron;
+    mHeader.voxelFormat = isSigned ? 1 : 0;
+
+    mInfos.resize(size_t(grid[0]) * grid[1] * grid[2]);
+    mHeader.brickInfoOffset = sizeof(Header);
+    mHeader.sliceRangeOffset =
+        mHeader.brickInfoOffset + mInfos.size() * sizeof(mInfos[0]);
+    mHeader.brickDataOffset =
+        alignUp(mHeader.sliceRangeOffset + dims[2] * sizeof(SliceRange),
+                kAlignment);
+    mHeader.brickStride = alignUp(
+        BrickedVolume::kBrickVoxelCount * sizeof(uint16_t), kAlignment);
+
+    // Same staging scheme as the volume cache
+    mTmpPath = getStagingPath(path);
+    mFile.open(mTmpPath, std::ios::binary | std::ios::trunc);
+    if (!mFile) {
+        logWarning("Failed to create brick store {}.", mTmpPath.string());
+        return;
+    }
+    mFile.write(reinterpret_cast<const char*>(&mHeader), sizeof(Header));
+    std::vector<char> padding(mHeader.brickDataOffset - sizeof(Header), 0);
+    mFile.write(padding.data(), padding.size());
+    mSlab.resize(mHeader.brickStride / sizeof(uint16_t) * grid[0] * grid[1]);
+}
+
+BrickStore::Writer::~Writer() {
+    if (mIsFinished || mTmpPath.empty()) return;
+    mFile.close();
+    std::error_code ec;
+    std::filesystem::remove(mTmpPath, ec);
+}
+
+bool BrickStore::Writer::writeSlab(uint32_t bz,
+                                   std::span<const uint16_t> slices,
+                                   uint32_t beginZ) {
+    if (!isOpen() || bz != mNextSlab || bz >= getSlabCount()) return false;
+    const auto* grid = mHeader.grid;
+    std::array<uint32_t, 3> dims = {mHeader.dims[0], mHeader.dims[1],
+                                    mHeader.dims[2]};
+    uint32_t slabBrickCount = grid[0] * grid[1];
+    size_t strideVoxels = mHeader.brickStride / sizeof(uint16_t);
+
+    // Bricks of a slab are built in parallel into their padded slots
+    std::vector<uint32_t> slabBricks(slabBrickCount);
+    std::iota(slabBricks.begin(), slabBricks.end(), 0u);
+    forEachParallel(slabBricks.begin(), slabBricks.end(), [&](uint32_t b) {
+        mInfos[size_t(bz) * slabBrickCount + b] = BrickedVolume::fillBrick(
+            slices, beginZ, dims, mHeader.voxelFormat == 1, b % grid[0],
+            b / grid[0], bz,
+            {mSlab.data() + strideVoxels * b,
+             BrickedVolume::kBrickVoxelCount});
+    });
+    mFile.write(reinterpret_cast<const char*>(mSlab.data()),
+                mSlab.size() * sizeof(uint16_t));
+    mNextSlab++;
+    return bool(mFile);
+}
+
+bool BrickStore::Writer::finish(std::span<const SliceRange> sliceRanges) {
+    if (!isOpen() || mNextSlab != getSlabCount() ||
+        sliceRanges.size() != mHeader.dims[2])
+        return false;
+
+    // Ranges are known once all bricks are built
+    mFile.seekp(std::streamoff(mHeader.brickInfoOffset));
+    mFile.write(reinterpret_cast<const char*>(mInfos.data()),
+                mInfos.size() * sizeof(mInfos[0]));
+    mFile.write(reinterpret_cast<const char*>(sliceRanges.data()),
+                sliceRanges.size_bytes());
+    mFile.close();
+    if (!mFile) {
+        logWarning("Failed to write brick store {}.", mTmpPath.string());
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(mTmpPath, mPath, ec);
+    if (ec) return false;
+    mIsFinished = true;
+    VolCache::prune();
+
+    logInfo("Bricked volume into {}x{}x{} bricks on disk in {:.1f} ms.",
+            mHeader.grid[0], mHeader.grid[1], mHeader.grid[2],
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - mStart)
+                .count());
+    return true;
+}
+
+BrickStore::SharedPtr BrickStore::open(const std::filesystem::path& path,
+                                       uint64_t contentKey) {
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) return nullptr;
+    uint64_t fileSize = std::filesystem::file_size(path, ec);
+    if (ec) return nullptr;
+
+    SharedPtr pStore(new BrickStore());
+#if VL_WINDOWS
+    HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ,
+                              FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    pStore->mFileHandle = file;
+    auto handle = pStore->mFileHandle;
+#else
+    pStore->mFd = ::open(path.c_str(), O_RDONLY);
+    if (pStore->mFd < 0) return nullptr;
+    auto handle = pStore->mFd;
+#endif
+
+    Header header;
+    if (fileSize < sizeof(Header) ||
+        !readAt(handle, 0, &header, sizeof(Header)) ||
+        std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion || header.headerSize != sizeof(Header) ||
+        header.contentKey != contentKey ||
+        header.brickSize != BrickedVolume::kBrickSize ||
+        header.apron != BrickedVolume::kApron) {
+        logWarning("Brick store {} is stale, ignored.", path.string());
+        return nullptr;
+    }
+
+    uint64_t brickCount = uint64_t(header.grid[0]) * header.grid[1] *
+                          header.grid[2];
+    if (header.brickStride <
+            BrickedVolume::kBrickVoxelCount * sizeof(uint16_t) ||
+        header.sliceRangeOffset + header.dims[2] * sizeof(SliceRange) >
+            header.brickDataOffset ||
+        header.brickDataOffset + brickCount * header.brickStride > fileSize) {
+        logWarning("Brick store {} is truncated, ignored.", path.string());
+        return nullptr;
+    }
+
+    pStore->mBrickInfos.resize(brickCount);
+    if (!readAt(handle, header.brickInfoOffset, pStore->mBrickInfos.data(),
+                brickCount * sizeof(BrickedVolume::BrickInfo))) {
+        return nullptr;
+    }
+    pStore->mSliceRanges.resize(header.dims[2]);
+    if (!readAt(handle, header.sliceRangeOffset, pStore->mSliceRanges.data(),
+                header.dims[2] * sizeof(SliceRange))) {
+        return nullptr;
+    }
+    for (int i = 0; i < 3; i++) {
+        pStore->mDims[i] = header.dims[i];
+        pStore->mGrid[i] = header.grid[i];
+    }
+    pStore->mIsSigned = header.voxelFormat == 1;
+    pStore->mBrickDataOffset = header.brickDataOffset;
+    pStore->mBrickStride = header.brickStride;
+
+    // Opens order the stores for eviction along with the volume caches
+    std::filesystem::last_write_time(
+        path, std::filesystem::file_time_type::clock::now(), ec);
+    return pStore;
+}
+
+bool BrickStore::readBrick(uint32_t index, std::span<uint16_t> dst) const {
+    if (index >= getBrickCount() ||
+        dst.size() < BrickedVolume::kBrickVoxelCount)
+        return false;
+#if VL_WINDOWS
+    auto handle = mFileHandle;
+#else
+    auto handle = mFd;
+#endif
+    return readAt(handle, mBrickDataOffset + mBrickStride * index, dst.data(),
+                  BrickedVolume::kBrickVoxelCount * sizeof(uint16_t));
+}
+
+BrickStore::~BrickStore() {
+#if VL_WINDOWS
+    if (mFileHandle) CloseHandle(mFileHandle);
+#else
+    if (mFd >= 0) close(mFd);
+#endif
+}
+} // namespace Voluma
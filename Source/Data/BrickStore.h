@@ -0,0 +1,165 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "Core/Macros.h"
+#include "Data/BrickedVolume.h"
+
+namespace Voluma {
+/** On-disk bricked volume, the backing store of the out-of-core mode.
+ *
+ * File layout:
+ *   BrickStore::Header
+ *   BrickedVolume::BrickInfo x brickCount
+ *   BrickStore::SliceRange x slice count
+ *   padded brick voxels, every brick starts at a kAlignment boundary
+ *
+ * Bricks use the BrickedVolume layout, apron included, so a brick read from
+ * disk can be sampled like an in-memory one. Only the header and the brick
+ * ranges are kept in memory, bricks are read on demand and reads of
+ * different bricks may run concurrently. The slice ranges let a volume be
+ * opened from its store alone, without decoding its series.
+ */
+class VL_API BrickStore {
+   public:
+    using SharedPtr = std::shared_ptr<BrickStore>;
+
+    static constexpr uint32_t kVersion = 2;
+    static constexpr uint64_t kAlignment = 4096; ///< Brick data alignment
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint64_t contentKey; ///< Content key of the source volume cache
+
+        uint32_t dims[3];
+        uint32_t grid[3];
+        uint32_t brickSize;
+        uint32_t apron;
+        uint32_t voxelFormat;
+        uint32_t padding;
+
+        uint64_t brickInfoOffset;
+        uint64_t sliceRangeOffset;
+        uint64_t brickDataOffset;
+        uint64_t brickStride; ///< Bytes between two bricks
+    };
+
+    /** Stored value range of a slice.
+     */
+    struct SliceRange {
+        int32_t minValue;
+        int32_t maxValue;
+    };
+
+    /** Store file written one slab(a z row of bricks) at a time, so neither
+     * the bricks nor the voxels of the whole volume are held in memory. The
+     * file is staged and only moved into place by finish.
+     */
+    class VL_API Writer {
+       public:
+        /** Start a store file of a volume, see isOpen.
+         */
+        Writer(const std::filesystem::path& path,
+               const std::array<uint32_t, 3>& dims, bool isSigned,
+               uint64_t contentKey);
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        /** Discard the staging file unless finished.
+         */
+        ~Writer();
+
+        bool isOpen() const { return mFile.is_open() && bool(mFile); }
+
+        /** Get the number of slabs, z bricks of the volume.
+         */
+        uint32_t getSlabCount() const { return mHeader.grid[2]; }
+
+        /** Brick slab bz and append it, slabs go in order. slices holds the
+         * raw slices from beginZ on, see BrickedVolume::fillBrick.
+         */
+        bool writeSlab(uint32_t bz, std::span<const uint16_t> slices,
+                       uint32_t beginZ);
+
+        /** Write the brick and slice ranges once all slabs are written and
+         * move the file into place, the cache folder is pruned with
+         * VolCache::prune afterwards. Returns false on failure.
+         */
+        bool finish(std::span<const SliceRange> sliceRanges);
+
+       private:
+        std::filesystem::path mPath;
+        std::filesystem::path mTmpPath;
+        std::ofstream mFile;
+        Header mHeader = {};
+        std::vector<BrickedVolume::BrickInfo> mInfos;
+        std::vector<uint16_t> mSlab; ///< Padded bricks of a slab
+        uint32_t mNextSlab = 0;
+        bool mIsFinished = false;
+        std::chrono::steady_clock::time_point mStart;
+    };
+
+    BrickStore(const BrickStore&) = delete;
+    BrickStore& operator=(const BrickStore&) = delete;
+
+    /** Get the store file path of a volume cache content key, empty if
+     * there is no per-user cache folder.
+     */
+    static std::filesystem::path getStorePath(uint64_t contentKey);
+
+    /** Open a store file, returns nullptr if it is missing or does not match
+     * the content key.
+     */
+    static SharedPtr open(const std::filesystem::path& path,
+                          uint64_t contentKey);
+
+    const std::array<uint32_t, 3>& getVolumeDims() const { return mDims; }
+    const std::array<uint32_t, 3>& getBrickGrid() const { return mGrid; }
+    uint32_t getBrickCount() const { return uint32_t(mBrickInfos.size()); }
+    bool isSigned() const { return mIsSigned; }
+
+    uint32_t getBrickIndex(uint32_t bx, uint32_t by, uint32_t bz) const {
+        return (bz * mGrid[1] + by) * mGrid[0] + bx;
+    }
+
+    std::span<const BrickedVolume::BrickInfo> getBrickInfos() const {
+        return mBrickInfos;
+    }
+
+    std::span<const SliceRange> getSliceRanges() const {
+        return mSliceRanges;
+    }
+
+    /** Read the padded voxels of a brick, dst must hold
+     * BrickedVolume::kBrickVoxelCount voxels. Thread safe.
+     */
+    bool readBrick(uint32_t index, std::span<uint16_t> dst) const;
+
+    ~BrickStore();
+
+   private:
+    BrickStore() = default;
+
+    std::array<uint32_t, 3> mDims = {};
+    std::array<uint32_t, 3> mGrid = {};
+    bool mIsSigned = false;
+    uint64_t mBrickDataOffset = 0;
+    uint64_t mBrickStride = 0;
+    std::vector<BrickedVolume::BrickInfo> mBrickInfos;
+    std::vector<SliceRange> mSliceRanges;
+#if VL_WINDOWS
+    void* mFileHandle = nullptr;
+#else
+    int mFd = -1;
+#endif
+};
+} // namespace Voluma
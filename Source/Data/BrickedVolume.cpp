@@ -0,0 +1,168 @@
+#include "BrickedVolume.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+
+#include "Data/VolData.h"
+#include "Utils/Logger.h"
+#include "Utils/Parallel.h"
+#include "Utils/VoxelKernels.h"
+
+namespace Voluma {
+BrickedVolume::SharedPtr BrickedVolume::create(const VolData& volData) {
+    auto start = std::chrono::steady_clock::now();
+
+    SharedPtr pBricks(new BrickedVolume());
+    pBricks->mDims = {uint32_t(volData.getColWidth()),
+                      uint32_t(volData.getRowWidth()),
+                      uint32_t(volData.getSliceCount())};
+    pBricks->mGrid = getBrickGrid(pBricks->mDims);
+    pBricks->mIsSigned = volData.getVoxelFormat() == VoxelFormat::Int16;
+
+    const auto& grid = pBricks->mGrid;
+    uint32_t brickCount = grid[0] * grid[1] * grid[2];
+    pBricks->mVoxels.resize(kBrickVoxelCount * brickCount);
+    pBricks->mBrickInfos.resize(brickCount);
+
+    // Every brick owns its voxels and info, no synchronization needed
+    std::vector<uint32_t> brickIndices(brickCount);
+    std::iota(brickIndices.begin(), brickIndices.end(), 0u);
+    forEachParallel(brickIndices.begin(), brickIndices.end(), [&](uint32_t b) {
+        pBricks->mBrickInfos[b] = fillBrick(
+            volData.getBufferData(), 0, pBricks->mDims, pBricks->mIsSigned,
+            b % grid[0], b / grid[0] % grid[1], b / (grid[0] * grid[1]),
+            {pBricks->mVoxels.data() + kBrickVoxelCount * b,
+             kBrickVoxelCount});
+    });
+
+    logInfo("Bricked volume into {}x{}x{} bricks in {:.1f} ms.", grid[0],
+            grid[1], grid[2],
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start)
+                .count());
+    return pBricks;
+}
+
+std::array<uint32_t, 3> BrickedVolume::getBrickGrid(
+    const std::array<uint32_t, 3>& dims) {
+    std::array<uint32_t, 3> grid;
+    for (int i = 0; i < 3; i++)
+        grid[i] = (dims[i] + kBrickSize - 1) / kBrickSize;
+    return grid;
+}
+
+BrickedVolume::BrickInfo BrickedVolume::fillBrick(
+    std::span<const uint16_t> src, uint32_t srcBeginZ,
+    const std::array<uint32_t, 3>& volumeDims, bool isSigned, uint32_t bx,
+    uint32_t by, uint32_t bz, std::span<uint16_t> dst) {
+    int32_t dims[3] = {int32_t(volumeDims[0]), int32_t(volumeDims[1]),
+                       int32_t(volumeDims[2])};
+    int32_t origin[3] = {int32_t(bx * kBrickSize) - int32_t(kApron),
+                         int32_t(by * kBrickSize) - int32_t(kApron),
+                         int32_t(bz * kBrickSize) - int32_t(kApron)};
+    uint16_t* pDst = dst.data();
+
+    // Copy rows, clipped rows and voxels outside of the volume are 0
+    std::fill(pDst, pDst + kBrickVoxelCount, uint16_t(0));
+    int32_t x0 = std::max(origin[0], 0);
+    int32_t x1 = std::min(origin[0] + int32_t(kPaddedSize), dims[0]);
+    for (uint32_t z = 0; z < kPaddedSize; z++) {
+        int32_t sz = origin[2] + int32_t(z);
+        if (sz < 0 || sz >= dims[2]) continue;
+        for (uint32_t y = 0; y < kPaddedSize; y++) {
+            int32_t sy = origin[1] + int32_t(y);
+            if (sy < 0 || sy >= dims[1] || x0 >= x1) continue;
+            const uint16_t* pRow =
+                src.data() +
+                (size_t(sz - int32_t(srcBeginZ)) * dims[1] + sy) * dims[0];
+            std::copy(pRow + x0, pRow + x1,
+                      pDst + (size_t(z) * kPaddedSize + y) * kPaddedSize +
+                          (x0 - origin[0]));
+        }
+    }
+
+    BrickInfo info;
+    VoxelKernels::MinMax range;
+    int64_t sum = 0;
+    if (isSigned) {
+        std::span<const int16_t> signedVoxels(
+            reinterpret_cast<const int16_t*>(pDst), kBrickVoxelCount);
+        range = VoxelKernels::computeMinMax(signedVoxels);
+        for (int16_t v : signedVoxels) sum += v;
+    } else {
+        std::span<const uint16_t> voxels(pDst, kBrickVoxelCount);
+        range = VoxelKernels::computeMinMax(voxels);
+        for (uint16_t v : voxels) sum += v;
+    }
+    info.minValue = range.min;
+    info.maxValue = range.max;
+    info.meanValue = float(double(sum) / double(kBrickVoxelCount));
+    info.padding = 0;
+    return info;
+}
+
+int32_t BrickedVolume::getStoredValue(int32_t x, int32_t y, int32_t z) const {
+    if (x < 0 || y < 0 || z < 0 || x >= int32_t(mDims[0]) ||
+        y >= int32_t(mDims[1]) || z >= int32_t(mDims[2]))
+        return 0;
+    auto voxels = getBrickVoxels(getBrickIndexOfVoxel(x, y, z));
+    size_t lx = x % kBrickSize + kApron;
+    size_t ly = y % kBrickSize + kApron;
+    size_t lz = z % kBrickSize + kApron;
+    return decode(voxels[(lz * kPaddedSize + ly) * kPaddedSize + lx]);
+}
+
+float BrickedVolume::sampleBrick(std::span<const uint16_t> voxels,
+                                 bool isSigned, uint32_t x, uint32_t y,
+                                 uint32_t z, const float f[3]) {
+    auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+    float c[2][2];
+    for (uint32_t dz = 0; dz < 2; dz++) {
+        for (uint32_t dy = 0; dy < 2; dy++) {
+            size_t row = ((size_t(z) + dz) * kPaddedSize + y + dy) *
+                             kPaddedSize +
+                         x;
+            c[dz][dy] = lerp(float(decode(voxels[row], isSigned)),
+                             float(decode(voxels[row + 1], isSigned)), f[0]);
+        }
+    }
+    return lerp(lerp(c[0][0], c[0][1], f[1]), lerp(c[1][0], c[1][1], f[1]),
+                f[2]);
+}
+
+float BrickedVolume::sampleStored(float x, float y, float z) const {
+    int32_t x0 = int32_t(std::floor(x));
+    int32_t y0 = int32_t(std::floor(y));
+    int32_t z0 = int32_t(std::floor(z));
+    float f[3] = {x - float(x0), y - float(y0), z - float(z0)};
+
+    if (x0 >= 0 && y0 >= 0 && z0 >= 0 && x0 < int32_t(mDims[0]) &&
+        y0 < int32_t(mDims[1]) && z0 < int32_t(mDims[2])) {
+        // The apron holds the +1 neighbors, all 8 corners are in one brick
+        return sampleBrick(getBrickVoxels(getBrickIndexOfVoxel(x0, y0, z0)),
+                           mIsSigned, x0 % kBrickSize + kApron,
+                           y0 % kBrickSize + kApron, z0 % kBrickSize + kApron,
+                           f);
+    }
+
+    auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+    float c[2][2];
+    for (int dz = 0; dz < 2; dz++)
+        for (int dy = 0; dy < 2; dy++)
+            c[dz][dy] =
+                lerp(float(getStoredValue(x0, y0 + dy, z0 + dz)),
+                     float(getStoredValue(x0 + 1, y0 + dy, z0 + dz)), f[0]);
+    return lerp(lerp(c[0][0], c[0][1], f[1]), lerp(c[1][0], c[1][1], f[1]),
+                f[2]);
+}
+
+float BrickedVolume::getEmptyFraction(int32_t storedThreshold) const {
+    if (mBrickInfos.empty()) return 0.f;
+    size_t emptyCount = std::count_if(
+        mBrickInfos.begin(), mBrickInfos.end(),
+        [=](const BrickInfo& info) { return info.maxValue < storedThreshold; });
+    return float(emptyCount) / float(mBrickInfos.size());
+}
+} // namespace Voluma
\ No newline at end of file
@@ -0,0 +1,130 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "Core/Macros.h"
+
+namespace Voluma {
+class VolData;
+
+/** Bricked copy of a volume with per-brick value ranges.
+ *
+ * The volume is cut into kBrickSize^3 bricks, each stored contiguously with
+ * a kApron voxel border copied from its neighbors. A trilinear sample whose
+ * base voxel lies in a brick therefore never leaves that brick, and the
+ * brick range bounds every sample taken in it, which lets renderers skip
+ * bricks that cannot pass a threshold. Voxels outside of the volume are
+ * stored as 0, matching the ray marching shader.
+ */
+class VL_API BrickedVolume {
+   public:
+    using SharedPtr = std::shared_ptr<BrickedVolume>;
+
+    static constexpr uint32_t kBrickSize = 32; ///< Interior voxels per axis
+    static constexpr uint32_t kApron = 1;
+    static constexpr uint32_t kPaddedSize = kBrickSize + 2 * kApron;
+    static constexpr size_t kBrickVoxelCount =
+        size_t(kPaddedSize) * kPaddedSize * kPaddedSize;
+
+    /** Value range of a brick in stored values, apron included.
+     */
+    struct BrickInfo {
+        int32_t minValue;
+        int32_t maxValue;
+        float meanValue;
+        uint32_t padding;
+    };
+
+    /** Brick the voxels of a loaded volume, bricks are built in parallel.
+     */
+    static SharedPtr create(const VolData& volData);
+
+    /** Get the brick grid covering volume dimensions.
+     */
+    static std::array<uint32_t, 3> getBrickGrid(
+        const std::array<uint32_t, 3>& dims);
+
+    /** Copy the padded voxels of brick (bx, by, bz) of a volume into dst,
+     * which must hold kBrickVoxelCount voxels, and get its range. src holds
+     * the raw slices of the volume from srcBeginZ on and must cover the
+     * slices of the brick and its apron inside of the volume. Used to build
+     * bricks without holding all of them, see BrickStore::Writer.
+     */
+    static BrickInfo fillBrick(std::span<const uint16_t> src,
+                               uint32_t srcBeginZ,
+                               const std::array<uint32_t, 3>& dims,
+                               bool isSigned, uint32_t bx, uint32_t by,
+                               uint32_t bz, std::span<uint16_t> dst);
+
+    const std::array<uint32_t, 3>& getVolumeDims() const { return mDims; }
+    const std::array<uint32_t, 3>& getBrickGrid() const { return mGrid; }
+    uint32_t getBrickCount() const { return uint32_t(mBrickInfos.size()); }
+    bool isSigned() const { return mIsSigned; }
+
+    uint32_t getBrickIndex(uint32_t bx, uint32_t by, uint32_t bz) const {
+        return (bz * mGrid[1] + by) * mGrid[0] + bx;
+    }
+
+    /** Get the padded voxels of a brick in X-Y-Z order, kPaddedSize voxels
+     * per row.
+     */
+    std::span<const uint16_t> getBrickVoxels(uint32_t index) const {
+        return {mVoxels.data() + kBrickVoxelCount * index, kBrickVoxelCount};
+    }
+
+    const BrickInfo& getBrickInfo(uint32_t index) const {
+        return mBrickInfos[index];
+    }
+
+    /** Get the ranges of all bricks in brick index order, e.g. to upload as
+     * a brick grid sized 3D texture.
+     */
+    std::span<const BrickInfo> getBrickInfos() const { return mBrickInfos; }
+
+    /** Get the brick holding a voxel.
+     */
+    uint32_t getBrickIndexOfVoxel(uint32_t x, uint32_t y, uint32_t z) const {
+        return getBrickIndex(x / kBrickSize, y / kBrickSize, z / kBrickSize);
+    }
+
+    /** Get a stored voxel value, 0 outside of the volume.
+     */
+    int32_t getStoredValue(int32_t x, int32_t y, int32_t z) const;
+
+    /** Trilinear sample of stored values at voxel coordinates, voxel centers
+     * are at integer coordinates like VolData::getVolData in the shader.
+     */
+    float sampleStored(float x, float y, float z) const;
+
+    /** Fraction of bricks whose max stored value is below a threshold.
+     */
+    float getEmptyFraction(int32_t storedThreshold) const;
+
+    /** Decode a raw brick voxel to its stored value.
+     */
+    static int32_t decode(uint16_t v, bool isSigned) {
+        return isSigned ? int32_t(int16_t(v)) : int32_t(v);
+    }
+
+    /** Trilinear sample inside of one padded brick, (x, y, z) is the base
+     * voxel in padded brick coordinates and f the fraction towards +1.
+     */
+    static float sampleBrick(std::span<const uint16_t> voxels, bool isSigned,
+                             uint32_t x, uint32_t y, uint32_t z,
+                             const float f[3]);
+
+   private:
+    BrickedVolume() = default;
+
+    int32_t decode(uint16_t v) const { return decode(v, mIsSigned); }
+
+    std::array<uint32_t, 3> mDims = {};
+    std::array<uint32_t, 3> mGrid = {};
+    bool mIsSigned = false;
+    std::vector<uint16_t> mVoxels;
+    std::vector<BrickInfo> mBrickInfos;
+};
+} // namespace Voluma
@@ -0,0 +1,408 @@
+#include "DcmCatalog.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+
+#include "Utils/FileUtils.h"
+#include "Utils/Hash.h"
+#include "Utils/Logger.h"
+
+namespace Voluma {
+static_assert(std::is_trivially_copyable_v<DcmCatalog::Header>);
+static_assert(std::is_trivially_copyable_v<DcmCatalog::FileRecord>);
+static_assert(std::is_trivially_copyable_v<DcmCatalog::SeriesRecord>);
+
+static constexpr char kMagic[8] = {'V', 'L', 'C', 'A', 'T', 'L', 'G', 0};
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static int64_t getModifiedTime(const std::string& path) {
+    std::error_code ec;
+    return std::filesystem::last_write_time(path, ec)
+        .time_since_epoch()
+        .count();
+}
+
+namespace {
+/** Builds the string pool and the tables in memory before writing them out.
+ */
+struct CatalogWriter {
+    std::vector<DcmCatalog::FileRecord> files;
+    std::vector<DcmCatalog::SeriesRecord> series;
+    std::vector<uint32_t> seriesFiles;
+    std::vector<uint32_t> hashTable;
+    std::string strings;
+
+    DcmCatalog::StringRef addString(std::string_view str) {
+        DcmCatalog::StringRef ref = {uint32_t(strings.size()),
+                                     uint32_t(str.size())};
+        strings.append(str);
+        return ref;
+    }
+
+    template <typename T>
+    static void writeTable(std::ofstream& file, uint64_t offset,
+                           const std::vector<T>& table) {
+        std::vector<char> padding(offset - uint64_t(file.tellp()), 0);
+        file.write(padding.data(), padding.size());
+        file.write(reinterpret_cast<const char*>(table.data()),
+                   table.size() * sizeof(T));
+    }
+
+    bool write(const std::filesystem::path& path, std::string_view root) {
+        DcmCatalog::Header header = {};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = DcmCatalog::kVersion;
+        header.headerSize = sizeof(DcmCatalog::Header);
+        header.rootFolder = addString(root);
+        header.fileCount = uint32_t(files.size());
+        header.seriesCount = uint32_t(series.size());
+        header.seriesFileCount = uint32_t(seriesFiles.size());
+        header.hashCapacity = uint32_t(hashTable.size());
+
+        header.fileTableOffset = alignUp(sizeof(header), 8);
+        header.seriesTableOffset =
+            alignUp(header.fileTableOffset +
+                        files.size() * sizeof(DcmCatalog::FileRecord),
+                    8);
+        header.seriesFileOffset =
+            alignUp(header.seriesTableOffset +
+                        series.size() * sizeof(DcmCatalog::SeriesRecord),
+                    8);
+        header.hashTableOffset = alignUp(
+            header.seriesFileOffset + seriesFiles.size() * sizeof(uint32_t),
+            8);
+        header.stringPoolOffset =
+            header.hashTableOffset + hashTable.size() * sizeof(uint32_t);
+        header.stringPoolSize = strings.size();
+
+        std::error_code ec;
+        std::filesystem::create_directories(path.parent_path(), ec);
+        // Concurrent updates of the same folder each stage their own file,
+        // the last rename wins with a complete catalog
+        auto tmpPath = getStagingPath(path);
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                logWarning("Failed to create catalog {}.", tmpPath.string());
+                return false;
+            }
+            file.write(reinterpret_cast<const char*>(&header),
+                       sizeof(header));
+            writeTable(file, header.fileTableOffset, files);
+            writeTable(file, header.seriesTableOffset, series);
+            writeTable(file, header.seriesFileOffset, seriesFiles);
+            writeTable(file, header.hashTableOffset, hashTable);
+            file.write(strings.data(), strings.size());
+            if (!file) {
+                logWarning("Failed to write catalog {}.", tmpPath.string());
+                file.close();
+                std::filesystem::remove(tmpPath, ec);
+                return false;
+            }
+        }
+        std::filesystem::rename(tmpPath, path, ec);
+        if (ec) {
+            std::filesystem::remove(tmpPath, ec);
+            return false;
+        }
+        return true;
+    }
+};
+} // namespace
+
+std::filesystem::path DcmCatalog::getCatalogPath(
+    const std::filesystem::path& folder) {
+    std::error_code ec;
+    auto root = std::filesystem::weakly_canonical(folder, ec).string();
+    auto dir = getUserCacheDir();
+    if (dir.empty()) return dir;
+    return dir / fmt::format("{:016x}.vlcat", hashString(root));
+}
+
+DcmCatalog::SharedPtr DcmCatalog::open(const std::filesystem::path& path) {
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) return nullptr;
+
+    auto pFile = MappedFile::open(path);
+    if (!pFile || pFile->getSize() < sizeof(Header)) return nullptr;
+
+    const auto* pHeader = reinterpret_cast<const Header*>(pFile->getData());
+    if (std::memcmp(pHeader->magic, kMagic, sizeof(kMagic)) != 0 ||
+        pHeader->version != kVersion || pHeader->headerSize != sizeof(Header)) {
+        logWarning("Catalog {} is outdated, ignored.", path.string());
+        return nullptr;
+    }
+
+    auto tableEnd = [](uint64_t offset, uint64_t count, size_t size) {
+        return offset + count * size;
+    };
+    if (!std::has_single_bit(pHeader->hashCapacity) ||
+        tableEnd(pHeader->fileTableOffset, pHeader->fileCount,
+                 sizeof(FileRecord)) > pFile->getSize() ||
+        tableEnd(pHeader->seriesTableOffset, pHeader->seriesCount,
+                 sizeof(SeriesRecord)) > pFile->getSize() ||
+        tableEnd(pHeader->seriesFileOffset, pHeader->seriesFileCount,
+                 sizeof(uint32_t)) > pFile->getSize() ||
+        tableEnd(pHeader->hashTableOffset, pHeader->hashCapacity,
+                 sizeof(uint32_t)) > pFile->getSize() ||
+        pHeader->stringPoolOffset + pHeader->stringPoolSize >
+            pFile->getSize()) {
+        logWarning("Catalog {} is truncated, ignored.", path.string());
+        return nullptr;
+    }
+
+    SharedPtr pCatalog(new DcmCatalog());
+    const uint8_t* pData = pFile->getData();
+    pCatalog->mpHeader = pHeader;
+    pCatalog->mpFiles =
+        reinterpret_cast<const FileRecord*>(pData + pHeader->fileTableOffset);
+    pCatalog->mpSeries = reinterpret_cast<const SeriesRecord*>(
+        pData + pHeader->seriesTableOffset);
+    pCatalog->mpSeriesFiles =
+        reinterpret_cast<const uint32_t*>(pData + pHeader->seriesFileOffset);
+    pCatalog->mpHashTable =
+        reinterpret_cast<const uint32_t*>(pData + pHeader->hashTableOffset);
+    pCatalog->mpStrings =
+        reinterpret_cast<const char*>(pData + pHeader->stringPoolOffset);
+    pCatalog->mpFile = std::move(pFile);
+    return pCatalog;
+}
+
+DcmCatalog::SharedPtr DcmCatalog::update(const std::filesystem::path& folder,
+                                         const std::filesystem::path& path) {
+    auto updateStart = std::chrono::steady_clock::now();
+    std::error_code ec;
+    auto root = std::filesystem::weakly_canonical(folder, ec).string();
+
+    auto files = DcmScanner::listFiles(folder, true);
+    std::vector<uint64_t> sizes(files.size());
+    std::vector<int64_t> mtimes(files.size());
+    std::vector<std::optional<DcmScanner::FileHeader>> headers(files.size());
+
+    // Reuse the headers of unchanged files from the previous catalog
+    std::vector<uint32_t> staleIndices;
+    {
+        auto pOld = open(path);
+        if (pOld && pOld->getRootFolder() != root) pOld = nullptr;
+
+        std::unordered_map<std::string_view, uint32_t> oldFiles;
+        if (pOld) {
+            oldFiles.reserve(pOld->getFileCount());
+            for (uint32_t i = 0; i < pOld->getFileCount(); i++)
+                oldFiles.emplace(pOld->getString(pOld->getFile(i).path), i);
+        }
+
+        for (uint32_t i = 0; i < files.size(); i++) {
+            sizes[i] = std::filesystem::file_size(files[i], ec);
+            mtimes[i] = getModifiedTime(files[i]);
+
+            auto it = oldFiles.find(files[i]);
+            if (it == oldFiles.end()) {
+                staleIndices.push_back(i);
+                continue;
+            }
+            const FileRecord& record = pOld->getFile(it->second);
+            if (record.size != sizes[i] || record.mtime != mtimes[i]) {
+                staleIndices.push_back(i);
+                continue;
+            }
+            if (record.seriesIndex == kInvalidIndex) continue;
+
+            const SeriesRecord& series = pOld->getSeries(record.seriesIndex);
+            DcmScanner::FileHeader& header = headers[i].emplace();
+            header.seriesInstanceUid =
+                pOld->getString(series.seriesInstanceUid);
+            header.studyInstanceUid = pOld->getString(series.studyInstanceUid);
+            header.patientId = pOld->getString(series.patientId);
+            header.patientName = pOld->getString(series.patientName);
+            header.patientBirthDate =
+                pOld->getString(series.patientBirthDate);
+            header.patientSex = pOld->getString(series.patientSex);
+            header.modality = pOld->getString(series.modality);
+            header.seriesDescription =
+                pOld->getString(series.seriesDescription);
+            header.rows = record.rows;
+            header.columns = record.columns;
+            header.numberOfFrames = int32_t(record.frameCount);
+        }
+        // The old mapping is released here, before the file is replaced
+    }
+
+    std::vector<std::string> staleFiles;
+    staleFiles.reserve(staleIndices.size());
+    for (uint32_t i : staleIndices) staleFiles.push_back(files[i]);
+    auto staleHeaders = DcmScanner::readHeaders(staleFiles);
+    for (size_t i = 0; i < staleIndices.size(); i++)
+        headers[staleIndices[i]] = std::move(staleHeaders[i]);
+
+    // Index every modality, loaders filter on lookup
+    DcmScanner::Options scanOptions;
+    scanOptions.modalities.clear();
+    auto seriesList = DcmScanner::group(files, headers, scanOptions);
+
+    CatalogWriter writer;
+    std::unordered_map<std::string_view, uint32_t> fileIndices;
+    std::unordered_map<std::string_view, uint32_t> seriesIndices;
+    fileIndices.reserve(files.size());
+    for (uint32_t i = 0; i < files.size(); i++) fileIndices[files[i]] = i;
+    for (uint32_t i = 0; i < seriesList.size(); i++)
+        seriesIndices[seriesList[i].seriesInstanceUid] = i;
+
+    writer.files.resize(files.size());
+    for (uint32_t i = 0; i < files.size(); i++) {
+        FileRecord& record = writer.files[i];
+        record.path = writer.addString(files[i]);
+        record.size = sizes[i];
+        record.mtime = mtimes[i];
+        record.seriesIndex = kInvalidIndex;
+        record.rows = record.columns = 0;
+        record.frameCount = 0;
+        if (headers[i]) {
+            record.seriesIndex = seriesIndices[headers[i]->seriesInstanceUid];
+            record.rows = headers[i]->rows;
+            record.columns = headers[i]->columns;
+            record.frameCount =
+                uint32_t(std::max(headers[i]->numberOfFrames, 1));
+        }
+    }
+
+    writer.series.resize(seriesList.size());
+    for (uint32_t i = 0; i < seriesList.size(); i++) {
+        const auto& info = seriesList[i];
+        SeriesRecord& record = writer.series[i];
+        record.uidHash = hashString(info.seriesInstanceUid);
+        record.seriesInstanceUid = writer.addString(info.seriesInstanceUid);
+        record.studyInstanceUid = writer.addString(info.studyInstanceUid);
+        record.patientId = writer.addString(info.patientId);
+        record.patientName = writer.addString(info.patientName);
+        record.patientBirthDate = writer.addString(info.patientBirthDate);
+        record.patientSex = writer.addString(info.patientSex);
+        record.modality = writer.addString(info.modality);
+        record.seriesDescription = writer.addString(info.seriesDescription);
+        record.rows = info.rows;
+        record.columns = info.columns;
+        record.firstFile = uint32_t(writer.seriesFiles.size());
+        record.sliceCount = uint32_t(info.files.size());
+        record.frameCount = info.frameCount;
+        record.fileCount = 0;
+        for (const auto& file : info.files)
+            writer.seriesFiles.push_back(fileIndices[file]);
+    }
+    for (const auto& file : writer.files) {
+        if (file.seriesIndex != kInvalidIndex)
+            writer.series[file.seriesIndex].fileCount++;
+    }
+
+    // Open addressing with linear probing, at most half full
+    writer.hashTable.assign(
+        std::bit_ceil(std::max<size_t>(seriesList.size() * 2, 1)), 0);
+    uint32_t mask = uint32_t(writer.hashTable.size()) - 1;
+    for (uint32_t i = 0; i < writer.series.size(); i++) {
+        uint32_t slot = uint32_t(writer.series[i].uidHash) & mask;
+        while (writer.hashTable[slot] != 0) slot = (slot + 1) & mask;
+        writer.hashTable[slot] = i + 1;
+    }
+
+    if (!writer.write(path, root)) return nullptr;
+    logInfo(
+        "Updated catalog of {} in {:.1f} ms: {} files, {} parsed, {} series.",
+        root,
+        std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - updateStart)
+            .count(),
+        files.size(), staleFiles.size(), seriesList.size());
+    return open(path);
+}
+
+std::string_view DcmCatalog::getRootFolder() const {
+    return getString(mpHeader->rootFolder);
+}
+
+std::string_view DcmCatalog::getString(StringRef ref) const {
+    if (uint64_t(ref.offset) + ref.length > mpHeader->stringPoolSize)
+        return {};
+    return std::string_view(mpStrings + ref.offset, ref.length);
+}
+
+std::optional<uint32_t> DcmCatalog::findSeries(std::string_view uid) const {
+    uint64_t hash = hashString(uid);
+    uint32_t mask = mpHeader->hashCapacity - 1;
+    for (uint32_t slot = uint32_t(hash) & mask, probe = 0;
+         probe < mpHeader->hashCapacity; slot = (slot + 1) & mask, probe++) {
+        uint32_t entry = mpHashTable[slot];
+        if (entry == 0 || entry > mpHeader->seriesCount) break;
+        const SeriesRecord& series = mpSeries[entry - 1];
+        if (series.uidHash == hash &&
+            getString(series.seriesInstanceUid) == uid)
+            return entry - 1;
+    }
+    return std::nullopt;
+}
+
+std::optional<uint32_t> DcmCatalog::findLargestSeries(
+    const std::vector<std::string>& modalities) const {
+    std::optional<uint32_t> largest;
+    for (uint32_t i = 0; i < getSeriesCount(); i++) {
+        auto modality = getString(mpSeries[i].modality);
+        if (!modalities.empty() &&
+            std::find(modalities.begin(), modalities.end(), modality) ==
+                modalities.end())
+            continue;
+        if (!largest || mpSeries[i].frameCount > mpSeries[*largest].frameCount)
+            largest = i;
+    }
+    return largest;
+}
+
+std::vector<std::string> DcmCatalog::getSeriesFiles(uint32_t index) const {
+    const SeriesRecord& series = mpSeries[index];
+    std::vector<std::string> files;
+    files.reserve(series.sliceCount);
+    for (uint32_t i = 0; i < series.sliceCount; i++) {
+        uint32_t fileIndex = mpSeriesFiles[series.firstFile + i];
+        files.emplace_back(getString(mpFiles[fileIndex].path));
+    }
+    return files;
+}
+
+DcmScanner::SeriesInfo DcmCatalog::getSeriesInfo(uint32_t index) const {
+    const SeriesRecord& series = mpSeries[index];
+    DcmScanner::SeriesInfo info;
+    info.seriesInstanceUid = getString(series.seriesInstanceUid);
+    info.studyInstanceUid = getString(series.studyInstanceUid);
+    info.patientId = getString(series.patientId);
+    info.patientName = getString(series.patientName);
+    info.patientBirthDate = getString(series.patientBirthDate);
+    info.patientSex = getString(series.patientSex);
+    info.modality = getString(series.modality);
+    info.seriesDescription = getString(series.seriesDescription);
+    info.rows = series.rows;
+    info.columns = series.columns;
+    info.frameCount = series.frameCount;
+    info.files = getSeriesFiles(index);
+    return info;
+}
+
+PatientData DcmCatalog::getPatientData(uint32_t index) const {
+    const SeriesRecord& series = mpSeries[index];
+    auto sex = getString(series.patientSex);
+
+    PatientData pd;
+    pd.id = getString(series.patientId);
+    pd.name = getString(series.patientName);
+    pd.birthDate = getString(series.patientBirthDate);
+    pd.gender = (sex == "M")   ? Gender::Male
+                : (sex == "F") ? Gender::Female
+                               : Gender::Others;
+    return pd;
+}
+} // namespace Voluma
\ No newline at end of file
@@ -0,0 +1,150 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Core/Macros.h"
+#include "Data/DcmScanner.h"
+#include "Data/Patient.h"
+#include "Utils/MappedFile.h"
+
+namespace Voluma {
+/** Persistent patient/study/series index of a DICOM folder tree.
+ *
+ * File layout:
+ *   DcmCatalog::Header
+ *   DcmCatalog::FileRecord x fileCount
+ *   DcmCatalog::SeriesRecord x seriesCount
+ *   uint32_t file index x seriesFileCount, grouped per series
+ *   uint32_t hash slot x hashCapacity, series index + 1, 0 if empty
+ *   string pool, referenced by StringRef
+ *
+ * The file is memory mapped and queried in place. Updating it only reads the
+ * headers of files whose size or modification time changed, and opening a
+ * series by its UID is a single hash probe.
+ */
+class VL_API DcmCatalog {
+   public:
+    using SharedPtr = std::shared_ptr<DcmCatalog>;
+
+    static constexpr uint32_t kVersion = 2;
+    static constexpr uint32_t kInvalidIndex = ~0u;
+
+    struct StringRef {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        StringRef rootFolder;
+
+        uint32_t fileCount;
+        uint32_t seriesCount;
+        uint32_t seriesFileCount;
+        uint32_t hashCapacity; ///< Power of two
+
+        uint64_t fileTableOffset;
+        uint64_t seriesTableOffset;
+        uint64_t seriesFileOffset;
+        uint64_t hashTableOffset;
+        uint64_t stringPoolOffset;
+        uint64_t stringPoolSize;
+    };
+
+    /** Every regular file of the tree, non-DICOM files are kept so they are
+     * not sniffed again.
+     */
+    struct FileRecord {
+        StringRef path;
+        uint64_t size;
+        int64_t mtime;
+        uint32_t seriesIndex; ///< kInvalidIndex if not a DICOM file
+        uint16_t rows, columns;
+        uint32_t frameCount;
+    };
+
+    struct SeriesRecord {
+        uint64_t uidHash;
+        StringRef seriesInstanceUid;
+        StringRef studyInstanceUid;
+        StringRef patientId;
+        StringRef patientName;
+        StringRef patientBirthDate;
+        StringRef patientSex;
+        StringRef modality;
+        StringRef seriesDescription;
+        uint16_t rows, columns;
+        uint32_t firstFile;  ///< Into the series file list
+        uint32_t sliceCount; ///< Accepted files
+        uint32_t frameCount; ///< Volume slices, frames of multi-frame files
+        uint32_t fileCount;  ///< All files of the UID, incl. rejected ones
+    };
+
+    /** Get the default catalog path of a folder, empty if there is no
+     * per-user cache folder.
+     */
+    static std::filesystem::path getCatalogPath(
+        const std::filesystem::path& folder);
+
+    /** Map a catalog file, returns nullptr if it is missing or invalid.
+     */
+    static SharedPtr open(const std::filesystem::path& path);
+
+    /** Bring the catalog of a folder up to date and map it. Only files that
+     * are new or whose size or modification time changed are parsed.
+     */
+    static SharedPtr update(const std::filesystem::path& folder,
+                            const std::filesystem::path& path);
+
+    static SharedPtr update(const std::filesystem::path& folder) {
+        return update(folder, getCatalogPath(folder));
+    }
+
+    std::string_view getRootFolder() const;
+    uint32_t getFileCount() const { return mpHeader->fileCount; }
+    uint32_t getSeriesCount() const { return mpHeader->seriesCount; }
+
+    const FileRecord& getFile(uint32_t index) const {
+        return mpFiles[index];
+    }
+    const SeriesRecord& getSeries(uint32_t index) const {
+        return mpSeries[index];
+    }
+    std::string_view getString(StringRef ref) const;
+
+    /** Find a series by its SeriesInstanceUID.
+     */
+    std::optional<uint32_t> findSeries(std::string_view uid) const;
+
+    /** Find the series with the most frames among the given modalities.
+     */
+    std::optional<uint32_t> findLargestSeries(
+        const std::vector<std::string>& modalities) const;
+
+    /** Get the accepted slice files of a series, sorted by path.
+     */
+    std::vector<std::string> getSeriesFiles(uint32_t index) const;
+
+    DcmScanner::SeriesInfo getSeriesInfo(uint32_t index) const;
+
+    PatientData getPatientData(uint32_t index) const;
+
+   private:
+    DcmCatalog() = default;
+
+    MappedFile::SharedPtr mpFile;
+    const Header* mpHeader = nullptr;
+    const FileRecord* mpFiles = nullptr;
+    const SeriesRecord* mpSeries = nullptr;
+    const uint32_t* mpSeriesFiles = nullptr;
+    const uint32_t* mpHashTable = nullptr;
+    const char* mpStrings = nullptr;
+};
+} // namespace Voluma
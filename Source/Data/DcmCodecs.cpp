@@ -0,0 +1,30 @@
+#include "DcmCodecs.h"
+
+#include <dcmtk/dcmdata/dcrledrg.h>
+#include <dcmtk/dcmjpeg/djdecode.h>
+#include <dcmtk/dcmjpls/djdecode.h>
+
+#include "Utils/Logger.h"
+
+namespace Voluma {
+namespace {
+struct DecoderRegistry {
+    DecoderRegistry() {
+        DcmRLEDecoderRegistration::registerCodecs();
+        DJDecoderRegistration::registerCodecs();
+        DJLSDecoderRegistration::registerCodecs();
+        logInfo("Registered RLE, JPEG and JPEG-LS decoders.");
+    }
+    ~DecoderRegistry() {
+        DJLSDecoderRegistration::cleanup();
+        DJDecoderRegistration::cleanup();
+        DcmRLEDecoderRegistration::cleanup();
+    }
+};
+} // namespace
+
+void DcmCodecs::registerDecoders() {
+    // Function local static, constructed once and destroyed at exit
+    static DecoderRegistry registry;
+}
+} // namespace Voluma
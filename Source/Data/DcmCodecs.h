@@ -0,0 +1,18 @@
+#pragma once
+#include "Core/Macros.h"
+
+namespace Voluma {
+/** Registration of the DCMTK pixel data decoders.
+ *
+ * Supported encapsulated transfer syntaxes are RLE lossless, JPEG baseline,
+ * extended and lossless, and JPEG-LS. JPEG 2000 has no decoder in the open
+ * source DCMTK, such files fail to decode with an error.
+ */
+class VL_API DcmCodecs {
+   public:
+    /** Register the decoders once, safe to call from any thread. They are
+     * unregistered at exit.
+     */
+    static void registerDecoders();
+};
+} // namespace Voluma
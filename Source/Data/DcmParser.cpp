@@ -1,33 +1,43 @@
 #include "DcmParser.h"
 
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcxfer.h>
 #include <dcmtk/ofstd/oftypes.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <limits>
+#include <memory>
 #include <vector>
+
+#include "Data/DcmCatalog.h"
+#include "Data/VolSlice.h"
+#include "Utils/Logger.h"
 namespace Voluma {
 std::string DcmParser::getString(const DcmTagKey& key) const {
     OFString value;
-    if (mpDataset->findAndGetOFString(key, value).good()) {
+    if (mpItem->findAndGetOFString(key, value).good()) {
         return value.c_str();
     }
     return "";
 }
 
 uint16_t DcmParser::getU16(const DcmTagKey& key) const {
-    Uint16 val;
-    mpDataset->findAndGetUint16(key, val);
+    Uint16 val = 0;
+    mpItem->findAndGetUint16(key, val);
     return uint16_t(val);
 }
 
 int DcmParser::getInt(const DcmTagKey& key) const {
-    Sint32 val;
-    mpDataset->findAndGetSint32(key, val);
+    Sint32 val = 0;
+    mpItem->findAndGetSint32(key, val);
     return int(val);
 }
 
 double DcmParser::getF64(const DcmTagKey& key) const {
-    Float64 val;
-    mpDataset->findAndGetFloat64(key, val);
+    Float64 val = 0.0;
+    mpItem->findAndGetFloat64(key, val);
     return double(val);
 }
 
@@ -35,7 +45,7 @@ std::vector<uint16_t> DcmParser::getU16Array(const DcmTagKey& key) const {
     const Uint16* pData = nullptr;
     unsigned long cnt;
 
-    mpDataset->findAndGetUint16Array(key, pData, &cnt);
+    mpItem->findAndGetUint16Array(key, pData, &cnt);
     if (!pData) {
         return {};
     }
@@ -43,4 +53,127 @@ std::vector<uint16_t> DcmParser::getU16Array(const DcmTagKey& key) const {
     return std::vector<uint16_t>(pData, pData + cnt);
 }
 
+std::span<const uint16_t> DcmParser::getU16Span(const DcmTagKey& key) const {
+    const Uint16* pData = nullptr;
+    unsigned long cnt = 0;
+
+    mpItem->findAndGetUint16Array(key, pData, &cnt);
+    if (!pData) {
+        return {};
+    }
+
+    return std::span<const uint16_t>(pData, cnt);
+}
+
+bool DcmParser::readU16Array(const DcmTagKey& key,
+                             std::span<uint16_t> dst) const {
+    DcmElement* pElement = nullptr;
+    auto* pDataset = dynamic_cast<DcmDataset*>(mpItem);
+    if (!pDataset || pDataset->findAndGetElement(key, pElement).bad() ||
+        !pElement)
+        return false;
+    if (DcmXfer(pDataset->getOriginalXfer()).isEncapsulated()) return false;
+
+    Uint32 numBytes = Uint32(dst.size_bytes());
+    if (pElement->getLength() != numBytes) return false;
+
+    DcmFileCache fileCache;
+    return pElement
+        ->getPartialValue(dst.data(), 0, numBytes, &fileCache, gLocalByteOrder)
+        .good();
+}
+
+void DcmParser::readValue(DcmElement* pElement, std::string& value) {
+    OFString str;
+    if (pElement->getOFString(str, 0).good()) value = str.c_str();
+}
+
+void DcmParser::readValue(DcmElement* pElement, uint16_t& value) {
+    Uint16 val;
+    if (pElement->getUint16(val).good()) value = val;
+}
+
+void DcmParser::readValue(DcmElement* pElement, int32_t& value) {
+    Sint32 val;
+    if (pElement->getSint32(val).good()) value = val;
+}
+
+void DcmParser::readValue(DcmElement* pElement, double& value) {
+    Float64 val;
+    if (pElement->getFloat64(val).good()) value = val;
+}
+
+void DcmParser::readValue(DcmElement* pElement, std::vector<double>& value) {
+    unsigned long vm = pElement->getVM();
+    value.resize(vm);
+    for (unsigned long i = 0; i < vm; i++) {
+        Float64 val = 0.0;
+        pElement->getFloat64(val, i);
+        value[i] = val;
+    }
+}
+
+void DcmParser::runBenchmark(const std::filesystem::path& folder) {
+    auto pCatalog = DcmCatalog::update(folder);
+    if (!pCatalog) {
+        logError("Failed to build the catalog of {}.", folder.string());
+        return;
+    }
+    auto seriesIndex = pCatalog->findLargestSeries({"CT"});
+    if (!seriesIndex) {
+        logError("No CT series found in {}.", folder.string());
+        return;
+    }
+
+    // Headers are loaded once up front, only the tag extraction is timed
+    std::vector<std::unique_ptr<DcmFileFormat>> files;
+    for (const auto& fn : pCatalog->getSeriesFiles(*seriesIndex)) {
+        auto pFile = std::make_unique<DcmFileFormat>();
+        if (pFile->loadFileUntilTag(fn.c_str(), EXS_Unknown, EGL_noChange,
+                                    DCM_MaxReadLength, ERM_autoDetect,
+                                    DCM_PixelData)
+                .good())
+            files.push_back(std::move(pFile));
+    }
+    if (files.empty()) {
+        logError("No slice header could be loaded from {}.", folder.string());
+        return;
+    }
+
+    const auto& tags = SliceHeader::getTagSet();
+    unsigned long elementCount = 0;
+    for (const auto& pFile : files) elementCount += pFile->getDataset()->card();
+    logInfo("Benchmarking {} tags over {} slice headers, {:.1f} elements per "
+            "header.",
+            tags.size(), files.size(), double(elementCount) / files.size());
+
+    // Best of a few runs, time per file and per extracted tag
+    auto measure = [&](const char* name, auto&& parse) {
+        double best = std::numeric_limits<double>::max();
+        size_t found = 0;
+        for (int run = 0; run < 5; run++) {
+            found = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (const auto& pFile : files) {
+                SliceHeader header;
+                found += parse(DcmParser(pFile->getDataset()), header);
+            }
+            best = std::min(best, std::chrono::duration<double>(
+                                      std::chrono::steady_clock::now() - start)
+                                      .count());
+        }
+        logInfo("Parse {:<8} {:8.2f} us/file {:8.1f} ns/tag, {} tags found",
+                name, best / files.size() * 1e6,
+                best / std::max<size_t>(found, 1) * 1e9, found);
+        return best;
+    };
+
+    double perTag = measure("per-tag", [&](DcmParser parser, auto& header) {
+        return parser.extractEach(tags, header);
+    });
+    double walk = measure("walk", [&](DcmParser parser, auto& header) {
+        return parser.extract(tags, header);
+    });
+    logInfo("Single walk speedup {:.2f}x.", perTag / std::max(walk, 1e-9));
+}
 } // namespace Voluma
\ No newline at end of file
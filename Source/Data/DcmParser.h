@@ -3,12 +3,62 @@
 #include <dcmtk/dcmdata/dcdatset.h>
 #include <dcmtk/dcmdata/dcdeftag.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <utility>
+#include <variant>
 #include <vector>
 
 namespace Voluma {
+/** Declarative set of tags bound to the fields of a struct T.
+ *
+ * Usage:
+ *   static const DcmTagSet<Header> kTags = {
+ *       {DCM_Rows, &Header::rows},
+ *       {DCM_PixelSpacing, &Header::pixelSpacing},
+ *   };
+ *   parser.extract(kTags, header);
+ *
+ * Multi-valued decimal strings are bound to std::vector<double> fields.
+ */
+template <typename T>
+class DcmTagSet {
+   public:
+    using Field =
+        std::variant<std::string T::*, uint16_t T::*, int32_t T::*,
+                     double T::*, std::vector<double> T::*>;
+
+    DcmTagSet(std::initializer_list<std::pair<DcmTagKey, Field>> fields)
+        : mEntries(fields) {
+        // Dataset elements are stored in ascending tag order, keep the same
+        // order so that extraction is a single merge walk.
+        std::sort(mEntries.begin(), mEntries.end(),
+                  [](const auto& a, const auto& b) {
+                      return a.first < b.first;
+                  });
+    }
+
+    size_t size() const { return mEntries.size(); }
+    const DcmTagKey& getKey(size_t index) const {
+        return mEntries[index].first;
+    }
+    const Field& getField(size_t index) const {
+        return mEntries[index].second;
+    }
+
+   private:
+    std::vector<std::pair<DcmTagKey, Field>> mEntries;
+};
+
 class DcmParser {
    public:
-    DcmParser(DcmDataset* pDataset) : mpDataset(pDataset) {}
+    /** Parse a dataset or a sequence item, e.g. a functional group macro.
+     */
+    DcmParser(DcmItem* pItem) : mpItem(pItem) {}
 
     std::string getString(const DcmTagKey& key) const;
     uint16_t getU16(const DcmTagKey& key) const;
@@ -17,7 +67,91 @@ class DcmParser {
 
     std::vector<uint16_t> getU16Array(const DcmTagKey& key) const;
 
+    /** Get a view of an uint16 array element without copying it, the view is
+     * valid as long as the underlying dataset is alive.
+     */
+    std::span<const uint16_t> getU16Span(const DcmTagKey& key) const;
+
+    /** Read an uint16 array element straight into caller-provided memory.
+     *
+     * If the dataset was loaded with a small maxReadLength, the element value
+     * is still on disk and is read from file into dst without any
+     * intermediate buffer. Only native(not encapsulated) values of a top
+     * level dataset are supported.
+     * @return false if the element is missing or its size mismatches dst.
+     */
+    bool readU16Array(const DcmTagKey& key, std::span<uint16_t> dst) const;
+
+    /** Max element length to load eagerly when large values(PixelData) should
+     * stay on disk for readU16Array.
+     */
+    static constexpr Uint32 kLazyReadLength = 4096;
+
+    /** Fill all tags of the set into out with one walk over the top level
+     * dataset. Fields of missing tags are left untouched.
+     * @return Number of tags found.
+     */
+    template <typename T>
+    size_t extract(const DcmTagSet<T>& tags, T& out) const;
+
+    /** Fill all tags of the set with one lookup per tag, the way the getters
+     * do. Same result as extract, kept as the baseline of runBenchmark.
+     * @return Number of tags found.
+     */
+    template <typename T>
+    size_t extractEach(const DcmTagSet<T>& tags, T& out) const;
+
+    /** Time extract against extractEach on the slice headers of the largest
+     * series in folder and log the time per file and per tag.
+     */
+    static void runBenchmark(const std::filesystem::path& folder);
+
    private:
-    DcmDataset* mpDataset;
+    static void readValue(DcmElement* pElement, std::string& value);
+    static void readValue(DcmElement* pElement, uint16_t& value);
+    static void readValue(DcmElement* pElement, int32_t& value);
+    static void readValue(DcmElement* pElement, double& value);
+    static void readValue(DcmElement* pElement, std::vector<double>& value);
+
+    DcmItem* mpItem;
 };
-}  // namespace Voluma
\ No newline at end of file
+
+template <typename T>
+size_t DcmParser::extract(const DcmTagSet<T>& tags, T& out) const {
+    size_t found = 0;
+    size_t tagIndex = 0;
+    // nextInContainer steps from the current list node, indexed access would
+    // walk the element list from its head for every element
+    for (DcmObject* pObject = mpItem->nextInContainer(nullptr);
+         pObject && tagIndex < tags.size();
+         pObject = mpItem->nextInContainer(pObject)) {
+        auto* pElement = static_cast<DcmElement*>(pObject);
+        const DcmTagKey& elementKey = pElement->getTag();
+        while (tagIndex < tags.size() && tags.getKey(tagIndex) < elementKey)
+            tagIndex++;
+        if (tagIndex == tags.size()) break;
+        if (tags.getKey(tagIndex) == elementKey) {
+            std::visit([&](auto field) { readValue(pElement, out.*field); },
+                       tags.getField(tagIndex));
+            found++;
+            tagIndex++;
+        }
+    }
+    return found;
+}
+
+template <typename T>
+size_t DcmParser::extractEach(const DcmTagSet<T>& tags, T& out) const {
+    size_t found = 0;
+    for (size_t tagIndex = 0; tagIndex < tags.size(); tagIndex++) {
+        DcmElement* pElement = nullptr;
+        if (mpItem->findAndGetElement(tags.getKey(tagIndex), pElement).bad() ||
+            !pElement)
+            continue;
+        std::visit([&](auto field) { readValue(pElement, out.*field); },
+                   tags.getField(tagIndex));
+        found++;
+    }
+    return found;
+}
+}  // namespace Voluma
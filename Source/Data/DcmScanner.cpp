@@ -0,0 +1,152 @@
+#include "DcmScanner.h"
+
+#include <dcmtk/dcmdata/dcfilefo.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <system_error>
+
+#include "Data/DcmParser.h"
+#include "Utils/Logger.h"
+#include "Utils/Parallel.h"
+
+namespace Voluma {
+using FileHeader = DcmScanner::FileHeader;
+
+static const DcmTagSet<FileHeader>& getFileHeaderTagSet() {
+    static const DcmTagSet<FileHeader> kTagSet = {
+        {DCM_SeriesInstanceUID, &FileHeader::seriesInstanceUid},
+        {DCM_StudyInstanceUID, &FileHeader::studyInstanceUid},
+        {DCM_PatientID, &FileHeader::patientId},
+        {DCM_PatientName, &FileHeader::patientName},
+        {DCM_PatientBirthDate, &FileHeader::patientBirthDate},
+        {DCM_PatientSex, &FileHeader::patientSex},
+        {DCM_Modality, &FileHeader::modality},
+        {DCM_SeriesDescription, &FileHeader::seriesDescription},
+        {DCM_Rows, &FileHeader::rows},
+        {DCM_Columns, &FileHeader::columns},
+        {DCM_NumberOfFrames, &FileHeader::numberOfFrames},
+    };
+    return kTagSet;
+}
+
+bool DcmScanner::isDicomFile(const std::filesystem::path& path) {
+    char preamble[132];
+    std::ifstream file(path, std::ios::binary);
+    if (!file.read(preamble, sizeof(preamble))) return false;
+    return std::memcmp(preamble + 128, "DICM", 4) == 0;
+}
+
+std::vector<std::string> DcmScanner::listFiles(
+    const std::filesystem::path& folder, bool recursive) {
+    std::vector<std::string> files;
+    std::error_code ec;
+    auto addEntry = [&](const std::filesystem::directory_entry& entry) {
+        if (entry.is_regular_file(ec)) files.push_back(entry.path().string());
+    };
+    if (recursive) {
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(
+                 folder,
+                 std::filesystem::directory_options::skip_permission_denied,
+                 ec))
+            addEntry(entry);
+    } else {
+        for (const auto& entry :
+             std::filesystem::directory_iterator(folder, ec))
+            addEntry(entry);
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+std::vector<std::optional<FileHeader>> DcmScanner::readHeaders(
+    const std::vector<std::string>& files) {
+    // Sniff and read the header up to the image pixel module in parallel,
+    // every file owns its slot.
+    std::vector<std::optional<FileHeader>> headers(files.size());
+    forEachParallel(headers.begin(), headers.end(), [&](auto& header) {
+        const std::string& fn = files[&header - headers.data()];
+        if (!isDicomFile(fn)) return;
+
+        DcmFileFormat dfile;
+        if (dfile.loadFileUntilTag(fn.c_str(), EXS_Unknown, EGL_noChange,
+                                   DcmParser::kLazyReadLength, ERM_autoDetect,
+                                   DCM_BitsAllocated)
+                .bad())
+            return;
+
+        FileHeader fileHeader;
+        DcmParser(dfile.getDataset())
+            .extract(getFileHeaderTagSet(), fileHeader);
+        if (fileHeader.seriesInstanceUid.empty()) return;
+        header = std::move(fileHeader);
+    });
+    return headers;
+}
+
+std::vector<DcmScanner::SeriesInfo> DcmScanner::group(
+    const std::vector<std::string>& files,
+    const std::vector<std::optional<FileHeader>>& headers,
+    const Options& options) {
+    // Group by series, std::map keeps the file order
+    std::map<std::string, std::vector<size_t>> seriesFiles;
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (headers[i]) seriesFiles[headers[i]->seriesInstanceUid].push_back(i);
+    }
+
+    std::vector<SeriesInfo> series;
+    for (const auto& [uid, fileIndices] : seriesFiles) {
+        const FileHeader& first = *headers[fileIndices[0]];
+        if (!options.modalities.empty() &&
+            std::find(options.modalities.begin(), options.modalities.end(),
+                      first.modality) == options.modalities.end()) {
+            logInfo("Skip {} series {} with {} files.", first.modality, uid,
+                    fileIndices.size());
+            continue;
+        }
+
+        // Keep the most common image size of the series
+        std::map<std::pair<uint16_t, uint16_t>, size_t> sizeCount;
+        for (size_t i : fileIndices)
+            sizeCount[{headers[i]->rows, headers[i]->columns}]++;
+        auto [size, count] = *std::max_element(
+            sizeCount.begin(), sizeCount.end(),
+            [](const auto& a, const auto& b) { return a.second < b.second; });
+        if (count != fileIndices.size()) {
+            logWarning(
+                "Series {} has {} files with divergent image size, rejected.",
+                uid, fileIndices.size() - count);
+        }
+
+        SeriesInfo info;
+        info.seriesInstanceUid = uid;
+        info.studyInstanceUid = first.studyInstanceUid;
+        info.patientId = first.patientId;
+        info.patientName = first.patientName;
+        info.patientBirthDate = first.patientBirthDate;
+        info.patientSex = first.patientSex;
+        info.modality = first.modality;
+        info.seriesDescription = first.seriesDescription;
+        info.rows = size.first;
+        info.columns = size.second;
+        for (size_t i : fileIndices) {
+            if (headers[i]->rows == info.rows &&
+                headers[i]->columns == info.columns) {
+                info.files.push_back(files[i]);
+                info.frameCount +=
+                    uint32_t(std::max(headers[i]->numberOfFrames, 1));
+            }
+        }
+        series.push_back(std::move(info));
+    }
+
+    std::stable_sort(series.begin(), series.end(),
+                     [](const SeriesInfo& a, const SeriesInfo& b) {
+                         return a.frameCount > b.frameCount;
+                     });
+    return series;
+}
+} // namespace Voluma
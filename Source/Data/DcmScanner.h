@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Core/Macros.h"
+
+namespace Voluma {
+/** Finds DICOM files in directory trees and groups them by series.
+ *
+ * Files are identified by the "DICM" magic after the 128 byte preamble, not
+ * by their extension, and only the header up to the image pixel module is
+ * parsed. Nothing is decoded.
+ */
+class VL_API DcmScanner {
+   public:
+    struct Options {
+        bool recursive = true;
+        /// Modalities to keep, empty keeps everything
+        std::vector<std::string> modalities = {"CT"};
+    };
+
+    /** Tags read from every file, enough to group it into a series.
+     */
+    struct FileHeader {
+        std::string seriesInstanceUid;
+        std::string studyInstanceUid;
+        std::string patientId;
+        std::string patientName;
+        std::string patientBirthDate;
+        std::string patientSex;
+        std::string modality;
+        std::string seriesDescription;
+        uint16_t rows = 0;
+        uint16_t columns = 0;
+        int32_t numberOfFrames = 1;
+    };
+
+    struct SeriesInfo {
+        std::string seriesInstanceUid;
+        std::string studyInstanceUid;
+        std::string patientId;
+        std::string patientName;
+        std::string patientBirthDate;
+        std::string patientSex;
+        std::string modality;
+        std::string seriesDescription;
+        uint16_t rows = 0;
+        uint16_t columns = 0;
+        uint32_t frameCount = 0;        ///< Slices, multi-frame included
+        std::vector<std::string> files; ///< Sorted file paths
+    };
+
+    /** Check the DICOM magic at offset 128, reads 132 bytes only.
+     */
+    static bool isDicomFile(const std::filesystem::path& path);
+
+    /** List all regular files below a folder, sorted.
+     */
+    static std::vector<std::string> listFiles(
+        const std::filesystem::path& folder, bool recursive);
+
+    /** Sniff files and read their header in parallel, non-DICOM and
+     * unreadable files yield std::nullopt.
+     */
+    static std::vector<std::optional<FileHeader>> readHeaders(
+        const std::vector<std::string>& files);
+
+    /** Group files into series, series with most slices first. Series of other
+     * modalities and files whose image size diverges from the rest of their
+     * series are rejected.
+     */
+    static std::vector<SeriesInfo> group(
+        const std::vector<std::string>& files,
+        const std::vector<std::optional<FileHeader>>& headers,
+        const Options& options);
+
+    static std::vector<SeriesInfo> scan(const std::vector<std::string>& files,
+                                        const Options& options) {
+        return group(files, readHeaders(files), options);
+    }
+
+    static std::vector<SeriesInfo> scan(const std::filesystem::path& folder,
+                                        const Options& options) {
+        return scan(listFiles(folder, options.recursive), options);
+    }
+};
+} // namespace Voluma
@@ -0,0 +1,120 @@
+#include "GradientVolume.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+
+#include "Data/VolData.h"
+#include "Utils/Logger.h"
+#include "Utils/OctahedralMapping.slangh"
+#include "Utils/Parallel.h"
+
+namespace Voluma {
+static uint16_t toUnorm16(float v) {
+    return uint16_t(std::lround(std::clamp(v, 0.f, 1.f) * 65535.f));
+}
+
+GradientVolume::SharedPtr GradientVolume::create(const VolData& volData) {
+    if (volData.isOutOfCore()) {
+        logWarning("Gradient volumes of out-of-core volumes are not "
+                   "supported.");
+        return nullptr;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    SharedPtr pGradients(new GradientVolume());
+    auto& dims = pGradients->mDims;
+    dims = {uint32_t(volData.getColWidth()), uint32_t(volData.getRowWidth()),
+            uint32_t(volData.getSliceCount())};
+    size_t sliceSize = size_t(dims[0]) * dims[1];
+
+    auto voxels = volData.getBufferData();
+    bool isSigned = volData.getVoxelFormat() == VoxelFormat::Int16;
+    float slope = volData.getScanMetaData().rescaleSlope;
+    // Central differences in modality unit, voxels outside of the volume
+    // are stored value 0
+    auto computeGradient = [&](uint32_t x, uint32_t y, uint32_t z) {
+        auto value = [&](int64_t vx, int64_t vy, int64_t vz) {
+            if (vx < 0 || vy < 0 || vz < 0 || vx >= dims[0] ||
+                vy >= dims[1] || vz >= dims[2])
+                return 0.f;
+            uint16_t v = voxels[vz * sliceSize + size_t(vy) * dims[0] + vx];
+            return float(isSigned ? int32_t(int16_t(v)) : int32_t(v));
+        };
+        int64_t vx = x, vy = y, vz = z;
+        return float3(value(vx + 1, vy, vz) - value(vx - 1, vy, vz),
+                      value(vx, vy + 1, vz) - value(vx, vy - 1, vz),
+                      value(vx, vy, vz + 1) - value(vx, vy, vz - 1)) *
+               (0.5f * slope);
+    };
+
+    std::vector<uint32_t> slices(dims[2]);
+    std::iota(slices.begin(), slices.end(), 0u);
+
+    // Pass 1: find the largest magnitude to quantize against
+    std::vector<float> sliceMax(dims[2], 0.f);
+    forEachParallel(slices.begin(), slices.end(), [&](uint32_t z) {
+        float maxMagnitude = 0.f;
+        for (uint32_t y = 0; y < dims[1]; y++)
+            for (uint32_t x = 0; x < dims[0]; x++)
+                maxMagnitude =
+                    std::max(maxMagnitude, length(computeGradient(x, y, z)));
+        sliceMax[z] = maxMagnitude;
+    });
+    pGradients->mMaxMagnitude =
+        std::max(*std::max_element(sliceMax.begin(), sliceMax.end()), 1e-6f);
+
+    // Pass 2: recompute and pack, cheaper than keeping float gradients
+    pGradients->mTexels.resize(sliceSize * dims[2]);
+    float invMax = 1.f / pGradients->mMaxMagnitude;
+    forEachParallel(slices.begin(), slices.end(), [&](uint32_t z) {
+        Texel* pTexel = pGradients->mTexels.data() + z * sliceSize;
+        for (uint32_t y = 0; y < dims[1]; y++) {
+            for (uint32_t x = 0; x < dims[0]; x++, pTexel++) {
+                float3 gradient = computeGradient(x, y, z);
+                float magnitude = length(gradient);
+                float2 oct =
+                    magnitude > 0.f
+                        ? encodeOctahedralUnorm(gradient * (1.f / magnitude))
+                        : float2(0.5f, 0.5f);
+                *pTexel = {toUnorm16(oct.x), toUnorm16(oct.y),
+                           toUnorm16(magnitude * invMax), 0};
+            }
+        }
+    });
+
+    logInfo("Built gradient volume in {:.1f} ms, max magnitude {:.1f}.",
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start)
+                .count(),
+            pGradients->mMaxMagnitude);
+    return pGradients;
+}
+
+float3 GradientVolume::getGradient(int32_t x, int32_t y, int32_t z) const {
+    if (x < 0 || y < 0 || z < 0 || x >= int32_t(mDims[0]) ||
+        y >= int32_t(mDims[1]) || z >= int32_t(mDims[2]))
+        return float3(0.f);
+    const Texel& texel =
+        mTexels[(size_t(z) * mDims[1] + y) * mDims[0] + size_t(x)];
+    float3 direction = decodeOctahedralUnorm(
+        float2(texel.octU / 65535.f, texel.octV / 65535.f));
+    return direction * (texel.magnitude / 65535.f * mMaxMagnitude);
+}
+
+float3 GradientVolume::sampleGradient(float x, float y, float z) const {
+    int32_t x0 = int32_t(std::floor(x));
+    int32_t y0 = int32_t(std::floor(y));
+    int32_t z0 = int32_t(std::floor(z));
+    float fx = x - float(x0), fy = y - float(y0), fz = z - float(z0);
+
+    auto lerp = [](float3 a, float3 b, float t) { return a + (b - a) * t; };
+    float3 c[2][2];
+    for (int dz = 0; dz < 2; dz++)
+        for (int dy = 0; dy < 2; dy++)
+            c[dz][dy] = lerp(getGradient(x0, y0 + dy, z0 + dz),
+                             getGradient(x0 + 1, y0 + dy, z0 + dz), fx);
+    return lerp(lerp(c[0][0], c[0][1], fy), lerp(c[1][0], c[1][1], fy), fz);
+}
+} // namespace Voluma
@@ -0,0 +1,70 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "Core/Macros.h"
+#include "Core/Math.h"
+
+namespace Voluma {
+class VolData;
+
+/** Precomputed gradient volume.
+ *
+ * Gradients are central differences of modality values on the voxel grid.
+ * Voxels outside of the volume count as stored value 0, the border
+ * convention of the shader and VolData::sampleValueGradient. Every voxel is
+ * packed into an RGBA16_UNORM texel: the octahedral mapped gradient
+ * direction in RG and the magnitude relative to the largest one in B.
+ * The CPU sampler decodes texels exactly like
+ * VolData::samplePrecomputedGradient in the ray marching shader.
+ */
+class VL_API GradientVolume {
+   public:
+    using SharedPtr = std::shared_ptr<GradientVolume>;
+
+    struct Texel {
+        uint16_t octU, octV; ///< Octahedral gradient direction
+        uint16_t magnitude;  ///< Gradient magnitude / maxMagnitude
+        uint16_t padding;
+    };
+
+    /** Build the gradients of an in-memory volume in parallel, returns
+     * nullptr for out-of-core volumes.
+     */
+    static SharedPtr create(const VolData& volData);
+
+    const std::array<uint32_t, 3>& getDims() const { return mDims; }
+
+    /** Get the texels in X-Y-Z order, ready for a RGBA16_UNORM upload.
+     */
+    std::span<const Texel> getTexels() const { return mTexels; }
+
+    /** Get the largest gradient magnitude, in modality unit per voxel.
+     */
+    float getMaxMagnitude() const { return mMaxMagnitude; }
+
+    /** Get the decoded gradient of a voxel, 0 outside of the volume.
+     */
+    float3 getGradient(int32_t x, int32_t y, int32_t z) const;
+
+    /** Trilinear sample of the decoded gradients at voxel coordinates.
+     */
+    float3 sampleGradient(float x, float y, float z) const;
+
+    /** Get the shading normal, the negated normalized gradient.
+     */
+    float3 computeNormal(float x, float y, float z) const {
+        return -normalize(sampleGradient(x, y, z));
+    }
+
+   private:
+    GradientVolume() = default;
+
+    std::array<uint32_t, 3> mDims = {};
+    float mMaxMagnitude = 0.f;
+    std::vector<Texel> mTexels;
+};
+} // namespace Voluma
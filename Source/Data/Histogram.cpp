@@ -0,0 +1,272 @@
+#include "Histogram.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <random>
+
+#include "Data/BrickStore.h"
+#include "Utils/Logger.h"
+#include "Utils/Parallel.h"
+
+namespace Voluma {
+static constexpr size_t kMinChunkSize = size_t(1) << 20; ///< Voxels
+static constexpr uint32_t kMergeBlockSize = 4096;        ///< Bins
+
+/** Get a chunk count with one chunk per thread, small inputs use fewer
+ * chunks and every chunk fits uint32_t counts.
+ */
+static uint32_t getChunkCount(size_t itemCount, size_t minChunkSize) {
+    size_t threadCount = getWorkerCount();
+    size_t chunkCount = std::clamp<size_t>(itemCount / minChunkSize, 1,
+                                           threadCount);
+    return uint32_t(std::max<size_t>(chunkCount, itemCount / UINT32_MAX + 1));
+}
+
+/** Count voxels into two interleaved sub-histograms at pBins, 2 * kBinCount
+ * counters, so runs of equal values do not serialize on one counter.
+ */
+static void countVoxels(std::span<const uint16_t> voxels, bool isSigned,
+                        uint32_t* pBins) {
+    uint32_t* pBins0 = pBins;
+    uint32_t* pBins1 = pBins + Histogram::kBinCount;
+    const uint16_t* pVoxels = voxels.data();
+    // Signed values map to bins by flipping the sign bit
+    uint16_t flip = isSigned ? 0x8000 : 0;
+    size_t i = 0;
+    for (; i + 4 <= voxels.size(); i += 4) {
+        pBins0[pVoxels[i] ^ flip]++;
+        pBins1[pVoxels[i + 1] ^ flip]++;
+        pBins0[pVoxels[i + 2] ^ flip]++;
+        pBins1[pVoxels[i + 3] ^ flip]++;
+    }
+    for (; i < voxels.size(); i++) pBins0[pVoxels[i] ^ flip]++;
+}
+
+Histogram Histogram::compute(std::span<const uint16_t> voxels,
+                             bool isSigned) {
+    auto start = std::chrono::steady_clock::now();
+    Histogram histogram;
+    histogram.mIsSigned = isSigned;
+
+    uint32_t chunkCount = getChunkCount(voxels.size(), kMinChunkSize);
+    size_t chunkSize = (voxels.size() + chunkCount - 1) / chunkCount;
+    std::vector<std::vector<uint32_t>> partials(chunkCount);
+    std::vector<uint32_t> chunks(chunkCount);
+    std::iota(chunks.begin(), chunks.end(), 0u);
+    forEachParallel(chunks.begin(), chunks.end(), [&](uint32_t c) {
+        auto& partial = partials[c];
+        partial.assign(2 * kBinCount, 0);
+        size_t begin = std::min(c * chunkSize, voxels.size());
+        size_t end = std::min(begin + chunkSize, voxels.size());
+        countVoxels(voxels.subspan(begin, end - begin), isSigned,
+                    partial.data());
+    });
+    histogram.merge(partials);
+
+    logInfo("Built histogram of {} voxels in {:.1f} ms.", voxels.size(),
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start)
+                .count());
+    return histogram;
+}
+
+Histogram Histogram::compute(const BrickStore& store) {
+    auto start = std::chrono::steady_clock::now();
+    Histogram histogram;
+    histogram.mIsSigned = store.isSigned();
+
+    constexpr uint32_t kSize = BrickedVolume::kBrickSize;
+    constexpr uint32_t kPadded = BrickedVolume::kPaddedSize;
+    const auto& dims = store.getVolumeDims();
+    const auto& grid = store.getBrickGrid();
+    uint32_t brickCount = store.getBrickCount();
+
+    uint32_t chunkCount = getChunkCount(brickCount, 1);
+    uint32_t chunkSize = (brickCount + chunkCount - 1) / chunkCount;
+    std::vector<std::vector<uint32_t>> partials(chunkCount);
+    std::vector<uint32_t> chunks(chunkCount);
+    std::iota(chunks.begin(), chunks.end(), 0u);
+    forEachParallel(chunks.begin(), chunks.end(), [&](uint32_t c) {
+        auto& partial = partials[c];
+        partial.assign(kBinCount, 0);
+        uint16_t flip = store.isSigned() ? 0x8000 : 0;
+        std::vector<uint16_t> voxels(BrickedVolume::kBrickVoxelCount);
+
+        uint32_t begin = std::min(c * chunkSize, brickCount);
+        uint32_t end = std::min(begin + chunkSize, brickCount);
+        for (uint32_t b = begin; b < end; b++) {
+            if (!store.readBrick(b, voxels)) continue;
+            uint32_t size[3] = {
+                std::min(kSize, dims[0] - b % grid[0] * kSize),
+                std::min(kSize, dims[1] - b / grid[0] % grid[1] * kSize),
+                std::min(kSize, dims[2] - b / (grid[0] * grid[1]) * kSize)};
+            for (uint32_t z = 0; z < size[2]; z++) {
+                for (uint32_t y = 0; y < size[1]; y++) {
+                    const uint16_t* pRow =
+                        voxels.data() +
+                        ((size_t(z) + BrickedVolume::kApron) * kPadded + y +
+                         BrickedVolume::kApron) *
+                            kPadded +
+                        BrickedVolume::kApron;
+                    for (uint32_t x = 0; x < size[0]; x++)
+                        partial[pRow[x] ^ flip]++;
+                }
+            }
+        }
+    });
+    histogram.merge(partials);
+
+    logInfo("Built histogram of {} bricks in {:.1f} ms.", brickCount,
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start)
+                .count());
+    return histogram;
+}
+
+void Histogram::Accumulator::add(std::span<const uint16_t> voxels) {
+    std::unique_ptr<Partial> pPartial;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mIdle.empty()) {
+            pPartial = std::move(mIdle.back());
+            mIdle.pop_back();
+        }
+        // Retire a partial before any of its counters can overflow
+        if (pPartial && pPartial->count + voxels.size() > UINT32_MAX)
+            mFull.push_back(std::move(pPartial));
+    }
+    if (!pPartial) {
+        pPartial = std::make_unique<Partial>();
+        pPartial->bins.assign(2 * kBinCount, 0);
+    }
+
+    countVoxels(voxels, mIsSigned, pPartial->bins.data());
+    pPartial->count += voxels.size();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIdle.push_back(std::move(pPartial));
+}
+
+Histogram Histogram::Accumulator::finish(uint64_t totalCount) {
+    auto start = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<std::vector<uint32_t>> partials;
+    uint64_t count = 0;
+    for (auto* pPartials : {&mIdle, &mFull}) {
+        for (auto& pPartial : *pPartials) {
+            count += pPartial->count;
+            partials.push_back(std::move(pPartial->bins));
+        }
+        pPartials->clear();
+    }
+
+    Histogram histogram;
+    histogram.mIsSigned = mIsSigned;
+    histogram.merge(partials, totalCount - std::min(count, totalCount));
+
+    logInfo("Merged histogram of {} voxels from {} partials in {:.1f} ms.",
+            totalCount, partials.size(),
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start)
+                .count());
+    return histogram;
+}
+
+void Histogram::runBenchmark(size_t voxelCount) {
+    // Air, soft tissue and bone peaks of a CT scan in stored values
+    std::vector<uint16_t> voxels(voxelCount);
+    std::mt19937 rng(42);
+    std::normal_distribution<float> air(24.f, 20.f), tissue(1064.f, 60.f),
+        bone(2024.f, 300.f);
+    std::uniform_int_distribution<uint32_t> tissueType(0, 9);
+    for (auto& v : voxels) {
+        uint32_t type = tissueType(rng);
+        float value = type < 4 ? air(rng) : type < 9 ? tissue(rng) : bone(rng);
+        v = uint16_t(std::clamp(value, 0.f, 4095.f));
+    }
+
+    // Best of a few runs
+    double best = std::numeric_limits<double>::max();
+    for (int run = 0; run < 5; run++) {
+        auto start = std::chrono::steady_clock::now();
+        Histogram histogram = compute(voxels, false);
+        best = std::min(best, std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count());
+        if (histogram.getTotal() != voxelCount)
+            logWarning("Histogram counted {} of {} voxels.",
+                       histogram.getTotal(), voxelCount);
+    }
+    logInfo("Histogram of {} voxels on {} threads: {:.1f} ms, {:.2f} GB/s",
+            voxelCount, getChunkCount(voxelCount, kMinChunkSize), best * 1e3,
+            double(voxelCount * sizeof(uint16_t)) / best * 1e-9);
+}
+
+void Histogram::merge(const std::vector<std::vector<uint32_t>>& partials,
+                      uint64_t zeroCount) {
+    mBins.assign(kBinCount, 0);
+    std::vector<uint32_t> blocks(kBinCount / kMergeBlockSize);
+    std::iota(blocks.begin(), blocks.end(), 0u);
+    forEachParallel(blocks.begin(), blocks.end(), [&](uint32_t block) {
+        uint32_t begin = block * kMergeBlockSize;
+        for (const auto& partial : partials) {
+            // A partial may hold several interleaved sub-histograms
+            for (size_t offset = 0; offset < partial.size();
+                 offset += kBinCount) {
+                for (uint32_t i = begin; i < begin + kMergeBlockSize; i++)
+                    mBins[i] += partial[offset + i];
+            }
+        }
+    });
+
+    mBins[toBin(0)] += zeroCount;
+    mCumulative.resize(kBinCount);
+    std::partial_sum(mBins.begin(), mBins.end(), mCumulative.begin());
+    mTotal = mCumulative.back();
+}
+
+int32_t Histogram::getPercentile(float p, uint32_t firstBin,
+                                 uint32_t lastBin) const {
+    if (isEmpty()) return 0;
+    uint64_t base = firstBin > 0 ? mCumulative[firstBin - 1] : 0;
+    uint64_t rangeCount = getRangeCount(firstBin, lastBin);
+    uint64_t target =
+        base + std::max<uint64_t>(uint64_t(double(rangeCount) *
+                                           std::clamp(p, 0.f, 1.f)),
+                                  1);
+    auto it = std::lower_bound(mCumulative.begin() + firstBin,
+                               mCumulative.begin() + lastBin + 1, target);
+    uint32_t bin = std::min(uint32_t(it - mCumulative.begin()), lastBin);
+    return toStoredValue(bin);
+}
+
+int32_t Histogram::getOtsuThreshold(uint32_t firstBin,
+                                    uint32_t lastBin) const {
+    double totalCount = double(getRangeCount(firstBin, lastBin));
+    if (totalCount == 0.0) return toStoredValue(firstBin);
+    double totalSum = 0.0;
+    for (uint32_t i = firstBin; i <= lastBin; i++)
+        totalSum += double(i - firstBin) * double(mBins[i]);
+
+    // Class 0 is [firstBin, t), class 1 is [t, lastBin]
+    double count0 = 0.0, sum0 = 0.0;
+    double bestVariance = -1.0;
+    uint32_t bestBin = firstBin;
+    for (uint32_t t = firstBin + 1; t <= lastBin; t++) {
+        count0 += double(mBins[t - 1]);
+        sum0 += double(t - 1 - firstBin) * double(mBins[t - 1]);
+        double count1 = totalCount - count0;
+        if (count0 == 0.0) continue;
+        if (count1 == 0.0) break;
+        double meanDiff = sum0 / count0 - (totalSum - sum0) / count1;
+        double variance = count0 * count1 * meanDiff * meanDiff;
+        if (variance > bestVariance) {
+            bestVariance = variance;
+            bestBin = t;
+        }
+    }
+    return toStoredValue(bestBin);
+}
+} // namespace Voluma
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "Core/Macros.h"
+
+namespace Voluma {
+class BrickStore;
+
+/** Full 16-bit histogram of stored voxel values.
+ *
+ * Bin i counts the stored value i, or i - 32768 for signed volumes, so bins
+ * are ordered by value. Counts are accumulated in per-thread partial
+ * histograms over disjoint chunks and merged in parallel per bin range.
+ * Ingests count each slice as it is decoded through an Accumulator instead
+ * of passing over the whole volume again.
+ */
+class VL_API Histogram {
+   public:
+    static constexpr uint32_t kBinCount = 65536;
+
+    /** Histogram of voxel spans added by concurrent threads, e.g. the
+     * decode workers of an ingest. Every add counts into a partial no other
+     * thread holds, the partials are merged once by finish.
+     */
+    class VL_API Accumulator {
+       public:
+        explicit Accumulator(bool isSigned) : mIsSigned(isSigned) {}
+
+        /** Count raw voxels like compute, thread safe.
+         */
+        void add(std::span<const uint16_t> voxels);
+
+        /** Merge the partials into a histogram of totalCount voxels. Voxels
+         * never added count as stored value 0, like slices that failed to
+         * decode.
+         */
+        Histogram finish(uint64_t totalCount);
+
+       private:
+        struct Partial {
+            std::vector<uint32_t> bins; ///< Two interleaved sub-histograms
+            uint64_t count = 0;
+        };
+
+        bool mIsSigned;
+        std::mutex mMutex;
+        std::vector<std::unique_ptr<Partial>> mIdle; ///< Free, by mMutex
+        std::vector<std::unique_ptr<Partial>> mFull; ///< Near uint32_t counts
+    };
+
+    Histogram() = default;
+
+    /** Count raw voxels, signed volumes store the two's complement pattern.
+     */
+    static Histogram compute(std::span<const uint16_t> voxels, bool isSigned);
+
+    /** Count the voxels of a brick store, aprons are skipped.
+     */
+    static Histogram compute(const BrickStore& store);
+
+    bool isEmpty() const { return mTotal == 0; }
+    uint64_t getTotal() const { return mTotal; }
+    std::span<const uint64_t> getBins() const { return mBins; }
+
+    uint32_t toBin(int32_t storedValue) const {
+        return uint32_t(storedValue + (mIsSigned ? 32768 : 0));
+    }
+    int32_t toStoredValue(uint32_t bin) const {
+        return int32_t(bin) - (mIsSigned ? 32768 : 0);
+    }
+
+    /** Get the smallest stored value with at least a fraction p of the
+     * counts of [firstBin, lastBin] at or below it.
+     */
+    int32_t getPercentile(float p, uint32_t firstBin, uint32_t lastBin) const;
+    int32_t getPercentile(float p) const {
+        return getPercentile(p, 0, kBinCount - 1);
+    }
+
+    /** Get the Otsu threshold of [firstBin, lastBin], the stored value that
+     * maximizes the between-class variance of the values below and at or
+     * above it.
+     */
+    int32_t getOtsuThreshold(uint32_t firstBin, uint32_t lastBin) const;
+
+    /** Time compute over voxelCount random CT-like voxels and log the ms and
+     * GB/s, along with the thread count they were measured with.
+     */
+    static void runBenchmark(size_t voxelCount);
+
+   private:
+    /** Get the count of [firstBin, lastBin].
+     */
+    uint64_t getRangeCount(uint32_t firstBin, uint32_t lastBin) const {
+        return mCumulative[lastBin] -
+               (firstBin > 0 ? mCumulative[firstBin - 1] : 0);
+    }
+
+    /** Merge partial histograms into the bins, add zeroCount voxels of
+     * stored value 0 and build the prefix sums.
+     */
+    void merge(const std::vector<std::vector<uint32_t>>& partials,
+               uint64_t zeroCount = 0);
+
+    bool mIsSigned = false;
+    uint64_t mTotal = 0;
+    std::vector<uint64_t> mBins;
+    std::vector<uint64_t> mCumulative; ///< Inclusive prefix sums of mBins
+};
+} // namespace Voluma
@@ -0,0 +1,377 @@
+#include "IngestPipeline.h"
+
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcistrmb.h>
+#include <dcmtk/dcmdata/dcpixel.h>
+#include <dcmtk/dcmdata/dcxfer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#if !VL_WINDOWS
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Data/DcmCodecs.h"
+#include "Data/DcmParser.h"
+#include "Data/VolData.h"
+#include "Utils/BoundedQueue.h"
+#include "Utils/Logger.h"
+
+namespace Voluma {
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct FileBuffer {
+    std::vector<uint8_t> data;
+    size_t size = 0;
+};
+
+struct ReadItem {
+    uint32_t sliceIndex;
+    FileBuffer* pBuffer;
+};
+
+struct ParsedItem {
+    uint32_t sliceIndex;
+    FileBuffer* pBuffer;
+    size_t pixelOffset; ///< Byte offset of the native pixel value
+    size_t pixelBytes;
+};
+
+/** Accumulate the busy time of a stage work item.
+ */
+class StageTimer {
+   public:
+    StageTimer(std::atomic<uint64_t>& busyNs)
+        : mBusyNs(busyNs), mStart(Clock::now()) {}
+    ~StageTimer() {
+        mBusyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       Clock::now() - mStart)
+                       .count();
+    }
+
+   private:
+    std::atomic<uint64_t>& mBusyNs;
+    Clock::time_point mStart;
+};
+
+/** Read a whole file with sequential access hints, the buffer is reused and
+ * only grows.
+ */
+bool readWholeFile(const std::string& path, FileBuffer& buffer) {
+#if VL_WINDOWS
+    // "S" hints sequential access to the CRT
+    FILE* pFile = std::fopen(path.c_str(), "rbS");
+    if (!pFile) return false;
+    std::setvbuf(pFile, nullptr, _IONBF, 0);
+    std::fseek(pFile, 0, SEEK_END);
+    long size = std::ftell(pFile);
+    std::fseek(pFile, 0, SEEK_SET);
+    if (size <= 0) {
+        std::fclose(pFile);
+        return false;
+    }
+    if (buffer.data.size() < size_t(size)) buffer.data.resize(size_t(size));
+    buffer.size = std::fread(buffer.data.data(), 1, size_t(size), pFile);
+    std::fclose(pFile);
+    return buffer.size == size_t(size);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = size_t(st.st_size);
+#if VL_LINUX
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#elif VL_MACOSX
+    fcntl(fd, F_RDAHEAD, 1);
+#endif
+    if (buffer.data.size() < size) buffer.data.resize(size);
+    size_t offset = 0;
+    while (offset < size) {
+        ssize_t n = read(fd, buffer.data.data() + offset, size - offset);
+        if (n <= 0) break;
+        offset += size_t(n);
+    }
+    close(fd);
+    buffer.size = offset;
+    return offset == size;
+#endif
+}
+
+uint32_t readLE32(const uint8_t* p) {
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 |
+           uint32_t(p[3]) << 24;
+}
+
+/** Find the native little endian PixelData value in an in-memory DICOM file.
+ * Returns false if the pixel data needs DCMTK to be decoded.
+ */
+bool locatePixelData(const FileBuffer& buffer, size_t& pixelOffset,
+                     size_t& pixelBytes) {
+    DcmInputBufferStream stream;
+    stream.setBuffer(buffer.data.data(), offile_off_t(buffer.size));
+    stream.setEos();
+
+    // Parsing stops right in front of the PixelData element
+    DcmFileFormat dfile;
+    dfile.transferInit();
+    OFCondition result =
+        dfile.readUntilTag(stream, EXS_Unknown, EGL_noChange,
+                           DCM_MaxReadLength, DCM_PixelData);
+    dfile.transferEnd();
+    if (result.bad()) return false;
+
+    DcmXfer xfer(dfile.getDataset()->getOriginalXfer());
+    if (xfer.isEncapsulated() || xfer.isBigEndian() || xfer.isDeflated())
+        return false;
+
+    size_t offset = size_t(stream.tell());
+    size_t headerSize = xfer.isExplicitVR() ? 12 : 8;
+    if (offset + headerSize > buffer.size) return false;
+
+    const uint8_t* pHeader = buffer.data.data() + offset;
+    // (7FE0,0010) in little endian
+    const uint8_t kPixelDataTag[4] = {0xE0, 0x7F, 0x10, 0x00};
+    if (std::memcmp(pHeader, kPixelDataTag, 4) != 0) return false;
+
+    uint32_t length = readLE32(pHeader + headerSize - 4);
+    if (length == 0xFFFFFFFFu || offset + headerSize + length > buffer.size)
+        return false;
+
+    pixelOffset = offset + headerSize;
+    pixelBytes = length;
+    return true;
+}
+
+enum class DecodeResult {
+    Failed,
+    Decompressed, ///< Codec wrote the frame into the slice buffer
+    Copied,       ///< Native pixels copied out of a DCMTK buffer
+};
+
+/** Let DCMTK decode the whole file from memory, used when the pixel data can
+ * not be copied as is. Encapsulated frames are decompressed by the registered
+ * codec straight into the slice buffer.
+ */
+DecodeResult decodeWithDcmtk(const FileBuffer& buffer,
+                             std::span<uint16_t> dst) {
+    DcmInputBufferStream stream;
+    stream.setBuffer(buffer.data.data(), offile_off_t(buffer.size));
+    stream.setEos();
+
+    DcmFileFormat dfile;
+    dfile.transferInit();
+    OFCondition result = dfile.read(stream);
+    dfile.transferEnd();
+    if (result.bad()) return DecodeResult::Failed;
+
+    DcmDataset* pDataset = dfile.getDataset();
+    DcmXfer xfer(pDataset->getOriginalXfer());
+    if (xfer.isEncapsulated()) {
+        DcmElement* pElement = nullptr;
+        if (pDataset->findAndGetElement(DCM_PixelData, pElement).bad())
+            return DecodeResult::Failed;
+        auto* pPixelData = dynamic_cast<DcmPixelData*>(pElement);
+        Uint32 frameSize = 0;
+        if (!pPixelData ||
+            pPixelData->getUncompressedFrameSize(pDataset, frameSize).bad() ||
+            frameSize != dst.size_bytes())
+            return DecodeResult::Failed;
+
+        Uint32 startFragment = 0;
+        OFString colorModel;
+        result = pPixelData->getUncompressedFrame(
+            pDataset, 0, startFragment, dst.data(), frameSize, colorModel);
+        if (result.bad()) {
+            logError("Failed to decompress {} pixel data: {}.",
+                     xfer.getXferName(), result.text());
+            return DecodeResult::Failed;
+        }
+        return DecodeResult::Decompressed;
+    }
+
+    auto pixels = DcmParser(pDataset).getU16Span(DCM_PixelData);
+    if (pixels.size() != dst.size()) return DecodeResult::Failed;
+    std::copy(pixels.begin(), pixels.end(), dst.begin());
+    return DecodeResult::Copied;
+}
+} // namespace
+
+IngestPipeline::IngestPipeline(VolData& volData, const Desc& desc)
+    : mVolData(volData), mDesc(desc) {
+    DcmCodecs::registerDecoders();
+    mDesc.readerCount = std::max(mDesc.readerCount, 1u);
+    mDesc.placerCount = std::max(mDesc.placerCount, 1u);
+    mDesc.queueDepth = std::max(mDesc.queueDepth, 1u);
+    if (mDesc.parserCount == 0)
+        mDesc.parserCount = std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void IngestPipeline::run(std::span<const uint32_t> sliceIndices,
+                         const std::function<bool()>& isCancelled,
+                         const std::function<void(uint32_t)>& onSliceDone) {
+    if (sliceIndices.empty()) return;
+
+    size_t sliceSize = size_t(mVolData.getRowWidth()) * mVolData.getColWidth();
+    size_t sliceBytes = sliceSize * sizeof(uint16_t);
+
+    // Every buffer in flight is either in a queue or held by one worker
+    uint32_t bufferCount = mDesc.queueDepth * 2 + mDesc.readerCount +
+                           mDesc.parserCount + mDesc.placerCount;
+    std::vector<FileBuffer> buffers(bufferCount);
+    BoundedQueue<FileBuffer*> freeBuffers(bufferCount);
+    for (auto& buffer : buffers) freeBuffers.push(&buffer);
+
+    BoundedQueue<uint32_t> jobs(sliceIndices.size());
+    for (uint32_t index : sliceIndices) jobs.push(index);
+    jobs.close();
+
+    BoundedQueue<ReadItem> readQueue(mDesc.queueDepth);
+    BoundedQueue<ParsedItem> parsedQueue(mDesc.queueDepth);
+
+    auto sliceFailed = [&](uint32_t index) {
+        logError("Failed to decode pixel data of slice file {}.",
+                 mVolData.mVolumeSliceData[index].getFilePath());
+        onSliceDone(index);
+    };
+
+    auto readerMain = [&]() {
+        while (auto index = jobs.pop()) {
+            if (isCancelled()) continue;
+            FileBuffer* pBuffer = *freeBuffers.pop();
+            bool isRead;
+            {
+                StageTimer timer(mReadStats.busyNs);
+                isRead = readWholeFile(
+                    mVolData.mVolumeSliceData[*index].getFilePath(), *pBuffer);
+            }
+            if (!isRead) {
+                freeBuffers.push(pBuffer);
+                sliceFailed(*index);
+                continue;
+            }
+            mReadStats.files++;
+            mReadStats.bytes += pBuffer->size;
+            mVolData.mIngestCounters.bytesRead += pBuffer->size;
+            readQueue.push({*index, pBuffer});
+        }
+    };
+
+    auto parserMain = [&]() {
+        while (auto item = readQueue.pop()) {
+            if (isCancelled()) {
+                freeBuffers.push(item->pBuffer);
+                continue;
+            }
+            StageTimer timer(mParseStats.busyNs);
+            mParseStats.files++;
+            mParseStats.bytes += item->pBuffer->size;
+
+            size_t pixelOffset, pixelBytes;
+            if (locatePixelData(*item->pBuffer, pixelOffset, pixelBytes) &&
+                pixelBytes == sliceBytes) {
+                parsedQueue.push(
+                    {item->sliceIndex, item->pBuffer, pixelOffset, pixelBytes});
+                continue;
+            }
+
+            // Slow path, compressed frames are decoded on the parser threads
+            DecodeResult decoded;
+            {
+                StageTimer decodeTimer(mDecodeStats.busyNs);
+                decoded = decodeWithDcmtk(
+                    *item->pBuffer, mVolData.getSliceBuffer(item->sliceIndex));
+            }
+            freeBuffers.push(item->pBuffer);
+            if (decoded == DecodeResult::Failed) {
+                sliceFailed(item->sliceIndex);
+                continue;
+            }
+            mDecodeStats.files++;
+            mDecodeStats.bytes += sliceBytes;
+            mVolData.mIngestCounters.sliceCount++;
+            if (decoded == DecodeResult::Copied) {
+                // DCMTK owns an intermediate pixel buffer
+                mVolData.mIngestCounters.heapAllocations++;
+                mVolData.mIngestCounters.bytesCopied += sliceBytes;
+            }
+            mVolData.updateSliceRange(item->sliceIndex);
+            onSliceDone(item->sliceIndex);
+        }
+    };
+
+    auto placerMain = [&]() {
+        while (auto item = parsedQueue.pop()) {
+            {
+                StageTimer timer(mPlaceStats.busyNs);
+                auto dst = mVolData.getSliceBuffer(item->sliceIndex);
+                std::memcpy(dst.data(),
+                            item->pBuffer->data.data() + item->pixelOffset,
+                            item->pixelBytes);
+                mVolData.updateSliceRange(item->sliceIndex);
+                mPlaceStats.files++;
+                mPlaceStats.bytes += item->pixelBytes;
+            }
+            freeBuffers.push(item->pBuffer);
+            mVolData.mIngestCounters.sliceCount++;
+            mVolData.mIngestCounters.bytesCopied += item->pixelBytes;
+            onSliceDone(item->sliceIndex);
+        }
+    };
+
+    // Each stage closes its output queue once all of its workers are done
+    auto startStage = [](uint32_t count, auto workerMain, auto onFinished) {
+        auto pRemaining = std::make_shared<std::atomic<uint32_t>>(count);
+        std::vector<std::thread> threads;
+        for (uint32_t i = 0; i < count; i++) {
+            threads.emplace_back([=]() {
+                workerMain();
+                if (--*pRemaining == 0) onFinished();
+            });
+        }
+        return threads;
+    };
+
+    auto readers = startStage(mDesc.readerCount, readerMain,
+                              [&]() { readQueue.close(); });
+    auto parsers = startStage(mDesc.parserCount, parserMain,
+                              [&]() { parsedQueue.close(); });
+    auto placers = startStage(mDesc.placerCount, placerMain, []() {});
+
+    for (auto* pThreads : {&readers, &parsers, &placers}) {
+        for (auto& thread : *pThreads) thread.join();
+    }
+}
+
+void IngestPipeline::logStageStats(const char* name, const StageStats& stats,
+                                   uint32_t threadCount) const {
+    // Busy time is summed over threads, divide to get stage wall time
+    double seconds = double(stats.busyNs) * 1e-9 / threadCount;
+    if (seconds <= 0.0) return;
+    logInfo("Ingest {} x{}: {} files, {:.1f} MB, {:.1f} MB/s, {:.1f} files/s",
+            name, threadCount, uint64_t(stats.files),
+            double(stats.bytes) / (1 << 20),
+            double(stats.bytes) / (1 << 20) / seconds,
+            double(stats.files) / seconds);
+}
+
+void IngestPipeline::logStats() const {
+    logStageStats("read", mReadStats, mDesc.readerCount);
+    logStageStats("parse", mParseStats, mDesc.parserCount);
+    logStageStats("place", mPlaceStats, mDesc.placerCount);
+    logStageStats("decode", mDecodeStats, mDesc.parserCount);
+}
+} // namespace Voluma
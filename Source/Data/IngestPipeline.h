@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+
+#include "Core/Macros.h"
+
+namespace Voluma {
+class VolData;
+
+/** Staged pixel ingest of slice files into a preallocated volume.
+ *
+ *   reader  -> large sequential file reads into pooled memory buffers
+ *   parser  -> DCMTK parses the header from memory and locates PixelData,
+ *              compressed frames are decoded here into the Z slab
+ *   placer  -> pixels are copied into the Z slab of the slice
+ *
+ * Stages are connected by bounded queues and each runs on its own set of
+ * threads, so storage latency overlaps with parsing. Memory buffers are
+ * recycled and no pixel buffer is allocated per slice.
+ */
+class VL_API IngestPipeline {
+   public:
+    struct Desc {
+        uint32_t readerCount = 4; ///< Concurrent file reads
+        uint32_t parserCount = 0; ///< 0 - hardware concurrency
+        uint32_t placerCount = 2;
+        uint32_t queueDepth = 16; ///< Capacity of each stage queue
+    };
+
+    IngestPipeline(VolData& volData, const Desc& desc);
+
+    /** Decode the given slices of the volume, blocks until all of them are
+     * placed. onSliceDone is called from the worker threads.
+     */
+    void run(std::span<const uint32_t> sliceIndices,
+             const std::function<bool()>& isCancelled,
+             const std::function<void(uint32_t)>& onSliceDone);
+
+    /** Log per-stage throughput of all runs so far.
+     */
+    void logStats() const;
+
+   private:
+    struct StageStats {
+        std::atomic<uint64_t> files = 0;
+        std::atomic<uint64_t> bytes = 0;
+        std::atomic<uint64_t> busyNs = 0; ///< Summed over stage threads
+    };
+
+    void logStageStats(const char* name, const StageStats& stats,
+                       uint32_t threadCount) const;
+
+    VolData& mVolData;
+    Desc mDesc;
+
+    StageStats mReadStats;
+    StageStats mParseStats;
+    StageStats mPlaceStats;
+    StageStats mDecodeStats; ///< Subset of the parse stage, decoded bytes
+};
+} // namespace Voluma
@@ -0,0 +1,226 @@
+#include "MinMaxOctree.h"
+
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <chrono>
+#include <numeric>
+
+#include "Data/VolData.h"
+#include "Utils/EmptySpaceSkipping.slangh"
+#include "Utils/Logger.h"
+#include "Utils/Parallel.h"
+
+namespace Voluma {
+static_assert(BrickedVolume::kBrickSize % MinMaxOctree::kLeafSize == 0,
+              "Leaves must not straddle bricks");
+static_assert(BrickedVolume::kApron >= 1,
+              "Leaf ranges read one voxel past the leaf");
+
+static const float2 kEmptyRange = float2(FLT_MAX, -FLT_MAX);
+
+MinMaxOctree::SharedPtr MinMaxOctree::create(const VolData& volData) {
+    auto start = std::chrono::steady_clock::now();
+
+    SharedPtr pOctree(new MinMaxOctree());
+    auto& leafGrid = pOctree->mLeafGrid;
+    std::array<uint32_t, 3> dims = {uint32_t(volData.getColWidth()),
+                                    uint32_t(volData.getRowWidth()),
+                                    uint32_t(volData.getSliceCount())};
+    Level leaves;
+    for (int i = 0; i < 3; i++) {
+        leafGrid[i] = (dims[i] + kLeafSize - 1) / kLeafSize;
+        leaves.dims[i] = std::bit_ceil(leafGrid[i]);
+    }
+    leaves.ranges.assign(
+        size_t(leaves.dims[0]) * leaves.dims[1] * leaves.dims[2], kEmptyRange);
+
+    // Sort the ends, the rescale slope may be negative
+    auto setLeafRange = [&](const uint32_t leaf[3], int32_t minValue,
+                            int32_t maxValue) {
+        float a = volData.toModalityValue(minValue);
+        float c = volData.toModalityValue(maxValue);
+        leaves.ranges[(size_t(leaf[2]) * leaves.dims[1] + leaf[1]) *
+                          leaves.dims[0] +
+                      leaf[0]] = float2(std::min(a, c), std::max(a, c));
+    };
+
+    const auto& pCache = volData.getBrickCache();
+    if (pCache) {
+        // Streamed voxels are read brick by brick around the cache so the
+        // scan does not evict hot bricks, the apron holds the +1 voxels
+        constexpr uint32_t kLeavesPerBrick =
+            BrickedVolume::kBrickSize / kLeafSize;
+        constexpr uint32_t kPadded = BrickedVolume::kPaddedSize;
+        const BrickStore& store = *pCache->getStore();
+        const auto& brickGrid = store.getBrickGrid();
+        std::vector<uint32_t> bricks(store.getBrickCount());
+        std::iota(bricks.begin(), bricks.end(), 0u);
+        forEachParallel(bricks.begin(), bricks.end(), [&](uint32_t b) {
+            std::vector<uint16_t> voxels(BrickedVolume::kBrickVoxelCount);
+            if (!store.readBrick(b, voxels)) return;
+
+            uint32_t brick[3] = {b % brickGrid[0],
+                                 b / brickGrid[0] % brickGrid[1],
+                                 b / (brickGrid[0] * brickGrid[1])};
+            for (uint32_t lz = 0; lz < kLeavesPerBrick; lz++) {
+                for (uint32_t ly = 0; ly < kLeavesPerBrick; ly++) {
+                    for (uint32_t lx = 0; lx < kLeavesPerBrick; lx++) {
+                        uint32_t leaf[3] = {brick[0] * kLeavesPerBrick + lx,
+                                            brick[1] * kLeavesPerBrick + ly,
+                                            brick[2] * kLeavesPerBrick + lz};
+                        if (leaf[0] >= leafGrid[0] ||
+                            leaf[1] >= leafGrid[1] || leaf[2] >= leafGrid[2])
+                            continue;
+
+                        int32_t minValue = INT32_MAX, maxValue = INT32_MIN;
+                        uint32_t x0 = BrickedVolume::kApron + lx * kLeafSize;
+                        uint32_t y0 = BrickedVolume::kApron + ly * kLeafSize;
+                        uint32_t z0 = BrickedVolume::kApron + lz * kLeafSize;
+                        for (uint32_t z = z0; z <= z0 + kLeafSize; z++) {
+                            for (uint32_t y = y0; y <= y0 + kLeafSize; y++) {
+                                const uint16_t* pRow =
+                                    voxels.data() +
+                                    (size_t(z) * kPadded + y) * kPadded;
+                                for (uint32_t x = x0; x <= x0 + kLeafSize;
+                                     x++) {
+                                    int32_t v = BrickedVolume::decode(
+                                        pRow[x], store.isSigned());
+                                    minValue = std::min(minValue, v);
+                                    maxValue = std::max(maxValue, v);
+                                }
+                            }
+                        }
+                        setLeafRange(leaf, minValue, maxValue);
+                    }
+                }
+            }
+        });
+    } else {
+        // In-memory voxels are scanned in place, one task per leaf slab
+        bool isSigned = volData.getVoxelFormat() == VoxelFormat::Int16;
+        auto voxels = volData.getMipData(0);
+        std::vector<uint32_t> slabs(leafGrid[2]);
+        std::iota(slabs.begin(), slabs.end(), 0u);
+        forEachParallel(slabs.begin(), slabs.end(), [&](uint32_t lz) {
+            for (uint32_t ly = 0; ly < leafGrid[1]; ly++) {
+                for (uint32_t lx = 0; lx < leafGrid[0]; lx++) {
+                    uint32_t leaf[3] = {lx, ly, lz};
+                    // kLeafSize + 1 voxels per axis, voxels outside of the
+                    // volume read 0 like the brick apron
+                    uint32_t begin[3], end[3];
+                    bool isClipped = false;
+                    for (int i = 0; i < 3; i++) {
+                        begin[i] = leaf[i] * kLeafSize;
+                        end[i] = begin[i] + kLeafSize + 1;
+                        isClipped |= end[i] > dims[i];
+                        end[i] = std::min(end[i], dims[i]);
+                    }
+                    int32_t minValue = isClipped ? 0 : INT32_MAX;
+                    int32_t maxValue = isClipped ? 0 : INT32_MIN;
+                    for (uint32_t z = begin[2]; z < end[2]; z++) {
+                        for (uint32_t y = begin[1]; y < end[1]; y++) {
+                            const uint16_t* pRow =
+                                voxels.data() +
+                                (size_t(z) * dims[1] + y) * dims[0];
+                            for (uint32_t x = begin[0]; x < end[0]; x++) {
+                                int32_t v =
+                                    BrickedVolume::decode(pRow[x], isSigned);
+                                minValue = std::min(minValue, v);
+                                maxValue = std::max(maxValue, v);
+                            }
+                        }
+                    }
+                    setLeafRange(leaf, minValue, maxValue);
+                }
+            }
+        });
+    }
+    pOctree->mLevels.push_back(std::move(leaves));
+
+    // Halve every axis until a single node is left
+    while (true) {
+        const Level& child = pOctree->mLevels.back();
+        if (child.dims[0] * child.dims[1] * child.dims[2] == 1) break;
+        Level parent;
+        for (int i = 0; i < 3; i++)
+            parent.dims[i] = std::max(child.dims[i] / 2, 1u);
+        parent.ranges.resize(size_t(parent.dims[0]) * parent.dims[1] *
+                             parent.dims[2]);
+
+        // 2 children per axis, or 1 once an axis is down to a single node
+        uint32_t ratio[3];
+        for (int i = 0; i < 3; i++) ratio[i] = child.dims[i] / parent.dims[i];
+
+        std::vector<uint32_t> slices(parent.dims[2]);
+        std::iota(slices.begin(), slices.end(), 0u);
+        forEachParallel(slices.begin(), slices.end(), [&](uint32_t z) {
+            float2* pRange = parent.ranges.data() +
+                             size_t(z) * parent.dims[1] * parent.dims[0];
+            for (uint32_t y = 0; y < parent.dims[1]; y++) {
+                for (uint32_t x = 0; x < parent.dims[0]; x++, pRange++) {
+                    float2 range = kEmptyRange;
+                    for (uint32_t cz = z * ratio[2]; cz < (z + 1) * ratio[2];
+                         cz++) {
+                        for (uint32_t cy = y * ratio[1];
+                             cy < (y + 1) * ratio[1]; cy++) {
+                            const float2* pChild =
+                                child.ranges.data() +
+                                (size_t(cz) * child.dims[1] + cy) *
+                                    child.dims[0];
+                            for (uint32_t cx = x * ratio[0];
+                                 cx < (x + 1) * ratio[0]; cx++) {
+                                range.x = std::min(range.x, pChild[cx].x);
+                                range.y = std::max(range.y, pChild[cx].y);
+                            }
+                        }
+                    }
+                    *pRange = range;
+                }
+            }
+        });
+        pOctree->mLevels.push_back(std::move(parent));
+    }
+
+    logInfo("Built min/max octree with {} levels in {:.1f} ms.",
+            pOctree->getLevelCount(),
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start)
+                .count());
+    return pOctree;
+}
+
+float2 MinMaxOctree::getNodeRange(uint32_t level, int32_t x, int32_t y,
+                                  int32_t z) const {
+    const auto& l = mLevels[level];
+    if (x < 0 || y < 0 || z < 0 || x >= int32_t(l.dims[0]) ||
+        y >= int32_t(l.dims[1]) || z >= int32_t(l.dims[2]))
+        return kEmptyRange;
+    return l.ranges[(size_t(z) * l.dims[1] + y) * l.dims[0] + size_t(x)];
+}
+
+float MinMaxOctree::getEmptyDistance(float3 texLoc, float3 texDir,
+                                     float threshold, float margin) const {
+    if (texLoc.x < 0.f || texLoc.y < 0.f || texLoc.z < 0.f) return 0.f;
+    int3 node = int3(glm::floor(texLoc)) / int32_t(kLeafSize);
+    // Samples past the volume read voxels the leaves do not cover
+    if (node.x >= int32_t(mLeafGrid[0]) || node.y >= int32_t(mLeafGrid[1]) ||
+        node.z >= int32_t(mLeafGrid[2]) ||
+        getNodeRange(0, node.x, node.y, node.z).y >= threshold)
+        return 0.f;
+
+    uint32_t level = 0;
+    while (level + 1 < getLevelCount()) {
+        int3 parent = node / 2;
+        if (getNodeRange(level + 1, parent.x, parent.y, parent.z).y >=
+            threshold)
+            break;
+        node = parent;
+        level++;
+    }
+    float nodeSize = float(kLeafSize << level);
+    float3 boxMin = float3(node) * nodeSize;
+    return getEmptyBoxDistance(texLoc, texDir, boxMin, boxMin + nodeSize,
+                               margin);
+}
+} // namespace Voluma
@@ -0,0 +1,81 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "Core/Macros.h"
+#include "Core/Math.h"
+
+namespace Voluma {
+class VolData;
+
+/** Threshold independent min/max octree for first hit iso searches.
+ *
+ * Leaves are kLeafSize^3 voxel cells holding the modality range of the
+ * voxels a trilinear sample in the cell may read, i.e. one more voxel along
+ * each axis. Every coarser level halves the grid and keeps the range of its
+ * 2^3 children. The leaf grid is padded to a power of two per axis so the
+ * levels line up with the mip chain of a 3D texture, padded nodes are empty.
+ *
+ * The octree is built once per volume. A marcher ascends from the leaf of a
+ * sample to the largest node whose max is below the threshold and leaps to
+ * its exit, so threshold changes cost nothing.
+ */
+class VL_API MinMaxOctree {
+   public:
+    using SharedPtr = std::shared_ptr<MinMaxOctree>;
+
+    static constexpr uint32_t kLeafSize = 8; ///< Voxels per axis
+
+    /** Build the leaf ranges in parallel, from the voxels in memory or
+     * brick by brick from the store of an out-of-core volume, then the
+     * levels.
+     */
+    static SharedPtr create(const VolData& volData);
+
+    /** Get the leaf grid covering the volume, without padding.
+     */
+    const std::array<uint32_t, 3>& getLeafGrid() const { return mLeafGrid; }
+
+    uint32_t getLevelCount() const { return uint32_t(mLevels.size()); }
+
+    /** Get the node grid of a level, level 0 holds the padded leaves.
+     */
+    const std::array<uint32_t, 3>& getLevelDims(uint32_t level) const {
+        return mLevels[level].dims;
+    }
+
+    /** Get the modality min/max of the nodes of a level in X-Y-Z order,
+     * ready for a R32G32_FLOAT mip level upload.
+     */
+    std::span<const float2> getLevelRanges(uint32_t level) const {
+        return mLevels[level].ranges;
+    }
+
+    /** Get the range of a node, empty (min > max) outside of the grid.
+     */
+    float2 getNodeRange(uint32_t level, int32_t x, int32_t y,
+                        int32_t z) const;
+
+    /** Get the distance a ray can travel from texLoc through nodes whose max
+     * is below threshold, the CPU counterpart of getOctreeEmptyDistance in
+     * the ray marching shader. texLoc and texDir are in level 0 voxels, see
+     * getEmptyBoxDistance for margin.
+     */
+    float getEmptyDistance(float3 texLoc, float3 texDir, float threshold,
+                           float margin) const;
+
+   private:
+    struct Level {
+        std::array<uint32_t, 3> dims;
+        std::vector<float2> ranges;
+    };
+
+    MinMaxOctree() = default;
+
+    std::array<uint32_t, 3> mLeafGrid = {};
+    std::vector<Level> mLevels;
+};
+} // namespace Voluma
@@ -0,0 +1,345 @@
+#include "MultiFrameIngest.h"
+
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcpixel.h>
+#include <dcmtk/dcmdata/dcpixseq.h>
+#include <dcmtk/dcmdata/dcpxitem.h>
+#include <dcmtk/dcmdata/dcxfer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "Data/DcmCodecs.h"
+#include "Data/DcmParser.h"
+#include "Data/VolData.h"
+#include "Utils/Logger.h"
+
+namespace Voluma {
+namespace {
+/** Tags of the functional group macros used for geometry and rescale, the
+ * macros do not share tags so one set is applied to each of them.
+ */
+struct FrameGroup {
+    std::vector<double> pixelSpacing;
+    double sliceThickness = 0.0;
+    double rescaleIntercept = 0.0;
+    double rescaleSlope = 0.0;
+    std::vector<double> imageOrientation;
+    std::vector<double> imagePosition;
+
+    static const DcmTagSet<FrameGroup>& getTagSet() {
+        static const DcmTagSet<FrameGroup> kTagSet = {
+            {DCM_PixelSpacing, &FrameGroup::pixelSpacing},
+            {DCM_SliceThickness, &FrameGroup::sliceThickness},
+            {DCM_RescaleIntercept, &FrameGroup::rescaleIntercept},
+            {DCM_RescaleSlope, &FrameGroup::rescaleSlope},
+            {DCM_ImageOrientationPatient, &FrameGroup::imageOrientation},
+            {DCM_ImagePositionPatient, &FrameGroup::imagePosition},
+        };
+        return kTagSet;
+    }
+};
+
+/** Fill the values of one functional groups item, fields of absent macros
+ * are left untouched so shared values can be overridden per frame.
+ */
+void readFunctionalGroup(DcmItem* pGroup, FrameGroup& group) {
+    static const DcmTagKey kMacros[] = {
+        DCM_PixelMeasuresSequence,
+        DCM_PixelValueTransformationSequence,
+        DCM_PlaneOrientationSequence,
+        DCM_PlanePositionSequence,
+    };
+    for (const auto& macro : kMacros) {
+        DcmItem* pItem = nullptr;
+        if (pGroup->findAndGetSequenceItem(macro, pItem).good() && pItem)
+            DcmParser(pItem).extract(FrameGroup::getTagSet(), group);
+    }
+}
+
+/** Project the frame position onto the slice normal, falls back to the
+ * patient z axis without orientation.
+ */
+double getFrameLocation(const FrameGroup& group, int32_t frameIndex) {
+    if (group.imagePosition.size() < 3) return double(frameIndex);
+    const auto& p = group.imagePosition;
+    if (group.imageOrientation.size() < 6) return p[2];
+
+    const auto& o = group.imageOrientation;
+    double n[3] = {o[1] * o[5] - o[2] * o[4], o[2] * o[3] - o[0] * o[5],
+                   o[0] * o[4] - o[1] * o[3]};
+    return p[0] * n[0] + p[1] * n[1] + p[2] * n[2];
+}
+
+/** Check if the frames of a file can be found on their own. Encapsulated
+ * frames are located through the Basic Offset Table, or directly when every
+ * frame is one fragment. Without either, a frame only starts where the one
+ * before ends. Files that fail to load count as random access, the workers
+ * report them.
+ */
+bool hasFrameOffsets(const std::string& filePath, size_t frameCount) {
+    DcmFileFormat file;
+    if (file.loadFile(filePath.c_str(), EXS_Unknown, EGL_noChange,
+                      DcmParser::kLazyReadLength)
+            .bad())
+        return true;
+    DcmDataset* pDataset = file.getDataset();
+    E_TransferSyntax xfer = pDataset->getOriginalXfer();
+    if (!DcmXfer(xfer).isEncapsulated()) return true;
+
+    DcmElement* pElement = nullptr;
+    if (pDataset->findAndGetElement(DCM_PixelData, pElement).bad())
+        return true;
+    auto* pPixelData = dynamic_cast<DcmPixelData*>(pElement);
+    DcmPixelSequence* pSequence = nullptr;
+    if (!pPixelData ||
+        pPixelData->getEncapsulatedRepresentation(xfer, nullptr, pSequence)
+            .bad() ||
+        !pSequence)
+        return true;
+
+    // The first item is the offset table, one fragment per frame follows
+    if (pSequence->card() == frameCount + 1) return true;
+    DcmPixelItem* pOffsetTable = nullptr;
+    return pSequence->getItem(pOffsetTable, 0).good() && pOffsetTable &&
+           pOffsetTable->getLength() == frameCount * sizeof(Uint32);
+}
+
+using Clock = std::chrono::steady_clock;
+} // namespace
+
+std::vector<VolSlice> MultiFrameIngest::readFrames(DcmDataset* pDataset,
+                                                   const std::string& filePath,
+                                                   SliceHeader& header) {
+    FrameGroup shared;
+    DcmItem* pShared = nullptr;
+    if (pDataset->findAndGetSequenceItem(DCM_SharedFunctionalGroupsSequence,
+                                         pShared)
+            .good() &&
+        pShared)
+        readFunctionalGroup(pShared, shared);
+
+    DcmSequenceOfItems* pPerFrame = nullptr;
+    pDataset->findAndGetSequence(DCM_PerFrameFunctionalGroupsSequence,
+                                 pPerFrame);
+
+    // Step through the items along with the frames, getItem(i) would walk
+    // the item list from its head for every frame
+    DcmObject* pFrameItem =
+        pPerFrame ? pPerFrame->nextInContainer(nullptr) : nullptr;
+    std::vector<VolSlice> frames(size_t(std::max(header.numberOfFrames, 1)));
+    for (size_t i = 0; i < frames.size(); i++) {
+        FrameGroup group = shared;
+        if (pFrameItem) {
+            readFunctionalGroup(static_cast<DcmItem*>(pFrameItem), group);
+            pFrameItem = pPerFrame->nextInContainer(pFrameItem);
+        }
+
+        if (i == 0) {
+            // Scan metadata is per series, take it from the first frame
+            if (!group.pixelSpacing.empty())
+                header.pixelSpacing = group.pixelSpacing;
+            if (group.sliceThickness != 0.0)
+                header.sliceThickness = group.sliceThickness;
+            if (group.rescaleSlope != 0.0) {
+                header.rescaleIntercept = group.rescaleIntercept;
+                header.rescaleSlope = group.rescaleSlope;
+            }
+        }
+
+        VolSlice& frame = frames[i];
+        frame.mFilePath = filePath;
+        frame.mFrameIndex = int32_t(i);
+        frame.mInstanceNumber = int32_t(i);
+        frame.mThickness = float(group.sliceThickness != 0.0
+                                     ? group.sliceThickness
+                                     : header.sliceThickness);
+        frame.mLocation = float(getFrameLocation(group, int32_t(i)));
+    }
+    return frames;
+}
+
+MultiFrameIngest::MultiFrameIngest(VolData& volData, uint32_t threadCount)
+    : mVolData(volData), mThreadCount(threadCount) {
+    DcmCodecs::registerDecoders();
+    if (mThreadCount == 0)
+        mThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void MultiFrameIngest::run(std::span<const uint32_t> sliceIndices,
+                           const std::function<bool()>& isCancelled,
+                           const std::function<void(uint32_t)>& onSliceDone) {
+    if (sliceIndices.empty()) return;
+    auto start = Clock::now();
+
+    // Keep frames of a file together and in frame order, so workers reuse
+    // their dataset and read the file mostly forward.
+    std::vector<uint32_t> order(sliceIndices.begin(), sliceIndices.end());
+    const auto& slices = mVolData.mVolumeSliceData;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (slices[a].mFilePath != slices[b].mFilePath)
+            return slices[a].mFilePath < slices[b].mFilePath;
+        return slices[a].mFrameIndex < slices[b].mFrameIndex;
+    });
+
+    // Split the frames into chunks claimed by the workers. A file without
+    // frame offsets is a single chunk, one worker decodes it in order.
+    constexpr size_t kChunkSize = 8; ///< Frames claimed per worker at once
+    std::vector<std::pair<size_t, size_t>> chunks;
+    for (size_t begin = 0; begin < order.size();) {
+        const std::string& filePath = slices[order[begin]].mFilePath;
+        size_t fileEnd = begin;
+        while (fileEnd < order.size() &&
+               slices[order[fileEnd]].mFilePath == filePath)
+            fileEnd++;
+        auto [it, isNew] = mFileCursors.try_emplace(filePath);
+        if (isNew) {
+            size_t frameCount = std::count_if(
+                slices.begin(), slices.end(), [&](const VolSlice& slice) {
+                    return slice.mFilePath == filePath;
+                });
+            it->second.isSequential = !hasFrameOffsets(filePath, frameCount);
+            if (it->second.isSequential)
+                logWarning("{} has no frame offsets, its frames are decoded "
+                           "in order on one thread.",
+                           filePath);
+        }
+        size_t chunkSize =
+            it->second.isSequential ? fileEnd - begin : kChunkSize;
+        for (size_t i = begin; i < fileEnd; i += chunkSize)
+            chunks.emplace_back(i, std::min(i + chunkSize, fileEnd));
+        begin = fileEnd;
+    }
+
+    size_t sliceBytes = size_t(mVolData.getRowWidth()) *
+                        mVolData.getColWidth() * sizeof(uint16_t);
+    std::atomic<size_t> nextChunk = 0;
+
+    auto workerMain = [&]() {
+        std::string loadedPath;
+        std::unique_ptr<DcmFileFormat> pFile;
+        DcmPixelData* pPixelData = nullptr;
+        bool isEncapsulated = false;
+        DcmFileCache fileCache;
+        std::vector<uint16_t> skippedFrame;
+
+        auto loadFile = [&](const std::string& path) {
+            // Pixel data stays on disk, frames are read on demand
+            loadedPath = path;
+            pFile = std::make_unique<DcmFileFormat>();
+            pPixelData = nullptr;
+            if (pFile->loadFile(path.c_str(), EXS_Unknown, EGL_noChange,
+                                DcmParser::kLazyReadLength)
+                    .bad())
+                return;
+            DcmDataset* pDataset = pFile->getDataset();
+            DcmElement* pElement = nullptr;
+            if (pDataset->findAndGetElement(DCM_PixelData, pElement).good())
+                pPixelData = dynamic_cast<DcmPixelData*>(pElement);
+            isEncapsulated =
+                DcmXfer(pDataset->getOriginalXfer()).isEncapsulated();
+        };
+
+        // A start fragment of 0 makes the decoder look the frame up in the
+        // offset table, on success it is advanced to the next frame
+        auto decodeFrame = [&](int32_t frameIndex, std::span<uint16_t> dst,
+                               FileCursor& cursor) {
+            Uint32 startFragment =
+                frameIndex == cursor.nextFrame ? cursor.nextFragment : 0;
+            OFString colorModel;
+            bool isDecoded =
+                pPixelData
+                    ->getUncompressedFrame(
+                        pFile->getDataset(), Uint32(frameIndex),
+                        startFragment, dst.data(), Uint32(dst.size_bytes()),
+                        colorModel, &fileCache)
+                    .good();
+            cursor.nextFrame = isDecoded ? frameIndex + 1 : -1;
+            cursor.nextFragment = isDecoded ? startFragment : 0;
+            return isDecoded;
+        };
+
+        auto extractFrame = [&](uint32_t sliceIndex, FileCursor& cursor) {
+            const VolSlice& slice = slices[sliceIndex];
+            if (slice.mFilePath != loadedPath) loadFile(slice.mFilePath);
+            if (!pPixelData) return false;
+
+            auto dst = mVolData.getSliceBuffer(sliceIndex);
+            if (!isEncapsulated) {
+                Uint32 frameBytes = Uint32(dst.size_bytes());
+                return pPixelData
+                    ->getPartialValue(dst.data(),
+                                      Uint32(slice.mFrameIndex) * frameBytes,
+                                      frameBytes, &fileCache, gLocalByteOrder)
+                    .good();
+            }
+            if (cursor.isSequential) {
+                // Frames between the cursor and the requested one are
+                // decoded and dropped, an earlier frame starts over
+                if (cursor.nextFrame < 0 ||
+                    cursor.nextFrame > slice.mFrameIndex)
+                    cursor = {true, 0, 0};
+                skippedFrame.resize(dst.size());
+                while (cursor.nextFrame < slice.mFrameIndex) {
+                    if (!decodeFrame(cursor.nextFrame, skippedFrame, cursor))
+                        return false;
+                }
+            }
+            return decodeFrame(slice.mFrameIndex, dst, cursor);
+        };
+
+        while (true) {
+            size_t chunk = nextChunk++;
+            if (chunk >= chunks.size()) break;
+            auto [begin, end] = chunks[chunk];
+            // Consecutive frames of a chunk carry the start fragment over,
+            // the first one is seeded from the offset table. Files without
+            // offsets keep their cursor across runs.
+            const std::string& filePath = slices[order[begin]].mFilePath;
+            FileCursor& fileCursor = mFileCursors.at(filePath);
+            FileCursor chunkCursor;
+            FileCursor& cursor =
+                fileCursor.isSequential ? fileCursor : chunkCursor;
+            for (size_t i = begin; i < end; i++) {
+                if (isCancelled()) return;
+                uint32_t sliceIndex = order[i];
+                if (!extractFrame(sliceIndex, cursor)) {
+                    logError("Failed to extract frame {} of {}.",
+                             slices[sliceIndex].mFrameIndex,
+                             slices[sliceIndex].mFilePath);
+                    onSliceDone(sliceIndex);
+                    continue;
+                }
+                mVolData.updateSliceRange(sliceIndex);
+                mVolData.mIngestCounters.sliceCount++;
+                mVolData.mIngestCounters.bytesRead += sliceBytes;
+                mFrameCount++;
+                mBytes += sliceBytes;
+                onSliceDone(sliceIndex);
+            }
+        }
+    };
+
+    uint32_t threadCount =
+        uint32_t(std::min<size_t>(mThreadCount, chunks.size()));
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < threadCount; i++) threads.emplace_back(workerMain);
+    for (auto& thread : threads) thread.join();
+
+    mWallNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   Clock::now() - start)
+                   .count();
+}
+
+void MultiFrameIngest::logStats() const {
+    double seconds = double(mWallNs) * 1e-9;
+    if (seconds <= 0.0) return;
+    logInfo("Ingest frames x{}: {} frames, {:.1f} MB, {:.1f} MB/s, "
+            "{:.1f} frames/s",
+            mThreadCount, uint64_t(mFrameCount),
+            double(mBytes) / (1 << 20), double(mBytes) / (1 << 20) / seconds,
+            double(mFrameCount) / seconds);
+}
+} // namespace Voluma
\ No newline at end of file
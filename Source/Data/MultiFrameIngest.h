@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Core/Macros.h"
+#include "Data/VolSlice.h"
+
+namespace Voluma {
+class VolData;
+
+/** Frame extraction of multi-frame(Enhanced CT/MR) objects.
+ *
+ * Frame positions come from the per-frame functional groups, with the shared
+ * functional groups as fallback. Frames are extracted in parallel: every
+ * worker owns a lazily loaded dataset of the file, native frames are read
+ * from disk straight into their Z slab and encapsulated ones are decoded
+ * into it. Encapsulated frames are found through the Basic Offset Table,
+ * files without one are decoded in frame order on a single thread.
+ */
+class VL_API MultiFrameIngest {
+   public:
+    /** Create one slice per frame of a multi-frame dataset. Pixel spacing,
+     * thickness and rescale from the functional groups are written back to
+     * header so the scan metadata can be read from it as usual.
+     */
+    static std::vector<VolSlice> readFrames(DcmDataset* pDataset,
+                                            const std::string& filePath,
+                                            SliceHeader& header);
+
+    /** @param threadCount 0 - hardware concurrency
+     */
+    MultiFrameIngest(VolData& volData, uint32_t threadCount);
+
+    /** Extract the frames of the given slices, blocks until all of them are
+     * placed. onSliceDone is called from the worker threads.
+     */
+    void run(std::span<const uint32_t> sliceIndices,
+             const std::function<bool()>& isCancelled,
+             const std::function<void(uint32_t)>& onSliceDone);
+
+    /** Log extraction throughput of all runs so far.
+     */
+    void logStats() const;
+
+   private:
+    /** Decode position in the fragments of an encapsulated file.
+     */
+    struct FileCursor {
+        bool isSequential = false; ///< No frame offsets, see run
+        int32_t nextFrame = -1;    ///< Frame nextFragment starts, -1 none
+        uint32_t nextFragment = 0;
+    };
+
+    VolData& mVolData;
+    uint32_t mThreadCount;
+    /// Probed files, by path. Only the worker of a sequential file
+    /// touches its cursor during a run.
+    std::unordered_map<std::string, FileCursor> mFileCursors;
+
+    std::atomic<uint64_t> mFrameCount = 0;
+    std::atomic<uint64_t> mBytes = 0;
+    std::atomic<uint64_t> mWallNs = 0;
+};
+} // namespace Voluma
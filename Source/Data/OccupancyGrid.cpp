@@ -0,0 +1,185 @@
+#include "OccupancyGrid.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+
+#include "Utils/Parallel.h"
+
+namespace Voluma {
+OccupancyGrid::SharedPtr OccupancyGrid::create(const MinMaxOctree& octree) {
+    SharedPtr pGrid(new OccupancyGrid());
+    auto& grid = pGrid->mGrid;
+    grid = octree.getLeafGrid();
+    size_t cellCount = size_t(grid[0]) * grid[1] * grid[2];
+    pGrid->mCellMax.resize(cellCount);
+    // The leaves are padded to powers of two, cells are not
+    const auto& leafDims = octree.getLevelDims(0);
+    auto leaves = octree.getLevelRanges(0);
+    for (uint32_t z = 0; z < grid[2]; z++) {
+        for (uint32_t y = 0; y < grid[1]; y++) {
+            for (uint32_t x = 0; x < grid[0]; x++) {
+                pGrid->mCellMax[pGrid->getCellIndex(x, y, z)] =
+                    leaves[(size_t(z) * leafDims[1] + y) * leafDims[0] + x].y;
+            }
+        }
+    }
+
+    pGrid->mThreshold = -FLT_MAX;
+    pGrid->mOccupied.assign(cellCount, 1);
+    pGrid->mDistances.assign(cellCount, 0);
+    return pGrid;
+}
+
+OccupancyGrid::Region OccupancyGrid::setThreshold(float threshold) {
+    if (threshold == mThreshold) return {};
+    float low = std::min(threshold, mThreshold);
+    float high = std::max(threshold, mThreshold);
+    mThreshold = threshold;
+
+    // Flip the cells whose max lies in [low, high), tracking their bounds
+    std::vector<uint32_t> slices(mGrid[2]);
+    std::iota(slices.begin(), slices.end(), 0u);
+    std::vector<Region> sliceBounds(mGrid[2]);
+    forEachParallel(slices.begin(), slices.end(), [&](uint32_t cz) {
+        uint32_t lo[3] = {UINT32_MAX, UINT32_MAX, cz};
+        uint32_t hi[3] = {0, 0, cz};
+        for (uint32_t cy = 0; cy < mGrid[1]; cy++) {
+            for (uint32_t cx = 0; cx < mGrid[0]; cx++) {
+                uint32_t index = getCellIndex(cx, cy, cz);
+                float cellMax = mCellMax[index];
+                if (cellMax < low || cellMax >= high) continue;
+                mOccupied[index] = cellMax >= threshold ? 1 : 0;
+                lo[0] = std::min(lo[0], cx), hi[0] = std::max(hi[0], cx);
+                lo[1] = std::min(lo[1], cy), hi[1] = std::max(hi[1], cy);
+            }
+        }
+        if (lo[0] == UINT32_MAX) return;
+        for (int i = 0; i < 3; i++) {
+            sliceBounds[cz].offset[i] = lo[i];
+            sliceBounds[cz].size[i] = hi[i] - lo[i] + 1;
+        }
+    });
+
+    // Distances within kMaxDistance of a flipped cell may change
+    uint32_t lo[3] = {UINT32_MAX, UINT32_MAX, UINT32_MAX};
+    uint32_t hi[3] = {0, 0, 0};
+    for (const auto& bounds : sliceBounds) {
+        if (bounds.isEmpty()) continue;
+        for (int i = 0; i < 3; i++) {
+            lo[i] = std::min(lo[i], bounds.offset[i]);
+            hi[i] = std::max(hi[i], bounds.offset[i] + bounds.size[i]);
+        }
+    }
+    if (lo[0] == UINT32_MAX) return {};
+    Region region;
+    for (int i = 0; i < 3; i++) {
+        region.offset[i] = lo[i] > kMaxDistance ? lo[i] - kMaxDistance : 0;
+        region.size[i] =
+            std::min(hi[i] + kMaxDistance, mGrid[i]) - region.offset[i];
+    }
+    updateDistances(region);
+    return region;
+}
+
+void OccupancyGrid::updateDistances(const Region& region) {
+    // The Chebyshev distance is separable: min over q of max(|dx|, |dy|,
+    // |dz|) is computed one axis at a time. Every pass covers the region
+    // dilated by kMaxDistance along the axes of the passes after it.
+    uint32_t lo[3], hi[3], outerLo[3], outerHi[3];
+    for (int i = 0; i < 3; i++) {
+        lo[i] = region.offset[i];
+        hi[i] = region.offset[i] + region.size[i];
+        outerLo[i] = lo[i] > kMaxDistance ? lo[i] - kMaxDistance : 0;
+        outerHi[i] = std::min(hi[i] + kMaxDistance, mGrid[i]);
+    }
+    uint32_t sizeX = hi[0] - lo[0];
+    uint32_t sizeY = outerHi[1] - outerLo[1];
+    uint32_t sizeZ = outerHi[2] - outerLo[2];
+    auto at = [&](std::vector<uint8_t>& v, uint32_t x, uint32_t y,
+                  uint32_t z) -> uint8_t& {
+        return v[(size_t(z - outerLo[2]) * sizeY + (y - outerLo[1])) * sizeX +
+                 (x - lo[0])];
+    };
+
+    // Pass X: distance to the closest occupied cell in the row
+    std::vector<uint8_t> distX(size_t(sizeX) * sizeY * sizeZ);
+    std::vector<uint32_t> slices(sizeZ);
+    std::iota(slices.begin(), slices.end(), outerLo[2]);
+    forEachParallel(slices.begin(), slices.end(), [&](uint32_t z) {
+        for (uint32_t y = outerLo[1]; y < outerHi[1]; y++) {
+            const uint8_t* pRow = mOccupied.data() + getCellIndex(0, y, z);
+            for (uint32_t x = lo[0]; x < hi[0]; x++) {
+                uint32_t d = 0;
+                for (; d < kMaxDistance; d++) {
+                    if ((x >= d && pRow[x - d]) ||
+                        (x + d < mGrid[0] && pRow[x + d]))
+                        break;
+                }
+                at(distX, x, y, z) = uint8_t(d);
+            }
+        }
+    });
+
+    // Pass Y and Z: min over the axis of max(|d|, distance of the last pass)
+    auto minMax = [](auto&& distAt, uint32_t p, uint32_t begin,
+                     uint32_t end) {
+        uint32_t best = distAt(p);
+        for (uint32_t d = 1; d < best; d++) {
+            if (p >= begin + d)
+                best = std::min(best, std::max(d, distAt(p - d)));
+            if (p + d < end)
+                best = std::min(best, std::max(d, distAt(p + d)));
+        }
+        return uint8_t(best);
+    };
+    std::vector<uint8_t> distXY(distX.size());
+    forEachParallel(slices.begin(), slices.end(), [&](uint32_t z) {
+        for (uint32_t y = lo[1]; y < hi[1]; y++) {
+            for (uint32_t x = lo[0]; x < hi[0]; x++) {
+                at(distXY, x, y, z) = minMax(
+                    [&](uint32_t q) -> uint32_t { return at(distX, x, q, z); },
+                    y, outerLo[1], outerHi[1]);
+            }
+        }
+    });
+    slices.resize(hi[2] - lo[2]);
+    std::iota(slices.begin(), slices.end(), lo[2]);
+    forEachParallel(slices.begin(), slices.end(), [&](uint32_t z) {
+        for (uint32_t y = lo[1]; y < hi[1]; y++) {
+            for (uint32_t x = lo[0]; x < hi[0]; x++) {
+                mDistances[getCellIndex(x, y, z)] = minMax(
+                    [&](uint32_t q) -> uint32_t { return at(distXY, x, y, q); },
+                    z, outerLo[2], outerHi[2]);
+            }
+        }
+    });
+}
+
+uint8_t OccupancyGrid::getDistance(int32_t cx, int32_t cy, int32_t cz) const {
+    if (cx < 0 || cy < 0 || cz < 0 || cx >= int32_t(mGrid[0]) ||
+        cy >= int32_t(mGrid[1]) || cz >= int32_t(mGrid[2]))
+        return 0;
+    return mDistances[getCellIndex(cx, cy, cz)];
+}
+
+void OccupancyGrid::copyRegion(const Region& region,
+                               std::span<uint8_t> dst) const {
+    uint8_t* pDst = dst.data();
+    for (uint32_t z = 0; z < region.size[2]; z++) {
+        for (uint32_t y = 0; y < region.size[1]; y++) {
+            const uint8_t* pSrc =
+                mDistances.data() +
+                getCellIndex(region.offset[0], region.offset[1] + y,
+                             region.offset[2] + z);
+            pDst = std::copy(pSrc, pSrc + region.size[0], pDst);
+        }
+    }
+}
+
+float OccupancyGrid::getOccupiedFraction() const {
+    if (mOccupied.empty()) return 0.f;
+    size_t count = std::count(mOccupied.begin(), mOccupied.end(), 1);
+    return float(count) / float(mOccupied.size());
+}
+} // namespace Voluma
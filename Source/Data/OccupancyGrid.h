@@ -0,0 +1,92 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "Core/Macros.h"
+#include "Data/MinMaxOctree.h"
+
+namespace Voluma {
+/** Occupancy grid and Chebyshev distance field for empty space skipping.
+ *
+ * Cells are the leaves of a MinMaxOctree, whose max bounds every trilinear
+ * sample in the cell. A cell is occupied if it may hold a sample at or above
+ * the threshold. Every cell stores the Chebyshev distance in cells to the
+ * closest occupied cell, clamped to kMaxDistance, which lets a ray marcher
+ * leap over the cube of empty cells around it.
+ *
+ * Changing the threshold only flips the cells whose max lies between the old
+ * and the new threshold, and only distances within kMaxDistance of a flipped
+ * cell are recomputed.
+ */
+class VL_API OccupancyGrid {
+   public:
+    using SharedPtr = std::shared_ptr<OccupancyGrid>;
+
+    static constexpr uint32_t kCellSize = MinMaxOctree::kLeafSize;
+    static constexpr uint8_t kMaxDistance = 16;
+
+    /** Box of cells, e.g. the cells whose distance changed.
+     */
+    struct Region {
+        std::array<uint32_t, 3> offset = {};
+        std::array<uint32_t, 3> size = {};
+
+        bool isEmpty() const { return size[0] * size[1] * size[2] == 0; }
+        size_t getCellCount() const {
+            return size_t(size[0]) * size[1] * size[2];
+        }
+    };
+
+    /** Create a grid over the leaves of a min/max octree, cells are the
+     * leaves. The grid starts with every cell occupied, call setThreshold to
+     * classify.
+     */
+    static SharedPtr create(const MinMaxOctree& octree);
+
+    const std::array<uint32_t, 3>& getGrid() const { return mGrid; }
+    float getThreshold() const { return mThreshold; }
+
+    /** Reclassify the cells for a modality threshold and update the distance
+     * field, returns the region of cells whose distance changed.
+     */
+    Region setThreshold(float threshold);
+
+    uint32_t getCellIndex(uint32_t cx, uint32_t cy, uint32_t cz) const {
+        return (cz * mGrid[1] + cy) * mGrid[0] + cx;
+    }
+
+    /** Get the distances in X-Y-Z cell order, ready for a R8_UINT upload.
+     */
+    std::span<const uint8_t> getDistances() const { return mDistances; }
+
+    /** Get the distance of a cell, 0 outside of the grid so rays leaving the
+     * volume are never skipped past it.
+     */
+    uint8_t getDistance(int32_t cx, int32_t cy, int32_t cz) const;
+
+    /** Copy the distances of a region tightly packed, dst must hold
+     * region.getCellCount() cells.
+     */
+    void copyRegion(const Region& region, std::span<uint8_t> dst) const;
+
+    /** Fraction of cells that are occupied.
+     */
+    float getOccupiedFraction() const;
+
+   private:
+    OccupancyGrid() = default;
+
+    /** Recompute the distances of a region from the occupancy around it.
+     */
+    void updateDistances(const Region& region);
+
+    std::array<uint32_t, 3> mGrid = {};
+    float mThreshold = 0.f;
+    std::vector<float> mCellMax;    ///< Max modality value per cell
+    std::vector<uint8_t> mOccupied; ///< 1 if the cell max >= threshold
+    std::vector<uint8_t> mDistances;
+};
+} // namespace Voluma
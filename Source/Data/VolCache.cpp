@@ -0,0 +1,323 @@
+#include "VolCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <type_traits>
+
+#include "Data/VolData.h"
+#include "Utils/FileUtils.h"
+#include "Utils/Hash.h"
+#include "Utils/Logger.h"
+#include "Utils/MappedFile.h"
+
+namespace Voluma {
+static_assert(std::is_trivially_copyable_v<VolCache::Header>);
+static_assert(std::is_trivially_copyable_v<VolCache::SliceRecord>);
+
+static constexpr char kMagic[8] = {'V', 'L', 'V', 'O', 'L', 'C', 'H', 0};
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+template <size_t N>
+static void copyString(char (&dst)[N], const std::string& src) {
+    size_t len = std::min(src.size(), N - 1);
+    std::memcpy(dst, src.data(), len);
+    dst[len] = '\0';
+}
+
+uint64_t VolCache::computeContentKey(const std::vector<std::string>& files) {
+    std::vector<std::string> sortedFiles = files;
+    std::sort(sortedFiles.begin(), sortedFiles.end());
+
+    uint64_t hash = kFnvOffsetBasis;
+    hash = hashBytes(hash, &kVersion, sizeof(kVersion));
+    for (const auto& file : sortedFiles) {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(file, ec);
+        int64_t mtime = std::filesystem::last_write_time(file, ec)
+                            .time_since_epoch()
+                            .count();
+        hash = hashBytes(hash, file.data(), file.size());
+        hash = hashBytes(hash, &size, sizeof(size));
+        hash = hashBytes(hash, &mtime, sizeof(mtime));
+    }
+    return hash;
+}
+
+std::filesystem::path VolCache::getCacheDir() { return getUserCacheDir(); }
+
+std::filesystem::path VolCache::getCachePath(uint64_t contentKey) {
+    auto dir = getCacheDir();
+    if (dir.empty()) return dir;
+    return dir / fmt::format("{:016x}.vlvol", contentKey);
+}
+
+std::shared_ptr<VolData> VolCache::load(const std::filesystem::path& path,
+                                        uint64_t contentKey) {
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) return nullptr;
+
+    auto pFile = MappedFile::open(path);
+    if (!pFile || pFile->getSize() < sizeof(Header)) return nullptr;
+
+    Header header;
+    std::memcpy(&header, pFile->getData(), sizeof(Header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion || header.headerSize != sizeof(Header) ||
+        header.contentKey != contentKey) {
+        logWarning("Volume cache {} is stale, ignored.", path.string());
+        return nullptr;
+    }
+
+    // The voxels are reinterpreted by the format, never trust a mismatch
+    VoxelFormat expectedFormat = header.pixelRepresentation == 1
+                                     ? VoxelFormat::Int16
+                                     : VoxelFormat::UInt16;
+    if (header.voxelFormat != uint32_t(expectedFormat)) {
+        logWarning("Volume cache {} has voxel format {}, expected {}, "
+                   "ignored.",
+                   path.string(), header.voxelFormat, expectedFormat);
+        return nullptr;
+    }
+
+    uint64_t voxelCount = uint64_t(header.dims[0]) * header.dims[1] *
+                          header.dims[2];
+    uint64_t sliceTableSize = uint64_t(header.dims[2]) * sizeof(SliceRecord);
+    if (header.voxelSize != voxelCount * sizeof(uint16_t) ||
+        header.voxelOffset % alignof(uint16_t) != 0 ||
+        header.voxelOffset + header.voxelSize > pFile->getSize() ||
+        header.sliceTableOffset + sliceTableSize > pFile->getSize()) {
+        logWarning("Volume cache {} is truncated, ignored.", path.string());
+        return nullptr;
+    }
+
+    auto pVolData = std::make_shared<VolData>();
+
+    auto& meta = pVolData->mMetaData;
+    meta.rowCount = header.rowCount;
+    meta.colCount = header.colCount;
+    meta.pixelSpaceV = header.pixelSpaceV;
+    meta.pixelSpaceH = header.pixelSpaceH;
+    meta.rescaleIntercept = header.rescaleIntercept;
+    meta.rescaleSlope = header.rescaleSlope;
+    meta.pixelRepresentation = uint16_t(header.pixelRepresentation);
+
+    auto& patient = pVolData->mPatientData;
+    patient.id = header.patientId;
+    patient.name = header.patientName;
+    patient.birthDate = header.patientBirthDate;
+    patient.gender = Gender(header.patientGender);
+
+    pVolData->mMinValue = header.minValue;
+    pVolData->mMaxValue = header.maxValue;
+
+    pVolData->mVolumeSliceData.resize(header.dims[2]);
+    for (uint32_t i = 0; i < header.dims[2]; i++) {
+        SliceRecord record;
+        std::memcpy(&record,
+                    pFile->getData() + header.sliceTableOffset +
+                        i * sizeof(SliceRecord),
+                    sizeof(SliceRecord));
+        auto& slice = pVolData->mVolumeSliceData[i];
+        slice.mLocation = record.location;
+        slice.mThickness = record.thickness;
+        slice.mMinPixelValue = record.minValue;
+        slice.mMaxPixelValue = record.maxValue;
+    }
+
+    pVolData->mVoxels = std::span<const uint16_t>(
+        reinterpret_cast<const uint16_t*>(pFile->getData() +
+                                          header.voxelOffset),
+        voxelCount);
+    pVolData->mpMappedFile = pFile;
+
+    // The chain is skipped if inconsistent, the caller builds it again
+    if (header.mipLevelCount > 0) {
+        auto chainDims = VolData::getMipChainDims(
+            {header.dims[0], header.dims[1], header.dims[2]});
+        auto mipFilter = MipFilter(header.mipFilter);
+        uint32_t channelCount = VolData::getMipChannelCount(mipFilter);
+        uint64_t mipSize = 0;
+        for (const auto& dims : chainDims)
+            mipSize += uint64_t(dims[0]) * dims[1] * dims[2] * channelCount *
+                       sizeof(uint16_t);
+        if (header.mipLevelCount == chainDims.size() &&
+            header.mipSize == mipSize &&
+            header.mipFilter <= uint32_t(MipFilter::MinMax) &&
+            header.mipOffset % alignof(uint16_t) == 0 &&
+            header.mipOffset + header.mipSize <= pFile->getSize()) {
+            const auto* pMipData = reinterpret_cast<const uint16_t*>(
+                pFile->getData() + header.mipOffset);
+            // A MinMax level is its max channel followed by its min one
+            for (const auto& dims : chainDims) {
+                VolData::MipLevel level;
+                level.dims = dims;
+                size_t levelSize = size_t(dims[0]) * dims[1] * dims[2];
+                level.voxels = std::span<const uint16_t>(pMipData, levelSize);
+                if (channelCount == 2)
+                    level.minVoxels = std::span<const uint16_t>(
+                        pMipData + levelSize, levelSize);
+                pMipData += levelSize * channelCount;
+                pVolData->mMipLevels.push_back(std::move(level));
+            }
+            pVolData->mMipFilter = mipFilter;
+        } else {
+            logWarning("Volume cache {} has an inconsistent mip chain, "
+                       "ignored.",
+                       path.string());
+        }
+    }
+
+    // Loads order the files for eviction
+    std::filesystem::last_write_time(
+        path, std::filesystem::file_time_type::clock::now(), ec);
+    return pVolData;
+}
+
+bool VolCache::write(const std::filesystem::path& path, const VolData& data,
+                     uint64_t contentKey) {
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    Header header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.headerSize = sizeof(Header);
+    header.contentKey = contentKey;
+
+    const auto& meta = data.getScanMetaData();
+    header.rowCount = meta.rowCount;
+    header.colCount = meta.colCount;
+    header.pixelSpaceV = meta.pixelSpaceV;
+    header.pixelSpaceH = meta.pixelSpaceH;
+    header.rescaleIntercept = meta.rescaleIntercept;
+    header.rescaleSlope = meta.rescaleSlope;
+    header.pixelRepresentation = meta.pixelRepresentation;
+
+    const auto& patient = data.getPatientData();
+    copyString(header.patientId, patient.id);
+    copyString(header.patientName, patient.name);
+    copyString(header.patientBirthDate, patient.birthDate);
+    header.patientGender = uint32_t(patient.gender);
+
+    header.voxelFormat = uint32_t(data.getVoxelFormat());
+    header.dims[0] = data.getColWidth();
+    header.dims[1] = data.getRowWidth();
+    header.dims[2] = data.getSliceCount();
+    header.minValue = data.mMinValue;
+    header.maxValue = data.mMaxValue;
+
+    auto voxels = data.getBufferData();
+    header.sliceTableOffset = sizeof(Header);
+    header.brickIndexOffset = 0;
+    header.brickIndexSize = 0;
+    header.voxelOffset =
+        alignUp(header.sliceTableOffset +
+                    data.mVolumeSliceData.size() * sizeof(SliceRecord),
+                kAlignment);
+    header.voxelSize = voxels.size_bytes();
+    header.mipFilter = uint32_t(data.getMipFilter());
+    header.mipLevelCount = data.getMipLevelCount() - 1;
+    header.mipOffset =
+        alignUp(header.voxelOffset + header.voxelSize, kAlignment);
+    header.mipSize = 0;
+    for (uint32_t level = 1; level <= header.mipLevelCount; level++) {
+        header.mipSize += data.getMipData(level).size_bytes() +
+                          data.getMipMinData(level).size_bytes();
+    }
+
+    // Write to a staging file first so a crash never leaves a valid header
+    // in front of partial voxel data.
+    auto tmpPath = getStagingPath(path);
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            logWarning("Failed to create volume cache {}.", tmpPath.string());
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        for (const auto& slice : data.mVolumeSliceData) {
+            SliceRecord record = {slice.mLocation, slice.mThickness,
+                                  slice.mMinPixelValue, slice.mMaxPixelValue};
+            file.write(reinterpret_cast<const char*>(&record),
+                       sizeof(SliceRecord));
+        }
+        std::vector<char> padding(header.voxelOffset - uint64_t(file.tellp()),
+                                  0);
+        file.write(padding.data(), padding.size());
+        file.write(reinterpret_cast<const char*>(voxels.data()),
+                   voxels.size_bytes());
+        padding.assign(header.mipOffset - uint64_t(file.tellp()), 0);
+        file.write(padding.data(), padding.size());
+        for (uint32_t level = 1; level <= header.mipLevelCount; level++) {
+            for (auto mipData :
+                 {data.getMipData(level), data.getMipMinData(level)}) {
+                file.write(reinterpret_cast<const char*>(mipData.data()),
+                           mipData.size_bytes());
+            }
+        }
+        if (!file) {
+            logWarning("Failed to write volume cache {}.", tmpPath.string());
+            file.close();
+            std::filesystem::remove(tmpPath, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    prune();
+    return true;
+}
+
+void VolCache::prune(uint64_t maxSize) {
+    struct CacheFile {
+        std::filesystem::path path;
+        std::filesystem::file_time_type lastUse;
+        uint64_t size;
+    };
+    std::vector<CacheFile> files;
+    uint64_t totalSize = 0;
+    auto now = std::filesystem::file_time_type::clock::now();
+
+    auto dir = getCacheDir();
+    if (dir.empty()) return;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        std::error_code entryEc;
+        auto lastUse = entry.last_write_time(entryEc);
+        uint64_t size = entry.file_size(entryEc);
+        if (entryEc) continue;
+        const auto& path = entry.path();
+        if (path.extension() == ".tmp") {
+            // Writers finish within minutes, older ones crashed
+            if (now - lastUse > std::chrono::hours(24))
+                std::filesystem::remove(path, entryEc);
+        } else if (path.extension() == ".vlvol" ||
+                   path.extension() == ".vlbrk") {
+            files.push_back({path, lastUse, size});
+            totalSize += size;
+        }
+    }
+
+    std::sort(files.begin(), files.end(),
+              [](const CacheFile& a, const CacheFile& b) {
+                  return a.lastUse < b.lastUse;
+              });
+    for (const auto& file : files) {
+        if (totalSize <= maxSize) break;
+        // Files mapped by another process may refuse deletion, skip them
+        if (std::filesystem::remove(file.path, ec)) {
+            logInfo("Evicted cache file {}.", file.path.string());
+            totalSize -= file.size;
+        }
+    }
+}
+} // namespace Voluma
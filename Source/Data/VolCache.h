@@ -0,0 +1,113 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Core/Macros.h"
+
+namespace Voluma {
+class VolData;
+
+/** Voluma-native binary volume cache.
+ *
+ * File layout:
+ *   VolCache::Header
+ *   VolCache::SliceRecord x sliceCount
+ *   brick index (optional, brickIndexSize bytes)
+ *   voxel data, aligned to kAlignment
+ *   mip chain (optional), levels 1 and coarser back to back, a MinMax
+ *     level as its max channel followed by its min channel
+ *
+ * The file is memory mapped on load and the voxel data is handed to VolData
+ * without copying. Files live in a per-user cache folder which is kept under
+ * kMaxSize by evicting the least recently loaded files after every write,
+ * the brick stores of the folder count towards the same budget.
+ * Removing the folder by hand is always safe, the volumes are rebuilt from
+ * their series.
+ */
+class VL_API VolCache {
+   public:
+    static constexpr uint32_t kVersion = 2;
+    static constexpr uint64_t kAlignment = 4096; ///< Voxel data alignment
+    static constexpr uint64_t kMaxSize = uint64_t(32) << 30; ///< Bytes
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint64_t contentKey; ///< Hash of the source folder content
+
+        // VolData::ScanMeta
+        uint32_t rowCount, colCount;
+        float pixelSpaceV, pixelSpaceH;
+        float rescaleIntercept, rescaleSlope;
+        uint32_t pixelRepresentation;
+
+        // PatientData
+        char patientId[64];
+        char patientName[128];
+        char patientBirthDate[16];
+        uint32_t patientGender;
+
+        // Voxels
+        uint32_t voxelFormat;
+        uint32_t dims[3];
+        int32_t minValue, maxValue; ///< Stored value
+
+        uint64_t sliceTableOffset;
+        uint64_t brickIndexOffset; ///< 0 if there is no brick index
+        uint64_t brickIndexSize;
+        uint64_t voxelOffset;
+        uint64_t voxelSize;
+
+        // Mip chain, the level dims follow from dims
+        uint32_t mipFilter;
+        uint32_t mipLevelCount; ///< Stored levels, 0 if there is no chain
+        uint64_t mipOffset;
+        uint64_t mipSize;
+    };
+
+    struct SliceRecord {
+        float location;
+        float thickness;
+        int32_t minValue, maxValue;
+    };
+
+    /** Compute a cheap content key from file names, sizes and modification
+     * times, no file content is read.
+     */
+    static uint64_t computeContentKey(const std::vector<std::string>& files);
+
+    /** Get the folder holding the cache files, the per-user cache folder
+     * of getUserCacheDir(). Empty if there is none.
+     */
+    static std::filesystem::path getCacheDir();
+
+    /** Get the cache file path of a content key, empty if there is no
+     * cache folder.
+     */
+    static std::filesystem::path getCachePath(uint64_t contentKey);
+
+    /** Map a cache file, returns nullptr if the cache is missing, does not
+     * match the content key or is inconsistent, so the caller rebuilds it.
+     * A stored mip chain is mapped as well. A loaded file becomes the most
+     * recently used one.
+     */
+    static std::shared_ptr<VolData> load(const std::filesystem::path& path,
+                                         uint64_t contentKey);
+
+    /** Write volume to a cache file and prune the cache, returns false on
+     * failure. The mip chain is stored if the volume has one.
+     */
+    static bool write(const std::filesystem::path& path, const VolData& data,
+                      uint64_t contentKey);
+
+    /** Delete the least recently used volume caches and brick stores until
+     * the rest fit in maxSize bytes, along with staging files left behind by
+     * crashed writes.
+     */
+    static void prune(uint64_t maxSize = kMaxSize);
+};
+} // namespace Voluma
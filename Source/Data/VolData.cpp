@@ -7,89 +7,365 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <execution>
 #include <filesystem>
 #include <iterator>
 #include <memory>
-#include <mutex>
+#include <numeric>
 #include <optional>
 #include <string>
 #include <vector>
 
 #include "Core/Error.h"
+#include "Data/BrickStore.h"
+#include "Data/DcmCatalog.h"
 #include "Data/DcmParser.h"
+#include "Data/IngestPipeline.h"
+#include "Data/MultiFrameIngest.h"
+#include "Data/VolCache.h"
+#include "Utils/FileUtils.h"
 #include "Utils/Image.h"
 #include "Utils/Logger.h"
+#include "Utils/Parallel.h"
+#include "Utils/VoxelKernels.h"
 #include "fmt/format.h"
 namespace Voluma {
 using ScanMeta = VolData::ScanMeta;
-bool ScanMeta::operator==(const ScanMeta& other) {
+bool ScanMeta::operator==(const ScanMeta& other) const {
     return rowCount == other.rowCount && colCount == other.colCount &&
            //? Should we verify float here
            pixelSpaceV == other.pixelSpaceV &&
            pixelSpaceH == other.pixelSpaceH &&
            rescaleIntercept == other.rescaleIntercept &&
-           rescaleSlope == other.rescaleSlope;
+           rescaleSlope == other.rescaleSlope &&
+           pixelRepresentation == other.pixelRepresentation;
 }
 
 std::string ScanMeta::toString() const {
-    return fmt::format("ScanMeta(res = ({}, {}), pixelSpace = ({}, {}))",
-                       rowCount, colCount, pixelSpaceH, pixelSpaceV);
+    return fmt::format(
+        "ScanMeta(res = ({}, {}), pixelSpace = ({}, {}), rescale = ({}, {}))",
+        rowCount, colCount, pixelSpaceH, pixelSpaceV, rescaleSlope,
+        rescaleIntercept);
 }
 
 std::shared_ptr<VolData> VolData::loadFromDisk(
-    const std::filesystem::path& folder) {
+    const std::filesystem::path& folder, const LoadOptions& options) {
+    // A known series is opened straight from the existing catalog, anything
+    // else refreshes the catalog first.
+    auto catalogPath = DcmCatalog::getCatalogPath(folder);
+    // Without a cache folder the catalog is rebuilt into a private temporary
+    // file, which goes away once it is mapped
+    bool isTempCatalog = catalogPath.empty();
+    if (isTempCatalog) {
+        std::error_code ec;
+        catalogPath = getStagingPath(
+            std::filesystem::temp_directory_path(ec) / "voluma.vlcat");
+    }
+    DcmCatalog::SharedPtr pCatalog;
+    std::optional<uint32_t> seriesIndex;
+    if (!options.seriesInstanceUid.empty() && !isTempCatalog) {
+        pCatalog = DcmCatalog::open(catalogPath);
+        if (pCatalog)
+            seriesIndex = pCatalog->findSeries(options.seriesInstanceUid);
+    }
+    if (!seriesIndex) {
+        pCatalog = DcmCatalog::update(folder, catalogPath);
+        if (isTempCatalog) {
+            std::error_code ec;
+            std::filesystem::remove(catalogPath, ec);
+        }
+        if (!pCatalog) {
+            logFatal("Failed to build the catalog of {}.", folder.string());
+        }
+        seriesIndex = options.seriesInstanceUid.empty()
+                          ? pCatalog->findLargestSeries({"CT"})
+                          : pCatalog->findSeries(options.seriesInstanceUid);
+    }
+    if (!seriesIndex) {
+        logFatal("No CT series {} found in {}.", options.seriesInstanceUid,
+                 folder.string());
+    }
+
+    const auto& series = pCatalog->getSeries(*seriesIndex);
+    logInfo("Loading series {} ({}) with {} files.",
+            pCatalog->getString(series.seriesInstanceUid),
+            pCatalog->getString(series.seriesDescription), series.sliceCount);
+    return loadSeries(pCatalog->getSeriesFiles(*seriesIndex), options);
+}
+
+std::shared_ptr<VolData> VolData::loadSeries(
+    const std::vector<std::string>& filePaths, const LoadOptions& options) {
+    auto isCancelled = [&]() {
+        return options.isCancelled && options.isCancelled();
+    };
     auto pVolData = std::make_shared<VolData>();
+    if (filePaths.empty()) {
+        logFatal("Series has no file to load.");
+    }
 
-    std::vector<std::string> filePaths;
-    for (const auto& entry : std::filesystem::directory_iterator(folder)) {
-        auto fn = entry.path();
-        if (entry.is_regular_file() && fn.extension() == ".dcm") {
-            filePaths.push_back((folder / fn.filename()).string());
+    // Reuse the volume cache if the series files are unchanged
+    uint64_t contentKey = VolCache::computeContentKey(filePaths);
+    auto cachePath = VolCache::getCachePath(contentKey);
+    if (auto pCached = VolCache::load(cachePath, contentKey)) {
+        logInfo("Loaded volume from cache {}.", cachePath.string());
+        if (options.onProgress)
+            options.onProgress(pCached->getSliceCount(),
+                               pCached->getSliceCount());
+        if (!pCached->exceedsBudget(options.memoryBudget) ||
+            !pCached->openOutOfCore(contentKey, options.memoryBudget)) {
+            // The mip chain is mapped from the cache unless it is missing or
+            // was built with another filter
+            if (pCached->getMipLevelCount() == 1 ||
+                pCached->getMipFilter() != options.mipFilter)
+                pCached->buildMips(options.mipFilter);
         }
+        pCached->buildHistogram();
+        return pCached;
     }
 
-    std::mutex addSliceMutex;
-
-    auto loadDcmData = [&](const std::string& fn, bool isFirst = false) {
+    // Pass 1: parse the header of every file, stop before the pixel data.
+    // Every file owns its slot so no synchronization is needed, multi-frame
+    // files expand into one slice per frame.
+    std::vector<std::vector<VolSlice>> fileSlices(filePaths.size());
+    auto loadDcmHeader = [&](std::vector<VolSlice>& slices,
+                             bool isFirst = false) {
+        if (isCancelled()) return;
+        const std::string& fn = filePaths[&slices - fileSlices.data()];
         DcmFileFormat dfile;
-        OFCondition result = dfile.loadFile(fn.c_str());
+        OFCondition result = dfile.loadFileUntilTag(
+            fn.c_str(), EXS_Unknown, EGL_noChange, DCM_MaxReadLength,
+            ERM_autoDetect, DCM_PixelData);
 
-        if (result.bad()) logError("Failed to load slice file {}.", fn);
+        if (result.bad()) {
+            logError("Failed to load slice file {}.", fn);
+            return;
+        }
 
-        auto* pDataset = dfile.getDataset();
-        DcmParser parser(pDataset);
+        DcmParser parser(dfile.getDataset());
+        SliceHeader header;
+        parser.extract(SliceHeader::getTagSet(), header);
+        if (header.numberOfFrames > 1) {
+            slices = MultiFrameIngest::readFrames(dfile.getDataset(), fn,
+                                                  header);
+        }
 
         if (isFirst) {
             // Read meta data from the first .dcm file
-            pVolData->mPatientData = pVolData->loadPatientData(parser);
-            pVolData->mMetaData = pVolData->loadScanMeta(parser);
+            pVolData->mPatientData = pVolData->loadPatientData(header);
+            pVolData->mMetaData = pVolData->loadScanMeta(header);
         } else {
             // Otherwise, verify the metadata and patient data
-            if (!pVolData->verify(parser))
+            if (!pVolData->verify(header))
                 logError(
                     "Slice file {} has divergent meta data with previous "
                     "ones.",
                     fn);
         }
-        {
-            std::unique_lock<std::mutex> lck(addSliceMutex);
-            pVolData->addSlice(VolSlice(parser));
+        if (header.numberOfFrames <= 1) {
+            slices.emplace_back(header);
+            slices.back().mFilePath = fn;
         }
     };
 
-    loadDcmData(filePaths[0], true);
-#if VL_MACOSX
-    std::for_each(filePaths.begin() + 1, filePaths.end(), loadDcmData);
-#else
-    std::for_each(std::execution::par_unseq, filePaths.begin() + 1, filePaths.end(), loadDcmData);
-#endif
+    auto headerStart = std::chrono::steady_clock::now();
+    loadDcmHeader(fileSlices[0], true);
+    forEachParallel(
+        fileSlices.begin() + 1, fileSlices.end(),
+        [&](std::vector<VolSlice>& slices) { loadDcmHeader(slices); });
+    if (isCancelled()) return nullptr;
+    logInfo("Parsed {} slice headers in {:.1f} ms.", fileSlices.size(),
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - headerStart)
+                .count());
+
+    // Flatten, unreadable files have no slices. Reorder slices by their
+    // location, only metadata is moved around here.
+    std::vector<VolSlice> slices;
+    for (auto& fileSlice : fileSlices) {
+        std::move(fileSlice.begin(), fileSlice.end(),
+                  std::back_inserter(slices));
+    }
+    std::sort(slices.begin(), slices.end(),
+              [](const VolSlice& s1, const VolSlice& s2) {
+                  if (s1.mLocation != s2.mLocation)
+                      return s1.mLocation < s2.mLocation;
+                  return s1.mInstanceNumber < s2.mInstanceNumber;
+              });
+    pVolData->mVolumeSliceData = std::move(slices);
+    uint32_t sliceCount = pVolData->getSliceCount();
+
+    std::atomic<uint32_t> loadedCount = 0;
+    auto onSliceDone = [&](uint32_t) {
+        uint32_t loaded = ++loadedCount;
+        if (options.onProgress) options.onProgress(loaded, sliceCount);
+    };
+
+    // The decode workers count the histogram as they place the slices
+    bool isSigned = pVolData->getVoxelFormat() == VoxelFormat::Int16;
+
+    // Single-frame files go through the staged pipeline, frames of
+    // multi-frame files are extracted from their file directly.
+    IngestPipeline pipeline(*pVolData, options.pipeline);
+    MultiFrameIngest frameIngest(*pVolData, options.pipeline.parserCount);
+    auto ingest = [&](std::span<const uint32_t> sliceIndices) {
+        std::vector<uint32_t> fileIndices, frameIndices;
+        for (uint32_t i : sliceIndices) {
+            if (pVolData->mVolumeSliceData[i].isFrame())
+                frameIndices.push_back(i);
+            else
+                fileIndices.push_back(i);
+        }
+        pipeline.run(fileIndices, isCancelled, onSliceDone);
+        frameIngest.run(frameIndices, isCancelled, onSliceDone);
+    };
+
+    // Pass 2 over budget: decode slab by slab straight into the brick store
+    // so the whole volume is never held in memory, a series already in the
+    // store is not decoded at all. No preview is published.
+    if (pVolData->exceedsBudget(options.memoryBudget)) {
+        auto storePath = BrickStore::getStorePath(contentKey);
+        BrickStore::SharedPtr pStore;
+        if (!storePath.empty())
+            pStore = BrickStore::open(storePath, contentKey);
+        if (pStore && pStore->getSliceRanges().size() != sliceCount)
+            pStore = nullptr;
+        if (pStore) {
+            auto sliceRanges = pStore->getSliceRanges();
+            for (uint32_t i = 0; i < sliceCount; i++) {
+                VolSlice& slice = pVolData->mVolumeSliceData[i];
+                slice.mMinPixelValue = sliceRanges[i].minValue;
+                slice.mMaxPixelValue = sliceRanges[i].maxValue;
+            }
+            logInfo("Opened brick store {}.", storePath.string());
+            if (options.onProgress)
+                options.onProgress(sliceCount, sliceCount);
+        } else if (!storePath.empty()) {
+            pVolData->mpHistogramAccumulator =
+                std::make_unique<Histogram::Accumulator>(isSigned);
+            pStore = pVolData->ingestBrickStore(storePath, contentKey, ingest,
+                                                isCancelled);
+            if (isCancelled()) return nullptr;
+            pipeline.logStats();
+            frameIngest.logStats();
+        }
+        if (pStore) {
+            pVolData->streamFrom(pStore, options.memoryBudget);
+            pVolData->finalize();
+            pVolData->buildHistogram();
+            return pVolData;
+        }
+        logWarning("No brick store for the volume, it is decoded into "
+                   "memory.");
+        loadedCount = 0;
+    }
+
+    // Pass 2: size the volume once and decode every file into its Z slab.
+    // Every previewStride-th slice is decoded first so a coarse preview can be
+    // published before the whole series is in.
+    pVolData->mBufferData.resize(pVolData->getVolumeSize());
+    pVolData->mpHistogramAccumulator =
+        std::make_unique<Histogram::Accumulator>(isSigned);
+    uint32_t previewStride =
+        options.onPreview ? std::max(options.previewStride, 1u) : 1u;
+
+    std::vector<uint32_t> decodeOrder(sliceCount);
+    std::iota(decodeOrder.begin(), decodeOrder.end(), 0u);
+    auto restBegin = std::stable_partition(
+        decodeOrder.begin(), decodeOrder.end(),
+        [=](uint32_t i) { return i % previewStride == 0; });
+
+    ingest({decodeOrder.begin(), restBegin});
+    if (isCancelled()) return nullptr;
+    if (options.onPreview && previewStride > 1) {
+        options.onPreview(pVolData->createPreview(previewStride));
+    }
+    ingest({restBegin, decodeOrder.end()});
+    if (isCancelled()) return nullptr;
+    pipeline.logStats();
+    frameIngest.logStats();
+
     pVolData->finalize();
+    // The mip chain is cached along with the voxels
+    pVolData->buildMips(options.mipFilter);
+    if (!cachePath.empty() &&
+        VolCache::write(cachePath, *pVolData, contentKey)) {
+        logInfo("Wrote volume cache {}.", cachePath.string());
+    }
+    pVolData->buildHistogram();
+    return pVolData;
+}
+
+std::shared_ptr<VolData> VolData::createFromVoxels(
+    const ScanMeta& meta, uint32_t sliceCount, float sliceThickness,
+    std::vector<uint16_t> voxels) {
+    auto pVolData = std::make_shared<VolData>();
+    pVolData->mMetaData = meta;
+    pVolData->mVolumeSliceData.resize(sliceCount);
+    for (uint32_t z = 0; z < sliceCount; z++) {
+        VolSlice& slice = pVolData->mVolumeSliceData[z];
+        slice.mLocation = float(z) * sliceThickness;
+        slice.mThickness = sliceThickness;
+        slice.mInstanceNumber = int32_t(z);
+    }
+    if (voxels.size() != pVolData->getVolumeSize())
+        logFatal("createFromVoxels: {} voxels given for a {}x{}x{} volume.",
+                 voxels.size(), meta.colCount, meta.rowCount, sliceCount);
+    pVolData->mBufferData = std::move(voxels);
+    for (uint32_t z = 0; z < sliceCount; z++) pVolData->updateSliceRange(z);
 
+    pVolData->finalize();
+    pVolData->buildMips(MipFilter::MinMax);
+    pVolData->buildHistogram();
     return pVolData;
 }
 
+std::span<uint16_t> VolData::getSliceBuffer(uint32_t index) {
+    size_t sliceSize = size_t(getRowWidth()) * getColWidth();
+    return {mBufferData.data() + sliceSize * (index - mBufferBeginZ),
+            sliceSize};
+}
+
+void VolData::updateSliceRange(uint32_t index) {
+    VolSlice& slice = mVolumeSliceData[index];
+    auto pixels = getSliceBuffer(index);
+
+    VoxelKernels::MinMax range;
+    if (getVoxelFormat() == VoxelFormat::Int16) {
+        range = VoxelKernels::computeMinMax(std::span<const int16_t>(
+            reinterpret_cast<const int16_t*>(pixels.data()), pixels.size()));
+    } else {
+        range = VoxelKernels::computeMinMax(pixels);
+    }
+    slice.mMinPixelValue = std::min(range.min, slice.mMinPixelValue);
+    slice.mMaxPixelValue = std::max(range.max, slice.mMaxPixelValue);
+    if (mpHistogramAccumulator) mpHistogramAccumulator->add(pixels);
+}
+
+void VolData::getSliceValues(uint32_t index, std::span<float> dst, float slope,
+                             float intercept) const {
+    size_t sliceSize = size_t(getRowWidth()) * getColWidth();
+    std::span<const uint16_t> pixels;
+    std::vector<uint16_t> streamedPixels;
+    if (mpBrickCache) {
+        streamedPixels.resize(sliceSize);
+        mpBrickCache->readSlice(index, streamedPixels);
+        pixels = streamedPixels;
+    } else {
+        pixels = mVoxels.subspan(sliceSize * index, sliceSize);
+    }
+    if (getVoxelFormat() == VoxelFormat::Int16) {
+        VoxelKernels::convert(
+            std::span<const int16_t>(
+                reinterpret_cast<const int16_t*>(pixels.data()),
+                pixels.size()),
+            dst, slope, intercept);
+    } else {
+        VoxelKernels::convert(pixels, dst, slope, intercept);
+    }
+}
+
 void VolData::saveSlice(const std::filesystem::path& filename,
                         int index) const {
     if (filename.extension() != ".exr") {
@@ -99,102 +375,423 @@ void VolData::saveSlice(const std::filesystem::path& filename,
     VL_ASSERT(index < mVolumeSliceData.size());
     const VolSlice& slice = mVolumeSliceData[index];
 
+    // Normalize the stored values by the slice range
+    float range =
+        std::max(float(slice.mMaxPixelValue - slice.mMinPixelValue), 1.f);
+    std::vector<float> values(size_t(getRowWidth()) * getColWidth());
+    getSliceValues(index, values, 1.f / range,
+                   -float(slice.mMinPixelValue) / range);
+    VoxelKernels::clamp(values, 0.f, 1.f);
+
     Image image(getColWidth(), getRowWidth(), 1, ColorSpace::Linear);
     for (int i = 0; i < image.getArea(); i++) {
-        float normalizedVal =
-            float(slice.mRawData[i]) /
-            float(slice.mMaxPixelValue - slice.mMinPixelValue);
-        image.setPixel(i, 0, normalizedVal);
+        image.setPixel(i, 0, values[i]);
     }
     image.writeEXR(filename);
 }
 
-PatientData VolData::loadPatientData(const DcmParser& parser) const {
-    // Initialize patient data
-    std::string id, name, birthDate;
-
-    id = parser.getString(DCM_PatientID);
-    name = parser.getString(DCM_PatientName);
-    birthDate = parser.getString(DCM_PatientBirthDate);
-
-    std::string genderStr = parser.getString(DCM_PatientSex);
-    auto gender = (genderStr == "M")   ? Gender::Male
-                  : (genderStr == "F") ? Gender::Female
-                                       : Gender::Others;
+PatientData VolData::loadPatientData(const SliceHeader& header) const {
+    auto gender = (header.patientSex == "M")   ? Gender::Male
+                  : (header.patientSex == "F") ? Gender::Female
+                                               : Gender::Others;
 
     PatientData pd;
-    pd.id = id;
-    pd.name = name;
-    pd.birthDate = birthDate;
+    pd.id = header.patientId;
+    pd.name = header.patientName;
+    pd.birthDate = header.patientBirthDate;
     pd.gender = gender;
     return pd;
 }
 
-ScanMeta VolData::loadScanMeta(const DcmParser& parser) const {
-    uint32_t rows, cols;
-    float pixelSpaceV, pixelSpaceH;
-    float rescaleIntercept, rescaleSlope;
-
-    rows = parser.getU16(DCM_Rows);
-    cols = parser.getU16(DCM_Columns);
-
-    std::string pixelSpace = parser.getString(DCM_PixelSpacing);
-    auto segEnd = pixelSpace.find('\\');
-    pixelSpaceH = std::stof(pixelSpace.substr(0, segEnd));
-    pixelSpaceV = std::stof(pixelSpace.substr(segEnd + 1));
-
-    rescaleIntercept = (float)parser.getF64(DCM_RescaleIntercept);
-    rescaleSlope = (float)parser.getF64(DCM_RescaleSlope);
-
+ScanMeta VolData::loadScanMeta(const SliceHeader& header) const {
     ScanMeta meta;
-    meta.rowCount = rows;
-    meta.colCount = cols;
-    meta.pixelSpaceV = pixelSpaceV;
-    meta.pixelSpaceH = pixelSpaceH;
-    meta.rescaleIntercept = rescaleIntercept;
-    meta.rescaleSlope = rescaleSlope;
+    meta.rowCount = header.rows;
+    meta.colCount = header.columns;
+
+    // PixelSpacing is "row spacing\column spacing"
+    meta.pixelSpaceV =
+        header.pixelSpacing.size() > 0 ? (float)header.pixelSpacing[0] : 1.f;
+    meta.pixelSpaceH = header.pixelSpacing.size() > 1
+                           ? (float)header.pixelSpacing[1]
+                           : meta.pixelSpaceV;
+
+    meta.rescaleIntercept = (float)header.rescaleIntercept;
+    meta.rescaleSlope = (float)header.rescaleSlope;
+    // Slope is absent for modalities without rescaling
+    if (meta.rescaleSlope == 0.f) meta.rescaleSlope = 1.f;
+
+    meta.pixelRepresentation = header.pixelRepresentation;
     return meta;
 }
 
-void VolData::addSlice(VolSlice&& slice) {
-    mVolumeSliceData.emplace_back(std::move(slice));
-}
-
-bool VolData::verify(const DcmParser& parser) const {
+bool VolData::verify(const SliceHeader& header) const {
     bool isSame = true;
     // Verify patient id
-    isSame |= mPatientData.id == parser.getString(DCM_PatientID);
+    isSame &= mPatientData.id == header.patientId;
 
-    auto meta = loadScanMeta(parser);
     // Verify slice meta data
-    isSame |= mMetaData == meta;
+    isSame &= mMetaData == loadScanMeta(header);
 
     return isSame;
 }
 
-void VolData::finalize() {
-    // Reorder slices by their location
-    std::sort(mVolumeSliceData.begin(), mVolumeSliceData.end(),
-              [](const VolSlice& s1, const VolSlice& s2) {
-                  return s1.mLocation <= s2.mLocation;
-              });
+std::string VolData::IngestStats::toString() const {
+    uint64_t slices = std::max<uint64_t>(sliceCount, 1);
+    return fmt::format(
+        "IngestStats(slices = {}, allocations/slice = {:.2f}, bytes "
+        "copied/slice = {}, bytes read/slice = {})",
+        sliceCount, double(heapAllocations) / slices, bytesCopied / slices,
+        bytesRead / slices);
+}
 
-    mBufferData.reserve(getVolumeSize());
+VolData::IngestStats VolData::getIngestStats() const {
+    IngestStats stats;
+    stats.sliceCount = mIngestCounters.sliceCount;
+    stats.heapAllocations = mIngestCounters.heapAllocations;
+    stats.bytesCopied = mIngestCounters.bytesCopied;
+    stats.bytesRead = mIngestCounters.bytesRead;
+    return stats;
+}
 
-    for (const auto& slice : mVolumeSliceData) {
-        std::transform(slice.mRawData.begin(), slice.mRawData.end(),
-                       std::back_inserter(mBufferData),
-                       [](uint16_t v) { return float(v); });
+std::shared_ptr<VolData> VolData::createPreview(uint32_t stride) const {
+    auto pPreview = std::make_shared<VolData>();
+    pPreview->mPatientData = mPatientData;
+    pPreview->mMetaData = mMetaData;
+    pPreview->mMetaData.rowCount = (getRowWidth() + stride - 1) / stride;
+    pPreview->mMetaData.colCount = (getColWidth() + stride - 1) / stride;
+    pPreview->mMetaData.pixelSpaceV *= float(stride);
+    pPreview->mMetaData.pixelSpaceH *= float(stride);
+
+    for (size_t z = 0; z < mVolumeSliceData.size(); z += stride) {
+        const VolSlice& slice = mVolumeSliceData[z];
+        VolSlice previewSlice;
+        previewSlice.mFilePath = slice.mFilePath;
+        previewSlice.mLocation = slice.mLocation;
+        previewSlice.mThickness = slice.mThickness * float(stride);
+        previewSlice.mInstanceNumber = slice.mInstanceNumber;
+        previewSlice.mFrameIndex = slice.mFrameIndex;
+        previewSlice.mMinPixelValue = slice.mMinPixelValue;
+        previewSlice.mMaxPixelValue = slice.mMaxPixelValue;
+        pPreview->mVolumeSliceData.push_back(std::move(previewSlice));
+    }
+
+    // Point sample every stride-th voxel of the decoded slices
+    uint32_t width = pPreview->getColWidth();
+    uint32_t height = pPreview->getRowWidth();
+    pPreview->mBufferData.resize(pPreview->getVolumeSize());
+    uint16_t* pDst = pPreview->mBufferData.data();
+    for (size_t z = 0; z < mVolumeSliceData.size(); z += stride) {
+        const uint16_t* pSrc =
+            mBufferData.data() + size_t(getRowWidth()) * getColWidth() * z;
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                *pDst++ = pSrc[size_t(y) * stride * getColWidth() +
+                               size_t(x) * stride];
+            }
+        }
+    }
+    pPreview->finalize();
+    pPreview->buildMips(MipFilter::MinMax);
+    pPreview->buildHistogram();
+    return pPreview;
+}
+
+std::array<uint32_t, 3> VolData::getMipDims(uint32_t level) const {
+    if (level == 0)
+        return {uint32_t(getColWidth()), uint32_t(getRowWidth()),
+                uint32_t(getSliceCount())};
+    return mMipLevels[level - 1].dims;
+}
+
+std::vector<std::array<uint32_t, 3>> VolData::getMipChainDims(
+    const std::array<uint32_t, 3>& baseDims) {
+    std::vector<std::array<uint32_t, 3>> chainDims;
+    auto dims = baseDims;
+    while (dims[0] > 1 || dims[1] > 1 || dims[2] > 1) {
+        for (int i = 0; i < 3; i++) dims[i] = std::max(dims[i] / 2, 1u);
+        chainDims.push_back(dims);
+    }
+    return chainDims;
+}
+
+void VolData::buildMips(MipFilter filter) {
+    auto start = std::chrono::steady_clock::now();
+    mMipLevels.clear();
+    mMipFilter = filter;
+    bool isSigned = getVoxelFormat() == VoxelFormat::Int16;
+    auto decode = [=](uint16_t v) {
+        return isSigned ? int32_t(int16_t(v)) : int32_t(v);
+    };
+
+    bool isMinMax = filter == MipFilter::MinMax;
+    auto srcDims = getMipDims(0);
+    for (const auto& levelDims : getMipChainDims(srcDims)) {
+        MipLevel level;
+        level.dims = levelDims;
+        const auto& dims = level.dims;
+        size_t levelSize = size_t(dims[0]) * dims[1] * dims[2];
+        level.buffer.resize(levelSize * getMipChannelCount(filter));
+        level.voxels = {level.buffer.data(), levelSize};
+        if (isMinMax)
+            level.minVoxels = {level.buffer.data() + levelSize, levelSize};
+
+        // Output voxel i covers [i * src / dst, (i + 1) * src / dst), which
+        // is 2 voxels, 3 at the end of an odd axis and 1 on a flat axis.
+        auto footprint = [&](int axis, uint32_t i) {
+            return std::pair<uint32_t, uint32_t>(
+                uint32_t(uint64_t(i) * srcDims[axis] / dims[axis]),
+                uint32_t(uint64_t(i + 1) * srcDims[axis] / dims[axis]));
+        };
+
+        // The min of a MinMax level comes from the min channel below it
+        auto src = getMipData(getMipLevelCount() - 1);
+        auto minSrc = getMipMinData(getMipLevelCount() - 1);
+        std::vector<uint32_t> slices(dims[2]);
+        std::iota(slices.begin(), slices.end(), 0u);
+        forEachParallel(slices.begin(), slices.end(), [&](uint32_t z) {
+            auto [z0, z1] = footprint(2, z);
+            size_t dstIndex = size_t(z) * dims[0] * dims[1];
+            for (uint32_t y = 0; y < dims[1]; y++) {
+                auto [y0, y1] = footprint(1, y);
+                for (uint32_t x = 0; x < dims[0]; x++, dstIndex++) {
+                    auto [x0, x1] = footprint(0, x);
+                    int64_t sum = 0;
+                    int32_t minValue = std::numeric_limits<int32_t>::max();
+                    int32_t maxValue = std::numeric_limits<int32_t>::min();
+                    for (uint32_t sz = z0; sz < z1; sz++) {
+                        for (uint32_t sy = y0; sy < y1; sy++) {
+                            size_t row =
+                                (size_t(sz) * srcDims[1] + sy) * srcDims[0];
+                            for (uint32_t sx = x0; sx < x1; sx++) {
+                                int32_t v = decode(src[row + sx]);
+                                sum += v;
+                                maxValue = std::max(maxValue, v);
+                                if (isMinMax)
+                                    minValue = std::min(
+                                        minValue, decode(minSrc[row + sx]));
+                            }
+                        }
+                    }
+                    int32_t value = maxValue;
+                    if (filter == MipFilter::Box) {
+                        int64_t count =
+                            int64_t(x1 - x0) * (y1 - y0) * (z1 - z0);
+                        value = int32_t(std::llround(double(sum) / count));
+                    }
+                    level.buffer[dstIndex] = uint16_t(value);
+                    if (isMinMax)
+                        level.buffer[levelSize + dstIndex] =
+                            uint16_t(minValue);
+                }
+            }
+        });
+        srcDims = level.dims;
+        mMipLevels.push_back(std::move(level));
+    }
+
+    logInfo("Built {} mip levels with {} filter in {:.1f} ms.",
+            getMipLevelCount(), filter,
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start)
+                .count());
+}
 
+bool VolData::openOutOfCore(uint64_t contentKey, uint64_t memoryBudget) {
+    auto storePath = BrickStore::getStorePath(contentKey);
+    if (storePath.empty()) {
+        logWarning("No cache folder for a brick store, the volume is kept in "
+                   "memory.");
+        return false;
+    }
+    auto pStore = BrickStore::open(storePath, contentKey);
+    if (!pStore) {
+        // Bricks go to disk slab by slab straight from the voxels mapped
+        // from the volume cache
+        BrickStore::Writer writer(storePath, getMipDims(0),
+                                  getVoxelFormat() == VoxelFormat::Int16,
+                                  contentKey);
+        bool isWritten = writer.isOpen();
+        for (uint32_t bz = 0; bz < writer.getSlabCount() && isWritten; bz++)
+            isWritten = writer.writeSlab(bz, mVoxels, 0);
+        if (isWritten && writer.finish(getSliceRanges()))
+            pStore = BrickStore::open(storePath, contentKey);
+        if (!pStore) {
+            logWarning("Failed to write brick store {}, the volume is kept "
+                       "in memory.",
+                       storePath.string());
+            return false;
+        }
+        logInfo("Wrote brick store {}.", storePath.string());
+    }
+    streamFrom(pStore, memoryBudget);
+    return true;
+}
+
+std::vector<BrickStore::SliceRange> VolData::getSliceRanges() const {
+    std::vector<BrickStore::SliceRange> sliceRanges;
+    sliceRanges.reserve(mVolumeSliceData.size());
+    for (const auto& slice : mVolumeSliceData)
+        sliceRanges.push_back({slice.mMinPixelValue, slice.mMaxPixelValue});
+    return sliceRanges;
+}
+
+BrickStore::SharedPtr VolData::ingestBrickStore(
+    const std::filesystem::path& storePath, uint64_t contentKey,
+    const std::function<void(std::span<const uint32_t>)>& ingest,
+    const std::function<bool()>& isCancelled) {
+    BrickStore::Writer writer(storePath, getMipDims(0),
+                              getVoxelFormat() == VoxelFormat::Int16,
+                              contentKey);
+    if (!writer.isOpen()) return nullptr;
+
+    // A slab needs its slices plus the apron slices on both sides, the
+    // apron slices shared by two slabs are decoded once and carried over
+    constexpr uint32_t kSize = BrickedVolume::kBrickSize;
+    constexpr uint32_t kApron = BrickedVolume::kApron;
+    uint32_t sliceCount = getSliceCount();
+    size_t sliceSize = size_t(getRowWidth()) * getColWidth();
+    mBufferData.assign(
+        sliceSize * std::min(kSize + 2 * kApron, sliceCount), 0);
+    mBufferBeginZ = 0;
+    uint32_t decodedEnd = 0;
+    std::vector<uint32_t> sliceIndices;
+    bool isWritten = true;
+    for (uint32_t bz = 0; bz < writer.getSlabCount() && isWritten; bz++) {
+        uint32_t beginZ = bz * kSize > kApron ? bz * kSize - kApron : 0;
+        uint32_t endZ = std::min(bz * kSize + kSize + kApron, sliceCount);
+        uint16_t* pBuffer = mBufferData.data();
+        if (decodedEnd > beginZ) {
+            std::copy(pBuffer + sliceSize * (beginZ - mBufferBeginZ),
+                      pBuffer + sliceSize * (decodedEnd - mBufferBeginZ),
+                      pBuffer);
+        }
+        uint32_t decodeBeginZ = std::max(beginZ, decodedEnd);
+        // Failed slices read 0 like in a freshly allocated volume
+        std::fill(pBuffer + sliceSize * (decodeBeginZ - beginZ),
+                  pBuffer + sliceSize * (endZ - beginZ), uint16_t(0));
+        mBufferBeginZ = beginZ;
+
+        sliceIndices.resize(endZ - decodeBeginZ);
+        std::iota(sliceIndices.begin(), sliceIndices.end(), decodeBeginZ);
+        ingest(sliceIndices);
+        if (isCancelled()) break;
+        decodedEnd = endZ;
+        isWritten = writer.writeSlab(
+            bz, {pBuffer, sliceSize * (endZ - beginZ)}, beginZ);
+    }
+    std::vector<uint16_t>().swap(mBufferData);
+    mBufferBeginZ = 0;
+    if (isCancelled() || !isWritten) return nullptr;
+
+    if (!writer.finish(getSliceRanges())) return nullptr;
+    logInfo("Wrote brick store {}.", storePath.string());
+    return BrickStore::open(storePath, contentKey);
+}
+
+void VolData::streamFrom(BrickStore::SharedPtr pStore, uint64_t memoryBudget) {
+    mpBrickCache = std::make_shared<BrickCache>(pStore, memoryBudget);
+    mpBricks = nullptr;
+    mMipLevels.clear();
+    mVoxels = {};
+    std::vector<uint16_t>().swap(mBufferData);
+    mpMappedFile = nullptr;
+    logInfo("Streaming volume from its brick store, cache holds {}/{} "
+            "bricks.",
+            mpBrickCache->getCapacity(), pStore->getBrickCount());
+}
+
+TrilinearSample VolData::sampleValueGradient(float x, float y,
+                                             float z) const {
+    int32_t x0 = int32_t(std::floor(x));
+    int32_t y0 = int32_t(std::floor(y));
+    int32_t z0 = int32_t(std::floor(z));
+    auto cell = [&](int32_t cx, int32_t cy, int32_t cz) {
+        if (cx < 0 || cy < 0 || cz < 0 || cx >= int32_t(getColWidth()) ||
+            cy >= int32_t(getRowWidth()) || cz >= int32_t(getSliceCount()))
+            return toModalityValue(0);
+        return getVoxelValue(cx, cy, cz);
+    };
+    return trilinearValueGradient(
+        cell(x0, y0, z0), cell(x0 + 1, y0, z0), cell(x0, y0 + 1, z0),
+        cell(x0 + 1, y0 + 1, z0), cell(x0, y0, z0 + 1),
+        cell(x0 + 1, y0, z0 + 1), cell(x0, y0 + 1, z0 + 1),
+        cell(x0 + 1, y0 + 1, z0 + 1),
+        float3(x - float(x0), y - float(y0), z - float(z0)));
+}
+
+bool VolData::buildGradients() {
+    if (!mpGradients) mpGradients = GradientVolume::create(*this);
+    return mpGradients != nullptr;
+}
+
+void VolData::buildHistogram() {
+    if (mpHistogramAccumulator) {
+        mHistogram = mpHistogramAccumulator->finish(getVolumeSize());
+        mpHistogramAccumulator = nullptr;
+        return;
+    }
+    mHistogram = mpBrickCache
+                     ? Histogram::compute(*mpBrickCache->getStore())
+                     : Histogram::compute(
+                           mVoxels, getVoxelFormat() == VoxelFormat::Int16);
+}
+
+VolData::WindowLevel VolData::getAutoWindow(float lowPercentile,
+                                            float highPercentile) const {
+    if (mHistogram.isEmpty()) {
+        return {0.5f * (getMinValue() + getMaxValue()),
+                getMaxValue() - getMinValue()};
+    }
+    float low = toModalityValue(mHistogram.getPercentile(lowPercentile));
+    float high = toModalityValue(mHistogram.getPercentile(highPercentile));
+    if (low > high) std::swap(low, high);
+    return {0.5f * (low + high), std::max(high - low, 1.f)};
+}
+
+std::vector<VolData::TissuePreset> VolData::getTissuePresets() const {
+    std::vector<TissuePreset> presets;
+    if (mHistogram.isEmpty()) return presets;
+
+    uint32_t firstBin = mHistogram.toBin(mMinValue);
+    uint32_t lastBin = mHistogram.toBin(mMaxValue);
+    int32_t body = mHistogram.getOtsuThreshold(firstBin, lastBin);
+    int32_t dense =
+        mHistogram.getOtsuThreshold(mHistogram.toBin(body), lastBin);
+
+    auto getClassWindow = [&](int32_t low, int32_t high) {
+        uint32_t lowBin = mHistogram.toBin(low);
+        uint32_t highBin = std::max(mHistogram.toBin(high), lowBin);
+        float lowValue =
+            toModalityValue(mHistogram.getPercentile(0.01f, lowBin, highBin));
+        float highValue =
+            toModalityValue(mHistogram.getPercentile(0.99f, lowBin, highBin));
+        return WindowLevel{0.5f * (lowValue + highValue),
+                           std::max(highValue - lowValue, 1.f)};
+    };
+
+    presets.push_back({"Auto", toModalityValue(body), getAutoWindow()});
+    presets.push_back({"Soft tissue", toModalityValue(body),
+                       getClassWindow(body, dense - 1)});
+    presets.push_back({"Bone", toModalityValue(dense),
+                       getClassWindow(dense, mMaxValue)});
+    return presets;
+}
+
+void VolData::finalize() {
+    for (const auto& slice : mVolumeSliceData) {
         mMinValue = std::min(slice.mMinPixelValue, mMinValue);
         mMaxValue = std::max(slice.mMaxPixelValue, mMaxValue);
     }
 
-    logInfo("Min val: {}, max val: {}", mMinValue, mMaxValue);
-    if (mBufferData.size() != getVolumeSize()) {
+    logInfo("Min val: {}, max val: {}", getMinValue(), getMaxValue());
+    if (!mpBrickCache && mBufferData.size() != getVolumeSize()) {
         logError("Bad buffer data size!");
     }
-    mBufferData.shrink_to_fit();
+    mVoxels = mBufferData;
+
+    if (mIngestCounters.sliceCount > 0) {
+        logInfo("Ingest stats: {}", getIngestStats());
+    }
 }
 
 } // namespace Voluma
\ No newline at end of file
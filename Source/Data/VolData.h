@@ -3,18 +3,53 @@
 #include <dcmtk/dcmdata/dctk.h>
 #include <fmt/core.h>
 
+#include <array>
+#include <atomic>
+#include <cmath>
 #include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <limits>
+#include <memory>
+#include <span>
 #include <string>
+#include <vector>
 
 #include "Core/Enum.h"
+#include "Data/BrickCache.h"
+#include "Data/BrickedVolume.h"
 #include "Data/DcmParser.h"
+#include "Data/GradientVolume.h"
+#include "Data/Histogram.h"
+#include "Data/IngestPipeline.h"
 #include "Patient.h"
+#include "Utils/TrilinearGradient.slangh"
+#include "Utils/MappedFile.h"
 #include "VolSlice.h"
 
 namespace Voluma {
 
+/** Storage format of the voxels, voxels are kept as the stored DICOM value and
+ * converted to modality value(e.g. HU) with the rescale slope/intercept on
+ * access.
+ */
+enum class VoxelFormat { UInt16, Int16 };
+VL_ENUM_INFO(VoxelFormat, {{VoxelFormat::UInt16, "UInt16"},
+                           {VoxelFormat::Int16, "Int16"}})
+VL_ENUM_REGISTER(VoxelFormat);
+
+/** Downsampling filter of the volume mip chain.
+ */
+enum class MipFilter {
+    Box, ///< Average of the footprint
+    Max, ///< Max of the footprint, keeps thin bright structures for thresholds
+    MinMax, ///< Min and max of the footprint, the max is sampled like Max
+};
+VL_ENUM_INFO(MipFilter, {{MipFilter::Box, "Box"},
+                         {MipFilter::Max, "Max"},
+                         {MipFilter::MinMax, "MinMax"}})
+VL_ENUM_REGISTER(MipFilter);
+
 class VL_API VolData {
    public:
     struct ScanMeta {
@@ -28,7 +63,69 @@ class VL_API VolData {
         float rescaleIntercept;
         float rescaleSlope;
 
-        bool operator==(const ScanMeta& other);
+        uint16_t pixelRepresentation; ///< 0 - unsigned, 1 - two's complement
+
+        bool operator==(const ScanMeta& other) const;
+
+        std::string toString() const;
+    };
+
+    /** Options of a load, the hooks are called from the loader worker
+     * threads.
+     */
+    struct LoadOptions {
+        std::function<void(uint32_t loaded, uint32_t total)> onProgress;
+        std::function<bool()> isCancelled;
+        /// Receives a downsampled volume built from every previewStride-th
+        /// slice, published before the remaining slices are decoded.
+        std::function<void(std::shared_ptr<VolData>)> onPreview;
+        uint32_t previewStride = 4;
+        IngestPipeline::Desc pipeline; ///< Pixel ingest stage parallelism
+        /// Series to load from a folder, empty picks the largest CT series
+        std::string seriesInstanceUid;
+        MipFilter mipFilter = MipFilter::MinMax;
+        /// Host memory budget of the voxels in bytes, a larger volume is
+        /// streamed from a brick store on disk. 0 keeps it in memory.
+        uint64_t memoryBudget = 0;
+    };
+
+    /** Display window in modality unit.
+     */
+    struct WindowLevel {
+        float center;
+        float width;
+
+        float getLow() const { return center - 0.5f * width; }
+        float getHigh() const { return center + 0.5f * width; }
+    };
+
+    /** Threshold and window of a tissue class derived from the histogram.
+     */
+    struct TissuePreset {
+        std::string name;
+        float threshold; ///< Modality value
+        WindowLevel window;
+    };
+
+    /** Level of the volume mip chain, in X-Y-Z order like the base level.
+     */
+    struct MipLevel {
+        std::array<uint32_t, 3> dims;
+        std::vector<uint16_t> buffer;     ///< Owned voxels, empty if mapped
+        std::span<const uint16_t> voxels; ///< View of the level voxels
+        /// Footprint min of a MinMax level, voxels hold the max. Empty for
+        /// other filters.
+        std::span<const uint16_t> minVoxels;
+    };
+
+    /** Pixel ingest counters of the decode pass, per-slice numbers show
+     * whether pixels took the zero-copy path.
+     */
+    struct IngestStats {
+        uint64_t sliceCount = 0;
+        uint64_t heapAllocations = 0; ///< Pixel buffers allocated per slice
+        uint64_t bytesCopied = 0;     ///< Memory to memory pixel copies
+        uint64_t bytesRead = 0;       ///< Pixels read from file into volume
 
         std::string toString() const;
     };
@@ -37,20 +134,43 @@ class VL_API VolData {
 
     VolData(const VolData& d) = delete;
 
+    /** Load a DICOM series from a folder tree through its catalog, returns
+     * nullptr if the load is cancelled.
+     */
+    static std::shared_ptr<VolData> loadFromDisk(
+        const std::filesystem::path& folder, const LoadOptions& options);
+
     static std::shared_ptr<VolData> loadFromDisk(
-        const std::filesystem::path& folder);
+        const std::filesystem::path& folder) {
+        return loadFromDisk(folder, LoadOptions());
+    }
+
+    /** Load the files of a single series, returns nullptr if the load is
+     * cancelled.
+     */
+    static std::shared_ptr<VolData> loadSeries(
+        const std::vector<std::string>& filePaths, const LoadOptions& options);
+
+    /** Create a volume from voxels in memory, e.g. a synthetic volume.
+     * voxels holds meta.colCount x meta.rowCount x sliceCount voxels in
+     * X-Y-Z order, slices are sliceThickness apart. Bricks, mips and the
+     * histogram are built like for a loaded series.
+     */
+    static std::shared_ptr<VolData> createFromVoxels(
+        const ScanMeta& meta, uint32_t sliceCount, float sliceThickness,
+        std::vector<uint16_t> voxels);
 
     // Member getter
-    const auto& getPatientData() { return mPatientData; }
+    const auto& getPatientData() const { return mPatientData; }
 
-    const auto& getScanMetaData() { return mMetaData; }
+    const auto& getScanMetaData() const { return mMetaData; }
 
     auto getRowWidth() const { return mMetaData.rowCount; }
 
     auto getColWidth() const { return mMetaData.colCount; }
 
-    uint32_t getVolumeSize() const {
-        return getRowWidth() * getColWidth() * getSliceCount();
+    uint64_t getVolumeSize() const {
+        return uint64_t(getRowWidth()) * getColWidth() * getSliceCount();
     }
 
     /** Save slice image to disk.
@@ -59,33 +179,270 @@ class VL_API VolData {
     int getSliceCount() const { return mVolumeSliceData.size(); }
 
     // TODO: Move otherwhere
-    PatientData loadPatientData(const DcmParser& parser) const;
-    ScanMeta loadScanMeta(const DcmParser& parser) const;
+    PatientData loadPatientData(const SliceHeader& header) const;
+    ScanMeta loadScanMeta(const SliceHeader& header) const;
+
+    bool verify(const SliceHeader& header) const;
+
+    /** Get the raw voxel buffer in X-Y-Z order, signed volumes store the two's
+     * complement bit pattern. The buffer is either owned by VolData or mapped
+     * from a volume cache file, it is empty if the volume is out of core.
+     */
+    std::span<const uint16_t> getBufferData() const { return mVoxels; }
+
+    VoxelFormat getVoxelFormat() const {
+        return mMetaData.pixelRepresentation == 1 ? VoxelFormat::Int16
+                                                  : VoxelFormat::UInt16;
+    }
+
+    /** Convert a stored voxel value to modality value.
+     */
+    float toModalityValue(int32_t storedValue) const {
+        return float(storedValue) * mMetaData.rescaleSlope +
+               mMetaData.rescaleIntercept;
+    }
+
+    /** Get stored voxel value, reinterpreted by the voxel format.
+     */
+    int32_t getStoredValue(size_t index) const {
+        if (mpBrickCache) {
+            size_t row = index / getColWidth();
+            return mpBrickCache->getStoredValue(
+                int32_t(index % getColWidth()), int32_t(row % getRowWidth()),
+                int32_t(row / getRowWidth()));
+        }
+        uint16_t v = mVoxels[index];
+        return getVoxelFormat() == VoxelFormat::Int16 ? int32_t(int16_t(v))
+                                                      : int32_t(v);
+    }
+
+    /** Convert the stored values of a slice to float, dst = stored * slope +
+     * intercept. dst must hold a whole slice.
+     */
+    void getSliceValues(uint32_t index, std::span<float> dst, float slope,
+                        float intercept) const;
 
-    bool verify(const DcmParser& parser) const;
-    void addSlice(VolSlice&& slice);
+    /** Convert a slice to modality values(HU for CT).
+     */
+    void getSliceValues(uint32_t index, std::span<float> dst) const {
+        getSliceValues(index, dst, mMetaData.rescaleSlope,
+                       mMetaData.rescaleIntercept);
+    }
+
+    /** Get voxel value in modality unit, this is the CPU sampler counterpart
+     * of VolData::getVolCell in the ray marching shader.
+     */
+    float getVoxelValue(uint32_t x, uint32_t y, uint32_t z) const {
+        if (mpBrickCache)
+            return toModalityValue(mpBrickCache->getStoredValue(x, y, z));
+        size_t index =
+            (size_t(z) * getRowWidth() + y) * getColWidth() + size_t(x);
+        return toModalityValue(getStoredValue(index));
+    }
+
+    /** Trilinear sample in modality unit and its analytic gradient at voxel
+     * coordinates, the CPU counterpart of VolData::getVolDataGradient in the
+     * ray marching shader. Voxels outside of the volume read stored value 0.
+     */
+    TrilinearSample sampleValueGradient(float x, float y, float z) const;
 
-    const std::vector<float>& getBufferData() const { return mBufferData; }
+    /** Convert a modality value to the closest stored value, e.g. to compare
+     * a HU threshold against brick ranges.
+     */
+    int32_t toStoredValue(float modalityValue) const {
+        return int32_t(std::floor((modalityValue - mMetaData.rescaleIntercept) /
+                                  mMetaData.rescaleSlope));
+    }
 
     void finalize();
 
-    auto getMinValue() { return mMinValue; }
-    auto getMaxValue() { return mMaxValue; }
+    /** Build the bricked copy of the loaded voxels on demand. Loads do not
+     * build it, the min/max octree reads the voxels in place.
+     */
+    void buildBricks() { mpBricks = BrickedVolume::create(*this); }
+
+    /** Build the mip chain down to 1x1x1 in parallel. Every level halves each
+     * dimension(rounded down, at least 1) like GPU mip levels, so
+     * non-power-of-two and anisotropic volumes are handled. The footprint of
+     * an odd sized axis is widened so no voxel is dropped. MinMax levels
+     * hold two channels, the min and the max of the footprint.
+     */
+    void buildMips(MipFilter filter);
+
+    /** Get the dimensions of the levels buildMips creates below a base
+     * level, finest first.
+     */
+    static std::vector<std::array<uint32_t, 3>> getMipChainDims(
+        const std::array<uint32_t, 3>& baseDims);
+
+    /** Get the filter the mip chain was built with.
+     */
+    MipFilter getMipFilter() const { return mMipFilter; }
+
+    /** Get the number of channels per texel of the levels below level 0.
+     */
+    static uint32_t getMipChannelCount(MipFilter filter) {
+        return filter == MipFilter::MinMax ? 2 : 1;
+    }
+
+    /** Get the number of mip levels, level 0 is the full resolution volume.
+     * Out-of-core volumes have no mip chain.
+     */
+    uint32_t getMipLevelCount() const {
+        return uint32_t(mMipLevels.size()) + 1;
+    }
+
+    std::array<uint32_t, 3> getMipDims(uint32_t level) const;
+
+    /** Get the raw voxels the renderers sample at a mip level, same
+     * encoding as getBufferData. A MinMax level returns its max channel.
+     */
+    std::span<const uint16_t> getMipData(uint32_t level) const {
+        return level == 0 ? mVoxels : mMipLevels[level - 1].voxels;
+    }
+
+    /** Get the footprint min of a mip level, the voxels themselves at level
+     * 0 and empty unless the chain was built with MipFilter::MinMax.
+     */
+    std::span<const uint16_t> getMipMinData(uint32_t level) const {
+        return level == 0 ? mVoxels : mMipLevels[level - 1].minVoxels;
+    }
+
+    /** Get the bricked volume, nullptr until buildBricks is called or if
+     * the volume is out of core.
+     */
+    const BrickedVolume::SharedPtr& getBricks() const { return mpBricks; }
+
+    /** Build the precomputed gradient volume, does nothing for out-of-core
+     * volumes. Returns true if the gradients are available.
+     */
+    bool buildGradients();
+
+    /** Get the gradient volume, nullptr until buildGradients is called.
+     */
+    const GradientVolume::SharedPtr& getGradients() const {
+        return mpGradients;
+    }
+
+    /** Check if the voxels are streamed through a brick cache instead of
+     * being held in memory.
+     */
+    bool isOutOfCore() const { return mpBrickCache != nullptr; }
+
+    /** Get the brick cache of an out-of-core volume, nullptr otherwise.
+     */
+    const BrickCache::SharedPtr& getBrickCache() const { return mpBrickCache; }
+
+    IngestStats getIngestStats() const;
+
+    /** Build the histogram of the in-memory or streamed voxels. After an
+     * ingest the slices counted as they were decoded are merged instead.
+     */
+    void buildHistogram();
+
+    /** Get the stored value histogram, empty until buildHistogram is called.
+     */
+    const Histogram& getHistogram() const { return mHistogram; }
+
+    /** Get the window spanning the given percentiles of all voxels.
+     */
+    WindowLevel getAutoWindow(float lowPercentile, float highPercentile) const;
+
+    WindowLevel getAutoWindow() const { return getAutoWindow(0.005f, 0.995f); }
+
+    /** Get threshold presets from the histogram. Otsu's method splits the
+     * value range into background and body, then the body into soft tissue
+     * and dense tissue(bone for CT). Windows span the 1st to 99th
+     * percentile of each class.
+     */
+    std::vector<TissuePreset> getTissuePresets() const;
+
+    /** Get min/max voxel value in modality unit.
+     */
+    float getMinValue() const { return toModalityValue(mMinValue); }
+    float getMaxValue() const { return toModalityValue(mMaxValue); }
 
    private:
+    std::shared_ptr<VolData> createPreview(uint32_t stride) const;
+
+    /** Get the Z slab of a slice in the owned voxel buffer, which holds the
+     * slices from mBufferBeginZ on.
+     */
+    std::span<uint16_t> getSliceBuffer(uint32_t index);
+
+    /** Update slice min/max from its decoded pixels, and count them into
+     * the histogram of a running ingest.
+     */
+    void updateSliceRange(uint32_t index);
+
+    /** Check if the voxels exceed a memory budget, 0 is unlimited.
+     */
+    bool exceedsBudget(uint64_t memoryBudget) const {
+        return memoryBudget > 0 &&
+               getVolumeSize() * sizeof(uint16_t) > memoryBudget;
+    }
+
+    /** Switch to streaming the voxels from the brick store of a content key,
+     * the store is written first if needed. The in-memory voxels, bricks and
+     * mips are released, returns false if the store cannot be written.
+     */
+    bool openOutOfCore(uint64_t contentKey, uint64_t memoryBudget);
+
+    /** Get the stored value ranges of the slices.
+     */
+    std::vector<BrickStore::SliceRange> getSliceRanges() const;
+
+    /** Decode the slices slab by slab into a new brick store. The voxel
+     * buffer only ever holds the slices of one brick slab and its apron,
+     * ingest decodes the given slices into it. Returns nullptr on failure or
+     * cancellation.
+     */
+    BrickStore::SharedPtr ingestBrickStore(
+        const std::filesystem::path& storePath, uint64_t contentKey,
+        const std::function<void(std::span<const uint32_t>)>& ingest,
+        const std::function<bool()>& isCancelled);
+
+    /** Stream the voxels from an open store and release the in-memory
+     * voxels, bricks and mips.
+     */
+    void streamFrom(BrickStore::SharedPtr pStore, uint64_t memoryBudget);
+
     // File metadata
     PatientData mPatientData; ///< Patient data
     ScanMeta mMetaData;       ///< Scanning metadata
 
-    uint16_t mMaxValue = 0;
-    uint16_t mMinValue = std::numeric_limits<uint16_t>::max();
+    int32_t mMaxValue = std::numeric_limits<int32_t>::min(); ///< Stored value
+    int32_t mMinValue = std::numeric_limits<int32_t>::max(); ///< Stored value
 
-    // CT Slices
+    // CT Slices, sorted by their location
     std::vector<VolSlice> mVolumeSliceData;
 
-    std::vector<float> mBufferData;
+    std::vector<uint16_t> mBufferData; ///< Owned voxels, empty if mapped
+    uint32_t mBufferBeginZ = 0; ///< First slice in mBufferData
+    MappedFile::SharedPtr mpMappedFile; ///< Backing volume cache file
+    std::span<const uint16_t> mVoxels;  ///< View of the active voxel storage
+    BrickedVolume::SharedPtr mpBricks;
+    BrickCache::SharedPtr mpBrickCache; ///< Set if out of core
+    GradientVolume::SharedPtr mpGradients;
+    std::vector<MipLevel> mMipLevels; ///< Level 1 and coarser
+    MipFilter mMipFilter = MipFilter::Box;
+    Histogram mHistogram;
+    /// Counts the decoded slices during an ingest, see buildHistogram
+    std::unique_ptr<Histogram::Accumulator> mpHistogramAccumulator;
+
+    struct {
+        std::atomic<uint64_t> sliceCount = 0;
+        std::atomic<uint64_t> heapAllocations = 0;
+        std::atomic<uint64_t> bytesCopied = 0;
+        std::atomic<uint64_t> bytesRead = 0;
+    } mIngestCounters;
+
+    friend class VolCache;
+    friend class IngestPipeline;
+    friend class MultiFrameIngest;
 };
 
 } // namespace Voluma
 
-VL_FMT(Voluma::VolData::ScanMeta)
\ No newline at end of file
+VL_FMT(Voluma::VolData::ScanMeta)
+VL_FMT(Voluma::VolData::IngestStats)
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "VolLoader.h"
+
+#include <exception>
+#include <thread>
+#include <utility>
+
+#include "Utils/Logger.h"
+
+namespace Voluma {
+VolLoadTask::VolLoadTask(const std::filesystem::path& folder,
+                         const Options& options)
+    : mFolder(folder), mOptions(options) {
+    mDone = mDonePromise.get_future().share();
+}
+
+VolLoadTask::SharedPtr VolLoadTask::start(const std::filesystem::path& folder,
+                                          const Options& options) {
+    SharedPtr pTask(new VolLoadTask(folder, options));
+    // The worker keeps the task alive, so dropping the handle never blocks.
+    std::thread([pTask]() { pTask->run(); }).detach();
+    return pTask;
+}
+
+float VolLoadTask::getProgress() const {
+    uint32_t total = mTotalSlices;
+    return total == 0 ? 0.f : float(mLoadedSlices) / float(total);
+}
+
+VolLoadTask::Volume VolLoadTask::takePreview() {
+    std::unique_lock<std::mutex> lck(mResultMutex);
+    return std::exchange(mPreview, Volume());
+}
+
+VolLoadTask::Volume VolLoadTask::getResult() {
+    if (!mIsDone) return Volume();
+    std::unique_lock<std::mutex> lck(mResultMutex);
+    return mResult;
+}
+
+VolLoadTask::Volume VolLoadTask::createVolume(
+    std::shared_ptr<VolData> pVolData) {
+    Volume volume;
+    volume.pOctree = MinMaxOctree::create(*pVolData);
+    volume.pOccupancy = OccupancyGrid::create(*volume.pOctree);
+    volume.pVolData = std::move(pVolData);
+    return volume;
+}
+
+void VolLoadTask::run() {
+    VolData::LoadOptions options;
+    options.onProgress = [this](uint32_t loaded, uint32_t total) {
+        mTotalSlices = total;
+        // Slices finish out of order, only move forward
+        uint32_t prev = mLoadedSlices;
+        while (prev < loaded &&
+               !mLoadedSlices.compare_exchange_weak(prev, loaded)) {
+        }
+    };
+    options.isCancelled = [this]() { return isCancelled(); };
+    options.onPreview = [this](std::shared_ptr<VolData> pPreview) {
+        Volume preview = createVolume(std::move(pPreview));
+        std::unique_lock<std::mutex> lck(mResultMutex);
+        mPreview = std::move(preview);
+    };
+    options.previewStride = mOptions.previewStride;
+    options.memoryBudget = mOptions.memoryBudget;
+
+    Volume result;
+    try {
+        auto pVolData = VolData::loadFromDisk(mFolder, options);
+        if (pVolData && !isCancelled()) {
+            if (mOptions.buildGradients && !pVolData->buildGradients())
+                logWarning("Precomputed gradients unavailable for {}.",
+                           mFolder.string());
+            result = createVolume(std::move(pVolData));
+        }
+    } catch (const std::exception& e) {
+        logError("Failed to load volume {}: {}", mFolder.string(), e.what());
+    }
+
+    if (isCancelled()) {
+        logInfo("Volume load of {} cancelled.", mFolder.string());
+        result = Volume();
+    }
+    {
+        std::unique_lock<std::mutex> lck(mResultMutex);
+        mResult = std::move(result);
+    }
+    mIsDone = true;
+    mDonePromise.set_value();
+}
+} // namespace Voluma
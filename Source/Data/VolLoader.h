@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+
+#include "Core/Macros.h"
+#include "Data/MinMaxOctree.h"
+#include "Data/OccupancyGrid.h"
+#include "Data/VolData.h"
+
+namespace Voluma {
+/** Handle of a volume load running on a background thread.
+ *
+ * The handle can be polled from the render loop: progress and the preview
+ * volume are published as soon as they are available, and the load can be
+ * cancelled at any time without blocking the caller. The structures derived
+ * from a volume are built on the loader thread too, so the render loop only
+ * uploads and swaps.
+ */
+class VL_API VolLoadTask : public std::enable_shared_from_this<VolLoadTask> {
+   public:
+    using SharedPtr = std::shared_ptr<VolLoadTask>;
+
+    struct Options {
+        uint32_t previewStride = 4; ///< Slice/pixel stride of the preview
+        uint64_t memoryBudget = 0;  ///< See VolData::LoadOptions
+        bool buildGradients = false; ///< Build the precomputed gradients
+    };
+
+    /** A volume and the empty space skipping structures over it.
+     */
+    struct Volume {
+        std::shared_ptr<VolData> pVolData;
+        MinMaxOctree::SharedPtr pOctree;
+        OccupancyGrid::SharedPtr pOccupancy; ///< Not classified yet
+
+        explicit operator bool() const { return pVolData != nullptr; }
+    };
+
+    /** Start loading a DICOM series folder in the background.
+     */
+    static SharedPtr start(const std::filesystem::path& folder,
+                           const Options& options);
+
+    static SharedPtr start(const std::filesystem::path& folder) {
+        return start(folder, Options());
+    }
+
+    const std::filesystem::path& getFolder() const { return mFolder; }
+
+    /** Get load progress in [0, 1].
+     */
+    float getProgress() const;
+
+    uint32_t getLoadedSliceCount() const { return mLoadedSlices; }
+    uint32_t getTotalSliceCount() const { return mTotalSlices; }
+
+    /** Request cancellation, workers stop before decoding the next slice.
+     */
+    void cancel() { mIsCancelled = true; }
+    bool isCancelled() const { return mIsCancelled; }
+
+    bool isDone() const { return mIsDone; }
+
+    /** Block until the load finishes or is cancelled.
+     */
+    void wait() const { mDone.wait(); }
+
+    /** Take the preview volume once it is published, returns an empty
+     * volume if there is no new preview.
+     */
+    Volume takePreview();
+
+    /** Get the loaded volume, returns an empty volume if the load is still
+     * running, failed or was cancelled.
+     */
+    Volume getResult();
+
+   private:
+    VolLoadTask(const std::filesystem::path& folder, const Options& options);
+
+    void run();
+
+    /** Build the structures derived from a loaded volume.
+     */
+    static Volume createVolume(std::shared_ptr<VolData> pVolData);
+
+    std::filesystem::path mFolder;
+    Options mOptions;
+
+    std::atomic<uint32_t> mLoadedSlices = 0;
+    std::atomic<uint32_t> mTotalSlices = 0;
+    std::atomic<bool> mIsCancelled = false;
+    std::atomic<bool> mIsDone = false;
+
+    std::mutex mResultMutex;
+    Volume mPreview; ///< Guarded by mResultMutex
+    Volume mResult;  ///< Guarded by mResultMutex
+
+    std::promise<void> mDonePromise;
+    std::shared_future<void> mDone;
+};
+} // namespace Voluma
@@ -1,22 +1,29 @@
 #include "VolSlice.h"
 
 namespace Voluma {
-VolSlice::VolSlice(const DcmParser& parser) {
-    mRawData = parser.getU16Array(DCM_PixelData);
-
-    for (auto v : mRawData) {
-        mMaxPixelValue = std::max(v, mMaxPixelValue);
-        mMinPixelValue = std::min(v, mMinPixelValue);
-    }
-
-    mThickness = (float)parser.getF64(DCM_SliceThickness);
-    mLocation = (float)parser.getF64(DCM_SliceLocation);
+const DcmTagSet<SliceHeader>& SliceHeader::getTagSet() {
+    static const DcmTagSet<SliceHeader> kTagSet = {
+        {DCM_PatientID, &SliceHeader::patientId},
+        {DCM_PatientName, &SliceHeader::patientName},
+        {DCM_PatientBirthDate, &SliceHeader::patientBirthDate},
+        {DCM_PatientSex, &SliceHeader::patientSex},
+        {DCM_Rows, &SliceHeader::rows},
+        {DCM_Columns, &SliceHeader::columns},
+        {DCM_PixelSpacing, &SliceHeader::pixelSpacing},
+        {DCM_RescaleIntercept, &SliceHeader::rescaleIntercept},
+        {DCM_RescaleSlope, &SliceHeader::rescaleSlope},
+        {DCM_PixelRepresentation, &SliceHeader::pixelRepresentation},
+        {DCM_NumberOfFrames, &SliceHeader::numberOfFrames},
+        {DCM_SliceThickness, &SliceHeader::sliceThickness},
+        {DCM_SliceLocation, &SliceHeader::sliceLocation},
+        {DCM_InstanceNumber, &SliceHeader::instanceNumber},
+    };
+    return kTagSet;
 }
 
-VolSlice::VolSlice(VolSlice&& other) noexcept
-    : mRawData(other.mRawData),
-      mThickness(other.mThickness),
-      mLocation(other.mLocation),
-      mMaxPixelValue(other.mMaxPixelValue),
-      mMinPixelValue(other.mMinPixelValue) {}
+VolSlice::VolSlice(const SliceHeader& header) {
+    mThickness = (float)header.sliceThickness;
+    mLocation = (float)header.sliceLocation;
+    mInstanceNumber = header.instanceNumber;
+}
 } // namespace Voluma
\ No newline at end of file
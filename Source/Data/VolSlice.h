@@ -1,28 +1,70 @@
 #pragma once
 #include <cstdint>
+#include <limits>
+#include <string>
 #include <vector>
 
 #include "DcmParser.h"
 namespace Voluma {
+/** Tags read from the header of every slice file, extracted with a single
+ * walk over the dataset.
+ */
+struct SliceHeader {
+    // Patient
+    std::string patientId;
+    std::string patientName;
+    std::string patientBirthDate;
+    std::string patientSex;
+
+    // Scan
+    uint16_t rows = 0;
+    uint16_t columns = 0;
+    std::vector<double> pixelSpacing;
+    double rescaleIntercept = 0.0;
+    double rescaleSlope = 0.0;
+    uint16_t pixelRepresentation = 0;
+    int32_t numberOfFrames = 1; ///< > 1 for multi-frame objects
+
+    // Slice
+    double sliceThickness = 0.0;
+    double sliceLocation = 0.0;
+    int32_t instanceNumber = 0;
+
+    static const DcmTagSet<SliceHeader>& getTagSet();
+};
+
 class VolSlice {
    public:
     VolSlice() = default;
     VolSlice(const VolSlice&) = delete;
-    VolSlice(const DcmParser& parser);
-    VolSlice(VolSlice&& other) noexcept;
+    /** Create slice from its header, pixel data is not touched.
+     */
+    VolSlice(const SliceHeader& header);
+    VolSlice(VolSlice&& other) noexcept = default;
 
     VolSlice& operator=(const VolSlice&) = delete;
     VolSlice& operator=(VolSlice&&) = default;
 
+    const std::string& getFilePath() const { return mFilePath; }
+
+    /** Whether the slice is a frame of a multi-frame file.
+     */
+    bool isFrame() const { return mFrameIndex >= 0; }
+    int32_t getFrameIndex() const { return mFrameIndex; }
+
    private:
-    std::vector<uint16_t> mRawData;  ///< CT data stored in Hounsfield Unit(HU)
+    std::string mFilePath;  ///< Source .dcm file of the slice
     // Slice metadata
-    float mThickness;  ///< 3D slice image thickness
-    float mLocation;   ///< Depth location of the slice, could be negative
+    float mThickness = 0.f;  ///< 3D slice image thickness
+    float mLocation = 0.f;   ///< Depth location of the slice, could be negative
+    int mInstanceNumber = 0; ///< Tie breaker when slice locations are equal
+    int32_t mFrameIndex = -1; ///< Frame in a multi-frame file, -1 if none
 
-    uint16_t mMaxPixelValue = 0u;
-    uint16_t mMinPixelValue = std::numeric_limits<uint16_t>::max();
+    int32_t mMaxPixelValue = std::numeric_limits<int32_t>::min();
+    int32_t mMinPixelValue = std::numeric_limits<int32_t>::max();
 
     friend class VolData;
+    friend class VolCache;
+    friend class MultiFrameIngest;
 };
 }  // namespace Voluma
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "CpuKernelRenderer.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "Core/Program/Program.h"
+#include "Data/BrickedVolume.h"
+#include "Data/VolData.h"
+#include "Utils/Logger.h"
+
+namespace Voluma {
+CpuKernelRenderer::SharedPtr CpuKernelRenderer::create(
+    std::shared_ptr<const VolData> pVolData, MinMaxOctree::SharedPtr pOctree,
+    GradientVolume::SharedPtr pGradients) {
+    ProgramManager programManager;
+    auto pKernel =
+        programManager.createCpuKernel("Shaders/RayMarching.cs.slang", "main");
+    if (!pKernel) return nullptr;
+    return SharedPtr(new CpuKernelRenderer(std::move(pVolData),
+                                           std::move(pOctree),
+                                           std::move(pGradients), pKernel));
+}
+
+CpuKernelRenderer::CpuKernelRenderer(std::shared_ptr<const VolData> pVolData,
+                                     MinMaxOctree::SharedPtr pOctree,
+                                     GradientVolume::SharedPtr pGradients,
+                                     CpuKernel::SharedPtr pKernel)
+    : mpVolData(std::move(pVolData)),
+      mpOctree(std::move(pOctree)),
+      mpGradients(std::move(pGradients)),
+      mpKernel(std::move(pKernel)) {
+    if (!mpOctree) mpOctree = MinMaxOctree::create(*mpVolData);
+
+    // Stored values normalized like R16_UNORM/R16_SNORM texels
+    bool isSigned = mpVolData->getVoxelFormat() == VoxelFormat::Int16;
+    float normScale = isSigned ? 32767.f : 65535.f;
+    std::vector<uint3> mipDims;
+    for (uint32_t level = 0; level < mpVolData->getMipLevelCount(); level++) {
+        auto dims = mpVolData->getMipDims(level);
+        mipDims.emplace_back(dims[0], dims[1], dims[2]);
+    }
+    mVolTex.emplace(mipDims,
+                    VolumeFetch{mpVolData.get(), mipDims, isSigned, normScale});
+
+    std::vector<uint3> levelDims;
+    for (uint32_t level = 0; level < mpOctree->getLevelCount(); level++) {
+        const auto& dims = mpOctree->getLevelDims(level);
+        levelDims.emplace_back(dims[0], dims[1], dims[2]);
+    }
+    mNodeRangeTex.emplace(levelDims, NodeRangeFetch{mpOctree.get()});
+
+    auto rootVar = mpKernel->getRootVar();
+    rootVar["volData"]["volTex"] = *mVolTex;
+    rootVar["volData"]["volDim"] =
+        uint3(mpVolData->getColWidth(), mpVolData->getRowWidth(),
+              mpVolData->getSliceCount());
+    // Map normalized texel back to stored value, then to modality value
+    const auto& scanMeta = mpVolData->getScanMetaData();
+    rootVar["volData"]["valueScale"] = normScale * scanMeta.rescaleSlope;
+    rootVar["volData"]["valueOffset"] = scanMeta.rescaleIntercept;
+    const auto& cellGrid = mpOctree->getLeafGrid();
+    rootVar["volData"]["cellGrid"] =
+        uint3(cellGrid[0], cellGrid[1], cellGrid[2]);
+    rootVar["volData"]["cellSize"] = OccupancyGrid::kCellSize;
+    rootVar["volData"]["nodeRange"] = *mNodeRangeTex;
+    rootVar["volData"]["octreeLevelCount"] = mpOctree->getLevelCount();
+    rootVar["volData"]["mipLevelCount"] = mpVolData->getMipLevelCount();
+}
+
+float CpuKernelRenderer::VolumeFetch::operator()(int3 texLoc,
+                                                 uint32_t lod) const {
+    const uint3& dims = mipDims[lod];
+    size_t index = (size_t(texLoc.z) * dims.y + size_t(texLoc.y)) * dims.x +
+                   size_t(texLoc.x);
+    int32_t storedValue =
+        lod == 0 ? pVolData->getStoredValue(index)
+                 : BrickedVolume::decode(pVolData->getMipData(lod)[index],
+                                         isSigned);
+    return std::max(float(storedValue) / normScale, -1.f);
+}
+
+uint32_t CpuKernelRenderer::CellDistanceFetch::operator()(int3 cell,
+                                                          uint32_t) const {
+    // Without a distance field no cell is skipped
+    if (!pOccupancy) return 0;
+    return uint32_t(pOccupancy->getDistance(cell.x, cell.y, cell.z));
+}
+
+float2 CpuKernelRenderer::NodeRangeFetch::operator()(int3 node,
+                                                     uint32_t level) const {
+    return pOctree->getNodeRange(level, node.x, node.y, node.z);
+}
+
+float4 CpuKernelRenderer::GradientFetch::operator()(int3 texLoc,
+                                                    uint32_t) const {
+    // RGBA16_UNORM texels
+    GradientVolume::Texel texel = {};
+    if (pGradients) {
+        size_t index = (size_t(texLoc.z) * dims.y + size_t(texLoc.y)) *
+                           dims.x +
+                       size_t(texLoc.x);
+        texel = pGradients->getTexels()[index];
+    }
+    return float4(texel.octU, texel.octV, texel.magnitude, texel.padding) /
+           65535.f;
+}
+
+CpuKernel::Stats CpuKernelRenderer::render(const CameraData& camera,
+                                           const SampleAppParam& inParams,
+                                           Image& image) const {
+    if (image.getChannels() != 4) image.resizeChannels(4);
+
+    SampleAppParam params = inParams;
+    if (params.gradientMode == GradientMode::Precomputed && !mpGradients)
+        params.gradientMode = GradientMode::FiniteDifference;
+
+    // Per frame bindings go into a copy of the uniform state
+    std::vector<uint8_t> state = mpKernel->copyUniformState();
+    auto rootVar = mpKernel->getRootVar(state);
+
+    // The distance field depends on the threshold, built per frame like in
+    // CpuRenderer
+    OccupancyGrid::SharedPtr pOccupancy;
+    if (params.emptySpaceMode == EmptySpaceMode::DistanceField) {
+        pOccupancy = OccupancyGrid::create(*mpOctree);
+        pOccupancy->setThreshold(float(params.filterValue));
+    }
+    const auto& cellGrid = mpOctree->getLeafGrid();
+    CpuTexture3D<uint32_t, CellDistanceFetch> cellDistanceTex(
+        {uint3(cellGrid[0], cellGrid[1], cellGrid[2])},
+        CellDistanceFetch{pOccupancy.get()});
+    rootVar["volData"]["cellDistance"] = cellDistanceTex;
+
+    // A 1x1x1 placeholder unless the gradients are used
+    const GradientVolume* pGradients =
+        params.gradientMode == GradientMode::Precomputed ? mpGradients.get()
+                                                         : nullptr;
+    uint3 gradientDims(1);
+    if (pGradients) {
+        const auto& dims = pGradients->getDims();
+        gradientDims = uint3(dims[0], dims[1], dims[2]);
+    }
+    CpuTexture3D<float4, GradientFetch> gradientTex(
+        {gradientDims}, GradientFetch{pGradients, gradientDims});
+    rootVar["volData"]["gradientTex"] = gradientTex;
+    rootVar["volData"]["gradientScale"] =
+        pGradients ? pGradients->getMaxMagnitude() : 0.f;
+
+    uint2 frameDim(image.getWidth(), image.getHeight());
+    CpuRWTexture2D<float4> dstTex(frameDim);
+    rootVar["cameraData"] = camera;
+    rootVar["frameDim"] = frameDim;
+    rootVar["dstTex"] = dstTex;
+    rootVar["params"].setBlob(params);
+    auto stats = mpKernel->dispatch(uint3(frameDim, 1), state);
+
+    auto texels = dstTex.getTexels();
+    for (uint32_t y = 0; y < frameDim.y; y++) {
+        for (uint32_t x = 0; x < frameDim.x; x++) {
+            const float4& texel = texels[size_t(y) * frameDim.x + x];
+            for (int c = 0; c < 4; c++)
+                image.getPixel(int(x), int(y), c) = texel[c];
+        }
+    }
+    return stats;
+}
+} // namespace Voluma
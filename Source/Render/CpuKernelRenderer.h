@@ -0,0 +1,92 @@
+#pragma once
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "Core/CameraData.slang"
+#include "Core/Macros.h"
+#include "Core/Math.h"
+#include "Core/Program/CpuKernel.h"
+#include "Core/SampleAppShared.slangh"
+#include "Data/GradientVolume.h"
+#include "Data/MinMaxOctree.h"
+#include "Data/OccupancyGrid.h"
+#include "Utils/Image.h"
+
+namespace Voluma {
+class VolData;
+
+/** Renders frames by running RayMarching.cs.slang itself on the CPU.
+ *
+ * The shader is built to host callable code and its main entry point is
+ * dispatched over all cores in 16x16 thread groups, so GPU-less nodes run
+ * the same marcher source as the GPU. The volume, the cell distances, the
+ * octree node ranges and the gradients are bound as CPU Texture3Ds reading
+ * the CPU side data with the texel formats of the GPU textures. The volume
+ * and octree bindings are made once, the per frame ones go into a copy of
+ * the uniform state of the kernel, so rendering leaves the renderer as is.
+ */
+class VL_API CpuKernelRenderer {
+   public:
+    using SharedPtr = std::shared_ptr<CpuKernelRenderer>;
+
+    /** Build the kernel and bind the volume, returns nullptr if the shader
+     * cannot be built for the CPU. pOctree is built if nullptr, without
+     * pGradients the precomputed gradient mode falls back to finite
+     * differences.
+     */
+    static SharedPtr create(std::shared_ptr<const VolData> pVolData,
+                            MinMaxOctree::SharedPtr pOctree = nullptr,
+                            GradientVolume::SharedPtr pGradients = nullptr);
+
+    /** Render a frame into an RGBA image, the image size is the frame size.
+     */
+    CpuKernel::Stats render(const CameraData& camera,
+                            const SampleAppParam& params, Image& image) const;
+
+   private:
+    CpuKernelRenderer(std::shared_ptr<const VolData> pVolData,
+                      MinMaxOctree::SharedPtr pOctree,
+                      GradientVolume::SharedPtr pGradients,
+                      CpuKernel::SharedPtr pKernel);
+
+    /** Texel fetches of the bound textures, in the texel formats of the
+     * GPU textures.
+     */
+    struct VolumeFetch {
+        const VolData* pVolData;
+        std::vector<uint3> mipDims;
+        bool isSigned;
+        float normScale; ///< Stored value of a normalized texel of 1
+
+        float operator()(int3 texLoc, uint32_t lod) const;
+    };
+
+    struct CellDistanceFetch {
+        const OccupancyGrid* pOccupancy; ///< No skipping if nullptr
+
+        uint32_t operator()(int3 cell, uint32_t) const;
+    };
+
+    struct NodeRangeFetch {
+        const MinMaxOctree* pOctree;
+
+        float2 operator()(int3 node, uint32_t level) const;
+    };
+
+    struct GradientFetch {
+        const GradientVolume* pGradients; ///< Placeholder texel if nullptr
+        uint3 dims;
+
+        float4 operator()(int3 texLoc, uint32_t) const;
+    };
+
+    std::shared_ptr<const VolData> mpVolData;
+    MinMaxOctree::SharedPtr mpOctree;
+    GradientVolume::SharedPtr mpGradients;
+    CpuKernel::SharedPtr mpKernel;
+
+    std::optional<CpuTexture3D<float, VolumeFetch>> mVolTex;
+    std::optional<CpuTexture3D<float2, NodeRangeFetch>> mNodeRangeTex;
+};
+} // namespace Voluma
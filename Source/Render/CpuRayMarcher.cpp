@@ -0,0 +1,149 @@
+#include "CpuRayMarcher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "Data/VolData.h"
+#include "Utils/EmptySpaceSkipping.slangh"
+#include "Utils/Parallel.h"
+
+namespace Voluma {
+std::string CpuRayMarcher::Stats::toString() const {
+    return fmt::format(
+        "RayMarchStats(rays = {}, hits = {}, samples = {}, samples per ray = "
+        "{:.1f})",
+        rayCount, hitCount, sampleCount, getSamplesPerRay());
+}
+
+CpuRayMarcher::CpuRayMarcher(std::shared_ptr<const VolData> pVolData,
+                             OccupancyGrid::SharedPtr pOccupancy,
+                             MinMaxOctree::SharedPtr pOctree)
+    : mpVolData(std::move(pVolData)),
+      mpOccupancy(std::move(pOccupancy)),
+      mpOctree(std::move(pOctree)) {
+    mVolDim = float3(mpVolData->getColWidth(), mpVolData->getRowWidth(),
+                     mpVolData->getSliceCount());
+    mBounds = float3(1.f, 1.f / mVolDim.x * mVolDim.y,
+                     1.f / mVolDim.x * mVolDim.z);
+}
+
+float3 CpuRayMarcher::worldPositionToTexCoord(float3 posW) const {
+    float3 boundsHalf = mBounds * 0.5f;
+    float3 texLoc = float3(posW.x, posW.z, posW.y) + boundsHalf;
+    texLoc /= boundsHalf * 2.f;
+    return texLoc * mVolDim;
+}
+
+bool CpuRayMarcher::isInside(float3 posW) const {
+    float3 boundsHalf = mBounds * 0.5f;
+    for (int i = 0; i < 3; i++) {
+        if (posW[i] < -boundsHalf[i] || posW[i] > boundsHalf[i]) return false;
+    }
+    return true;
+}
+
+bool CpuRayMarcher::rayBoxIntersection(float3 origin, float3 dir,
+                                       float2& t) const {
+    float3 boxMin = -mBounds * 0.5f;
+    float3 boxMax = mBounds * 0.5f;
+    float3 invDir = 1.f / dir;
+    float3 tMin = (boxMin - origin) * invDir;
+    float3 tMax = (boxMax - origin) * invDir;
+    float3 t0 = glm::min(tMin, tMax);
+    float3 t1 = glm::max(tMin, tMax);
+    float tNear = std::max(std::max(t0.x, t0.y), t0.z);
+    float tFar = std::min(std::min(t1.x, t1.y), t1.z);
+    if (tNear > tFar || tFar < 0.f) return false;
+    t = float2(tNear, tFar);
+    return true;
+}
+
+CpuRayMarcher::Hit CpuRayMarcher::marchRay(float3 origin, float3 dir,
+                                           float threshold,
+                                           uint64_t& sampleCount) const {
+    const float kStepSize = 1.f / kMaxSteps;
+    Hit hit;
+    float2 t;
+    if (!rayBoxIntersection(origin, dir, t)) return hit;
+    float3 p = origin + dir * t.x;
+
+    float3 texDir =
+        worldPositionToTexCoord(p + dir) - worldPositionToTexCoord(p);
+    bool useOccupancy = !mpOctree && mpOccupancy &&
+                        mpOccupancy->getThreshold() == threshold;
+    for (int i = 0; i < kMaxSteps; i++) {
+        if (!isInside(p)) {
+            p += kStepSize * dir;
+            continue;
+        }
+        float3 texLoc = worldPositionToTexCoord(p);
+        float emptyDistance = 0.f;
+        if (mpOctree) {
+            emptyDistance =
+                mpOctree->getEmptyDistance(texLoc, texDir, threshold, 0.f);
+        } else if (useOccupancy && texLoc.x >= 0.f && texLoc.y >= 0.f &&
+                   texLoc.z >= 0.f) {
+            int3 cell = int3(glm::floor(texLoc)) /
+                        int32_t(OccupancyGrid::kCellSize);
+            emptyDistance = getEmptyCellDistance(
+                texLoc, texDir, cell,
+                mpOccupancy->getDistance(cell.x, cell.y, cell.z),
+                OccupancyGrid::kCellSize, 0.f);
+        }
+        if (emptyDistance > 0.f) {
+            // Same step grid as the shader
+            int skipCount = std::max(1, int(emptyDistance / kStepSize));
+            p += float(skipCount) * kStepSize * dir;
+            i += skipCount - 1;
+            continue;
+        }
+
+        sampleCount++;
+        float value =
+            mpVolData->sampleValueGradient(texLoc.x, texLoc.y, texLoc.z).value;
+        if (value >= threshold) {
+            hit = {true, value, p, texLoc};
+            return hit;
+        }
+        p += kStepSize * dir;
+    }
+    return hit;
+}
+
+void CpuRayMarcher::getCameraRay(const CameraData& camera, uint2 pixel,
+                                 uint2 frameDim, float3& origin,
+                                 float3& dir) {
+    float2 p = (float2(pixel) + 0.5f) / float2(frameDim);
+    float2 ndc = float2(2.f, -2.f) * p + float2(-1.f, 1.f);
+    dir = normalize(camera.target - camera.posW);
+    origin = camera.posW + (ndc.x * camera.cameraU + ndc.y * camera.cameraV) *
+                               kOrthoHalfExtent;
+}
+
+CpuRayMarcher::Stats CpuRayMarcher::measure(const CameraData& camera,
+                                            uint2 frameDim,
+                                            float threshold) const {
+    std::atomic<uint64_t> hitCount = 0, sampleCount = 0;
+    std::vector<uint32_t> rows(frameDim.y);
+    std::iota(rows.begin(), rows.end(), 0u);
+    forEachParallel(rows.begin(), rows.end(), [&](uint32_t y) {
+        uint64_t rowHits = 0, rowSamples = 0;
+        for (uint32_t x = 0; x < frameDim.x; x++) {
+            float3 origin, dir;
+            getCameraRay(camera, uint2(x, y), frameDim, origin, dir);
+            if (marchRay(origin, dir, threshold, rowSamples).isHit) rowHits++;
+        }
+        hitCount += rowHits;
+        sampleCount += rowSamples;
+    });
+
+    Stats stats;
+    stats.rayCount = uint64_t(frameDim.x) * frameDim.y;
+    stats.hitCount = hitCount;
+    stats.sampleCount = sampleCount;
+    return stats;
+}
+} // namespace Voluma
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "Core/CameraData.slang"
+#include "Core/Macros.h"
+#include "Core/Math.h"
+#include "Data/MinMaxOctree.h"
+#include "Data/OccupancyGrid.h"
+#include "Utils/Logger.h"
+
+namespace Voluma {
+class VolData;
+
+/** CPU reference of the first hit search of the ray marching shader.
+ *
+ * Rays are generated and marched exactly like computeCameraRayOrtho and
+ * rayMarch, with the same step grid and empty space leaps, so the sample
+ * counts measure what skipping saves on the GPU. Samples are trilinear
+ * fetches of VolData::sampleValueGradient at level 0.
+ */
+class VL_API CpuRayMarcher {
+   public:
+    static constexpr int kMaxSteps = 1000;
+
+    struct Stats {
+        uint64_t rayCount = 0;
+        uint64_t hitCount = 0;
+        uint64_t sampleCount = 0; ///< Trilinear fetches
+
+        float getSamplesPerRay() const {
+            return rayCount > 0 ? float(double(sampleCount) / rayCount) : 0.f;
+        }
+
+        std::string toString() const;
+    };
+
+    struct Hit {
+        bool isHit = false;
+        float value = 0.f;        ///< Modality value of the hit sample
+        float3 posW = float3(0.f);
+        float3 texLoc = float3(0.f);
+    };
+
+    /** Create a marcher that leaps over empty space with the octree if set,
+     * else with the occupancy grid if set, else marches every step.
+     */
+    CpuRayMarcher(std::shared_ptr<const VolData> pVolData,
+                  OccupancyGrid::SharedPtr pOccupancy = nullptr,
+                  MinMaxOctree::SharedPtr pOctree = nullptr);
+
+    /** Find the first sample at or above threshold. The occupancy grid only
+     * skips empty space if it was classified for the same threshold, the
+     * octree works for any threshold. sampleCount is incremented by the
+     * samples taken.
+     */
+    Hit marchRay(float3 origin, float3 dir, float threshold,
+                 uint64_t& sampleCount) const;
+
+    /** Get the orthographic camera ray of a pixel center, like
+     * computeCameraRayOrtho in the shader.
+     */
+    static void getCameraRay(const CameraData& camera, uint2 pixel,
+                             uint2 frameDim, float3& origin, float3& dir);
+
+    /** March one ray per pixel in parallel and count the samples.
+     */
+    Stats measure(const CameraData& camera, uint2 frameDim,
+                  float threshold) const;
+
+    /** Map a world position to level 0 voxel coordinates, like
+     * VolData::worldPositionToTexCoord in the shader.
+     */
+    float3 worldPositionToTexCoord(float3 posW) const;
+
+    /** Check a world position against the normalized volume bounds.
+     */
+    bool isInside(float3 posW) const;
+
+    /** Intersect a ray with the normalized volume bounds, t receives the
+     * entry and exit distances.
+     */
+    bool rayBoxIntersection(float3 origin, float3 dir, float2& t) const;
+
+    /** Get the normalized volume bounds, centered at the origin.
+     */
+    const float3& getBounds() const { return mBounds; }
+
+   private:
+    std::shared_ptr<const VolData> mpVolData;
+    OccupancyGrid::SharedPtr mpOccupancy;
+    MinMaxOctree::SharedPtr mpOctree;
+    float3 mVolDim;
+    float3 mBounds; ///< Normalized volume bounds, x is 1
+};
+} // namespace Voluma
+
+VL_FMT(Voluma::CpuRayMarcher::Stats)
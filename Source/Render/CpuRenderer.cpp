@@ -0,0 +1,918 @@
+#include "CpuRenderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "Data/VolData.h"
+#include "Utils/EmptySpaceSkipping.slangh"
+#include "Utils/Parallel.h"
+#include "Utils/Simd.h"
+
+namespace Voluma {
+static const float3 kBackgroundColor = float3(0.03f, 0.3f, 0.3f);
+
+struct TransportStep {
+    float4 color;
+    int valueThreshold;
+};
+static const int kBreakpointCount = 3;
+static const TransportStep kTransportSteps[kBreakpointCount] = {
+    {float4(0.1f, 0.1f, 0.7f, 0.2f), -500},
+    {float4(0.2f, 0.2f, 0.4f, 0.3f), 0},
+    {float4(1.0f, 1.0f, 1.0f, 0.5f), 800}};
+
+std::string CpuRenderer::Stats::toString() const {
+    double seconds = std::max(elapsedMs, 1e-3) * 1e-3;
+    return fmt::format(
+        "CpuRenderStats({}, rays = {}, samples = {}, time = {:.1f} ms, "
+        "Mrays/s = {:.2f}, Msamples/s = {:.2f})",
+        simdLevel, rayCount, sampleCount, elapsedMs,
+        double(rayCount) / seconds * 1e-6,
+        double(sampleCount) / seconds * 1e-6);
+}
+
+CpuRenderer::CpuRenderer(std::shared_ptr<const VolData> pVolData,
+                         MinMaxOctree::SharedPtr pOctree,
+                         GradientVolume::SharedPtr pGradients)
+    : mpVolData(std::move(pVolData)),
+      mpOctree(std::move(pOctree)),
+      mpGradients(std::move(pGradients)),
+      mGeometry(mpVolData),
+      mSimdLevel(VoxelKernels::getSimdLevel()) {
+    mVolDim = int3(mpVolData->getColWidth(), mpVolData->getRowWidth(),
+                   mpVolData->getSliceCount());
+    mMipLevelCount = mpVolData->getMipLevelCount();
+    if (!mpOctree) mpOctree = MinMaxOctree::create(*mpVolData);
+}
+
+void CpuRenderer::setSimdLevel(SimdLevel level) {
+    mSimdLevel = std::min(level, VoxelKernels::getSimdLevel());
+}
+
+float CpuRenderer::getVolCell(int3 texLoc, int lod) const {
+    // Outside of the volume behaves as stored value 0, like the texture
+    // loads of the shader
+    auto dims = mpVolData->getMipDims(uint32_t(lod));
+    if (texLoc.x < 0 || texLoc.y < 0 || texLoc.z < 0 ||
+        texLoc.x >= int32_t(dims[0]) || texLoc.y >= int32_t(dims[1]) ||
+        texLoc.z >= int32_t(dims[2]))
+        return mpVolData->toModalityValue(0);
+    if (lod == 0) return mpVolData->getVoxelValue(texLoc.x, texLoc.y, texLoc.z);
+
+    uint16_t v = mpVolData->getMipData(uint32_t(lod))
+                     [(size_t(texLoc.z) * dims[1] + texLoc.y) * dims[0] +
+                      size_t(texLoc.x)];
+    return mpVolData->toModalityValue(BrickedVolume::decode(
+        v, mpVolData->getVoxelFormat() == VoxelFormat::Int16));
+}
+
+bool CpuRenderer::getPinnedCells(int3 i0, BrickPin& pin,
+                                 float cells[8]) const {
+    const auto& pCache = mpVolData->getBrickCache();
+    if (!pCache || i0.x < -1 || i0.y < -1 || i0.z < -1 ||
+        i0.x >= mVolDim.x || i0.y >= mVolDim.y || i0.z >= mVolDim.z)
+        return false;
+    constexpr int32_t kSize = int32_t(BrickedVolume::kBrickSize);
+    constexpr size_t kPadded = BrickedVolume::kPaddedSize;
+    const auto& pStore = pCache->getStore();
+    int3 brick = glm::max(i0, int3(0)) / kSize;
+    uint32_t index = pStore->getBrickIndex(brick.x, brick.y, brick.z);
+    if (index != pin.index) {
+        pin.pBrick = pCache->getBrick(index);
+        pin.index = index;
+    }
+
+    // The apron holds the -1 and +1 neighbors, 0 outside of the volume like
+    // getVolCell
+    int3 local = i0 - brick * kSize + int3(BrickedVolume::kApron);
+    const uint16_t* pBase =
+        pin.pBrick->data() +
+        (size_t(local.z) * kPadded + size_t(local.y)) * kPadded +
+        size_t(local.x);
+    for (int i = 0; i < 8; i++) {
+        size_t offset = (size_t(i >> 2) * kPadded + ((i >> 1) & 1)) * kPadded +
+                        size_t(i & 1);
+        cells[i] = mpVolData->toModalityValue(
+            BrickedVolume::decode(pBase[offset], pStore->isSigned()));
+    }
+    return true;
+}
+
+float CpuRenderer::getVolData(float3 texLoc, int lod, BrickPin& pin) const {
+    return getVolDataGradient(texLoc, lod, pin).value;
+}
+
+TrilinearSample CpuRenderer::getVolDataGradient(float3 texLoc, int lod,
+                                                BrickPin& pin) const {
+    auto dims = mpVolData->getMipDims(uint32_t(lod));
+    float3 mipScale = float3(dims[0], dims[1], dims[2]) / float3(mVolDim);
+    if (lod > 0) texLoc = (texLoc + 0.5f) * mipScale - 0.5f;
+    int3 i0 = int3(glm::floor(texLoc));
+    float c[8];
+    if (lod > 0 || !getPinnedCells(i0, pin, c)) {
+        for (int i = 0; i < 8; i++)
+            c[i] = getVolCell(i0 + int3(i & 1, (i >> 1) & 1, i >> 2), lod);
+    }
+    TrilinearSample s = trilinearValueGradient(
+        c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7], texLoc - float3(i0));
+    s.gradient *= mipScale;
+    return s;
+}
+
+float3 CpuRenderer::computeGradient(float3 texLoc, int lod,
+                                    BrickPin& pin) const {
+    float epsilon = 1.f / float(mVolDim.x) * 0.1f * float(1 << lod);
+    return float3(getVolData(texLoc + float3(epsilon, 0.f, 0.f), lod, pin) -
+                      getVolData(texLoc - float3(epsilon, 0.f, 0.f), lod, pin),
+                  getVolData(texLoc + float3(0.f, epsilon, 0.f), lod, pin) -
+                      getVolData(texLoc - float3(0.f, epsilon, 0.f), lod, pin),
+                  getVolData(texLoc + float3(0.f, 0.f, epsilon), lod, pin) -
+                      getVolData(texLoc - float3(0.f, 0.f, epsilon), lod,
+                                 pin)) *
+           0.5f;
+}
+
+float3 CpuRenderer::computeNormal(const FrameContext& ctx, float3 texLoc,
+                                  int lod, BrickPin& pin) const {
+    switch (ctx.params.gradientMode) {
+        case GradientMode::Precomputed:
+            return -normalize(
+                mpGradients->sampleGradient(texLoc.x, texLoc.y, texLoc.z));
+        case GradientMode::Analytic:
+            return -normalize(getVolDataGradient(texLoc, lod, pin).gradient);
+        default:
+            return -normalize(computeGradient(texLoc, lod, pin));
+    }
+}
+
+float CpuRenderer::getEmptySpaceDistance(const FrameContext& ctx,
+                                         float3 texLoc, float3 texDir,
+                                         int lod) const {
+    if (ctx.params.emptySpaceMode == EmptySpaceMode::Disabled ||
+        texLoc.x < 0.f || texLoc.y < 0.f || texLoc.z < 0.f)
+        return 0.f;
+    int3 cell = int3(glm::floor(texLoc)) / int32_t(OccupancyGrid::kCellSize);
+    const auto& grid = mpOctree->getLeafGrid();
+    if (cell.x >= int32_t(grid[0]) || cell.y >= int32_t(grid[1]) ||
+        cell.z >= int32_t(grid[2]))
+        return 0.f;
+    float margin = lod > 0 ? 1.5f * float(1 << lod) + 0.5f : 0.f;
+    if (ctx.params.emptySpaceMode == EmptySpaceMode::Octree) {
+        return mpOctree->getEmptyDistance(
+            texLoc, texDir, float(ctx.params.filterValue), margin);
+    }
+    return getEmptyCellDistance(
+        texLoc, texDir, cell,
+        ctx.pOccupancy->getDistance(cell.x, cell.y, cell.z),
+        OccupancyGrid::kCellSize, margin);
+}
+
+/** Mirror of transportFunc in the shader.
+ */
+static float4 transportFunc(float value, int& nextTFIndex) {
+    if (nextTFIndex >= kBreakpointCount) return float4(0.f);
+    const TransportStep& nextStep = kTransportSteps[nextTFIndex];
+    if (value >= float(nextStep.valueThreshold)) {
+        nextTFIndex++;
+        return nextStep.color;
+    }
+    return float4(0.f);
+}
+
+int CpuRenderer::selectLod(const FrameContext& ctx, float3 texDir) const {
+    // Same mip level selection as the shader
+    const float stepSize = 1.f / CpuRayMarcher::kMaxSteps;
+    float filmWidth = 2.f * kOrthoHalfExtent * length(ctx.camera.cameraU);
+    float voxelsPerPixel =
+        filmWidth / float(ctx.frameDim.x) * float(mVolDim.x);
+    float voxelsPerStep = stepSize * length(texDir);
+    float footprint = std::max(voxelsPerPixel, voxelsPerStep);
+    int lod = footprint > 1.f ? int(std::floor(std::log2(footprint))) : 0;
+    return std::clamp(lod, 0, int(mMipLevelCount) - 1);
+}
+
+bool CpuRenderer::rayMarch(const FrameContext& ctx, float3 origin,
+                           float3 dir, ShadingData& sd,
+                           uint64_t& sampleCount) const {
+    const int kMaxSteps = CpuRayMarcher::kMaxSteps;
+    const float stepSize = 1.f / kMaxSteps;
+    const auto& params = ctx.params;
+
+    float2 t;
+    if (!mGeometry.rayBoxIntersection(origin, dir, t)) return false;
+    float3 p = origin + dir * t.x;
+
+    int nextTFIndex = 0;
+    sd.transportColor = float4(0.f);
+
+    float3 texDir = mGeometry.worldPositionToTexCoord(p + dir) -
+                    mGeometry.worldPositionToTexCoord(p);
+
+    int lod = selectLod(ctx, texDir);
+
+    // Consecutive samples mostly share a brick of an out-of-core volume
+    BrickPin pin;
+    for (int i = 0; i < kMaxSteps; i++) {
+        float emptyDistance = 0.f;
+        if (mGeometry.isInside(p)) {
+            emptyDistance = getEmptySpaceDistance(
+                ctx, mGeometry.worldPositionToTexCoord(p), texDir, lod);
+        }
+        if (emptyDistance > 0.f) {
+            int skipCount = std::max(1, int(emptyDistance / stepSize));
+            p += float(skipCount) * stepSize * dir;
+            i += skipCount - 1;
+            continue;
+        }
+        if (mGeometry.isInside(p)) {
+            float3 texLoc = mGeometry.worldPositionToTexCoord(p);
+            TrilinearSample s;
+            if (params.gradientMode == GradientMode::Analytic) {
+                s = getVolDataGradient(texLoc, lod, pin);
+            } else {
+                s.value = getVolData(texLoc, lod, pin);
+            }
+            sampleCount++;
+            if (s.value >= float(params.filterValue)) {
+                sd.density = s.value;
+                sd.posW = p;
+                sd.normW = params.gradientMode == GradientMode::Analytic
+                               ? -normalize(s.gradient)
+                               : computeNormal(ctx, texLoc, lod, pin);
+                if (params.shadingMode == ShadingMode::TransportFunc) {
+                    float4 c = transportFunc(s.value, nextTFIndex);
+                    sd.transportColor += float4(float3(c) * c.w, c.w);
+                    if (nextTFIndex == kBreakpointCount) return true;
+                } else {
+                    return true;
+                }
+            }
+        }
+        p += stepSize * dir;
+    }
+    if (params.shadingMode != ShadingMode::TransportFunc) return false;
+    return sd.transportColor.w != 0.f;
+}
+
+float3 CpuRenderer::shadePixel(const FrameContext& ctx, uint2 pixel,
+                               uint64_t& sampleCount) const {
+    float3 origin, dir;
+    CpuRayMarcher::getCameraRay(ctx.camera, pixel, ctx.frameDim, origin, dir);
+
+    ShadingData sd;
+    bool isHit = rayMarch(ctx, origin, dir, sd, sampleCount);
+    return shade(ctx, isHit, sd);
+}
+
+float3 CpuRenderer::shade(const FrameContext& ctx, bool isHit,
+                          const ShadingData& sd) const {
+    if (!isHit) return kBackgroundColor;
+    switch (ctx.params.shadingMode) {
+        case ShadingMode::FlatShade: {
+            // phongShading without specular
+            float3 L = normalize(float3(0.f, 0.f, -3.f) - ctx.camera.target);
+            float3 ambient = float3(0.2f);
+            float3 diffuse = float3(0.4f) * std::max(0.f, dot(sd.normW, L));
+            return ambient + diffuse;
+        }
+        case ShadingMode::Normal:
+            return sd.normW * 0.5f + 0.5f;
+        default:
+            return float3(sd.transportColor) +
+                   (1.f - sd.transportColor.w) * kBackgroundColor;
+    }
+}
+
+namespace {
+/** Rays of a pixel block in SoA layout, one lane per pixel.
+ */
+struct RayPacket {
+    static constexpr int kWidth = int(CpuRenderer::kPacketWidth);
+
+    alignas(32) float posX[kWidth]; ///< Ray origins, then box entries
+    alignas(32) float posY[kWidth];
+    alignas(32) float posZ[kWidth];
+    uint32_t laneMask = 0; ///< Lanes holding a pixel, then lanes in the box
+
+    uint32_t hitMask = 0;
+    alignas(32) float texLocX[kWidth]; ///< Hit sample of the surface modes
+    alignas(32) float texLocY[kWidth];
+    alignas(32) float texLocZ[kWidth];
+    alignas(32) float colorR[kWidth]; ///< Composited transport color
+    alignas(32) float colorG[kWidth];
+    alignas(32) float colorB[kWidth];
+    alignas(32) float colorA[kWidth];
+};
+
+/** Constants of a packet, uniform over the lanes.
+ */
+struct PacketSetup {
+    float3 dir;
+    float3 boundsHalf;
+    float3 volDim;
+    float stepSize;
+
+    // Level sampled by the packet
+    const uint16_t* pVoxels;
+    int3 mipDim;
+    float3 mipScale;
+    bool isRemapped; ///< lod > 0
+    bool isSigned;
+    float slope;
+    float intercept;
+
+    float filterValue;
+    bool isTransport;
+    bool isSkipping;
+
+    // Level 0 octree nodes to reject occupied leaves on all lanes at once,
+    // nullptr to ask every lane
+    const float2* pLeafRanges;
+    int3 leafDims; ///< Padded dims of the leaf level
+    int3 leafGrid;
+};
+
+#if VL_X86
+VL_TARGET("avx2")
+__m256 maskFromBits(uint32_t bits) {
+    const __m256i kLaneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i v = _mm256_and_si256(_mm256_set1_epi32(int(bits)), kLaneBits);
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(v, kLaneBits));
+}
+
+VL_TARGET("avx2")
+__m256 lerpAVX2(__m256 a, __m256 b, __m256 t) {
+    return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+}
+
+VL_TARGET("avx2")
+__m256 toModalityAVX2(__m256i storedValue, __m256 slope, __m256 intercept) {
+    return _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(storedValue), slope),
+                         intercept);
+}
+
+VL_TARGET("avx2")
+__m256 toTexCoordAVX2(__m256 p, float boundsHalf, float volDim) {
+    // Same operation order as CpuRayMarcher::worldPositionToTexCoord
+    __m256 t = _mm256_add_ps(p, _mm256_set1_ps(boundsHalf));
+    t = _mm256_div_ps(t, _mm256_set1_ps(boundsHalf * 2.f));
+    return _mm256_mul_ps(t, _mm256_set1_ps(volDim));
+}
+
+/** Intersect the lanes with the volume bounds like
+ * CpuRayMarcher::rayBoxIntersection, origins are moved to the box entries.
+ */
+VL_TARGET("avx2")
+void intersectPacketAVX2(const PacketSetup& s, RayPacket& packet) {
+    __m256 p[3] = {_mm256_load_ps(packet.posX), _mm256_load_ps(packet.posY),
+                   _mm256_load_ps(packet.posZ)};
+    float3 invDir = 1.f / s.dir;
+    __m256 tNear, tFar;
+    for (int i = 0; i < 3; i++) {
+        __m256 vInvDir = _mm256_set1_ps(invDir[i]);
+        __m256 tMin = _mm256_mul_ps(
+            _mm256_sub_ps(_mm256_set1_ps(-s.boundsHalf[i]), p[i]), vInvDir);
+        __m256 tMax = _mm256_mul_ps(
+            _mm256_sub_ps(_mm256_set1_ps(s.boundsHalf[i]), p[i]), vInvDir);
+        // Operand order keeps the NaN behavior of glm::min/max, std::min/max
+        __m256 t0 = _mm256_min_ps(tMax, tMin);
+        __m256 t1 = _mm256_max_ps(tMax, tMin);
+        tNear = i == 0 ? t0 : _mm256_max_ps(t0, tNear);
+        tFar = i == 0 ? t1 : _mm256_min_ps(t1, tFar);
+    }
+    __m256 isEntered = _mm256_and_ps(
+        _mm256_cmp_ps(tNear, tFar, _CMP_NGT_UQ),
+        _mm256_cmp_ps(tFar, _mm256_setzero_ps(), _CMP_NLT_UQ));
+    packet.laneMask &= uint32_t(_mm256_movemask_ps(isEntered));
+
+    float* pDst[3] = {packet.posX, packet.posY, packet.posZ};
+    for (int i = 0; i < 3; i++) {
+        __m256 entry =
+            _mm256_add_ps(p[i], _mm256_mul_ps(_mm256_set1_ps(s.dir[i]), tNear));
+        _mm256_store_ps(pDst[i], entry);
+    }
+}
+
+/** Trilinear sample of the packet level, like CpuRenderer::getVolData.
+ *
+ * The 2 corners along x are adjacent 16 bit voxels, so one 32 bit gather
+ * fetches both. The pair starts at x0 clamped to [0, dim - 2] so it never
+ * reads past a row, the corners are then picked from the halves. Corners
+ * outside of the level read stored value 0.
+ */
+VL_TARGET("avx2")
+__m256 sampleTrilinearAVX2(const PacketSetup& s, __m256 tx, __m256 ty,
+                           __m256 tz, __m256 laneMask) {
+    const __m256 kHalf = _mm256_set1_ps(0.5f);
+    if (s.isRemapped) {
+        tx = _mm256_sub_ps(
+            _mm256_mul_ps(_mm256_add_ps(tx, kHalf),
+                          _mm256_set1_ps(s.mipScale.x)),
+            kHalf);
+        ty = _mm256_sub_ps(
+            _mm256_mul_ps(_mm256_add_ps(ty, kHalf),
+                          _mm256_set1_ps(s.mipScale.y)),
+            kHalf);
+        tz = _mm256_sub_ps(
+            _mm256_mul_ps(_mm256_add_ps(tz, kHalf),
+                          _mm256_set1_ps(s.mipScale.z)),
+            kHalf);
+    }
+    __m256i x0 = _mm256_cvttps_epi32(_mm256_floor_ps(tx));
+    __m256i y0 = _mm256_cvttps_epi32(_mm256_floor_ps(ty));
+    __m256i z0 = _mm256_cvttps_epi32(_mm256_floor_ps(tz));
+    __m256 fracX = _mm256_sub_ps(tx, _mm256_cvtepi32_ps(x0));
+    __m256 fracY = _mm256_sub_ps(ty, _mm256_cvtepi32_ps(y0));
+    __m256 fracZ = _mm256_sub_ps(tz, _mm256_cvtepi32_ps(z0));
+
+    const __m256i kOne = _mm256_set1_epi32(1);
+    const __m256i kZero = _mm256_setzero_si256();
+    __m256i dimX = _mm256_set1_epi32(s.mipDim.x);
+    __m256i dimY = _mm256_set1_epi32(s.mipDim.y);
+    __m256i dimZ = _mm256_set1_epi32(s.mipDim.z);
+    __m256i base =
+        _mm256_min_epi32(_mm256_max_epi32(x0, kZero),
+                         _mm256_sub_epi32(dimX, _mm256_set1_epi32(2)));
+    // x0 in [-1, dim - 1] keeps at least one corner in the pair
+    __m256i isXInside =
+        _mm256_and_si256(_mm256_cmpgt_epi32(x0, _mm256_set1_epi32(-2)),
+                         _mm256_cmpgt_epi32(dimX, x0));
+    __m256i isX0Low = _mm256_cmpeq_epi32(x0, base);
+    __m256i isX0High = _mm256_cmpeq_epi32(x0, _mm256_add_epi32(base, kOne));
+    __m256i isX1Low = _mm256_cmpeq_epi32(_mm256_add_epi32(x0, kOne), base);
+    __m256i gatherMask =
+        _mm256_and_si256(isXInside, _mm256_castps_si256(laneMask));
+
+    __m256 vSlope = _mm256_set1_ps(s.slope);
+    __m256 vIntercept = _mm256_set1_ps(s.intercept);
+    __m256 v0[2][2], v1[2][2]; // [dz][dy] corners at x0 and x0 + 1
+    for (int dz = 0; dz < 2; dz++) {
+        __m256i z = _mm256_add_epi32(z0, _mm256_set1_epi32(dz));
+        __m256i isZInside =
+            _mm256_andnot_si256(_mm256_cmpgt_epi32(kZero, z),
+                                _mm256_cmpgt_epi32(dimZ, z));
+        for (int dy = 0; dy < 2; dy++) {
+            __m256i y = _mm256_add_epi32(y0, _mm256_set1_epi32(dy));
+            __m256i isYInside =
+                _mm256_andnot_si256(_mm256_cmpgt_epi32(kZero, y),
+                                    _mm256_cmpgt_epi32(dimY, y));
+            __m256i mask = _mm256_and_si256(
+                gatherMask, _mm256_and_si256(isYInside, isZInside));
+            __m256i index = _mm256_add_epi32(
+                _mm256_mullo_epi32(
+                    _mm256_add_epi32(_mm256_mullo_epi32(z, dimY), y), dimX),
+                base);
+            __m256i pair = _mm256_mask_i32gather_epi32(
+                kZero, reinterpret_cast<const int*>(s.pVoxels), index, mask,
+                2);
+            __m256i low, high;
+            if (s.isSigned) {
+                low = _mm256_srai_epi32(_mm256_slli_epi32(pair, 16), 16);
+                high = _mm256_srai_epi32(pair, 16);
+            } else {
+                low = _mm256_and_si256(pair, _mm256_set1_epi32(0xFFFF));
+                high = _mm256_srli_epi32(pair, 16);
+            }
+            __m256i c0 = _mm256_or_si256(_mm256_and_si256(isX0Low, low),
+                                         _mm256_and_si256(isX0High, high));
+            __m256i c1 = _mm256_or_si256(_mm256_and_si256(isX0Low, high),
+                                         _mm256_and_si256(isX1Low, low));
+            v0[dz][dy] = toModalityAVX2(c0, vSlope, vIntercept);
+            v1[dz][dy] = toModalityAVX2(c1, vSlope, vIntercept);
+        }
+    }
+
+    // Same operation order as trilinearValueGradient
+    __m256 c00 = lerpAVX2(v0[0][0], v1[0][0], fracX);
+    __m256 c10 = lerpAVX2(v0[0][1], v1[0][1], fracX);
+    __m256 c01 = lerpAVX2(v0[1][0], v1[1][0], fracX);
+    __m256 c11 = lerpAVX2(v0[1][1], v1[1][1], fracX);
+    __m256 c0 = lerpAVX2(c00, c10, fracY);
+    __m256 c1 = lerpAVX2(c01, c11, fracY);
+    return lerpAVX2(c0, c1, fracZ);
+}
+
+/** March the lanes in the box like CpuRenderer::rayMarch and return the
+ * samples taken. getEmptyDistance(lane, texLoc) is asked for the empty space
+ * leap of a lane.
+ */
+template <typename EmptyFn>
+VL_TARGET("avx2")
+uint64_t marchPacketAVX2(const PacketSetup& s, RayPacket& packet,
+                         EmptyFn&& getEmptyDistance) {
+    constexpr int kWidth = RayPacket::kWidth;
+    constexpr int kLeafShift = std::countr_zero(MinMaxOctree::kLeafSize);
+    static_assert(std::has_single_bit(MinMaxOctree::kLeafSize));
+
+    __m256 px = _mm256_load_ps(packet.posX);
+    __m256 py = _mm256_load_ps(packet.posY);
+    __m256 pz = _mm256_load_ps(packet.posZ);
+    __m256i steps = _mm256_setzero_si256();
+    __m256 isDone = _mm256_setzero_ps();
+    __m256 lanes = maskFromBits(packet.laneMask);
+    const float3 stepDir = s.stepSize * s.dir;
+    const __m256i kMaxSteps = _mm256_set1_epi32(CpuRayMarcher::kMaxSteps);
+    const __m256 vFilter = _mm256_set1_ps(s.filterValue);
+
+    __m256 hitX = _mm256_setzero_ps(), hitY = hitX, hitZ = hitX;
+    __m256 colorR = hitX, colorG = hitX, colorB = hitX, colorA = hitX;
+    __m256i nextTFIndex = _mm256_setzero_si256();
+    // Breakpoints past the last one never pass, NaN compares false
+    alignas(32) float thresholds[kWidth], stepR[kWidth], stepG[kWidth],
+        stepB[kWidth], stepA[kWidth];
+    for (int i = 0; i < kWidth; i++) {
+        bool isStep = i < kBreakpointCount;
+        thresholds[i] = isStep ? float(kTransportSteps[i].valueThreshold)
+                               : std::numeric_limits<float>::quiet_NaN();
+        float4 c = isStep ? kTransportSteps[i].color : float4(0.f);
+        stepR[i] = c.x;
+        stepG[i] = c.y;
+        stepB[i] = c.z;
+        stepA[i] = c.w;
+    }
+
+    uint64_t sampleCount = 0;
+    alignas(32) float laneX[kWidth], laneY[kWidth], laneZ[kWidth];
+    alignas(32) float texX[kWidth], texY[kWidth], texZ[kWidth];
+    alignas(32) int32_t laneSteps[kWidth];
+    while (true) {
+        __m256 isActive = _mm256_andnot_ps(
+            isDone, _mm256_and_ps(lanes, _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+                                             kMaxSteps, steps))));
+        if (_mm256_movemask_ps(isActive) == 0) break;
+
+        __m256 isInside = isActive;
+        __m256 p[3] = {px, py, pz};
+        for (int i = 0; i < 3; i++) {
+            __m256 lo = _mm256_set1_ps(-s.boundsHalf[i]);
+            __m256 hi = _mm256_set1_ps(s.boundsHalf[i]);
+            isInside = _mm256_and_ps(
+                isInside, _mm256_and_ps(_mm256_cmp_ps(p[i], lo, _CMP_NLT_UQ),
+                                        _mm256_cmp_ps(p[i], hi, _CMP_NGT_UQ)));
+        }
+        // World y is the slice axis, like worldPositionToTexCoord
+        __m256 tx = toTexCoordAVX2(px, s.boundsHalf.x, s.volDim.x);
+        __m256 ty = toTexCoordAVX2(pz, s.boundsHalf.y, s.volDim.y);
+        __m256 tz = toTexCoordAVX2(py, s.boundsHalf.z, s.volDim.z);
+
+        uint32_t skipMask = 0;
+        if (s.isSkipping) {
+            __m256 isCandidate = isInside;
+            if (s.pLeafRanges) {
+                // Lanes in an occupied leaf would get a distance of 0
+                __m256 zero = _mm256_setzero_ps();
+                isCandidate = _mm256_and_ps(
+                    isCandidate,
+                    _mm256_and_ps(_mm256_cmp_ps(tx, zero, _CMP_GE_OQ),
+                                  _mm256_and_ps(
+                                      _mm256_cmp_ps(ty, zero, _CMP_GE_OQ),
+                                      _mm256_cmp_ps(tz, zero, _CMP_GE_OQ))));
+                __m256i cx = _mm256_srai_epi32(
+                    _mm256_cvttps_epi32(_mm256_floor_ps(tx)), kLeafShift);
+                __m256i cy = _mm256_srai_epi32(
+                    _mm256_cvttps_epi32(_mm256_floor_ps(ty)), kLeafShift);
+                __m256i cz = _mm256_srai_epi32(
+                    _mm256_cvttps_epi32(_mm256_floor_ps(tz)), kLeafShift);
+                __m256i isInGrid = _mm256_and_si256(
+                    _mm256_cmpgt_epi32(_mm256_set1_epi32(s.leafGrid.x), cx),
+                    _mm256_and_si256(
+                        _mm256_cmpgt_epi32(_mm256_set1_epi32(s.leafGrid.y),
+                                           cy),
+                        _mm256_cmpgt_epi32(_mm256_set1_epi32(s.leafGrid.z),
+                                           cz)));
+                isCandidate = _mm256_and_ps(isCandidate,
+                                            _mm256_castsi256_ps(isInGrid));
+                // Max of the float2 range of the node
+                __m256i index = _mm256_add_epi32(
+                    _mm256_slli_epi32(
+                        _mm256_add_epi32(
+                            _mm256_mullo_epi32(
+                                _mm256_add_epi32(
+                                    _mm256_mullo_epi32(
+                                        cz, _mm256_set1_epi32(s.leafDims.y)),
+                                    cy),
+                                _mm256_set1_epi32(s.leafDims.x)),
+                            cx),
+                        1),
+                    _mm256_set1_epi32(1));
+                __m256 leafMax = _mm256_mask_i32gather_ps(
+                    vFilter, reinterpret_cast<const float*>(s.pLeafRanges),
+                    index, isCandidate, 4);
+                isCandidate = _mm256_and_ps(
+                    isCandidate, _mm256_cmp_ps(leafMax, vFilter, _CMP_LT_OQ));
+            }
+
+            uint32_t candidates = uint32_t(_mm256_movemask_ps(isCandidate));
+            if (candidates) {
+                _mm256_store_ps(laneX, px);
+                _mm256_store_ps(laneY, py);
+                _mm256_store_ps(laneZ, pz);
+                _mm256_store_ps(texX, tx);
+                _mm256_store_ps(texY, ty);
+                _mm256_store_ps(texZ, tz);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(laneSteps),
+                                   steps);
+                for (; candidates; candidates &= candidates - 1) {
+                    int lane = std::countr_zero(candidates);
+                    float distance = getEmptyDistance(
+                        lane, float3(texX[lane], texY[lane], texZ[lane]));
+                    if (distance <= 0.f) continue;
+                    int skipCount =
+                        std::max(1, int(distance / s.stepSize));
+                    float3 leap = float(skipCount) * s.stepSize * s.dir;
+                    laneX[lane] += leap.x;
+                    laneY[lane] += leap.y;
+                    laneZ[lane] += leap.z;
+                    laneSteps[lane] += skipCount;
+                    skipMask |= 1u << lane;
+                }
+                if (skipMask) {
+                    px = _mm256_load_ps(laneX);
+                    py = _mm256_load_ps(laneY);
+                    pz = _mm256_load_ps(laneZ);
+                    steps = _mm256_load_si256(
+                        reinterpret_cast<const __m256i*>(laneSteps));
+                }
+            }
+        }
+        __m256 isSkipped = maskFromBits(skipMask);
+
+        __m256 isSampled = _mm256_andnot_ps(isSkipped, isInside);
+        int sampleMask = _mm256_movemask_ps(isSampled);
+        if (sampleMask) {
+            sampleCount += uint64_t(std::popcount(uint32_t(sampleMask)));
+            __m256 value = sampleTrilinearAVX2(s, tx, ty, tz, isSampled);
+            __m256 isHit = _mm256_and_ps(
+                isSampled, _mm256_cmp_ps(value, vFilter, _CMP_GE_OQ));
+            if (s.isTransport) {
+                __m256 threshold = _mm256_permutevar8x32_ps(
+                    _mm256_load_ps(thresholds), nextTFIndex);
+                __m256 isPassed = _mm256_and_ps(
+                    isHit, _mm256_cmp_ps(value, threshold, _CMP_GE_OQ));
+                // color += float4(c.rgb * c.a, c.a) on the passing lanes
+                __m256 a = _mm256_permutevar8x32_ps(_mm256_load_ps(stepA),
+                                                    nextTFIndex);
+                __m256* pColors[3] = {&colorR, &colorG, &colorB};
+                const float* pSteps[3] = {stepR, stepG, stepB};
+                for (int i = 0; i < 3; i++) {
+                    __m256 c = _mm256_permutevar8x32_ps(
+                        _mm256_load_ps(pSteps[i]), nextTFIndex);
+                    *pColors[i] = _mm256_blendv_ps(
+                        *pColors[i],
+                        _mm256_add_ps(*pColors[i], _mm256_mul_ps(c, a)),
+                        isPassed);
+                }
+                colorA = _mm256_blendv_ps(colorA, _mm256_add_ps(colorA, a),
+                                          isPassed);
+                nextTFIndex = _mm256_sub_epi32(nextTFIndex,
+                                               _mm256_castps_si256(isPassed));
+                isDone = _mm256_or_ps(
+                    isDone, _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+                                nextTFIndex,
+                                _mm256_set1_epi32(kBreakpointCount))));
+            } else {
+                hitX = _mm256_blendv_ps(hitX, tx, isHit);
+                hitY = _mm256_blendv_ps(hitY, ty, isHit);
+                hitZ = _mm256_blendv_ps(hitZ, tz, isHit);
+                isDone = _mm256_or_ps(isDone, isHit);
+            }
+        }
+
+        // Lanes that did not leap take one step, done lanes are dropped
+        __m256 isStepped = _mm256_andnot_ps(isSkipped, isActive);
+        px = _mm256_add_ps(
+            px, _mm256_and_ps(isStepped, _mm256_set1_ps(stepDir.x)));
+        py = _mm256_add_ps(
+            py, _mm256_and_ps(isStepped, _mm256_set1_ps(stepDir.y)));
+        pz = _mm256_add_ps(
+            pz, _mm256_and_ps(isStepped, _mm256_set1_ps(stepDir.z)));
+        steps = _mm256_sub_epi32(steps, _mm256_castps_si256(isStepped));
+    }
+
+    if (s.isTransport) {
+        __m256 isComposited = _mm256_cmp_ps(colorA, _mm256_setzero_ps(),
+                                            _CMP_NEQ_UQ);
+        packet.hitMask = packet.laneMask &
+                         uint32_t(_mm256_movemask_ps(isComposited));
+    } else {
+        packet.hitMask =
+            packet.laneMask & uint32_t(_mm256_movemask_ps(isDone));
+    }
+    _mm256_store_ps(packet.texLocX, hitX);
+    _mm256_store_ps(packet.texLocY, hitY);
+    _mm256_store_ps(packet.texLocZ, hitZ);
+    _mm256_store_ps(packet.colorR, colorR);
+    _mm256_store_ps(packet.colorG, colorG);
+    _mm256_store_ps(packet.colorB, colorB);
+    _mm256_store_ps(packet.colorA, colorA);
+    return sampleCount;
+}
+#endif
+} // namespace
+
+void CpuRenderer::shadePacket(const FrameContext& ctx, uint2 blockMin,
+                              Image& image, uint64_t& sampleCount) const {
+    auto writePixel = [&](uint2 pixel, float3 color) {
+        for (int c = 0; c < 3; c++)
+            image.getPixel(int(pixel.x), int(pixel.y), c) = color[c];
+        image.getPixel(int(pixel.x), int(pixel.y), 3) = 1.f;
+    };
+    uint2 pixels[kPacketWidth];
+    uint32_t laneMask = 0;
+    for (uint32_t lane = 0; lane < kPacketWidth; lane++) {
+        pixels[lane] = blockMin + uint2(lane % 4, lane / 4);
+        if (pixels[lane].x < ctx.frameDim.x && pixels[lane].y < ctx.frameDim.y)
+            laneMask |= 1u << lane;
+    }
+
+#if VL_X86
+    RayPacket packet;
+    packet.laneMask = laneMask;
+    float3 dir;
+    for (uint32_t lane = 0; lane < kPacketWidth; lane++) {
+        float3 origin;
+        CpuRayMarcher::getCameraRay(ctx.camera, pixels[lane], ctx.frameDim,
+                                    origin, dir);
+        packet.posX[lane] = origin.x;
+        packet.posY[lane] = origin.y;
+        packet.posZ[lane] = origin.z;
+    }
+
+    PacketSetup s = {};
+    s.dir = dir;
+    s.boundsHalf = mGeometry.getBounds() * 0.5f;
+    s.volDim = float3(mVolDim);
+    s.stepSize = 1.f / CpuRayMarcher::kMaxSteps;
+    intersectPacketAVX2(s, packet);
+
+    // The step grid and empty space leaps follow each ray's own texDir and
+    // all lanes must share a mip level
+    float3 texDirs[kPacketWidth];
+    int lod = -1;
+    bool isUniform = true;
+    for (uint32_t m = packet.laneMask; m; m &= m - 1) {
+        int lane = std::countr_zero(m);
+        float3 p(packet.posX[lane], packet.posY[lane], packet.posZ[lane]);
+        texDirs[lane] = mGeometry.worldPositionToTexCoord(p + dir) -
+                        mGeometry.worldPositionToTexCoord(p);
+        int laneLod = selectLod(ctx, texDirs[lane]);
+        isUniform = isUniform && (lod < 0 || laneLod == lod);
+        lod = laneLod;
+    }
+    lod = std::max(lod, 0);
+    auto mipDims = mpVolData->getMipDims(uint32_t(lod));
+    if (isUniform && mipDims[0] >= 2) {
+        const auto& params = ctx.params;
+        s.pVoxels = mpVolData->getMipData(uint32_t(lod)).data();
+        s.mipDim = int3(mipDims[0], mipDims[1], mipDims[2]);
+        s.mipScale = float3(s.mipDim) / float3(mVolDim);
+        s.isRemapped = lod > 0;
+        s.isSigned = mpVolData->getVoxelFormat() == VoxelFormat::Int16;
+        s.slope = mpVolData->getScanMetaData().rescaleSlope;
+        s.intercept = mpVolData->getScanMetaData().rescaleIntercept;
+        s.filterValue = float(params.filterValue);
+        s.isTransport = params.shadingMode == ShadingMode::TransportFunc;
+        s.isSkipping = params.emptySpaceMode != EmptySpaceMode::Disabled;
+        if (params.emptySpaceMode == EmptySpaceMode::Octree) {
+            const auto& leafDims = mpOctree->getLevelDims(0);
+            const auto& leafGrid = mpOctree->getLeafGrid();
+            s.pLeafRanges = mpOctree->getLevelRanges(0).data();
+            s.leafDims = int3(leafDims[0], leafDims[1], leafDims[2]);
+            s.leafGrid = int3(leafGrid[0], leafGrid[1], leafGrid[2]);
+        }
+        sampleCount += marchPacketAVX2(s, packet, [&](int lane,
+                                                      float3 texLoc) {
+            return getEmptySpaceDistance(ctx, texLoc, texDirs[lane], lod);
+        });
+
+        BrickPin pin;
+        for (uint32_t lane = 0; lane < kPacketWidth; lane++) {
+            if (!(laneMask & (1u << lane))) continue;
+            bool isHit = (packet.hitMask & (1u << lane)) != 0;
+            ShadingData sd = {};
+            if (isHit && s.isTransport) {
+                sd.transportColor =
+                    float4(packet.colorR[lane], packet.colorG[lane],
+                           packet.colorB[lane], packet.colorA[lane]);
+            } else if (isHit) {
+                float3 texLoc(packet.texLocX[lane], packet.texLocY[lane],
+                              packet.texLocZ[lane]);
+                sd.normW = computeNormal(ctx, texLoc, lod, pin);
+            }
+            writePixel(pixels[lane], shade(ctx, isHit, sd));
+        }
+        return;
+    }
+#endif
+
+    for (uint32_t m = laneMask; m; m &= m - 1) {
+        int lane = std::countr_zero(m);
+        writePixel(pixels[lane], shadePixel(ctx, pixels[lane], sampleCount));
+    }
+}
+
+CpuRenderer::Stats CpuRenderer::render(const CameraData& camera,
+                                       const SampleAppParam& inParams,
+                                       Image& image) const {
+    auto start = std::chrono::steady_clock::now();
+    if (image.getChannels() != 4) image.resizeChannels(4);
+
+    SampleAppParam params = inParams;
+    if (params.gradientMode == GradientMode::Precomputed && !mpGradients)
+        params.gradientMode = GradientMode::FiniteDifference;
+    // Per frame, the distance field depends on the threshold
+    OccupancyGrid::SharedPtr pOccupancy;
+    if (params.emptySpaceMode == EmptySpaceMode::DistanceField) {
+        pOccupancy = OccupancyGrid::create(*mpOctree);
+        pOccupancy->setThreshold(float(params.filterValue));
+    }
+
+    // Packets gather from in-memory voxels with 32 bit indices
+    bool usePackets = mSimdLevel == SimdLevel::AVX2 &&
+                      !mpVolData->getBrickCache() &&
+                      mpVolData->getVolumeSize() <= uint64_t(INT32_MAX);
+
+    uint2 frameDim(image.getWidth(), image.getHeight());
+    FrameContext ctx = {camera, params, frameDim, pOccupancy.get(),
+                        usePackets};
+    uint2 tileGrid = (frameDim + kTileSize - 1u) / kTileSize;
+    std::atomic<uint64_t> sampleCount = 0;
+    parallelFor(size_t(tileGrid.x) * tileGrid.y, [&](size_t tile) {
+        uint2 tileMin =
+            uint2(tile % tileGrid.x, tile / tileGrid.x) * kTileSize;
+        uint2 tileMax = glm::min(tileMin + kTileSize, frameDim);
+        uint64_t tileSamples = 0;
+        if (usePackets) {
+            for (uint32_t y = tileMin.y; y < tileMax.y; y += 2) {
+                for (uint32_t x = tileMin.x; x < tileMax.x; x += 4)
+                    shadePacket(ctx, uint2(x, y), image, tileSamples);
+            }
+            sampleCount += tileSamples;
+            return;
+        }
+        for (uint32_t y = tileMin.y; y < tileMax.y; y++) {
+            for (uint32_t x = tileMin.x; x < tileMax.x; x++) {
+                float3 color = shadePixel(ctx, uint2(x, y), tileSamples);
+                for (int c = 0; c < 3; c++)
+                    image.getPixel(int(x), int(y), c) = color[c];
+                image.getPixel(int(x), int(y), 3) = 1.f;
+            }
+        }
+        sampleCount += tileSamples;
+    });
+
+    Stats stats;
+    stats.simdLevel = usePackets ? SimdLevel::AVX2 : SimdLevel::Scalar;
+    stats.rayCount = uint64_t(frameDim.x) * frameDim.y;
+    stats.sampleCount = sampleCount;
+    stats.elapsedMs = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    return stats;
+}
+
+void CpuRenderer::runBenchmark(const CameraData& camera,
+                               const SampleAppParam& params, uint2 frameDim) {
+    SimdLevel selected = mSimdLevel;
+    logInfo("Benchmarking the CPU renderer at {}x{}, selected level {}.",
+            frameDim.x, frameDim.y, selected);
+
+    // Best of a few frames, the first one may build gradients
+    auto measure = [&](SimdLevel level, Image& image) {
+        mSimdLevel = level;
+        Stats best;
+        for (int run = 0; run < 3; run++) {
+            Stats stats = render(camera, params, image);
+            if (run == 0 || stats.elapsedMs < best.elapsedMs) best = stats;
+        }
+        logInfo("CPU renderer {:<7} {}", level, best);
+        return best;
+    };
+
+    Image reference(frameDim.x, frameDim.y, 4);
+    Stats scalar = measure(SimdLevel::Scalar, reference);
+    if (VoxelKernels::getSimdLevel() >= SimdLevel::AVX2) {
+        Image image(frameDim.x, frameDim.y, 4);
+        Stats packets = measure(SimdLevel::AVX2, image);
+        float maxDifference = 0.f;
+        for (int c = 0; c < 4; c++) {
+            for (int i = 0; i < image.getArea(); i++) {
+                maxDifference =
+                    std::max(maxDifference, std::abs(image.getPixel(i, c) -
+                                                     reference.getPixel(i, c)));
+            }
+        }
+        logInfo("Ray packets run {:.2f}x the scalar rays/s, max difference "
+                "to the scalar image {}.",
+                scalar.elapsedMs / std::max(packets.elapsedMs, 1e-3),
+                maxDifference);
+    }
+    mSimdLevel = selected;
+}
+} // namespace Voluma
@@ -0,0 +1,151 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "Core/CameraData.slang"
+#include "Core/Macros.h"
+#include "Core/Math.h"
+#include "Core/SampleAppShared.slangh"
+#include "Data/BrickCache.h"
+#include "Data/GradientVolume.h"
+#include "Data/MinMaxOctree.h"
+#include "Data/OccupancyGrid.h"
+#include "Render/CpuRayMarcher.h"
+#include "Utils/Image.h"
+#include "Utils/Logger.h"
+#include "Utils/TrilinearGradient.slangh"
+#include "Utils/VoxelKernels.h"
+
+namespace Voluma {
+class VolData;
+
+/** Tile based CPU renderer reproducing the ray marching shader.
+ *
+ * rayMarch, transportFunc, phongShading, the shading and gradient modes, the
+ * mip level selection and the empty space skipping of RayMarching.cs.slang
+ * are mirrored step by step, so a frame matches the GPU one up to float
+ * rounding and serves as ground truth for GPU side optimizations. The frame
+ * is cut into kTileSize^2 tiles which are shaded independently on all
+ * cores, every tile writes disjoint pixels and keeps its counters local.
+ *
+ * With AVX2 the rays of a tile are marched in packets of kPacketWidth
+ * pixels, 4x2 blocks sharing one lane per pixel. Box intersection, stepping,
+ * trilinear gathers, termination and transfer function compositing run on
+ * all lanes at once, empty space leaps and hit shading stay per lane. The
+ * packets take the same steps and samples as the scalar path, so both
+ * produce the same image.
+ *
+ * Out-of-core volumes are marched by the scalar path. A ray pins the brick
+ * it samples and reads the 8 corners of a sample from the brick apron, so
+ * the brick cache is locked once per brick the ray enters, not per voxel.
+ */
+class VL_API CpuRenderer {
+   public:
+    static constexpr uint32_t kTileSize = 16;
+    static constexpr uint32_t kPacketWidth = 8;
+
+    struct Stats {
+        uint64_t rayCount = 0;
+        uint64_t sampleCount = 0; ///< Trilinear fetches of rayMarchStep
+        double elapsedMs = 0.0;
+        SimdLevel simdLevel = SimdLevel::Scalar; ///< Level the rays ran at
+
+        std::string toString() const;
+    };
+
+    /** Create a renderer, pOctree is built if nullptr. Without pGradients
+     * the precomputed gradient mode falls back to finite differences.
+     */
+    CpuRenderer(std::shared_ptr<const VolData> pVolData,
+                MinMaxOctree::SharedPtr pOctree = nullptr,
+                GradientVolume::SharedPtr pGradients = nullptr);
+
+    /** Render a frame into an RGBA image, the image size is the frame size.
+     * The tiles of a frame already run on all cores, so frames should be
+     * rendered one after another.
+     */
+    Stats render(const CameraData& camera, const SampleAppParam& params,
+                 Image& image) const;
+
+    /** Get the instruction set used to march rays, ray packets need AVX2.
+     */
+    SimdLevel getSimdLevel() const { return mSimdLevel; }
+
+    /** Limit the instruction set, clamped to the one supported by the CPU.
+     */
+    void setSimdLevel(SimdLevel level);
+
+    /** Time a frame at every supported level and log the rays/s and
+     * samples/s, along with the difference to the scalar image.
+     */
+    void runBenchmark(const CameraData& camera, const SampleAppParam& params,
+                      uint2 frameDim);
+
+   private:
+    struct ShadingData {
+        float3 posW;
+        float density;
+        float3 normW;
+        float4 transportColor;
+    };
+
+    /** Per frame state shared by all tiles.
+     */
+    struct FrameContext {
+        const CameraData& camera;
+        const SampleAppParam& params;
+        uint2 frameDim;
+        const OccupancyGrid* pOccupancy;
+        bool usePackets;
+    };
+
+    /** Brick of an out-of-core volume pinned by a ray.
+     */
+    struct BrickPin {
+        uint32_t index = UINT32_MAX;
+        BrickCache::BrickRef pBrick;
+    };
+
+    float getVolCell(int3 texLoc, int lod) const;
+
+    /** Get the 8 level 0 cells from i0 to i0 + 1 in the pinned brick of an
+     * out-of-core volume, the brick of i0 is pinned first if needed. Returns
+     * false if the volume is in memory or no corner is in the volume along
+     * some axis, so getVolCell does not touch the cache either.
+     */
+    bool getPinnedCells(int3 i0, BrickPin& pin, float cells[8]) const;
+
+    float getVolData(float3 texLoc, int lod, BrickPin& pin) const;
+    TrilinearSample getVolDataGradient(float3 texLoc, int lod,
+                                       BrickPin& pin) const;
+    float3 computeGradient(float3 texLoc, int lod, BrickPin& pin) const;
+    float3 computeNormal(const FrameContext& ctx, float3 texLoc, int lod,
+                         BrickPin& pin) const;
+    int selectLod(const FrameContext& ctx, float3 texDir) const;
+    float getEmptySpaceDistance(const FrameContext& ctx, float3 texLoc,
+                                float3 texDir, int lod) const;
+    bool rayMarch(const FrameContext& ctx, float3 origin, float3 dir,
+                  ShadingData& sd, uint64_t& sampleCount) const;
+    float3 shade(const FrameContext& ctx, bool isHit,
+                 const ShadingData& sd) const;
+    float3 shadePixel(const FrameContext& ctx, uint2 pixel,
+                      uint64_t& sampleCount) const;
+
+    /** Shade a 4x2 block of pixels as one ray packet, pixels outside of the
+     * frame are left untouched.
+     */
+    void shadePacket(const FrameContext& ctx, uint2 blockMin, Image& image,
+                     uint64_t& sampleCount) const;
+
+    std::shared_ptr<const VolData> mpVolData;
+    MinMaxOctree::SharedPtr mpOctree;
+    GradientVolume::SharedPtr mpGradients;
+    CpuRayMarcher mGeometry; ///< Volume bounds and camera rays
+    int3 mVolDim;
+    uint32_t mMipLevelCount;
+    SimdLevel mSimdLevel;
+};
+} // namespace Voluma
+
+VL_FMT(Voluma::CpuRenderer::Stats)
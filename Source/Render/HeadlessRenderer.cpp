@@ -0,0 +1,206 @@
+#include "HeadlessRenderer.h"
+
+#include <fmt/format.h>
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "Core/Camera.h"
+#include "Data/MinMaxOctree.h"
+#include "Data/VolData.h"
+#include "Render/CpuKernelRenderer.h"
+#include "Render/CpuRenderer.h"
+#include "Utils/Image.h"
+#include "Utils/Logger.h"
+
+namespace Voluma {
+static bool parseFloat3(const char* arg, float3& value) {
+    return std::sscanf(arg, "%f,%f,%f", &value.x, &value.y, &value.z) == 3;
+}
+
+void HeadlessRenderer::logUsage() {
+    logInfo(
+        "Usage: Voluma --headless <series folder>"
+        " [--output frame_{:04}.png] [--size 512x512] [--camera x,y,z]"
+        " [--target x,y,z] [--up x,y,z]"
+        " [--turntable frames] [--shading Normal|FlatShade|TransportFunc]"
+        " [--gradient FiniteDifference|Precomputed|Analytic]"
+        " [--empty-space Disabled|DistanceField|Octree] [--threshold value]"
+        " [--memory-budget-mb size] [--renderer reference|shader]");
+}
+
+bool HeadlessRenderer::parseArgs(std::span<const char* const> args,
+                                 Options& options) {
+    for (size_t i = 0; i < args.size(); i++) {
+        std::string_view arg = args[i];
+        // Every option takes one value
+        const char* value = arg.starts_with("--") && i + 1 < args.size()
+                                ? args[++i]
+                                : nullptr;
+        bool isValid = true;
+        if (!arg.starts_with("--")) {
+            options.seriesPath = arg;
+        } else if (!value) {
+            isValid = false;
+        } else if (arg == "--output") {
+            options.outputPattern = value;
+        } else if (arg == "--size") {
+            isValid = std::sscanf(value, "%ux%u", &options.frameDim.x,
+                                  &options.frameDim.y) == 2 &&
+                      options.frameDim.x > 0 && options.frameDim.y > 0;
+        } else if (arg == "--camera") {
+            isValid = parseFloat3(value, options.cameraPos);
+        } else if (arg == "--target") {
+            isValid = parseFloat3(value, options.cameraTarget);
+        } else if (arg == "--up") {
+            isValid = parseFloat3(value, options.cameraUp);
+        } else if (arg == "--turntable") {
+            isValid =
+                std::sscanf(value, "%u", &options.turntableFrames) == 1;
+        } else if (arg == "--shading") {
+            isValid = stringToEnum(value, options.params.shadingMode);
+        } else if (arg == "--gradient") {
+            isValid = stringToEnum(value, options.params.gradientMode);
+        } else if (arg == "--empty-space") {
+            isValid = stringToEnum(value, options.params.emptySpaceMode);
+        } else if (arg == "--threshold") {
+            isValid =
+                std::sscanf(value, "%d", &options.params.filterValue) == 1;
+        } else if (arg == "--memory-budget-mb") {
+            std::string_view sizeStr = value;
+            uint64_t size = 0;
+            auto [pEnd, ec] = std::from_chars(
+                sizeStr.data(), sizeStr.data() + sizeStr.size(), size);
+            isValid = ec == std::errc() &&
+                      pEnd == sizeStr.data() + sizeStr.size() &&
+                      size <= (~0ull >> 20);
+            options.memoryBudget = size << 20;
+        } else if (arg == "--renderer") {
+            std::string_view renderer = value;
+            isValid = renderer == "reference" || renderer == "shader";
+            options.useShaderKernel = renderer == "shader";
+        } else {
+            isValid = false;
+        }
+        if (!isValid) {
+            logError("Invalid headless argument {} {}", arg,
+                     value ? value : "");
+            logUsage();
+            return false;
+        }
+    }
+
+    if (options.seriesPath.empty()) {
+        logError("No series folder given.");
+        logUsage();
+        return false;
+    }
+    try {
+        (void)fmt::format(fmt::runtime(options.outputPattern), 0u);
+    } catch (const fmt::format_error& e) {
+        logError("Invalid output pattern {}: {}", options.outputPattern,
+                 e.what());
+        return false;
+    }
+    return true;
+}
+
+bool HeadlessRenderer::run(const Options& options) {
+    auto start = std::chrono::steady_clock::now();
+
+    VolData::LoadOptions loadOptions;
+    loadOptions.memoryBudget = options.memoryBudget;
+    std::shared_ptr<VolData> pVolData;
+    try {
+        pVolData = VolData::loadFromDisk(options.seriesPath, loadOptions);
+    } catch (const std::exception& e) {
+        logError("Failed to load volume {}: {}", options.seriesPath.string(),
+                 e.what());
+    }
+    if (!pVolData) return false;
+
+    // Build everything up front, frames share the renderer
+    SampleAppParam params = options.params;
+    if (params.gradientMode == GradientMode::Precomputed &&
+        !pVolData->buildGradients()) {
+        logWarning("Precomputed gradients unavailable, using finite "
+                   "differences.");
+        params.gradientMode = GradientMode::FiniteDifference;
+    }
+    auto pOctree = MinMaxOctree::create(*pVolData);
+    CpuRenderer renderer(pVolData, pOctree, pVolData->getGradients());
+    CpuKernelRenderer::SharedPtr pKernelRenderer;
+    if (options.useShaderKernel) {
+        pKernelRenderer = CpuKernelRenderer::create(pVolData, pOctree,
+                                                    pVolData->getGradients());
+        if (!pKernelRenderer) return false;
+    }
+
+    // Frames go one by one, the tiles or groups of a frame already run on
+    // all cores
+    uint32_t frameCount = std::max(options.turntableFrames, 1u);
+    uint32_t failedCount = 0;
+    uint64_t rayCount = 0, sampleCount = 0;
+    for (uint32_t frame = 0; frame < frameCount; frame++) {
+        // Turn the eye around the up axis through the target
+        float angle =
+            2.f * glm::pi<float>() * float(frame) / float(frameCount);
+        quatf rotation = glm::angleAxis(angle, normalize(options.cameraUp));
+        Camera camera;
+        camera.setPosition(options.cameraTarget +
+                           rotation * (options.cameraPos -
+                                       options.cameraTarget));
+        camera.setTarget(options.cameraTarget);
+        camera.setUp(options.cameraUp);
+        camera.setAspectRatio(float(options.frameDim.x) /
+                              float(options.frameDim.y));
+
+        // The shaded colors are display values, like the swapchain bytes
+        Image image(options.frameDim.x, options.frameDim.y, 4,
+                    ColorSpace::sRGB);
+        std::string statsText;
+        if (pKernelRenderer) {
+            auto stats =
+                pKernelRenderer->render(camera.getData(), params, image);
+            rayCount += uint64_t(options.frameDim.x) * options.frameDim.y;
+            statsText = stats.toString();
+        } else {
+            auto stats = renderer.render(camera.getData(), params, image);
+            rayCount += stats.rayCount;
+            sampleCount += stats.sampleCount;
+            statsText = stats.toString();
+        }
+
+        std::filesystem::path path =
+            fmt::format(fmt::runtime(options.outputPattern), frame);
+        try {
+            if (path.has_parent_path())
+                std::filesystem::create_directories(path.parent_path());
+            if (path.extension() == ".exr")
+                image.writeEXR(path);
+            else
+                image.writePNG(path);
+        } catch (const std::exception& e) {
+            logError("Failed to write frame {} to {}: {}", frame,
+                     path.string(), e.what());
+            failedCount++;
+            continue;
+        }
+        logInfo("Frame {} written to {}, {}", frame, path.string(),
+                statsText);
+    }
+
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    logInfo("Rendered {} frames in {:.1f} s, {:.2f} frames/s, {} rays, {} "
+            "samples.",
+            frameCount, seconds, frameCount / std::max(seconds, 1e-3),
+            rayCount, sampleCount);
+    if (failedCount > 0) logError("{} frames failed.", failedCount);
+    return failedCount == 0;
+}
+} // namespace Voluma
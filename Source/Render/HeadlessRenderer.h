@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+
+#include "Core/Macros.h"
+#include "Core/Math.h"
+#include "Core/SampleAppShared.slangh"
+
+namespace Voluma {
+/** Offline rendering of a series for batch jobs, e.g. thumbnails and
+ * turntables.
+ *
+ * Frames are rendered with the CPU renderer and written through Image, no
+ * window, swapchain or GPU device is created. Frames are rendered one after
+ * another, the tiles of a frame already run on all cores. With
+ * useShaderKernel the ray marching shader itself runs on the CPU instead,
+ * its thread groups spread over the cores the same way.
+ */
+class VL_API HeadlessRenderer {
+   public:
+    struct Options {
+        std::filesystem::path seriesPath;
+        std::string outputPattern = "frame_{:04}.png"; ///< .exr or .png
+        uint2 frameDim = uint2(512, 512);
+        float3 cameraPos = float3(0.f, 0.f, 2.f);
+        float3 cameraTarget = float3(0.f);
+        float3 cameraUp = float3(0.f, 1.f, 0.f);
+        uint32_t turntableFrames = 0; ///< Frames of a turn, 0 for one view
+        SampleAppParam params;
+        uint64_t memoryBudget = 0; ///< See VolData::LoadOptions
+        bool useShaderKernel = false; ///< Render with CpuKernelRenderer
+    };
+
+    /** Parse the arguments following --headless, logs the problem and the
+     * usage and returns false on bad input.
+     */
+    static bool parseArgs(std::span<const char* const> args,
+                          Options& options);
+
+    /** Load the series and write every frame, returns false if the series
+     * failed to load or any frame failed to write.
+     */
+    static bool run(const Options& options);
+
+   private:
+    static void logUsage();
+};
+} // namespace Voluma
@@ -0,0 +1,60 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace Voluma {
+/** Blocking multi-producer multi-consumer FIFO with a fixed capacity.
+ *
+ * push() blocks while the queue is full, pop() blocks while it is empty.
+ * After close() producers are rejected and consumers drain the remaining
+ * items, then pop() returns std::nullopt.
+ */
+template <typename T>
+class BoundedQueue {
+   public:
+    explicit BoundedQueue(size_t capacity) : mCapacity(capacity) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /** Push an item, returns false if the queue is closed.
+     */
+    bool push(T item) {
+        std::unique_lock<std::mutex> lck(mMutex);
+        mNotFull.wait(lck,
+                      [&]() { return mIsClosed || mItems.size() < mCapacity; });
+        if (mIsClosed) return false;
+        mItems.push_back(std::move(item));
+        mNotEmpty.notify_one();
+        return true;
+    }
+
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lck(mMutex);
+        mNotEmpty.wait(lck, [&]() { return mIsClosed || !mItems.empty(); });
+        if (mItems.empty()) return std::nullopt;
+        T item = std::move(mItems.front());
+        mItems.pop_front();
+        mNotFull.notify_one();
+        return item;
+    }
+
+    void close() {
+        std::unique_lock<std::mutex> lck(mMutex);
+        mIsClosed = true;
+        mNotEmpty.notify_all();
+        mNotFull.notify_all();
+    }
+
+   private:
+    size_t mCapacity;
+    bool mIsClosed = false;
+    std::deque<T> mItems;
+    std::mutex mMutex;
+    std::condition_variable mNotEmpty;
+    std::condition_variable mNotFull;
+};
+} // namespace Voluma
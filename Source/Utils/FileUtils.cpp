@@ -0,0 +1,72 @@
+#include "FileUtils.h"
+
+#include <cstdlib>
+
+#if !VL_WINDOWS
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Utils/Logger.h"
+
+namespace Voluma {
+namespace {
+std::filesystem::path getEnvPath(const char* name) {
+    const char* value = std::getenv(name);
+    return value && *value ? std::filesystem::path(value)
+                           : std::filesystem::path();
+}
+
+std::filesystem::path findUserCacheDir() {
+#if VL_WINDOWS
+    auto base = getEnvPath("LOCALAPPDATA");
+    return base.empty() ? base : base / "Voluma";
+#elif VL_MACOSX
+    auto home = getEnvPath("HOME");
+    return home.empty() ? home : home / "Library" / "Caches" / "Voluma";
+#else
+    auto base = getEnvPath("XDG_CACHE_HOME");
+    if (base.empty()) {
+        auto home = getEnvPath("HOME");
+        if (home.empty()) return home;
+        base = home / ".cache";
+    }
+    return base / "voluma";
+#endif
+}
+
+std::filesystem::path createUserCacheDir() {
+    auto dir = findUserCacheDir();
+    if (dir.empty()) {
+        logWarning("No per-user cache folder found, caching is disabled.");
+        return dir;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        logWarning("Failed to create cache folder {}: {}", dir.string(),
+                   ec.message());
+        return {};
+    }
+#if !VL_WINDOWS
+    // Cache files are mapped and trusted on load, only their owner may
+    // write them
+    struct stat info;
+    if (stat(dir.c_str(), &info) != 0 || info.st_uid != getuid()) {
+        logWarning("Cache folder {} belongs to another user, caching is "
+                   "disabled.",
+                   dir.string());
+        return {};
+    }
+#endif
+    std::filesystem::permissions(dir, std::filesystem::perms::owner_all,
+                                 std::filesystem::perm_options::replace, ec);
+    return dir;
+}
+} // namespace
+
+std::filesystem::path getUserCacheDir() {
+    static const std::filesystem::path dir = createUserCacheDir();
+    return dir;
+}
+} // namespace Voluma
@@ -0,0 +1,30 @@
+#pragma once
+#include <fmt/format.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <random>
+
+#include "Core/Macros.h"
+
+namespace Voluma {
+/** Get the per-user folder of the Voluma caches, created owner only (0700)
+ * if missing: %LOCALAPPDATA%/Voluma on Windows, ~/Library/Caches/Voluma on
+ * macOS and $XDG_CACHE_HOME/voluma or ~/.cache/voluma elsewhere. Returns an
+ * empty path if no such folder can be created, or if it belongs to another
+ * user, so caching is skipped rather than shared.
+ */
+VL_API std::filesystem::path getUserCacheDir();
+
+/** Get a unique sibling of path to stage a write into before renaming it over
+ * path. Concurrent writers of the same path never share a staging file, and
+ * the rename stays within one directory so it replaces path atomically.
+ */
+inline std::filesystem::path getStagingPath(const std::filesystem::path& path) {
+    std::random_device device;
+    uint64_t suffix = (uint64_t(device()) << 32) | device();
+    auto stagingPath = path;
+    stagingPath += fmt::format(".{:016x}.tmp", suffix);
+    return stagingPath;
+}
+} // namespace Voluma
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Voluma {
+static constexpr uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ull;
+
+/** FNV-1a, enough to tell file names and folder contents apart.
+ */
+inline uint64_t hashBytes(uint64_t hash, const void* pData, size_t size) {
+    const auto* pBytes = static_cast<const uint8_t*>(pData);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= pBytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+inline uint64_t hashString(std::string_view str) {
+    return hashBytes(kFnvOffsetBasis, str.data(), str.size());
+}
+} // namespace Voluma
@@ -0,0 +1,72 @@
+#include "MappedFile.h"
+
+#if VL_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Utils/Logger.h"
+
+namespace Voluma {
+#if VL_WINDOWS
+MappedFile::SharedPtr MappedFile::open(const std::filesystem::path& path) {
+    SharedPtr pFile(new MappedFile());
+    HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ,
+                              FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    pFile->mFileHandle = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return nullptr;
+    pFile->mSize = size_t(size.QuadPart);
+
+    HANDLE mapping =
+        CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) return nullptr;
+    pFile->mMappingHandle = mapping;
+
+    pFile->mpData = static_cast<const uint8_t*>(
+        MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (pFile->mpData == nullptr) {
+        logWarning("MappedFile: failed to map {}.", path.string());
+        return nullptr;
+    }
+    return pFile;
+}
+
+MappedFile::~MappedFile() {
+    if (mpData) UnmapViewOfFile(mpData);
+    if (mMappingHandle) CloseHandle(mMappingHandle);
+    if (mFileHandle) CloseHandle(mFileHandle);
+}
+#else
+MappedFile::SharedPtr MappedFile::open(const std::filesystem::path& path) {
+    SharedPtr pFile(new MappedFile());
+    pFile->mFd = ::open(path.c_str(), O_RDONLY);
+    if (pFile->mFd < 0) return nullptr;
+
+    struct stat st;
+    if (fstat(pFile->mFd, &st) != 0 || st.st_size == 0) return nullptr;
+    pFile->mSize = size_t(st.st_size);
+
+    void* pData =
+        mmap(nullptr, pFile->mSize, PROT_READ, MAP_SHARED, pFile->mFd, 0);
+    if (pData == MAP_FAILED) {
+        logWarning("MappedFile: failed to map {}.", path.string());
+        return nullptr;
+    }
+    pFile->mpData = static_cast<const uint8_t*>(pData);
+    return pFile;
+}
+
+MappedFile::~MappedFile() {
+    if (mpData) munmap(const_cast<uint8_t*>(mpData), mSize);
+    if (mFd >= 0) close(mFd);
+}
+#endif
+} // namespace Voluma
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+#include "Core/Macros.h"
+
+namespace Voluma {
+/** Read-only memory mapping of a whole file.
+ */
+class VL_API MappedFile {
+   public:
+    using SharedPtr = std::shared_ptr<MappedFile>;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /** Map a file into memory, returns nullptr on failure.
+     */
+    static SharedPtr open(const std::filesystem::path& path);
+
+    const uint8_t* getData() const { return mpData; }
+    size_t getSize() const { return mSize; }
+
+    ~MappedFile();
+
+   private:
+    MappedFile() = default;
+
+    const uint8_t* mpData = nullptr;
+    size_t mSize = 0;
+#if VL_WINDOWS
+    void* mFileHandle = nullptr;
+    void* mMappingHandle = nullptr;
+#else
+    int mFd = -1;
+#endif
+};
+} // namespace Voluma
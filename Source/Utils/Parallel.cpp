@@ -0,0 +1,105 @@
+#include "Parallel.h"
+
+namespace Voluma {
+namespace {
+/// Set on pool threads and on threads running a loop, nested loops run
+/// serially on them
+thread_local bool tIsInLoop = false;
+} // namespace
+
+WorkerPool& WorkerPool::get() {
+    static WorkerPool pool(getWorkerCount() - 1);
+    return pool;
+}
+
+WorkerPool::WorkerPool(uint32_t threadCount) {
+    mThreads.reserve(threadCount);
+    for (uint32_t t = 0; t < threadCount; t++)
+        mThreads.emplace_back([this]() { workerMain(); });
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mIsStopping = true;
+    }
+    mWakeCond.notify_all();
+    for (auto& thread : mThreads) thread.join();
+}
+
+void WorkerPool::run(size_t count, void (*invoke)(void*, size_t),
+                     void* pContext) {
+    if (mThreads.empty() || tIsInLoop) {
+        for (size_t i = 0; i < count; i++) invoke(pContext, i);
+        return;
+    }
+
+    Loop loop;
+    loop.invoke = invoke;
+    loop.pContext = pContext;
+    loop.count = count;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mLoops.push_back(&loop);
+    }
+    mWakeCond.notify_all();
+
+    tIsInLoop = true;
+    work(loop);
+    tIsInLoop = false;
+
+    // Pool threads may still be finishing items or about to leave, the
+    // loop lives on this stack until all of them are out
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDoneCond.wait(lock, [&]() {
+            return loop.doneCount == loop.count && loop.workerCount == 0;
+        });
+        mLoops.erase(std::find(mLoops.begin(), mLoops.end(), &loop));
+    }
+    if (loop.pException) std::rethrow_exception(loop.pException);
+}
+
+void WorkerPool::work(Loop& loop) {
+    // Every index is claimed once, so doneCount reaches count even after a
+    // cancellation
+    for (size_t i = loop.next++; i < loop.count; i = loop.next++) {
+        if (!loop.isCancelled) {
+            try {
+                loop.invoke(loop.pContext, i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(loop.exceptionMutex);
+                if (!loop.pException)
+                    loop.pException = std::current_exception();
+                loop.isCancelled = true;
+            }
+        }
+        loop.doneCount++;
+    }
+}
+
+void WorkerPool::workerMain() {
+    tIsInLoop = true;
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        Loop* pLoop = nullptr;
+        mWakeCond.wait(lock, [&]() {
+            for (Loop* pCandidate : mLoops) {
+                if (pCandidate->next < pCandidate->count) {
+                    pLoop = pCandidate;
+                    return true;
+                }
+            }
+            return mIsStopping;
+        });
+        if (!pLoop) return;
+
+        pLoop->workerCount++;
+        lock.unlock();
+        work(*pLoop);
+        lock.lock();
+        pLoop->workerCount--;
+        mDoneCond.notify_all();
+    }
+}
+} // namespace Voluma
@@ -0,0 +1,99 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "Core/Macros.h"
+
+namespace Voluma {
+/** Get the number of threads parallel loops run on, the caller included.
+ */
+inline uint32_t getWorkerCount() {
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+/** Persistent pool of getWorkerCount() - 1 threads running parallel loops.
+ *
+ * The threads are started on first use and wait for loops until exit, so a
+ * loop costs a wake up instead of a thread creation per thread. The thread
+ * starting a loop works along with the pool, items are handed out one at a
+ * time through an atomic counter so items of uneven cost balance out. Loops
+ * started from different threads share the pool. A loop started inside of
+ * another loop runs on its calling thread alone.
+ */
+class VL_API WorkerPool {
+   public:
+    /** Get the pool of the process.
+     */
+    static WorkerPool& get();
+
+    ~WorkerPool();
+
+    /** Run invoke(pContext, i) for every i in [0, count) and wait for all
+     * of them. The first exception thrown skips the remaining items and is
+     * rethrown.
+     */
+    void run(size_t count, void (*invoke)(void* pContext, size_t index),
+             void* pContext);
+
+   private:
+    struct Loop {
+        void (*invoke)(void*, size_t);
+        void* pContext;
+        size_t count;
+        std::atomic<size_t> next = 0;
+        std::atomic<size_t> doneCount = 0;
+        std::atomic<bool> isCancelled = false;
+        uint32_t workerCount = 0; ///< Pool threads in the loop, by mMutex
+        std::exception_ptr pException;
+        std::mutex exceptionMutex;
+    };
+
+    explicit WorkerPool(uint32_t threadCount);
+
+    void work(Loop& loop);
+    void workerMain();
+
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mWakeCond; ///< Loops added or stopping
+    std::condition_variable mDoneCond; ///< A thread left a loop
+    std::vector<Loop*> mLoops;         ///< Running loops, by mMutex
+    bool mIsStopping = false;
+};
+
+/** Run fn(i) for every i in [0, count) on the WorkerPool. Returns once all
+ * items are done, the first exception thrown by fn stops the loop and is
+ * rethrown. The parallel STL is not used as it is serial on macOS and on
+ * libstdc++ without TBB.
+ */
+template <typename Fn>
+void parallelFor(size_t count, Fn&& fn) {
+    if (count == 0) return;
+    if (count == 1) {
+        fn(size_t(0));
+        return;
+    }
+    using FnType = std::remove_reference_t<Fn>;
+    WorkerPool::get().run(
+        count,
+        [](void* pContext, size_t i) { (*static_cast<FnType*>(pContext))(i); },
+        const_cast<void*>(static_cast<const void*>(&fn)));
+}
+
+/** Run fn over the elements of a random access range with parallelFor.
+ */
+template <typename It, typename Fn>
+void forEachParallel(It begin, It end, Fn&& fn) {
+    parallelFor(size_t(std::distance(begin, end)),
+                [&](size_t i) { fn(begin[i]); });
+}
+} // namespace Voluma
@@ -0,0 +1,14 @@
+#pragma once
+#include "Core/Macros.h"
+
+// x86 intrinsics and per function instruction set targets, code using them
+// must check VoxelKernels::getSimdLevel before calling into a target.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define VL_X86 1
+#include <immintrin.h>
+#if VL_WINDOWS
+#include <intrin.h>
+#endif
+#define VL_TARGET(isa) __attribute__((target(isa)))
+#endif
@@ -0,0 +1,327 @@
+#include "VoxelKernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "Utils/Logger.h"
+#include "Utils/Simd.h"
+
+namespace Voluma {
+using MinMax = VoxelKernels::MinMax;
+
+namespace {
+// Scalar kernels, also used for the tails of the vector loops
+
+template <typename T>
+MinMax minMaxScalar(const T* pSrc, size_t count, MinMax result) {
+    for (size_t i = 0; i < count; i++) {
+        result.min = std::min(result.min, int32_t(pSrc[i]));
+        result.max = std::max(result.max, int32_t(pSrc[i]));
+    }
+    return result;
+}
+
+template <typename T>
+MinMax minMaxScalar(const T* pSrc, size_t count) {
+    return minMaxScalar(pSrc, count,
+                        {std::numeric_limits<int32_t>::max(),
+                         std::numeric_limits<int32_t>::min()});
+}
+
+template <typename T>
+void convertScalar(const T* pSrc, float* pDst, size_t count, float slope,
+                   float intercept) {
+    for (size_t i = 0; i < count; i++)
+        pDst[i] = float(pSrc[i]) * slope + intercept;
+}
+
+void clampScalar(float* pValues, size_t count, float lo, float hi) {
+    for (size_t i = 0; i < count; i++)
+        pValues[i] = std::min(std::max(pValues[i], lo), hi);
+}
+
+#if VL_X86
+// SSE4.1 kernels
+
+template <typename T>
+VL_TARGET("sse4.1")
+MinMax minMaxSSE41(const T* pSrc, size_t count) {
+    constexpr bool kSigned = std::is_signed_v<T>;
+    __m128i vMin = _mm_set1_epi16(kSigned ? int16_t(0x7FFF) : int16_t(-1));
+    __m128i vMax = _mm_set1_epi16(kSigned ? int16_t(0x8000) : int16_t(0));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i));
+        if constexpr (kSigned) {
+            vMin = _mm_min_epi16(vMin, v);
+            vMax = _mm_max_epi16(vMax, v);
+        } else {
+            vMin = _mm_min_epu16(vMin, v);
+            vMax = _mm_max_epu16(vMax, v);
+        }
+    }
+    alignas(16) T mins[8], maxs[8];
+    _mm_store_si128(reinterpret_cast<__m128i*>(mins), vMin);
+    _mm_store_si128(reinterpret_cast<__m128i*>(maxs), vMax);
+    MinMax result = minMaxScalar(pSrc + i, count - i);
+    if (i > 0) {
+        result = minMaxScalar(mins, 8, result);
+        result = minMaxScalar(maxs, 8, result);
+    }
+    return result;
+}
+
+template <typename T>
+VL_TARGET("sse4.1")
+void convertSSE41(const T* pSrc, float* pDst, size_t count, float slope,
+                  float intercept) {
+    __m128 vSlope = _mm_set1_ps(slope);
+    __m128 vIntercept = _mm_set1_ps(intercept);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v =
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pSrc + i));
+        __m128i v32;
+        if constexpr (std::is_signed_v<T>)
+            v32 = _mm_cvtepi16_epi32(v);
+        else
+            v32 = _mm_cvtepu16_epi32(v);
+        __m128 f = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(v32), vSlope),
+                              vIntercept);
+        _mm_storeu_ps(pDst + i, f);
+    }
+    convertScalar(pSrc + i, pDst + i, count - i, slope, intercept);
+}
+
+VL_TARGET("sse4.1")
+void clampSSE41(float* pValues, size_t count, float lo, float hi) {
+    __m128 vLo = _mm_set1_ps(lo);
+    __m128 vHi = _mm_set1_ps(hi);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_loadu_ps(pValues + i);
+        _mm_storeu_ps(pValues + i, _mm_min_ps(_mm_max_ps(v, vLo), vHi));
+    }
+    clampScalar(pValues + i, count - i, lo, hi);
+}
+
+// AVX2 kernels
+
+template <typename T>
+VL_TARGET("avx2")
+MinMax minMaxAVX2(const T* pSrc, size_t count) {
+    constexpr bool kSigned = std::is_signed_v<T>;
+    __m256i vMin =
+        _mm256_set1_epi16(kSigned ? int16_t(0x7FFF) : int16_t(-1));
+    __m256i vMax = _mm256_set1_epi16(kSigned ? int16_t(0x8000) : int16_t(0));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i v =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i));
+        if constexpr (kSigned) {
+            vMin = _mm256_min_epi16(vMin, v);
+            vMax = _mm256_max_epi16(vMax, v);
+        } else {
+            vMin = _mm256_min_epu16(vMin, v);
+            vMax = _mm256_max_epu16(vMax, v);
+        }
+    }
+    alignas(32) T mins[16], maxs[16];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(mins), vMin);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(maxs), vMax);
+    MinMax result = minMaxScalar(pSrc + i, count - i);
+    if (i > 0) {
+        result = minMaxScalar(mins, 16, result);
+        result = minMaxScalar(maxs, 16, result);
+    }
+    return result;
+}
+
+template <typename T>
+VL_TARGET("avx2")
+void convertAVX2(const T* pSrc, float* pDst, size_t count, float slope,
+                 float intercept) {
+    __m256 vSlope = _mm256_set1_ps(slope);
+    __m256 vIntercept = _mm256_set1_ps(intercept);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i));
+        __m256i v32;
+        if constexpr (std::is_signed_v<T>)
+            v32 = _mm256_cvtepi16_epi32(v);
+        else
+            v32 = _mm256_cvtepu16_epi32(v);
+        // No FMA, so results match the scalar version bit for bit
+        __m256 f = _mm256_add_ps(
+            _mm256_mul_ps(_mm256_cvtepi32_ps(v32), vSlope), vIntercept);
+        _mm256_storeu_ps(pDst + i, f);
+    }
+    convertScalar(pSrc + i, pDst + i, count - i, slope, intercept);
+}
+
+VL_TARGET("avx2")
+void clampAVX2(float* pValues, size_t count, float lo, float hi) {
+    __m256 vLo = _mm256_set1_ps(lo);
+    __m256 vHi = _mm256_set1_ps(hi);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_loadu_ps(pValues + i);
+        _mm256_storeu_ps(pValues + i,
+                         _mm256_min_ps(_mm256_max_ps(v, vLo), vHi));
+    }
+    clampScalar(pValues + i, count - i, lo, hi);
+}
+#endif
+
+struct KernelTable {
+    MinMax (*minMaxU16)(const uint16_t*, size_t);
+    MinMax (*minMaxI16)(const int16_t*, size_t);
+    void (*convertU16)(const uint16_t*, float*, size_t, float, float);
+    void (*convertI16)(const int16_t*, float*, size_t, float, float);
+    void (*clamp)(float*, size_t, float, float);
+};
+
+const KernelTable& getKernelTable(SimdLevel level) {
+    static const KernelTable kScalar = {
+        minMaxScalar<uint16_t>, minMaxScalar<int16_t>,
+        convertScalar<uint16_t>, convertScalar<int16_t>, clampScalar};
+#if VL_X86
+    static const KernelTable kSSE41 = {
+        minMaxSSE41<uint16_t>, minMaxSSE41<int16_t>, convertSSE41<uint16_t>,
+        convertSSE41<int16_t>, clampSSE41};
+    static const KernelTable kAVX2 = {
+        minMaxAVX2<uint16_t>, minMaxAVX2<int16_t>, convertAVX2<uint16_t>,
+        convertAVX2<int16_t>, clampAVX2};
+    switch (level) {
+        case SimdLevel::AVX2:
+            return kAVX2;
+        case SimdLevel::SSE41:
+            return kSSE41;
+        default:
+            break;
+    }
+#endif
+    return kScalar;
+}
+
+SimdLevel detectSimdLevel() {
+#if VL_X86
+#if VL_WINDOWS
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool hasSSE41 = (info[2] & (1 << 19)) != 0;
+    // AVX state must also be enabled by the OS
+    bool hasOSAVX = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+                    (_xgetbv(0) & 0x6) == 0x6;
+    bool hasAVX2 = false;
+    if (maxLeaf >= 7 && hasOSAVX) {
+        __cpuidex(info, 7, 0);
+        hasAVX2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool hasSSE41 = __builtin_cpu_supports("sse4.1");
+    bool hasAVX2 = __builtin_cpu_supports("avx2");
+#endif
+    if (hasAVX2) return SimdLevel::AVX2;
+    if (hasSSE41) return SimdLevel::SSE41;
+#endif
+    return SimdLevel::Scalar;
+}
+
+const KernelTable& getKernels() {
+    static const KernelTable& kernels =
+        getKernelTable(VoxelKernels::getSimdLevel());
+    return kernels;
+}
+} // namespace
+
+SimdLevel VoxelKernels::getSimdLevel() {
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+MinMax VoxelKernels::computeMinMax(std::span<const uint16_t> values) {
+    return getKernels().minMaxU16(values.data(), values.size());
+}
+
+MinMax VoxelKernels::computeMinMax(std::span<const int16_t> values) {
+    return getKernels().minMaxI16(values.data(), values.size());
+}
+
+void VoxelKernels::convert(std::span<const uint16_t> src,
+                           std::span<float> dst, float slope,
+                           float intercept) {
+    if (dst.size() < src.size()) logFatal("Kernel output is too small.");
+    getKernels().convertU16(src.data(), dst.data(), src.size(), slope,
+                            intercept);
+}
+
+void VoxelKernels::convert(std::span<const int16_t> src, std::span<float> dst,
+                           float slope, float intercept) {
+    if (dst.size() < src.size()) logFatal("Kernel output is too small.");
+    getKernels().convertI16(src.data(), dst.data(), src.size(), slope,
+                            intercept);
+}
+
+void VoxelKernels::clamp(std::span<float> values, float lo, float hi) {
+    getKernels().clamp(values.data(), values.size(), lo, hi);
+}
+
+void VoxelKernels::runBenchmark(size_t voxelCount) {
+    std::vector<uint16_t> src(voxelCount);
+    std::vector<float> dst(voxelCount);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint32_t> dist(0, 4095);
+    for (auto& v : src) v = uint16_t(dist(rng));
+    std::span<const int16_t> srcI16(
+        reinterpret_cast<const int16_t*>(src.data()), src.size());
+
+    // Best of a few runs, GB/s of source data
+    auto measure = [&](const char* name, SimdLevel level, size_t bytes,
+                       auto&& kernel) {
+        double best = std::numeric_limits<double>::max();
+        for (int run = 0; run < 5; run++) {
+            auto start = std::chrono::steady_clock::now();
+            kernel();
+            best = std::min(best, std::chrono::duration<double>(
+                                      std::chrono::steady_clock::now() - start)
+                                      .count());
+        }
+        logInfo("Kernel {:<10} {:<7} {:8.2f} GB/s", name, level,
+                double(bytes) / best * 1e-9);
+    };
+
+    logInfo("Benchmarking voxel kernels over {} voxels, selected level {}.",
+            voxelCount, getSimdLevel());
+    for (auto level : {SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2}) {
+        if (level > getSimdLevel()) break;
+        const KernelTable& kernels = getKernelTable(level);
+        size_t srcBytes = src.size() * sizeof(uint16_t);
+        MinMax sink = {};
+        measure("minMaxU16", level, srcBytes,
+                [&]() { sink = kernels.minMaxU16(src.data(), src.size()); });
+        measure("minMaxI16", level, srcBytes, [&]() {
+            sink = kernels.minMaxI16(srcI16.data(), srcI16.size());
+        });
+        measure("convertU16", level, srcBytes, [&]() {
+            kernels.convertU16(src.data(), dst.data(), src.size(), 1.f,
+                               -1024.f);
+        });
+        measure("convertI16", level, srcBytes, [&]() {
+            kernels.convertI16(srcI16.data(), dst.data(), srcI16.size(), 1.f,
+                               -1024.f);
+        });
+        measure("clamp", level, dst.size() * sizeof(float), [&]() {
+            kernels.clamp(dst.data(), dst.size(), -1000.f, 3000.f);
+        });
+        if (sink.min > sink.max) logWarning("Kernel produced no min/max.");
+    }
+}
+} // namespace Voluma
\ No newline at end of file
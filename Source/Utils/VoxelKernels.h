@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "Core/Enum.h"
+#include "Core/Macros.h"
+
+namespace Voluma {
+enum class SimdLevel { Scalar, SSE41, AVX2 };
+VL_ENUM_INFO(SimdLevel, {{SimdLevel::Scalar, "Scalar"},
+                         {SimdLevel::SSE41, "SSE4.1"},
+                         {SimdLevel::AVX2, "AVX2"}})
+VL_ENUM_REGISTER(SimdLevel);
+
+/** Vectorized kernels over 16-bit voxel data.
+ *
+ * Every kernel has an AVX2, an SSE4.1 and a scalar version, the best one
+ * supported by the CPU is selected once at runtime. Results are identical
+ * across levels.
+ */
+class VL_API VoxelKernels {
+   public:
+    struct MinMax {
+        int32_t min;
+        int32_t max;
+    };
+
+    /** Get the instruction set used by the kernels.
+     */
+    static SimdLevel getSimdLevel();
+
+    /** Fused min/max of the values, {INT32_MAX, INT32_MIN} if empty.
+     */
+    static MinMax computeMinMax(std::span<const uint16_t> values);
+    static MinMax computeMinMax(std::span<const int16_t> values);
+
+    /** dst = src * slope + intercept, e.g. stored value to HU. dst must be
+     * at least as large as src.
+     */
+    static void convert(std::span<const uint16_t> src, std::span<float> dst,
+                        float slope, float intercept);
+    static void convert(std::span<const int16_t> src, std::span<float> dst,
+                        float slope, float intercept);
+
+    /** Clamp values to [lo, hi] in place.
+     */
+    static void clamp(std::span<float> values, float lo, float hi);
+
+    /** Time every kernel at every supported level and log the GB/s of
+     * source data processed.
+     */
+    static void runBenchmark(size_t voxelCount);
+};
+} // namespace Voluma
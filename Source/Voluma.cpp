@@ -3,17 +3,80 @@
 #include <dcmtk/dcmdata/dctk.h>
 #include <dcmtk/dcmimage/diargimg.h>
 
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
 #include "Core/SampleApp.h"
+#include "Data/DcmParser.h"
+#include "Data/Histogram.h"
 #include "Data/VolData.h"
+#include "Render/HeadlessRenderer.h"
 #include "Utils/Logger.h"
+#include "Utils/VoxelKernels.h"
 
 using namespace Voluma;
 
 int main(int argc, const char **argv) {
     Logger::init(Logger::LoggerConfig());
 
+    if (argc > 1 && std::string_view(argv[1]) == "--benchmark-kernels") {
+        VoxelKernels::runBenchmark(size_t(256) << 20);
+        return 0;
+    }
+
+    if (argc > 1 && std::string_view(argv[1]) == "--benchmark-histogram") {
+        Histogram::runBenchmark(size_t(500) * 1000 * 1000);
+        return 0;
+    }
+
+    if (argc > 1 && std::string_view(argv[1]) == "--benchmark-parse") {
+        if (argc < 3) {
+            logError("Usage: Voluma --benchmark-parse <series folder>");
+            return 1;
+        }
+        DcmParser::runBenchmark(argv[2]);
+        return 0;
+    }
+
+    // Offline rendering without a window, see HeadlessRenderer::logUsage
+    if (argc > 1 && std::string_view(argv[1]) == "--headless") {
+        HeadlessRenderer::Options options;
+        if (!HeadlessRenderer::parseArgs(
+                std::span<const char* const>(argv + 2, size_t(argc - 2)),
+                options))
+            return 1;
+        return HeadlessRenderer::run(options) ? 0 : 1;
+    }
+
+    std::string seriesPath;
+    uint64_t memoryBudget = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--memory-budget-mb") {
+            // Whole MiB, the byte count must not overflow
+            std::string_view value = i + 1 < argc ? argv[++i] : "";
+            uint64_t size = 0;
+            const char* pValueEnd = value.data() + value.size();
+            auto [pEnd, ec] = std::from_chars(value.data(), pValueEnd, size);
+            if (value.empty() || ec != std::errc() || pEnd != pValueEnd ||
+                size > (~0ull >> 20)) {
+                logError("Invalid memory budget \"{}\".", value);
+                logError("Usage: Voluma [--memory-budget-mb size] "
+                         "[series folder]");
+                return 1;
+            }
+            memoryBudget = size << 20;
+        } else {
+            seriesPath = arg;
+        }
+    }
+
     SampleApp app;
-    app.loadFromDisk(argv[1]);
+    app.setMemoryBudget(memoryBudget);
+    // A series folder can also be dropped onto the window later on
+    if (!seriesPath.empty()) app.loadFromDisk(seriesPath);
     app.beginLoop();
 
     return 0;
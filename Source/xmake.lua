@@ -1,16 +1,16 @@
-vl_target("Voluma")
-    set_kind("binary")
+vl_target("VolumaLib")
+    set_kind("static")
     -- Public packages
     add_packages("fmt", {public = true})
     add_packages("vl_dcmtk", "lodepng", 
                  "tinyexr", "glfw", "glm", 
-                 "imgui", "slangd")
-    -- Source files
+                 "imgui", "slangd", {public = true})
+    -- Source files, shaders are copied into the target directory
     add_files(
         "Core/**.cpp",
         "Utils/**.cpp",
         "Data/**.cpp",
-        "Voluma.cpp",
+        "Render/**.cpp",
 
         "Core/*.slang",
         "Core/*.slangh",
@@ -18,4 +18,9 @@ vl_target("Voluma")
         "Utils/*.slangh"
     )
     -- Include directory
-    add_includedirs(".")
+    add_includedirs(".", {public = true})
+
+vl_target("Voluma")
+    set_kind("binary")
+    add_deps("VolumaLib")
+    add_files("Voluma.cpp")
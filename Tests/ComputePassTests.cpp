@@ -0,0 +1,36 @@
+#include "Core/Program/ComputePass.h"
+#include "Testing.h"
+
+using namespace Voluma;
+
+namespace {
+void checkGroupCount(uint3 threadCount, uint3 groupSize, uint3 expected) {
+    uint3 groupCount = ComputePass::getGroupCount(threadCount, groupSize);
+    for (int axis = 0; axis < 3; axis++)
+        VL_CHECK_EQ(groupCount[axis], expected[axis]);
+}
+} // namespace
+
+VL_TEST(groupCountOfExactMultiples) {
+    checkGroupCount(uint3(64, 32, 1), uint3(16, 16, 1), uint3(4, 2, 1));
+    checkGroupCount(uint3(256, 8, 4), uint3(256, 1, 1), uint3(1, 8, 4));
+    checkGroupCount(uint3(16, 16, 16), uint3(4, 4, 4), uint3(4, 4, 4));
+}
+
+VL_TEST(groupCountCoversPartialGroups) {
+    checkGroupCount(uint3(1920, 1080, 1), uint3(16, 16, 1),
+                    uint3(120, 68, 1));
+    checkGroupCount(uint3(1, 1, 1), uint3(16, 16, 1), uint3(1, 1, 1));
+    checkGroupCount(uint3(17, 33, 5), uint3(16, 16, 4), uint3(2, 3, 2));
+}
+
+VL_TEST(groupCountOfZeroThreads) {
+    checkGroupCount(uint3(0, 0, 0), uint3(16, 16, 1), uint3(0, 0, 0));
+    checkGroupCount(uint3(0, 1080, 1), uint3(16, 16, 1), uint3(0, 68, 1));
+}
+
+VL_TEST(groupCountOfSingleThreadGroups) {
+    checkGroupCount(uint3(1920, 1080, 3), uint3(1, 1, 1),
+                    uint3(1920, 1080, 3));
+    checkGroupCount(uint3(0, 7, 1), uint3(1, 1, 1), uint3(0, 7, 1));
+}
@@ -0,0 +1,52 @@
+#include "Data/MinMaxOctree.h"
+#include "Render/CpuKernelRenderer.h"
+#include "Render/CpuRenderer.h"
+#include "TestScenes.h"
+#include "Testing.h"
+
+using namespace Voluma;
+using namespace Voluma::Testing;
+
+/** The kernel runs the shader source, CpuRenderer mirrors it by hand. Both
+ * take the same steps, so pixels only differ where float rounding moves a
+ * threshold crossing by a step.
+ */
+VL_TEST(cpuKernelMatchesCpuRenderer) {
+    auto pVolData = createSphereVolume();
+    VL_CHECK(pVolData->buildGradients());
+    auto pOctree = MinMaxOctree::create(*pVolData);
+    auto pKernelRenderer = CpuKernelRenderer::create(pVolData, pOctree,
+                                                     pVolData->getGradients());
+    VL_CHECK(pKernelRenderer != nullptr);
+    if (!pKernelRenderer) return;
+    CpuRenderer renderer(pVolData, pOctree, pVolData->getGradients());
+    CameraData camera = createSphereCamera();
+
+    SampleAppParam paramSets[3];
+    paramSets[1].gradientMode = GradientMode::Precomputed;
+    paramSets[1].emptySpaceMode = EmptySpaceMode::DistanceField;
+    paramSets[2].gradientMode = GradientMode::Analytic;
+    paramSets[2].shadingMode = ShadingMode::Normal;
+    paramSets[2].emptySpaceMode = EmptySpaceMode::Disabled;
+    paramSets[2].filterValue = 500;
+    for (const SampleAppParam& params : paramSets) {
+        Image expected(kSceneFrameSize, kSceneFrameSize, 4);
+        Image image(kSceneFrameSize, kSceneFrameSize, 4);
+        renderer.render(camera, params, expected);
+        auto stats = pKernelRenderer->render(camera, params, image);
+        VL_CHECK_EQ(stats.threadCount,
+                    uint64_t(kSceneFrameSize) * kSceneFrameSize);
+
+        int differentCount = 0;
+        double differenceSum = 0.0;
+        for (int i = 0; i < expected.getArea(); i++) {
+            float difference = getPixelDifference(image, expected, i);
+            differentCount += difference > 1e-2f;
+            differenceSum += difference;
+        }
+        // The view must hit the sphere for the comparison to mean anything
+        VL_CHECK(countHitPixels(expected) > expected.getArea() / 20);
+        VL_CHECK(differentCount <= expected.getArea() / 100);
+        VL_CHECK_NEAR(differenceSum / expected.getArea(), 0.0, 1e-3);
+    }
+}
@@ -0,0 +1,60 @@
+#include "Data/MinMaxOctree.h"
+#include "Render/CpuRenderer.h"
+#include "TestScenes.h"
+#include "Testing.h"
+#include "Utils/VoxelKernels.h"
+
+using namespace Voluma;
+using namespace Voluma::Testing;
+
+/** The AVX2 ray packets take the same steps and samples as the scalar rays
+ * in the same operation order, so every pixel matches up to kEpsilon. The
+ * frame is not a multiple of the 4x2 packet block, so partial blocks at the
+ * right and bottom edges are covered too.
+ */
+VL_TEST(cpuRendererPacketsMatchScalar) {
+    constexpr float kEpsilon = 1e-5f;
+    if (VoxelKernels::getSimdLevel() < SimdLevel::AVX2) {
+        logWarning("cpuRendererPacketsMatchScalar: No AVX2, skipped.");
+        return;
+    }
+
+    auto pVolData = createSphereVolume();
+    VL_CHECK(pVolData->buildGradients());
+    CpuRenderer renderer(pVolData, MinMaxOctree::create(*pVolData),
+                         pVolData->getGradients());
+    CameraData camera = createSphereCamera();
+    const uint2 frameDim(kSceneFrameSize - 3, kSceneFrameSize - 5);
+
+    for (ShadingMode shadingMode : {ShadingMode::Normal, ShadingMode::FlatShade,
+                                    ShadingMode::TransportFunc}) {
+        for (GradientMode gradientMode :
+             {GradientMode::FiniteDifference, GradientMode::Precomputed,
+              GradientMode::Analytic}) {
+            for (EmptySpaceMode emptySpaceMode :
+                 {EmptySpaceMode::Disabled, EmptySpaceMode::DistanceField,
+                  EmptySpaceMode::Octree}) {
+                SampleAppParam params;
+                params.shadingMode = shadingMode;
+                params.gradientMode = gradientMode;
+                params.emptySpaceMode = emptySpaceMode;
+
+                Image expected(frameDim.x, frameDim.y, 4);
+                renderer.setSimdLevel(SimdLevel::Scalar);
+                auto scalarStats = renderer.render(camera, params, expected);
+                Image image(frameDim.x, frameDim.y, 4);
+                renderer.setSimdLevel(SimdLevel::AVX2);
+                auto packetStats = renderer.render(camera, params, image);
+                VL_CHECK(packetStats.simdLevel == SimdLevel::AVX2);
+                VL_CHECK_EQ(packetStats.sampleCount, scalarStats.sampleCount);
+                VL_CHECK(countHitPixels(expected) > expected.getArea() / 20);
+
+                int differentCount = 0;
+                for (int i = 0; i < expected.getArea(); i++)
+                    differentCount +=
+                        getPixelDifference(image, expected, i) > kEpsilon;
+                VL_CHECK_EQ(differentCount, 0);
+            }
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#include <random>
+#include <vector>
+
+#include "Data/VolData.h"
+#include "Testing.h"
+
+using namespace Voluma;
+
+namespace {
+// Crosses the brick borders at 32 and 64 on x and at 32 on y and z
+constexpr uint32_t kWidth = 70, kHeight = 40, kDepth = 36;
+constexpr float kStep = 1.f / 64.f; ///< Finite difference step, in voxels
+
+std::shared_ptr<VolData> createVolume(bool isSigned) {
+    VolData::ScanMeta meta = {};
+    meta.rowCount = kHeight;
+    meta.colCount = kWidth;
+    meta.pixelSpaceV = meta.pixelSpaceH = 0.5f;
+    meta.rescaleSlope = isSigned ? 1.f : 0.5f;
+    meta.rescaleIntercept = isSigned ? 0.f : -1024.f;
+    meta.pixelRepresentation = isSigned ? 1 : 0;
+
+    // Independent random voxels, so every cell has its own gradient
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int32_t> dist(isSigned ? -1024 : 0, 3071);
+    std::vector<uint16_t> voxels(size_t(kWidth) * kHeight * kDepth);
+    for (auto& v : voxels) v = uint16_t(dist(rng));
+    auto pVolData =
+        VolData::createFromVoxels(meta, kDepth, 0.5f, std::move(voxels));
+    pVolData->buildBricks();
+    return pVolData;
+}
+
+/** Compare the analytic gradient of the trilinear sample in cell (x, y, z)
+ * at fraction f against central differences of the sampled value. The
+ * interpolant is linear along each axis inside of a cell, so the
+ * differences are exact up to rounding while x +- kStep stays in the cell.
+ */
+void checkGradient(const VolData& volData, int32_t x, int32_t y, int32_t z,
+                   float3 f) {
+    float3 p = float3(float(x), float(y), float(z)) + f;
+    auto value = [&](float3 q) {
+        return volData.sampleValueGradient(q.x, q.y, q.z).value;
+    };
+    TrilinearSample sample = volData.sampleValueGradient(p.x, p.y, p.z);
+    float3 expected;
+    for (int axis = 0; axis < 3; axis++) {
+        float3 offset(0.f);
+        offset[axis] = kStep;
+        expected[axis] = (value(p + offset) - value(p - offset)) / (2 * kStep);
+    }
+
+    // Values reach a few thousand, the differences lose their low bits
+    float tolerance = 1e-3f * std::max(length(expected), 1.f) + 0.5f;
+    for (int axis = 0; axis < 3; axis++)
+        VL_CHECK_NEAR(sample.gradient[axis], expected[axis], tolerance);
+
+    // The value agrees with the bricked sampler, which reads the apron
+    const auto& pBricks = volData.getBricks();
+    float stored = pBricks->sampleStored(p.x, p.y, p.z);
+    float expectedValue = stored * volData.getScanMetaData().rescaleSlope +
+                          volData.getScanMetaData().rescaleIntercept;
+    VL_CHECK_NEAR(sample.value, expectedValue,
+                  1e-4f * std::abs(expectedValue) + 1e-2f);
+}
+
+/** Check the cells at -1, at the brick borders and at the last voxel of
+ * every axis, each against random fractions.
+ */
+void checkBorders(const VolData& volData) {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> frac(2 * kStep, 1.f - 2 * kStep);
+    auto randomFrac = [&]() { return float3(frac(rng), frac(rng), frac(rng)); };
+
+    const int32_t xCells[] = {-1, 0, 31, 32, 63, 64, int32_t(kWidth) - 1};
+    const int32_t yCells[] = {-1, 0, 31, 32, int32_t(kHeight) - 1};
+    const int32_t zCells[] = {-1, 0, 31, 32, int32_t(kDepth) - 1};
+    for (int32_t z : zCells)
+        for (int32_t y : yCells)
+            for (int32_t x : xCells)
+                checkGradient(volData, x, y, z, randomFrac());
+}
+
+void checkRandom(const VolData& volData, uint32_t sampleCount) {
+    std::mt19937 rng(13);
+    std::uniform_real_distribution<float> frac(2 * kStep, 1.f - 2 * kStep);
+    std::uniform_int_distribution<int32_t> xCell(-1, kWidth - 1),
+        yCell(-1, kHeight - 1), zCell(-1, kDepth - 1);
+    for (uint32_t i = 0; i < sampleCount; i++) {
+        checkGradient(volData, xCell(rng), yCell(rng), zCell(rng),
+                      float3(frac(rng), frac(rng), frac(rng)));
+    }
+}
+} // namespace
+
+VL_TEST(gradientMatchesFiniteDifferencesUnsigned) {
+    auto pVolData = createVolume(false);
+    checkRandom(*pVolData, 2000);
+    checkBorders(*pVolData);
+}
+
+VL_TEST(gradientMatchesFiniteDifferencesSigned) {
+    auto pVolData = createVolume(true);
+    checkRandom(*pVolData, 2000);
+    checkBorders(*pVolData);
+}
+
+VL_TEST(gradientIsZeroFarOutside) {
+    auto pVolData = createVolume(false);
+    // All 8 corners are outside of the volume, stored 0 everywhere
+    TrilinearSample sample = pVolData->sampleValueGradient(-3.5f, 10.f, 10.f);
+    VL_CHECK_NEAR(sample.value, pVolData->toModalityValue(0), 1e-4f);
+    VL_CHECK_NEAR(length(sample.gradient), 0.f, 1e-4f);
+}
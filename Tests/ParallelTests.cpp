@@ -0,0 +1,57 @@
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "Testing.h"
+#include "Utils/Parallel.h"
+
+using namespace Voluma;
+
+VL_TEST(parallelForVisitsEveryItemOnce) {
+    for (size_t count : {size_t(0), size_t(1), size_t(7), size_t(10000)}) {
+        std::vector<std::atomic<uint32_t>> visits(count);
+        parallelFor(count, [&](size_t i) { visits[i]++; });
+        uint32_t wrongCount = 0;
+        for (const auto& visit : visits) wrongCount += visit != 1;
+        VL_CHECK_EQ(wrongCount, 0u);
+    }
+}
+
+VL_TEST(parallelForRethrows) {
+    std::atomic<uint32_t> doneCount = 0;
+    bool isThrown = false;
+    try {
+        parallelFor(1000, [&](size_t i) {
+            if (i == 10) throw std::runtime_error("item 10");
+            doneCount++;
+        });
+    } catch (const std::runtime_error&) {
+        isThrown = true;
+    }
+    VL_CHECK(isThrown);
+    VL_CHECK(doneCount < 1000u);
+}
+
+VL_TEST(parallelForReusesPoolThreads) {
+    std::mutex idMutex;
+    std::set<std::thread::id> ids;
+    for (int run = 0; run < 20; run++) {
+        parallelFor(64, [&](size_t) {
+            std::lock_guard<std::mutex> lock(idMutex);
+            ids.insert(std::this_thread::get_id());
+        });
+    }
+    // A pool thread per worker and the caller, whatever the loop count
+    VL_CHECK(ids.size() <= getWorkerCount());
+}
+
+VL_TEST(parallelForRunsNestedLoops) {
+    std::atomic<uint32_t> itemCount = 0;
+    parallelFor(16, [&](size_t) {
+        parallelFor(16, [&](size_t) { itemCount++; });
+    });
+    VL_CHECK_EQ(itemCount.load(), 256u);
+}
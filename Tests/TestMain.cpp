@@ -0,0 +1,53 @@
+#include <cstdint>
+#include <exception>
+#include <string_view>
+
+#include "Testing.h"
+#include "Utils/Logger.h"
+
+namespace Voluma::Testing {
+static uint32_t gFailureCount = 0; ///< Of the running test case
+
+std::vector<TestCase>& getTestCases() {
+    static std::vector<TestCase> testCases;
+    return testCases;
+}
+
+void reportFailure(const char* file, int line, const std::string& message) {
+    logError("{}:{}: Check failed: {}", file, line, message);
+    gFailureCount++;
+}
+} // namespace Voluma::Testing
+
+using namespace Voluma;
+
+int main(int argc, const char** argv) {
+    Logger::init(Logger::LoggerConfig());
+    // Keep the output to the test results
+    Logger::setLogLevel(Logger::Level::Warning);
+
+    std::string_view filter = argc > 1 ? argv[1] : "";
+    uint32_t runCount = 0, failedCount = 0;
+    for (const auto& testCase : Testing::getTestCases()) {
+        if (!filter.empty() && filter != testCase.name) continue;
+        Testing::gFailureCount = 0;
+        try {
+            testCase.func();
+        } catch (const std::exception& e) {
+            Testing::reportFailure(__FILE__, __LINE__,
+                                   fmt::format("exception: {}", e.what()));
+        }
+        runCount++;
+        if (Testing::gFailureCount > 0) failedCount++;
+        fmt::print("[{}] {}\n", Testing::gFailureCount > 0 ? "FAIL" : " OK ",
+                   testCase.name);
+    }
+
+    if (runCount == 0) {
+        fmt::print("No test case matches \"{}\".\n", filter);
+        return 1;
+    }
+    fmt::print("{}/{} test cases passed.\n", runCount - failedCount,
+               runCount);
+    return failedCount > 0 ? 1 : 0;
+}
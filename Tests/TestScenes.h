@@ -0,0 +1,87 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "Core/Camera.h"
+#include "Data/VolData.h"
+#include "Utils/Image.h"
+
+/** Small synthetic scene shared by the renderer tests.
+ */
+namespace Voluma::Testing {
+constexpr uint32_t kSceneWidth = 48, kSceneHeight = 40, kSceneDepth = 36;
+constexpr uint32_t kSceneFrameSize = 64;
+
+/** Sphere of bone in soft tissue surrounded by air, with a smooth shell so
+ * the normals of all gradient modes are well defined.
+ */
+inline std::shared_ptr<VolData> createSphereVolume() {
+    VolData::ScanMeta meta = {};
+    meta.rowCount = kSceneHeight;
+    meta.colCount = kSceneWidth;
+    meta.pixelSpaceV = meta.pixelSpaceH = 0.5f;
+    meta.rescaleSlope = 1.f;
+    meta.rescaleIntercept = -1024.f;
+
+    float3 center = float3(kSceneWidth, kSceneHeight, kSceneDepth) * 0.5f;
+    std::vector<uint16_t> voxels(size_t(kSceneWidth) * kSceneHeight *
+                                 kSceneDepth);
+    for (uint32_t z = 0; z < kSceneDepth; z++) {
+        for (uint32_t y = 0; y < kSceneHeight; y++) {
+            for (uint32_t x = 0; x < kSceneWidth; x++) {
+                float r = length(float3(x, y, z) - center);
+                float hu = r < 8.f    ? 1000.f
+                           : r < 15.f ? 40.f
+                                      : -1000.f;
+                hu += 200.f * std::sin(0.5f * float(x + 2 * y));
+                voxels[(size_t(z) * kSceneHeight + y) * kSceneWidth + x] =
+                    uint16_t(std::clamp(hu + 1024.f, 0.f, 4095.f));
+            }
+        }
+    }
+    return VolData::createFromVoxels(meta, kSceneDepth, 0.5f,
+                                     std::move(voxels));
+}
+
+/** Camera looking at the sphere, the film zoomed onto the volume.
+ */
+inline CameraData createSphereCamera() {
+    Camera camera;
+    camera.setPosition(float3(0.6f, 0.4f, 2.f));
+    camera.setTarget(float3(0.f));
+    camera.setUp(float3(0.f, 1.f, 0.f));
+    camera.setAspectRatio(1.f);
+
+    CameraData data = camera.getData();
+    data.cameraU *= 0.4f;
+    data.cameraV *= 0.4f;
+    return data;
+}
+
+/** Count the pixels that differ from the background of the ray marcher.
+ */
+inline int countHitPixels(const Image& image) {
+    const float3 kBackgroundColor(0.03f, 0.3f, 0.3f);
+    int hitCount = 0;
+    for (int i = 0; i < image.getArea(); i++) {
+        bool isHit = false;
+        for (int c = 0; c < 3; c++)
+            isHit |= std::abs(image.getPixel(i, c) - kBackgroundColor[c]) >
+                     1e-3f;
+        hitCount += isHit;
+    }
+    return hitCount;
+}
+
+/** Get the largest difference of a pixel over all channels.
+ */
+inline float getPixelDifference(const Image& a, const Image& b, int index) {
+    float difference = 0.f;
+    for (int c = 0; c < a.getChannels(); c++)
+        difference = std::max(
+            difference, std::abs(a.getPixel(index, c) - b.getPixel(index, c)));
+    return difference;
+}
+} // namespace Voluma::Testing
@@ -0,0 +1,64 @@
+#pragma once
+#include <fmt/format.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace Voluma::Testing {
+using TestFunc = void (*)();
+
+struct TestCase {
+    const char* name;
+    TestFunc func;
+};
+
+/** Get all test cases, registered by VL_TEST during static initialization.
+ */
+std::vector<TestCase>& getTestCases();
+
+/** Record a failed check of the running test case.
+ */
+void reportFailure(const char* file, int line, const std::string& message);
+
+struct TestRegistrar {
+    TestRegistrar(const char* name, TestFunc func) {
+        getTestCases().push_back({name, func});
+    }
+};
+} // namespace Voluma::Testing
+
+/** Define a test case, checks failing in it are reported and the remaining
+ * checks still run. An exception fails the test case.
+ */
+#define VL_TEST(name)                                                   \
+    static void name();                                                 \
+    static ::Voluma::Testing::TestRegistrar name##Registrar(#name, name); \
+    static void name()
+
+#define VL_CHECK(cond)                                                  \
+    do {                                                                \
+        if (!(cond))                                                    \
+            ::Voluma::Testing::reportFailure(__FILE__, __LINE__, #cond); \
+    } while (0)
+
+#define VL_CHECK_EQ(a, b)                                               \
+    do {                                                                \
+        auto vlA = (a);                                                 \
+        auto vlB = (b);                                                 \
+        if (!(vlA == vlB))                                              \
+            ::Voluma::Testing::reportFailure(                           \
+                __FILE__, __LINE__,                                     \
+                fmt::format("{} == {} ({} vs {})", #a, #b, vlA, vlB));  \
+    } while (0)
+
+#define VL_CHECK_NEAR(a, b, tolerance)                                  \
+    do {                                                                \
+        double vlA = double(a);                                         \
+        double vlB = double(b);                                         \
+        if (!(std::abs(vlA - vlB) <= double(tolerance)))                \
+            ::Voluma::Testing::reportFailure(                           \
+                __FILE__, __LINE__,                                     \
+                fmt::format("{} ~ {} ({} vs {}, tolerance {})", #a, #b, \
+                            vlA, vlB, double(tolerance)));              \
+    } while (0)
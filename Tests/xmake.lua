@@ -0,0 +1,8 @@
+vl_target("VolumaTests")
+    set_kind("binary")
+    set_default(false)
+    add_deps("VolumaLib")
+    add_files("*.cpp")
+    add_includedirs(".")
+    -- xmake test runs every case, a test name argument runs a single one
+    add_tests("default")